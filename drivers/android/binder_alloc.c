@@ -23,6 +23,7 @@
 #include <linux/uaccess.h>
 #include <linux/highmem.h>
 #include <linux/sizes.h>
+#include <linux/log2.h>
 #include "binder_alloc.h"
 #include "binder_trace.h"
 #include <trace/hooks/binder.h>
@@ -42,6 +43,19 @@ static uint32_t binder_alloc_debug_mask = BINDER_DEBUG_USER_ERROR;
 module_param_named(debug_mask, binder_alloc_debug_mask,
 		   uint, 0644);
 
+/*
+ * Freed buffers up to this size are parked on a per-proc freelist of their
+ * power-of-two size class instead of being merged back into free_buffers.
+ * Buffers are carved at their exact size; a parked buffer is only handed
+ * out again for a request from its own class, so a reused buffer is less
+ * than twice the size asked for (or 128 bytes). 0 disables the size-class
+ * freelists.
+ */
+uint32_t binder_alloc_class_limit = SZ_1K;
+
+module_param_named(small_buffer_size, binder_alloc_class_limit,
+		   uint, 0644);
+
 #define binder_alloc_debug(mask, x...) \
 	do { \
 		if (binder_alloc_debug_mask & mask) \
@@ -66,6 +80,72 @@ static size_t binder_alloc_buffer_size(struct binder_alloc *alloc,
 	return binder_buffer_next(buffer)->user_data - buffer->user_data;
 }
 
+static size_t binder_alloc_class_size(int class)
+{
+	return (size_t)1 << (class + BINDER_ALLOC_CLASS_MIN_SHIFT);
+}
+
+/*
+ * Return the size class of @size, or -1 if it is too large to be parked.
+ * Class n holds buffers of [64 << n, 128 << n) bytes, class 0 also the
+ * ones below 64.
+ */
+static int binder_alloc_size_class(size_t size)
+{
+	size_t limit = min_t(size_t, READ_ONCE(binder_alloc_class_limit),
+			binder_alloc_class_size(BINDER_ALLOC_CLASS_NUM - 1));
+
+	if (size > limit)
+		return -1;
+	if (size < binder_alloc_class_size(1))
+		return 0;
+	return ilog2(size) - BINDER_ALLOC_CLASS_MIN_SHIFT;
+}
+
+/*
+ * Take a parked buffer of at least @size bytes from the class of @size.
+ * It stayed out of free_buffers and kept its place in alloc->buffers, so
+ * it only needs to become allocated again. A class buffer is smaller than
+ * a page and never owns a whole one, and the pages it does touch were
+ * mapped when it was carved, so there are none to bring back either.
+ */
+static struct binder_buffer *binder_alloc_class_get(struct binder_alloc *alloc,
+						    size_t size)
+{
+	struct binder_buffer *buffer;
+	int class = binder_alloc_size_class(size);
+
+	if (class < 0)
+		return NULL;
+
+	list_for_each_entry(buffer, &alloc->class_buffers[class], class_entry) {
+		if (binder_alloc_buffer_size(alloc, buffer) < size)
+			continue;
+		list_del(&buffer->class_entry);
+		alloc->class_count[class]--;
+		return buffer;
+	}
+	return NULL;
+}
+
+/*
+ * Park a buffer that has just left allocated_buffers. Returns false if it
+ * must be merged back into free_buffers instead.
+ */
+static bool binder_alloc_class_put(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer,
+				   size_t buffer_size)
+{
+	int class = binder_alloc_size_class(buffer_size);
+
+	if (class < 0 || alloc->class_count[class] >= BINDER_ALLOC_CLASS_DEPTH)
+		return false;
+
+	list_add(&buffer->class_entry, &alloc->class_buffers[class]);
+	alloc->class_count[class]++;
+	return true;
+}
+
 static void binder_insert_free_buffer(struct binder_alloc *alloc,
 				      struct binder_buffer *new_buffer)
 {
@@ -382,6 +462,8 @@ static bool debug_low_async_space_locked(struct binder_alloc *alloc, int pid)
 	return false;
 }
 
+static int binder_alloc_class_drain_locked(struct binder_alloc *alloc);
+
 static struct binder_buffer *binder_alloc_new_buf_locked(
 				struct binder_alloc *alloc,
 				size_t data_size,
@@ -390,7 +472,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				int is_async,
 				int pid)
 {
-	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
 	struct rb_node *best_fit = NULL;
@@ -434,6 +516,12 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	/* Pad 0-size buffers so they get assigned unique addresses */
 	size = max(size, sizeof(void *));
 
+	buffer = binder_alloc_class_get(alloc, size);
+	if (buffer)
+		goto got_buffer;
+
+retry:
+	n = alloc->free_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
@@ -449,6 +537,8 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 			break;
 		}
 	}
+	if (best_fit == NULL && binder_alloc_class_drain_locked(alloc))
+		goto retry;
 	if (best_fit == NULL) {
 		size_t allocated_buffers = 0;
 		size_t largest_alloc_size = 0;
@@ -523,6 +613,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 
 	rb_erase(best_fit, &alloc->free_buffers);
 	buffer->free = 0;
+got_buffer:
 	buffer->allow_user_free = 0;
 	binder_insert_allocated_buffer_locked(alloc, buffer);
 	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -651,6 +742,9 @@ static void binder_delete_free_buffer(struct binder_alloc *alloc,
 	kfree(buffer);
 }
 
+static void binder_merge_free_buf_locked(struct binder_alloc *alloc,
+					 struct binder_buffer *buffer);
+
 static void binder_free_buf_locked(struct binder_alloc *alloc,
 				   struct binder_buffer *buffer)
 {
@@ -686,6 +780,15 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 			  buffer->user_data + buffer_size) & PAGE_MASK));
 
 	rb_erase(&buffer->rb_node, &alloc->allocated_buffers);
+	if (binder_alloc_class_put(alloc, buffer, buffer_size))
+		return;
+
+	binder_merge_free_buf_locked(alloc, buffer);
+}
+
+static void binder_merge_free_buf_locked(struct binder_alloc *alloc,
+					 struct binder_buffer *buffer)
+{
 	buffer->free = 1;
 	if (!list_is_last(&buffer->entry, &alloc->buffers)) {
 		struct binder_buffer *next = binder_buffer_next(buffer);
@@ -707,6 +810,29 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 	binder_insert_free_buffer(alloc, buffer);
 }
 
+/*
+ * Merge every parked buffer back into free_buffers. Used when the address
+ * space is too fragmented for a best fit and on release. Returns the
+ * number of buffers merged.
+ */
+static int binder_alloc_class_drain_locked(struct binder_alloc *alloc)
+{
+	struct binder_buffer *buffer;
+	int class, count = 0;
+
+	for (class = 0; class < BINDER_ALLOC_CLASS_NUM; class++) {
+		while ((buffer = list_first_entry_or_null(
+				&alloc->class_buffers[class],
+				struct binder_buffer, class_entry))) {
+			list_del(&buffer->class_entry);
+			binder_merge_free_buf_locked(alloc, buffer);
+			count++;
+		}
+		alloc->class_count[class] = 0;
+	}
+	return count;
+}
+
 static void binder_alloc_clear_buf(struct binder_alloc *alloc,
 				   struct binder_buffer *buffer);
 /**
@@ -834,6 +960,7 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 		binder_free_buf_locked(alloc, buffer);
 		buffers++;
 	}
+	binder_alloc_class_drain_locked(alloc);
 
 	while (!list_empty(&alloc->buffers)) {
 		buffer = list_first_entry(&alloc->buffers,
@@ -920,6 +1047,7 @@ void binder_alloc_print_pages(struct seq_file *m,
 	int active = 0;
 	int lru = 0;
 	int free = 0;
+	int parked = 0;
 
 	mutex_lock(&alloc->mutex);
 	/*
@@ -937,8 +1065,11 @@ void binder_alloc_print_pages(struct seq_file *m,
 				lru++;
 		}
 	}
+	for (i = 0; i < BINDER_ALLOC_CLASS_NUM; i++)
+		parked += alloc->class_count[i];
 	mutex_unlock(&alloc->mutex);
 	seq_printf(m, "  pages: %d:%d:%d\n", active, lru, free);
+	seq_printf(m, "  parked small buffers: %d\n", parked);
 	seq_printf(m, "  pages high watermark: %zu\n", alloc->pages_high);
 }
 
@@ -1080,9 +1211,17 @@ static struct shrinker binder_shrinker = {
  */
 void binder_alloc_init(struct binder_alloc *alloc)
 {
+	int i;
+
+	/* parked buffers must never own a whole page, see class_get */
+	BUILD_BUG_ON(BINDER_ALLOC_CLASS_MIN_SHIFT + BINDER_ALLOC_CLASS_NUM >
+		     PAGE_SHIFT);
+
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	for (i = 0; i < BINDER_ALLOC_CLASS_NUM; i++)
+		INIT_LIST_HEAD(&alloc->class_buffers[i]);
 }
 
 int binder_alloc_shrinker_init(void)
@@ -16,12 +16,18 @@
 #include <uapi/linux/android/binder.h>
 
 extern struct list_lru binder_alloc_lru;
+extern uint32_t binder_alloc_class_limit;
 struct binder_transaction;
 
+#define BINDER_ALLOC_CLASS_MIN_SHIFT	6	/* smallest class is 64 bytes */
+#define BINDER_ALLOC_CLASS_NUM		6	/* largest class is 2K */
+#define BINDER_ALLOC_CLASS_DEPTH	16	/* parked buffers per class */
+
 /**
  * struct binder_buffer - buffer used for binder transactions
  * @entry:              entry alloc->buffers
  * @rb_node:            node for allocated_buffers/free_buffers rb trees
+ * @class_entry:        entry in alloc->class_buffers while parked
  * @free:               %true if buffer is free
  * @clear_on_free:      %true if buffer must be zeroed after use
  * @allow_user_free:    %true if user is allowed to free buffer
@@ -41,8 +47,11 @@ struct binder_transaction;
  */
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by address */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* free entry by size or allocated */
+					/* entry by address */
+		struct list_head class_entry; /* parked small buffer */
+	};
 	unsigned free:1;
 	unsigned clear_on_free:1;
 	unsigned allow_user_free:1;
@@ -92,6 +101,9 @@ struct binder_lru_page {
  * @pages_high:         high watermark of offset in @pages
  * @oneway_spam_detected: %true if oneway spam detection fired, clear that
  * flag once the async buffer has returned to a healthy state
+ * @class_buffers:      freed small buffers parked by size class; they are
+ *                      neither in @free_buffers nor in @allocated_buffers
+ * @class_count:        number of buffers on each @class_buffers list
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -113,6 +125,8 @@ struct binder_alloc {
 	int pid;
 	size_t pages_high;
 	bool oneway_spam_detected;
+	struct list_head class_buffers[BINDER_ALLOC_CLASS_NUM];
+	unsigned int class_count[BINDER_ALLOC_CLASS_NUM];
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
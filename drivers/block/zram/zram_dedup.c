@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Same-content deduplication of zram objects.
+ *
+ * Every compressed object stored while dedup is enabled gets a
+ * refcounted zram_entry hashed by the checksum of its compressed
+ * bytes. A later write that compresses to the same bytes takes a
+ * reference on that entry instead of allocating a new zsmalloc object.
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/highmem.h>
+
+#include "zram_drv.h"
+
+/* One hash bucket per this many device pages */
+#define ZRAM_HASH_SHIFT		3
+
+u64 zram_dedup_dup_size(struct zram *zram)
+{
+	return (u64)atomic64_read(&zram->stats.dup_data_size);
+}
+
+u64 zram_dedup_meta_size(struct zram *zram)
+{
+	return (u64)atomic64_read(&zram->stats.meta_data_size);
+}
+
+u32 zram_dedup_checksum(const void *mem, unsigned int len)
+{
+	return jhash(mem, len, 0);
+}
+
+static struct zram_hash *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->hash[checksum & (zram->hash_size - 1)];
+}
+
+static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+				const void *mem)
+{
+	void *cmem;
+	bool match;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	match = !memcmp(cmem, mem, entry->len);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look up a stored object with the same compressed content and take a
+ * reference on it. Called with the compression stream held, so this
+ * must not sleep.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, const void *mem,
+				unsigned int len, u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+	struct zram_entry *entry;
+
+	spin_lock(&hash->lock);
+	hlist_for_each_entry(entry, &hash->head, node) {
+		if (entry->checksum != checksum || entry->len != len)
+			continue;
+
+		if (!zram_dedup_match(zram, entry, mem))
+			continue;
+
+		entry->refcount++;
+		spin_unlock(&hash->lock);
+
+		atomic64_add(len, &zram->stats.dup_data_size);
+		atomic64_inc(&zram->stats.dedup_hits);
+		return entry;
+	}
+	spin_unlock(&hash->lock);
+
+	return NULL;
+}
+
+/*
+ * Publish a freshly stored object. On allocation failure the caller
+ * keeps owning @handle directly and the object is simply not shared.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				unsigned int len, u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+
+	spin_lock(&hash->lock);
+	hlist_add_head(&entry->node, &hash->head);
+	spin_unlock(&hash->lock);
+
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+	return entry;
+}
+
+/*
+ * Drop a reference. Returns true if it was the last one, in which case
+ * the zsmalloc object has been freed as well.
+ */
+bool zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, entry->checksum);
+	unsigned long refcount;
+
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		hlist_del(&entry->node);
+	spin_unlock(&hash->lock);
+
+	if (refcount) {
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+		return false;
+	}
+
+	zs_free(zram->mem_pool, entry->handle);
+	kfree(entry);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	return true;
+}
+
+/*
+ * Whether other slots hold a reference on @entry. Only a hint: the
+ * answer can change as soon as the bucket lock is dropped.
+ */
+bool zram_dedup_shared(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, entry->checksum);
+	bool shared;
+
+	spin_lock(&hash->lock);
+	shared = entry->refcount > 1;
+	spin_unlock(&hash->lock);
+
+	return shared;
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	size_t i;
+
+	if (!zram->use_dedup)
+		return 0;
+
+	zram->hash_size = roundup_pow_of_two(max_t(size_t,
+				num_pages >> ZRAM_HASH_SHIFT, 1));
+	zram->hash = vzalloc(array_size(zram->hash_size,
+					sizeof(struct zram_hash)));
+	if (!zram->hash) {
+		pr_err("Error allocating zram entry hash\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < zram->hash_size; i++) {
+		spin_lock_init(&zram->hash[i].lock);
+		INIT_HLIST_HEAD(&zram->hash[i].head);
+	}
+
+	atomic64_add(zram->hash_size * sizeof(struct zram_hash),
+			&zram->stats.meta_data_size);
+	return 0;
+}
+
+/* All slots must have been freed, so every entry is gone by now */
+void zram_dedup_fini(struct zram *zram)
+{
+	vfree(zram->hash);
+	zram->hash = NULL;
+	zram->hash_size = 0;
+}
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+struct zram;
+struct zram_entry;
+
+#ifdef CONFIG_ZRAM_DEDUP
+
+u64 zram_dedup_dup_size(struct zram *zram);
+u64 zram_dedup_meta_size(struct zram *zram);
+
+u32 zram_dedup_checksum(const void *mem, unsigned int len);
+struct zram_entry *zram_dedup_find(struct zram *zram, const void *mem,
+				unsigned int len, u32 checksum);
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				unsigned int len, u32 checksum);
+bool zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+bool zram_dedup_shared(struct zram *zram, struct zram_entry *entry);
+
+int zram_dedup_init(struct zram *zram, size_t num_pages);
+void zram_dedup_fini(struct zram *zram);
+#else
+
+static inline u64 zram_dedup_dup_size(struct zram *zram) { return 0; }
+static inline u64 zram_dedup_meta_size(struct zram *zram) { return 0; }
+
+static inline u32 zram_dedup_checksum(const void *mem, unsigned int len)
+{
+	return 0;
+}
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+		const void *mem, unsigned int len, u32 checksum)
+{
+	return NULL;
+}
+static inline struct zram_entry *zram_dedup_insert(struct zram *zram,
+		unsigned long handle, unsigned int len, u32 checksum)
+{
+	return NULL;
+}
+static inline bool zram_dedup_put(struct zram *zram,
+		struct zram_entry *entry)
+{
+	return true;
+}
+static inline bool zram_dedup_shared(struct zram *zram,
+		struct zram_entry *entry)
+{
+	return false;
+}
+
+static inline int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	return 0;
+}
+static inline void zram_dedup_fini(struct zram *zram) { }
+
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
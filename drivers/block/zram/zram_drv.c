@@ -34,6 +34,8 @@
 #include <linux/debugfs.h>
 #include <linux/cpuhotplug.h>
 #include <linux/part_stat.h>
+#include <linux/random.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -52,6 +54,9 @@ static unsigned int num_devices = 1;
  */
 static size_t huge_class_size;
 
+/* Spreads the pages of large write bios over the per-CPU zcomp streams */
+static struct workqueue_struct *zram_write_wq;
+
 static const struct block_device_operations zram_devops;
 static const struct block_device_operations zram_wb_devops;
 
@@ -85,8 +90,20 @@ static inline struct zram *dev_to_zram(struct device *dev)
 	return (struct zram *)dev_to_disk(dev)->private_data;
 }
 
+static inline bool zram_dedup_enabled(struct zram *zram)
+{
+#ifdef CONFIG_ZRAM_DEDUP
+	return zram->use_dedup;
+#else
+	return false;
+#endif
+}
+
 static unsigned long zram_get_handle(struct zram *zram, u32 index)
 {
+	if (zram->table[index].flags & BIT(ZRAM_DEDUP))
+		return zram->table[index].entry->handle;
+
 	return zram->table[index].handle;
 }
 
@@ -145,6 +162,25 @@ static inline bool zram_allocated(struct zram *zram, u32 index)
 			zram_test_flag(zram, index, ZRAM_WB);
 }
 
+static void zram_set_priority(struct zram *zram, u32 index, u32 prio)
+{
+	prio &= ZRAM_COMP_PRIORITY_MASK;
+	/*
+	 * Clear previous priority value first, in case if we recompress
+	 * further an already recompressed page
+	 */
+	zram->table[index].flags &= ~(ZRAM_COMP_PRIORITY_MASK <<
+				      ZRAM_COMP_PRIORITY_BIT1);
+	zram->table[index].flags |= (prio << ZRAM_COMP_PRIORITY_BIT1);
+}
+
+static inline u32 zram_get_priority(struct zram *zram, u32 index)
+{
+	u32 prio = zram->table[index].flags >> ZRAM_COMP_PRIORITY_BIT1;
+
+	return prio & ZRAM_COMP_PRIORITY_MASK;
+}
+
 #if PAGE_SIZE != 4096
 static inline bool is_partial_io(struct bio_vec *bvec)
 {
@@ -912,13 +948,16 @@ static ssize_t read_block_state(struct file *file, char __user *buf,
 
 		ts = ktime_to_timespec64(zram->table[index].ac_time);
 		copied = snprintf(kbuf + written, count,
-			"%12zd %12lld.%06lu %c%c%c%c\n",
+			"%12zd %12lld.%06lu %c%c%c%c%c%c\n",
 			index, (s64)ts.tv_sec,
 			ts.tv_nsec / NSEC_PER_USEC,
 			zram_test_flag(zram, index, ZRAM_SAME) ? 's' : '.',
 			zram_test_flag(zram, index, ZRAM_WB) ? 'w' : '.',
 			zram_test_flag(zram, index, ZRAM_HUGE) ? 'h' : '.',
-			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.');
+			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.',
+			zram_get_priority(zram, index) ? 'r' : '.',
+			zram_test_flag(zram, index,
+				       ZRAM_INCOMPRESSIBLE) ? 'n' : '.');
 
 		if (count < copied) {
 			zram_slot_unlock(zram, index);
@@ -992,47 +1031,165 @@ static ssize_t max_comp_streams_store(struct device *dev,
 	return len;
 }
 
-static ssize_t comp_algorithm_show(struct device *dev,
+static ssize_t parallel_write_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
-	size_t sz;
 	struct zram *zram = dev_to_zram(dev);
 
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+			 READ_ONCE(zram->parallel_pages));
+}
+
+/* Minimum pages in a write bio to compress it in parallel, 0 disables */
+static ssize_t parallel_write_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int val;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	WRITE_ONCE(zram->parallel_pages, val);
+	return len;
+}
+
+static void comp_algorithm_set(struct zram *zram, u32 prio, const char *alg)
+{
+	/* Do not free statically defined compression algorithms */
+	if (zram->comp_algs[prio] != default_compressor)
+		kfree(zram->comp_algs[prio]);
+
+	zram->comp_algs[prio] = alg;
+}
+
+static ssize_t __comp_algorithm_show(struct zram *zram, u32 prio, char *buf)
+{
+	ssize_t sz;
+
 	down_read(&zram->init_lock);
-	sz = zcomp_available_show(zram->compressor, buf);
+	sz = zcomp_available_show(zram->comp_algs[prio], buf);
 	up_read(&zram->init_lock);
 
 	return sz;
 }
 
-static ssize_t comp_algorithm_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t len)
+static int __comp_algorithm_store(struct zram *zram, u32 prio, const char *buf)
 {
-	struct zram *zram = dev_to_zram(dev);
-	char compressor[ARRAY_SIZE(zram->compressor)];
+	char *compressor;
 	size_t sz;
 
-	strlcpy(compressor, buf, sizeof(compressor));
+	sz = strlen(buf);
+	if (sz >= CRYPTO_MAX_ALG_NAME)
+		return -E2BIG;
+
+	compressor = kstrdup(buf, GFP_KERNEL);
+	if (!compressor)
+		return -ENOMEM;
+
 	/* ignore trailing newline */
-	sz = strlen(compressor);
 	if (sz > 0 && compressor[sz - 1] == '\n')
 		compressor[sz - 1] = 0x00;
 
-	if (!zcomp_available_algorithm(compressor))
+	if (!zcomp_available_algorithm(compressor)) {
+		kfree(compressor);
 		return -EINVAL;
+	}
 
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		up_write(&zram->init_lock);
+		kfree(compressor);
 		pr_info("Can't change algorithm for initialized device\n");
 		return -EBUSY;
 	}
 
-	strcpy(zram->compressor, compressor);
+	comp_algorithm_set(zram, prio, compressor);
 	up_write(&zram->init_lock);
-	return len;
+	return 0;
 }
 
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return __comp_algorithm_show(zram, ZRAM_PRIMARY_COMP, buf);
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int ret;
+
+	ret = __comp_algorithm_store(zram, ZRAM_PRIMARY_COMP, buf);
+	return ret ? ret : len;
+}
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t sz = 0;
+	u32 prio;
+
+	for (prio = ZRAM_SECONDARY_COMP; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio])
+			continue;
+
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2, "#%d: ", prio);
+		sz += __comp_algorithm_show(zram, prio, buf + sz);
+	}
+
+	return sz;
+}
+
+/*
+ * Set up a secondary algorithm, e.g. "algo=zstd priority=1". The
+ * priority (1 by default) orders the algorithms recompress tries.
+ */
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int prio = ZRAM_SECONDARY_COMP;
+	char *args, *param, *val;
+	char *alg = NULL;
+	int ret;
+
+	args = skip_spaces(buf);
+	while (*args) {
+		args = next_arg(args, &param, &val);
+
+		if (!val || !*val)
+			return -EINVAL;
+
+		if (!strcmp(param, "algo")) {
+			alg = val;
+			continue;
+		}
+
+		if (!strcmp(param, "priority")) {
+			ret = kstrtoint(val, 10, &prio);
+			if (ret)
+				return ret;
+			continue;
+		}
+	}
+
+	if (!alg)
+		return -EINVAL;
+
+	if (prio < ZRAM_SECONDARY_COMP || prio >= ZRAM_MAX_COMPS)
+		return -EINVAL;
+
+	ret = __comp_algorithm_store(zram, prio, alg);
+	return ret ? ret : len;
+}
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -1089,7 +1246,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
@@ -1097,7 +1254,9 @@ static ssize_t mm_stat_show(struct device *dev,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
 			atomic_long_read(&pool_stats.pages_compacted),
-			(u64)atomic64_read(&zram->stats.huge_pages));
+			(u64)atomic64_read(&zram->stats.huge_pages),
+			(u64)atomic64_read(&zram->stats.recomp_pages),
+			(u64)atomic64_read(&zram->stats.recomp_saved));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1132,17 +1291,74 @@ static ssize_t debug_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-			"version: %d\n%8llu %8llu\n",
+			"version: %d\n%8llu %8llu %8llu\n",
 			version,
 			(u64)atomic64_read(&zram->stats.writestall),
-			(u64)atomic64_read(&zram->stats.miss_free));
+			(u64)atomic64_read(&zram->stats.miss_free),
+			(u64)atomic64_read(&zram->stats.parallel_writes));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+
+static ssize_t dedup_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"%8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.dedup_hits),
+			zram_dedup_dup_size(zram),
+			zram_dedup_meta_size(zram));
 	up_read(&zram->init_lock);
 
 	return ret;
 }
+#endif
 
 static DEVICE_ATTR_RO(io_stat);
 static DEVICE_ATTR_RO(mm_stat);
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+static DEVICE_ATTR_RO(dedup_stat);
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RO(bd_stat);
 #endif
@@ -1157,6 +1373,7 @@ static void zram_meta_free(struct zram *zram, u64 disksize)
 	for (index = 0; index < num_pages; index++)
 		zram_free_page(zram, index);
 
+	zram_dedup_fini(zram);
 	zs_destroy_pool(zram->mem_pool);
 	vfree(zram->table);
 }
@@ -1176,6 +1393,12 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 		return false;
 	}
 
+	if (zram_dedup_init(zram, num_pages)) {
+		zs_destroy_pool(zram->mem_pool);
+		vfree(zram->table);
+		return false;
+	}
+
 	if (!huge_class_size)
 		huge_class_size = zs_huge_class_size(zram->mem_pool);
 	return true;
@@ -1201,6 +1424,11 @@ static void zram_free_page(struct zram *zram, size_t index)
 		atomic64_dec(&zram->stats.huge_pages);
 	}
 
+	if (zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+		zram_clear_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+
+	zram_set_priority(zram, index, 0);
+
 	if (zram_test_flag(zram, index, ZRAM_WB)) {
 		zram_clear_flag(zram, index, ZRAM_WB);
 		free_block_bdev(zram, zram_get_element(zram, index));
@@ -1217,11 +1445,18 @@ static void zram_free_page(struct zram *zram, size_t index)
 		goto out;
 	}
 
-	handle = zram_get_handle(zram, index);
-	if (!handle)
-		return;
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		/* Other slots still share the object */
+		if (!zram_dedup_put(zram, zram->table[index].entry))
+			goto out;
+	} else {
+		handle = zram_get_handle(zram, index);
+		if (!handle)
+			return;
 
-	zs_free(zram->mem_pool, handle);
+		zs_free(zram->mem_pool, handle);
+	}
 
 	atomic64_sub(zram_get_obj_size(zram, index),
 			&zram->stats.compr_data_size);
@@ -1233,29 +1468,20 @@ out:
 		~(1UL << ZRAM_LOCK | 1UL << ZRAM_UNDER_WB));
 }
 
-static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
-				struct bio *bio, bool partial_io)
+/*
+ * Decompress the slot with the algorithm it was stored by.
+ * Corresponding ZRAM slot should be locked.
+ */
+static int zram_read_from_zspool(struct zram *zram, struct page *page,
+				 u32 index)
 {
 	struct zcomp_strm *zstrm;
 	unsigned long handle;
 	unsigned int size;
 	void *src, *dst;
+	u32 prio;
 	int ret;
 
-	zram_slot_lock(zram, index);
-	if (zram_test_flag(zram, index, ZRAM_WB)) {
-		struct bio_vec bvec;
-
-		zram_slot_unlock(zram, index);
-
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
-		return read_from_bdev(zram, &bvec,
-				zram_get_element(zram, index),
-				bio, partial_io);
-	}
-
 	handle = zram_get_handle(zram, index);
 	if (!handle || zram_test_flag(zram, index, ZRAM_SAME)) {
 		unsigned long value;
@@ -1265,14 +1491,15 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		mem = kmap_atomic(page);
 		zram_fill_page(mem, PAGE_SIZE, value);
 		kunmap_atomic(mem);
-		zram_slot_unlock(zram, index);
 		return 0;
 	}
 
 	size = zram_get_obj_size(zram, index);
 
-	if (size != PAGE_SIZE)
-		zstrm = zcomp_stream_get(zram->comp);
+	if (size != PAGE_SIZE) {
+		prio = zram_get_priority(zram, index);
+		zstrm = zcomp_stream_get(zram->comps[prio]);
+	}
 
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 	if (size == PAGE_SIZE) {
@@ -1284,9 +1511,33 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(zram->comps[prio]);
 	}
 	zs_unmap_object(zram->mem_pool, handle);
+
+	return ret;
+}
+
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io)
+{
+	int ret;
+
+	zram_slot_lock(zram, index);
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		struct bio_vec bvec;
+
+		zram_slot_unlock(zram, index);
+
+		bvec.bv_page = page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		return read_from_bdev(zram, &bvec,
+				zram_get_element(zram, index),
+				bio, partial_io);
+	}
+
+	ret = zram_read_from_zspool(zram, page, index);
 	zram_slot_unlock(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
@@ -1341,6 +1592,8 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	struct page *page = bvec->bv_page;
 	unsigned long element = 0;
 	enum zram_pageflags flags = 0;
+	struct zram_entry *entry = NULL;
+	u32 checksum = 0;
 
 	mem = kmap_atomic(page);
 	if (page_same_filled(mem, &element)) {
@@ -1353,13 +1606,13 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	kunmap_atomic(mem);
 
 compress_again:
-	zstrm = zcomp_stream_get(zram->comp);
+	zstrm = zcomp_stream_get(zram->comps[ZRAM_PRIMARY_COMP]);
 	src = kmap_atomic(page);
 	ret = zcomp_compress(zstrm, src, &comp_len);
 	kunmap_atomic(src);
 
 	if (unlikely(ret)) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		pr_err("Compression failed! err=%d\n", ret);
 		zs_free(zram->mem_pool, handle);
 		return ret;
@@ -1367,6 +1620,19 @@ compress_again:
 
 	if (comp_len >= huge_class_size)
 		comp_len = PAGE_SIZE;
+
+	if (zram_dedup_enabled(zram) && comp_len != PAGE_SIZE) {
+		checksum = zram_dedup_checksum(zstrm->buffer, comp_len);
+		entry = zram_dedup_find(zram, zstrm->buffer, comp_len,
+					checksum);
+		if (entry) {
+			zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+			/* coming from the slow path, the handle is unused */
+			if (handle)
+				zs_free(zram->mem_pool, handle);
+			goto out;
+		}
+	}
 	/*
 	 * handle allocation has 2 paths:
 	 * a) fast path is executed with preemption disabled (for
@@ -1388,7 +1654,7 @@ compress_again:
 				__GFP_MOVABLE |
 				__GFP_CMA);
 	if (!handle) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		atomic64_inc(&zram->stats.writestall);
 		handle = zs_malloc(zram->mem_pool, comp_len,
 				GFP_NOIO | __GFP_HIGHMEM |
@@ -1402,7 +1668,7 @@ compress_again:
 	update_used_max(zram, alloced_pages);
 
 	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		zs_free(zram->mem_pool, handle);
 		return -ENOMEM;
 	}
@@ -1416,9 +1682,12 @@ compress_again:
 	if (comp_len == PAGE_SIZE)
 		kunmap_atomic(src);
 
-	zcomp_stream_put(zram->comp);
+	zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 	zs_unmap_object(zram->mem_pool, handle);
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
+
+	if (zram_dedup_enabled(zram) && comp_len != PAGE_SIZE)
+		entry = zram_dedup_insert(zram, handle, comp_len, checksum);
 out:
 	/*
 	 * Free memory associated with this sector
@@ -1435,7 +1704,11 @@ out:
 	if (flags) {
 		zram_set_flag(zram, index, flags);
 		zram_set_element(zram, index, element);
-	}  else {
+	} else if (entry) {
+		zram->table[index].entry = entry;
+		zram_set_flag(zram, index, ZRAM_DEDUP);
+		zram_set_obj_size(zram, index, comp_len);
+	} else {
 		zram_set_handle(zram, index, handle);
 		zram_set_obj_size(zram, index, comp_len);
 	}
@@ -1487,6 +1760,300 @@ out:
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+/*
+ * This function will decompress (unless it's ZRAM_HUGE) the page and then
+ * attempt to compress it using provided compression algorithm priority
+ * (which is potentially more effective).
+ *
+ * Corresponding ZRAM slot should be locked.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page,
+			   u32 threshold, u32 prio, u32 prio_max)
+{
+	struct zcomp_strm *zstrm = NULL;
+	unsigned long handle_old;
+	unsigned long handle_new;
+	unsigned int comp_len_old;
+	unsigned int comp_len_new;
+	unsigned int class_index_old;
+	unsigned int class_index_new;
+	u32 num_recomps = 0;
+	void *src, *dst;
+	int ret;
+
+	handle_old = zram_get_handle(zram, index);
+	if (!handle_old)
+		return -EINVAL;
+
+	comp_len_old = zram_get_obj_size(zram, index);
+	/*
+	 * Do not recompress objects that are already "small enough".
+	 */
+	if (comp_len_old < threshold)
+		return 0;
+
+	ret = zram_read_from_zspool(zram, page, index);
+	if (ret)
+		return ret;
+
+	class_index_old = zs_lookup_class_index(zram->mem_pool, comp_len_old);
+	/*
+	 * Iterate the secondary comp algorithms list (in order of priority)
+	 * and try to recompress the page.
+	 */
+	for (; prio < prio_max; prio++) {
+		if (!zram->comps[prio])
+			continue;
+
+		/*
+		 * Skip if the object is already re-compressed with a higher
+		 * priority algorithm (or same algorithm).
+		 */
+		if (prio <= zram_get_priority(zram, index))
+			continue;
+
+		num_recomps++;
+		zstrm = zcomp_stream_get(zram->comps[prio]);
+		src = kmap_atomic(page);
+		ret = zcomp_compress(zstrm, src, &comp_len_new);
+		kunmap_atomic(src);
+
+		if (ret) {
+			zcomp_stream_put(zram->comps[prio]);
+			return ret;
+		}
+
+		class_index_new = zs_lookup_class_index(zram->mem_pool,
+							comp_len_new);
+
+		/* Continue until we make progress */
+		if (class_index_new >= class_index_old ||
+		    (threshold && comp_len_new >= threshold)) {
+			zcomp_stream_put(zram->comps[prio]);
+			continue;
+		}
+
+		/* Recompression was successful so break out */
+		break;
+	}
+
+	/*
+	 * We did not try to recompress, e.g. when we have only one
+	 * secondary algorithm and the page is already recompressed
+	 * using that algorithm
+	 */
+	if (!zstrm)
+		return 0;
+
+	if (class_index_new >= class_index_old) {
+		/*
+		 * Secondary algorithms failed to re-compress the page
+		 * in a way that would save memory, mark the object as
+		 * incompressible so that we will not try to compress
+		 * it again.
+		 *
+		 * We need to make sure that all secondary algorithms have
+		 * failed, so we test if the number of recompressions matches
+		 * the number of active secondary algorithms.
+		 */
+		if (num_recomps == zram->num_active_comps - 1)
+			zram_set_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+		return 0;
+	}
+
+	/* Successful recompression but above threshold */
+	if (threshold && comp_len_new >= threshold)
+		return 0;
+
+	/*
+	 * No direct reclaim (slow path) for handle allocation and no
+	 * re-compression attempt (unlike in __zram_bvec_write()) since
+	 * we already have stored that object in zsmalloc. If we cannot
+	 * alloc memory for recompressed object then we bail out and
+	 * simply keep the old (existing) object in zsmalloc.
+	 */
+	handle_new = zs_malloc(zram->mem_pool, comp_len_new,
+			       __GFP_KSWAPD_RECLAIM |
+			       __GFP_NOWARN |
+			       __GFP_HIGHMEM |
+			       __GFP_MOVABLE);
+	if (!handle_new) {
+		zcomp_stream_put(zram->comps[prio]);
+		return -ENOMEM;
+	}
+
+	dst = zs_map_object(zram->mem_pool, handle_new, ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len_new);
+	zcomp_stream_put(zram->comps[prio]);
+
+	zs_unmap_object(zram->mem_pool, handle_new);
+
+	zram_free_page(zram, index);
+	zram_set_handle(zram, index, handle_new);
+	zram_set_obj_size(zram, index, comp_len_new);
+	zram_set_priority(zram, index, prio);
+
+	atomic64_add(comp_len_new, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+	atomic64_inc(&zram->stats.recomp_pages);
+	atomic64_add(comp_len_old - comp_len_new, &zram->stats.recomp_saved);
+
+	return 0;
+}
+
+#define RECOMPRESS_IDLE		(1 << 0)
+#define RECOMPRESS_HUGE		(1 << 1)
+
+/*
+ * Recompress slots with the secondary algorithms, e.g.
+ * "type=idle threshold=1024 algo=zstd max_pages=4096". Slots are picked
+ * by the same idle marking writeback uses; written back, same-filled
+ * and incompressible slots are skipped. So are slots whose dedup entry
+ * is shared: recompressing one of them would give it a private copy
+ * and store the content twice. An unshared entry is dropped by
+ * zram_free_page() like a plain handle.
+ */
+static ssize_t recompress_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t len)
+{
+	u32 prio = ZRAM_SECONDARY_COMP, prio_max = ZRAM_MAX_COMPS;
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	char *args, *param, *val, *algo = NULL;
+	unsigned long max_pages = ULONG_MAX;
+	u32 mode = 0, threshold = 0;
+	unsigned long index;
+	struct page *page;
+	ssize_t ret;
+
+	args = skip_spaces(buf);
+	while (*args) {
+		args = next_arg(args, &param, &val);
+
+		if (!val || !*val)
+			return -EINVAL;
+
+		if (!strcmp(param, "type")) {
+			if (!strcmp(val, "idle"))
+				mode = RECOMPRESS_IDLE;
+			else if (!strcmp(val, "huge"))
+				mode = RECOMPRESS_HUGE;
+			else if (!strcmp(val, "huge_idle"))
+				mode = RECOMPRESS_IDLE | RECOMPRESS_HUGE;
+			else
+				return -EINVAL;
+			continue;
+		}
+
+		if (!strcmp(param, "threshold")) {
+			/*
+			 * We will re-compress only idle objects equal or
+			 * greater in size than watermark.
+			 */
+			ret = kstrtouint(val, 10, &threshold);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		if (!strcmp(param, "max_pages")) {
+			ret = kstrtoul(val, 10, &max_pages);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		if (!strcmp(param, "algo")) {
+			algo = val;
+			continue;
+		}
+	}
+
+	if (threshold >= PAGE_SIZE)
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (algo) {
+		bool found = false;
+
+		for (; prio < ZRAM_MAX_COMPS; prio++) {
+			if (!zram->comp_algs[prio])
+				continue;
+
+			if (!strcmp(zram->comp_algs[prio], algo)) {
+				prio_max = min(prio + 1, ZRAM_MAX_COMPS);
+				found = true;
+				break;
+			}
+		}
+
+		if (!found) {
+			ret = -EINVAL;
+			goto release_init_lock;
+		}
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	ret = len;
+	for (index = 0; index < nr_pages && max_pages; index++) {
+		int err = 0;
+
+		zram_slot_lock(zram, index);
+
+		if (!zram_allocated(zram, index))
+			goto next;
+
+		if (mode & RECOMPRESS_IDLE &&
+		    !zram_test_flag(zram, index, ZRAM_IDLE))
+			goto next;
+
+		if (mode & RECOMPRESS_HUGE &&
+		    !zram_test_flag(zram, index, ZRAM_HUGE))
+			goto next;
+
+		if (zram_test_flag(zram, index, ZRAM_WB) ||
+		    zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+		    zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+			goto next;
+
+		if (zram_test_flag(zram, index, ZRAM_DEDUP) &&
+		    zram_dedup_shared(zram, zram->table[index].entry))
+			goto next;
+
+		max_pages--;
+		err = zram_recompress(zram, index, page, threshold,
+				      prio, prio_max);
+next:
+		zram_slot_unlock(zram, index);
+		if (err) {
+			ret = err;
+			break;
+		}
+
+		cond_resched();
+	}
+
+	__free_page(page);
+
+release_init_lock:
+	up_read(&zram->init_lock);
+	return ret;
+}
+#endif
+
 /*
  * zram_bio_discard - handler on discard request
  * @index: physical block index in PAGE_SIZE units
@@ -1558,6 +2125,280 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
+static void zram_pbatch_put(struct zram_pbatch *batch)
+{
+	struct bio *bio = batch->bio;
+
+	if (!atomic_dec_and_test(&batch->pending))
+		return;
+
+	if (!bio) {
+		complete(&batch->done);
+		return;
+	}
+
+	bio_end_io_acct(bio, batch->start_time);
+	bio_endio(bio);
+	kfree(batch);
+}
+
+static int zram_bench_compress(struct zram *zram, struct page *page)
+{
+	struct zcomp *comp = zram->comps[ZRAM_PRIMARY_COMP];
+	struct zcomp_strm *zstrm;
+	unsigned int comp_len;
+	void *src;
+	int ret;
+
+	zstrm = zcomp_stream_get(comp);
+	src = kmap_atomic(page);
+	ret = zcomp_compress(zstrm, src, &comp_len);
+	kunmap_atomic(src);
+	zcomp_stream_put(comp);
+
+	return ret;
+}
+
+static void zram_pwork_fn(struct work_struct *work)
+{
+	struct zram_pwork *pwork = container_of(work, struct zram_pwork, work);
+	struct zram_pbatch *batch = pwork->batch;
+	struct zram *zram = batch->zram;
+	struct bio_vec bvec;
+	unsigned int i;
+
+	for (i = pwork->first; i < pwork->first + pwork->nr_pages; i++) {
+		if (!batch->bio) {
+			zram_bench_compress(zram, batch->pages[i]);
+			continue;
+		}
+
+		bvec.bv_page = batch->pages[i];
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		if (zram_bvec_rw(zram, &bvec, batch->index + i, 0,
+				 REQ_OP_WRITE, batch->bio) < 0) {
+			WRITE_ONCE(batch->bio->bi_status, BLK_STS_IOERR);
+			break;
+		}
+	}
+
+	zram_pbatch_put(batch);
+}
+
+/* The work items sit behind pages[], at most one per online CPU */
+static struct zram_pbatch *zram_pbatch_alloc(struct zram *zram,
+					     unsigned int nr_pages, gfp_t gfp)
+{
+	unsigned int max_works = min(nr_pages, num_online_cpus());
+	struct zram_pbatch *batch;
+	size_t size;
+
+	size = struct_size(batch, pages, nr_pages);
+	batch = kzalloc(size + array_size(max_works, sizeof(*batch->works)),
+			gfp);
+	if (!batch)
+		return NULL;
+
+	batch->zram = zram;
+	batch->works = (void *)batch + size;
+	batch->max_works = max_works;
+	return batch;
+}
+
+/*
+ * Split the batch into runs of contiguous pages, one per online CPU,
+ * and queue each run on its CPU so that it is compressed with that
+ * CPU's zcomp stream. A CPU takes one work item per batch instead of
+ * one per page. The caller holds one reference on @batch and drops it
+ * once everything is queued.
+ */
+static void zram_pbatch_dispatch(struct zram_pbatch *batch)
+{
+	unsigned int nr_works = min(batch->nr_pages, batch->max_works);
+	unsigned int per_work = batch->nr_pages / nr_works;
+	unsigned int extra = batch->nr_pages % nr_works;
+	int cpu = raw_smp_processor_id();
+	unsigned int i, first = 0;
+
+	atomic_set(&batch->pending, nr_works + 1);
+	for (i = 0; i < nr_works; i++) {
+		struct zram_pwork *pwork = &batch->works[i];
+
+		pwork->batch = batch;
+		pwork->first = first;
+		pwork->nr_pages = per_work + (i < extra);
+		first += pwork->nr_pages;
+		INIT_WORK(&pwork->work, zram_pwork_fn);
+		queue_work_on(cpu, zram_write_wq, &pwork->work);
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+}
+
+/*
+ * Write a bio of whole pages in parallel. The bio is completed by the
+ * last run to finish, so it only ends once all of its pages are
+ * stored. Returns false if the bio has to take the serial path.
+ */
+static bool zram_write_parallel(struct zram *zram, struct bio *bio,
+				u32 index, int offset)
+{
+	unsigned int nr_pages = bio->bi_iter.bi_size >> PAGE_SHIFT;
+	struct zram_pbatch *batch;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	unsigned int i = 0;
+
+	if (!zram->parallel_pages || nr_pages < zram->parallel_pages ||
+	    num_online_cpus() < 2)
+		return false;
+
+	if (offset || !IS_ALIGNED(bio->bi_iter.bi_size, PAGE_SIZE))
+		return false;
+
+	bio_for_each_segment(bvec, bio, iter) {
+		if (bvec.bv_offset || bvec.bv_len != PAGE_SIZE)
+			return false;
+	}
+
+	batch = zram_pbatch_alloc(zram, nr_pages, GFP_NOIO | __GFP_NOWARN);
+	if (!batch)
+		return false;
+
+	batch->bio = bio;
+	batch->index = index;
+	batch->nr_pages = nr_pages;
+	bio_for_each_segment(bvec, bio, iter)
+		batch->pages[i++] = bvec.bv_page;
+
+	atomic64_inc(&zram->stats.parallel_writes);
+	batch->start_time = bio_start_io_acct(bio);
+	zram_pbatch_dispatch(batch);
+	zram_pbatch_put(batch);
+	return true;
+}
+
+static const unsigned int zram_bench_bursts[ZRAM_BENCH_BURSTS] = {
+	1, 16, 256
+};
+
+/* Pages compressed per burst size and mode */
+#define ZRAM_BENCH_PAGES	4096
+
+static unsigned int zram_bench_mbps(ktime_t start, unsigned int nr_pages)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (!ns)
+		return 0;
+	return div64_u64((u64)nr_pages * PAGE_SIZE * NSEC_PER_SEC,
+			 ns * SZ_1M);
+}
+
+/*
+ * Compress bursts of sequential pages, first one page after another on
+ * this CPU and then spread like a parallel write. Nothing is stored, so
+ * the device contents are untouched.
+ */
+static int zram_bench_run(struct zram *zram)
+{
+	unsigned int max_burst = zram_bench_bursts[ZRAM_BENCH_BURSTS - 1];
+	struct zram_pbatch *batch;
+	unsigned int b, i, done;
+	ktime_t start;
+	int ret = 0;
+
+	batch = zram_pbatch_alloc(zram, max_burst, GFP_KERNEL);
+	if (!batch)
+		return -ENOMEM;
+
+	for (i = 0; i < max_burst; i++) {
+		void *mem;
+
+		batch->pages[i] = alloc_page(GFP_KERNEL);
+		if (!batch->pages[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		/* half random, half zero: compresses roughly like swap */
+		mem = kmap(batch->pages[i]);
+		prandom_bytes(mem, PAGE_SIZE / 2);
+		memset(mem + PAGE_SIZE / 2, 0, PAGE_SIZE / 2);
+		kunmap(batch->pages[i]);
+	}
+
+	for (b = 0; b < ZRAM_BENCH_BURSTS; b++) {
+		unsigned int burst = zram_bench_bursts[b];
+
+		start = ktime_get();
+		for (done = 0; done < ZRAM_BENCH_PAGES; done += burst) {
+			for (i = 0; i < burst; i++)
+				zram_bench_compress(zram, batch->pages[i]);
+			cond_resched();
+		}
+		zram->bench_mbps[b][0] = zram_bench_mbps(start, done);
+
+		batch->nr_pages = burst;
+		start = ktime_get();
+		for (done = 0; done < ZRAM_BENCH_PAGES; done += burst) {
+			init_completion(&batch->done);
+			zram_pbatch_dispatch(batch);
+			zram_pbatch_put(batch);
+			wait_for_completion(&batch->done);
+		}
+		zram->bench_mbps[b][1] = zram_bench_mbps(start, done);
+	}
+out:
+	for (i = 0; i < max_burst; i++) {
+		if (batch->pages[i])
+			__free_page(batch->pages[i]);
+	}
+	kfree(batch);
+	return ret;
+}
+
+static ssize_t comp_bench_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t sz;
+	int b;
+
+	down_read(&zram->init_lock);
+	sz = scnprintf(buf, PAGE_SIZE, "%8s %8s %8s\n",
+		       "pages", "serial", "parallel");
+	for (b = 0; b < ZRAM_BENCH_BURSTS; b++)
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz, "%8u %8u %8u\n",
+				zram_bench_bursts[b],
+				zram->bench_mbps[b][0],
+				zram->bench_mbps[b][1]);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+/* Any write runs the benchmark; results are in MB/s */
+static ssize_t comp_bench_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int ret;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	ret = zram_bench_run(zram);
+	up_read(&zram->init_lock);
+
+	return ret ? ret : len;
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset;
@@ -1576,6 +2417,10 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		zram_bio_discard(zram, index, offset, bio);
 		bio_endio(bio);
 		return;
+	case REQ_OP_WRITE:
+		if (zram_write_parallel(zram, bio, index, offset))
+			return;
+		break;
 	default:
 		break;
 	}
@@ -1696,9 +2541,23 @@ out:
 	return ret;
 }
 
+static void zram_destroy_comps(struct zram *zram)
+{
+	u32 prio;
+
+	for (prio = 0; prio < ZRAM_MAX_COMPS; prio++) {
+		struct zcomp *comp = zram->comps[prio];
+
+		zram->comps[prio] = NULL;
+		if (!comp)
+			continue;
+		zcomp_destroy(comp);
+		zram->num_active_comps--;
+	}
+}
+
 static void zram_reset_device(struct zram *zram)
 {
-	struct zcomp *comp;
 	u64 disksize;
 
 	down_write(&zram->init_lock);
@@ -1710,7 +2569,13 @@ static void zram_reset_device(struct zram *zram)
 		return;
 	}
 
-	comp = zram->comp;
+	/*
+	 * Parallel writes complete their bio from zram_write_wq, so a
+	 * finished fsync does not mean their work items are gone. They
+	 * never take init_lock, so wait for them while holding it.
+	 */
+	flush_workqueue(zram_write_wq);
+
 	disksize = zram->disksize;
 	zram->disksize = 0;
 
@@ -1721,7 +2586,7 @@ static void zram_reset_device(struct zram *zram)
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
-	zcomp_destroy(comp);
+	zram_destroy_comps(zram);
 	reset_bdev(zram);
 }
 
@@ -1732,6 +2597,7 @@ static ssize_t disksize_store(struct device *dev,
 	struct zcomp *comp;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
+	u32 prio;
 
 	disksize = memparse(buf, NULL);
 	if (!disksize)
@@ -1750,15 +2616,21 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_unlock;
 	}
 
-	comp = zcomp_create(zram->compressor);
-	if (IS_ERR(comp)) {
-		pr_err("Cannot initialise %s compressing backend\n",
-				zram->compressor);
-		err = PTR_ERR(comp);
-		goto out_free_meta;
-	}
+	for (prio = 0; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio])
+			continue;
+
+		comp = zcomp_create(zram->comp_algs[prio]);
+		if (IS_ERR(comp)) {
+			pr_err("Cannot initialise %s compressing backend\n",
+			       zram->comp_algs[prio]);
+			err = PTR_ERR(comp);
+			goto out_free_comps;
+		}
 
-	zram->comp = comp;
+		zram->comps[prio] = comp;
+		zram->num_active_comps++;
+	}
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
@@ -1767,7 +2639,8 @@ static ssize_t disksize_store(struct device *dev,
 
 	return len;
 
-out_free_meta:
+out_free_comps:
+	zram_destroy_comps(zram);
 	zram_meta_free(zram, disksize);
 out_unlock:
 	up_write(&zram->init_lock);
@@ -1857,7 +2730,13 @@ static DEVICE_ATTR_WO(mem_limit);
 static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_WO(idle);
 static DEVICE_ATTR_RW(max_comp_streams);
+static DEVICE_ATTR_RW(parallel_write);
+static DEVICE_ATTR_RW(comp_bench);
 static DEVICE_ATTR_RW(comp_algorithm);
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 static DEVICE_ATTR_WO(writeback);
@@ -1874,7 +2753,13 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_idle.attr,
 	&dev_attr_max_comp_streams.attr,
+	&dev_attr_parallel_write.attr,
+	&dev_attr_comp_bench.attr,
 	&dev_attr_comp_algorithm.attr,
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
 	&dev_attr_writeback.attr,
@@ -1887,6 +2772,10 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_bd_stat.attr,
 #endif
 	&dev_attr_debug_stat.attr,
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_use_dedup.attr,
+	&dev_attr_dedup_stat.attr,
+#endif
 	NULL,
 };
 
@@ -1919,6 +2808,7 @@ static int zram_add(void)
 	device_id = ret;
 
 	init_rwsem(&zram->init_lock);
+	zram->parallel_pages = ZRAM_PARALLEL_MIN_PAGES;
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spin_lock_init(&zram->wb_limit_lock);
 #endif
@@ -1979,7 +2869,7 @@ static int zram_add(void)
 	blk_queue_flag_set(QUEUE_FLAG_STABLE_WRITES, zram->disk->queue);
 	device_add_disk(NULL, zram->disk, zram_disk_attr_groups);
 
-	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
+	comp_algorithm_set(zram, ZRAM_PRIMARY_COMP, default_compressor);
 
 	zram_debugfs_register(zram);
 	pr_info("Added device: %s\n", zram->disk->disk_name);
@@ -1997,6 +2887,7 @@ out_free_dev:
 static int zram_remove(struct zram *zram)
 {
 	struct block_device *bdev;
+	u32 prio;
 
 	bdev = bdget_disk(zram->disk, 0);
 	if (!bdev)
@@ -2024,6 +2915,8 @@ static int zram_remove(struct zram *zram)
 	del_gendisk(zram->disk);
 	blk_cleanup_queue(zram->disk->queue);
 	put_disk(zram->disk);
+	for (prio = 0; prio < ZRAM_MAX_COMPS; prio++)
+		comp_algorithm_set(zram, prio, NULL);
 	kfree(zram);
 	return 0;
 }
@@ -2110,6 +3003,7 @@ static void destroy_devices(void)
 	zram_debugfs_destroy();
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
+	destroy_workqueue(zram_write_wq);
 	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 }
 
@@ -2117,14 +3011,24 @@ static int __init zram_init(void)
 {
 	int ret;
 
+	BUILD_BUG_ON(__NR_ZRAM_PAGEFLAGS > BITS_PER_LONG);
+
 	ret = cpuhp_setup_state_multi(CPUHP_ZCOMP_PREPARE, "block/zram:prepare",
 				      zcomp_cpu_up_prepare, zcomp_cpu_dead);
 	if (ret < 0)
 		return ret;
 
+	zram_write_wq = alloc_workqueue("zram_write",
+					WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!zram_write_wq) {
+		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		return -ENOMEM;
+	}
+
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
+		destroy_workqueue(zram_write_wq);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 		return ret;
 	}
@@ -2134,6 +3038,7 @@ static int __init zram_init(void)
 	if (zram_major <= 0) {
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
+		destroy_workqueue(zram_write_wq);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 		return -EBUSY;
 	}
@@ -2168,3 +3073,7 @@ MODULE_PARM_DESC(num_devices, "Number of pre-created zram devices");
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_AUTHOR("Nitin Gupta <ngupta@vflare.org>");
 MODULE_DESCRIPTION("Compressed RAM Block Device");
+
+#ifdef CONFIG_ZRAM_KUNIT_TEST
+#include "zram_test.c"
+#endif
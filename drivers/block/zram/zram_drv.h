@@ -18,8 +18,11 @@
 #include <linux/rwsem.h>
 #include <linux/zsmalloc.h>
 #include <linux/crypto.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
 
 #include "zcomp.h"
+#include "zram_dedup.h"
 
 #define SECTORS_PER_PAGE_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
@@ -30,16 +33,18 @@
 
 
 /*
- * The lower ZRAM_FLAG_SHIFT bits of table.flags is for
- * object size (excluding header), the higher bits is for
- * zram_pageflags.
+ * ZRAM is mainly used for memory efficiency so we want to keep memory
+ * footprint small and thus squeeze size and zram pageflags into a flags
+ * member. The lower ZRAM_FLAG_SHIFT bits is for object size (excluding
+ * header), which cannot be larger than PAGE_SIZE (requiring PAGE_SHIFT
+ * + 1 bits), the higher bits are for zram_pageflags.
  *
- * zram is mainly used for memory efficiency so we want to keep memory
- * footprint small so we can squeeze size and flags into a field.
- * The lower ZRAM_FLAG_SHIFT bits is for object size (excluding header),
- * the higher bits is for zram_pageflags.
+ * We use BUILD_BUG_ON() to make sure that zram pageflags don't overflow.
  */
-#define ZRAM_FLAG_SHIFT 24
+#define ZRAM_FLAG_SHIFT (PAGE_SHIFT + 1)
+
+/* Only 2 bits are allowed for comp priority index */
+#define ZRAM_COMP_PRIORITY_MASK	0x3
 
 /* Flags for zram pages (table[page_no].flags) */
 enum zram_pageflags {
@@ -50,17 +55,37 @@ enum zram_pageflags {
 	ZRAM_UNDER_WB,	/* page is under writeback */
 	ZRAM_HUGE,	/* Incompressible page */
 	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_INCOMPRESSIBLE, /* none of the algorithms could compress it */
+	ZRAM_DEDUP,	/* slot refers to a shared zram_entry */
+
+	ZRAM_COMP_PRIORITY_BIT1, /* First bit of comp priority index */
+	ZRAM_COMP_PRIORITY_BIT2, /* Second bit of comp priority index */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/* A zsmalloc object shared by all slots holding the same content */
+struct zram_entry {
+	struct hlist_node node;
+	unsigned long handle;
+	unsigned int len;
+	u32 checksum;
+	unsigned long refcount;	/* protected by the hash bucket lock */
+};
+
+struct zram_hash {
+	spinlock_t lock;
+	struct hlist_head head;
+};
+
 /* Allocated for each disk page */
 struct zram_table_entry {
 	union {
 		unsigned long handle;
 		unsigned long element;
+		struct zram_entry *entry;	/* if ZRAM_DEDUP is set */
 	};
 	unsigned long flags;
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
@@ -82,6 +107,14 @@ struct zram_stats {
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
 	atomic64_t miss_free;		/* no. of missed free */
+	atomic64_t recomp_pages;	/* no. of pages recompressed */
+	atomic64_t recomp_saved;	/* bytes saved by recompression */
+	atomic64_t parallel_writes;	/* no. of bios written in parallel */
+#ifdef CONFIG_ZRAM_DEDUP
+	atomic64_t dedup_hits;		/* no. of writes served by dedup */
+	atomic64_t dup_data_size;	/* compressed bytes saved by dedup */
+	atomic64_t meta_data_size;	/* dedup hash and entry overhead */
+#endif
 #ifdef	CONFIG_ZRAM_WRITEBACK
 	atomic64_t bd_count;		/* no. of pages in backing device */
 	atomic64_t bd_reads;		/* no. of reads from backing device */
@@ -89,10 +122,46 @@ struct zram_stats {
 #endif
 };
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+#define ZRAM_PRIMARY_COMP	0U
+#define ZRAM_SECONDARY_COMP	1U
+#define ZRAM_MAX_COMPS	4U
+#else
+#define ZRAM_PRIMARY_COMP	0U
+#define ZRAM_SECONDARY_COMP	0U
+#define ZRAM_MAX_COMPS	1U
+#endif
+
+/* Write bios of at least this many pages are compressed in parallel */
+#define ZRAM_PARALLEL_MIN_PAGES	16
+
+/* A run of contiguous pages of a parallel write or benchmark batch */
+struct zram_pwork {
+	struct work_struct work;
+	struct zram_pbatch *batch;
+	unsigned int first;	/* index into batch->pages */
+	unsigned int nr_pages;
+};
+
+struct zram_pbatch {
+	struct zram *zram;
+	struct bio *bio;	/* NULL for benchmark batches */
+	unsigned long start_time;
+	atomic_t pending;
+	struct completion done;	/* benchmark batches only */
+	u32 index;		/* device page of pages[0] */
+	unsigned int nr_pages;
+	unsigned int max_works;
+	struct zram_pwork *works;	/* max_works, behind pages[] */
+	struct page *pages[];
+};
+
+#define ZRAM_BENCH_BURSTS	3
+
 struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
-	struct zcomp *comp;
+	struct zcomp *comps[ZRAM_MAX_COMPS];
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -107,7 +176,11 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
-	char compressor[CRYPTO_MAX_ALG_NAME];
+	const char *comp_algs[ZRAM_MAX_COMPS];
+	s8 num_active_comps;
+	unsigned int parallel_pages;
+	/* MB/s of the last comp_bench run, serial and parallel */
+	unsigned int bench_mbps[ZRAM_BENCH_BURSTS][2];
 	/*
 	 * zram is claimed so open request will be failed
 	 */
@@ -125,5 +198,10 @@ struct zram {
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
 #endif
+#ifdef CONFIG_ZRAM_DEDUP
+	bool use_dedup;
+	struct zram_hash *hash;
+	size_t hash_size;
+#endif
 };
 #endif
@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for zram, included by zram_drv.c.
+ */
+#include <kunit/test.h>
+
+#define ZRAM_TEST_PAGES		4
+
+/* Compressible but not same-filled, and different for every @seed */
+static void zram_test_fill(struct page *page, unsigned int seed)
+{
+	char *mem = kmap_atomic(page);
+	unsigned int i;
+
+	for (i = 0; i < PAGE_SIZE; i++)
+		mem[i] = 'a' + (i / 64 + seed) % 26;
+	kunmap_atomic(mem);
+}
+
+static void zram_test_write(struct kunit *test, struct zram *zram,
+			    struct page *page, u32 index)
+{
+	struct bio_vec bvec = {
+		.bv_page = page,
+		.bv_len = PAGE_SIZE,
+		.bv_offset = 0,
+	};
+
+	KUNIT_EXPECT_EQ(test, zram_bvec_rw(zram, &bvec, index, 0,
+					   REQ_OP_WRITE, NULL), 0);
+}
+
+/* Whether recompress looked at the slot at all */
+static bool zram_test_recompressed(struct zram *zram, u32 index)
+{
+	bool ret;
+
+	zram_slot_lock(zram, index);
+	ret = zram_get_priority(zram, index) ||
+	      zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+	zram_slot_unlock(zram, index);
+
+	return ret;
+}
+
+/*
+ * Slots 0 and 1 share one dedup entry, slot 2 holds an entry of its
+ * own. Recompress must leave the shared pair alone but still process
+ * slot 2, and slot 2 must read back intact afterwards.
+ */
+static void zram_test_recompress_dedup(struct kunit *test)
+{
+	char disksize[] = "1M", use_dedup[] = "1";
+	char recomp_alg[] = "algo=lzo", recompress[] = "algo=lzo";
+	struct page *page, *read;
+	struct bio_vec bvec;
+	struct zram *zram;
+	struct device *dev;
+	ssize_t ret;
+	int id;
+	char *a, *b;
+
+	page = alloc_page(GFP_KERNEL);
+	read = alloc_page(GFP_KERNEL);
+	if (!page || !read) {
+		if (page)
+			__free_page(page);
+		if (read)
+			__free_page(read);
+		KUNIT_FAIL(test, "page allocation failed");
+		return;
+	}
+
+	mutex_lock(&zram_index_mutex);
+	id = zram_add();
+	mutex_unlock(&zram_index_mutex);
+	if (id < 0) {
+		KUNIT_FAIL(test, "zram_add() failed: %d", id);
+		goto out_free_pages;
+	}
+	zram = idr_find(&zram_index_idr, id);
+	dev = disk_to_dev(zram->disk);
+
+	if (use_dedup_store(dev, NULL, use_dedup, strlen(use_dedup)) < 0 ||
+	    recomp_algorithm_store(dev, NULL, recomp_alg,
+				   strlen(recomp_alg)) < 0 ||
+	    disksize_store(dev, NULL, disksize, strlen(disksize)) < 0) {
+		KUNIT_FAIL(test, "zram%d setup failed", id);
+		goto out_remove;
+	}
+
+	zram_test_fill(page, 0);
+	zram_test_write(test, zram, page, 0);
+	zram_test_write(test, zram, page, 1);
+	zram_test_fill(page, 1);
+	zram_test_write(test, zram, page, 2);
+
+	KUNIT_EXPECT_TRUE(test, zram_test_flag(zram, 1, ZRAM_DEDUP));
+	KUNIT_EXPECT_TRUE(test, zram_test_flag(zram, 2, ZRAM_DEDUP));
+	KUNIT_EXPECT_EQ(test, zram->table[0].entry, zram->table[1].entry);
+	KUNIT_EXPECT_TRUE(test, zram_dedup_shared(zram, zram->table[1].entry));
+	KUNIT_EXPECT_FALSE(test, zram_dedup_shared(zram, zram->table[2].entry));
+
+	ret = recompress_store(dev, NULL, recompress, strlen(recompress));
+	KUNIT_EXPECT_EQ(test, ret, (ssize_t)strlen(recompress));
+
+	KUNIT_EXPECT_FALSE(test, zram_test_recompressed(zram, 0));
+	KUNIT_EXPECT_FALSE(test, zram_test_recompressed(zram, 1));
+	KUNIT_EXPECT_TRUE(test, zram_test_recompressed(zram, 2));
+
+	bvec.bv_page = read;
+	bvec.bv_len = PAGE_SIZE;
+	bvec.bv_offset = 0;
+	KUNIT_EXPECT_EQ(test, zram_bvec_rw(zram, &bvec, 2, 0,
+					   REQ_OP_READ, NULL), 0);
+	a = kmap(page);
+	b = kmap(read);
+	KUNIT_EXPECT_EQ(test, memcmp(a, b, PAGE_SIZE), 0);
+	kunmap(read);
+	kunmap(page);
+
+out_remove:
+	mutex_lock(&zram_index_mutex);
+	if (!zram_remove(zram))
+		idr_remove(&zram_index_idr, id);
+	mutex_unlock(&zram_index_mutex);
+out_free_pages:
+	__free_page(read);
+	__free_page(page);
+}
+
+static struct kunit_case zram_test_cases[] = {
+	KUNIT_CASE(zram_test_recompress_dedup),
+	{}
+};
+
+static struct kunit_suite zram_test_suite = {
+	.name = "zram",
+	.test_cases = zram_test_cases,
+};
+
+kunit_test_suites(&zram_test_suite);
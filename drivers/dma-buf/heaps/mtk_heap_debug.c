@@ -85,6 +85,8 @@ struct dmaheap_buf_copy {
 	char                    pid_name[TASK_COMM_LEN];
 	char                    tid_name[TASK_COMM_LEN];
 	unsigned long long       ts; /* us */
+	int                     map_users[BUF_PRIV_MAX_CNT];
+	struct list_head        iova_cache_node;
 };
 
 enum stats_type {
@@ -52,6 +52,8 @@ struct dma_heap_attachment {
 	bool mapped;
 
 	bool uncached;
+	/* table is the buffer's per-domain cached mapping, not owned */
+	bool cached;
 };
 
 struct mtk_heap_dev_info {
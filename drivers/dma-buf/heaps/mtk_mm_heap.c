@@ -454,6 +454,7 @@ static void mtk_mm_heap_buf_free(struct deferred_freelist_item *item,
 				 enum df_reason reason)
 {
 	struct mtk_mm_heap_buffer *buffer;
+	struct list_head pool_pages[NUM_ORDERS];
 	struct sg_table *table;
 	struct scatterlist *sg;
 	int i, j;
@@ -464,6 +465,9 @@ static void mtk_mm_heap_buf_free(struct deferred_freelist_item *item,
 		if (mtk_mm_heap_zero_buffer(buffer))
 			reason = DF_UNDER_PRESSURE; // On failure, just free
 
+	for (j = 0; j < NUM_ORDERS; j++)
+		INIT_LIST_HEAD(&pool_pages[j]);
+
 	table = &buffer->sg_table;
 	for_each_sg(table->sgl, sg, table->nents, i) {
 		struct page *page = sg_page(sg);
@@ -475,9 +479,18 @@ static void mtk_mm_heap_buf_free(struct deferred_freelist_item *item,
 				if (compound_order(page) == orders[j])
 					break;
 			}
-			dmabuf_page_pool_free(pools[j], page);
+			if (j >= NUM_ORDERS) {
+				WARN_ON(1);
+				__free_pages(page, compound_order(page));
+				continue;
+			}
+			list_add_tail(&page->lru, &pool_pages[j]);
 		}
 	}
+	/* give the pages back to each pool in one batch */
+	if (reason != DF_UNDER_PRESSURE)
+		for (j = 0; j < NUM_ORDERS; j++)
+			dmabuf_page_pool_free_bulk(pools[j], &pool_pages[j]);
 	sg_free_table(table);
 	kfree(buffer);
 }
@@ -537,23 +550,35 @@ static const struct dma_buf_ops mtk_mm_heap_buf_ops = {
 	.get_flags = mtk_mm_heap_dma_buf_get_flags,
 };
 
-static struct page *alloc_largest_available(unsigned long size,
-					    unsigned int max_order)
+/*
+ * Fill @pages with chunks covering @size, largest order first. Each order
+ * is taken from its pool with one bulk call, so a large buffer costs a
+ * handful of pool operations rather than one per chunk.
+ * Return the number of chunks added to @pages, 0 on failure.
+ */
+static unsigned int alloc_largest_available(unsigned long size,
+					    struct list_head *pages)
 {
-	struct page *page;
+	unsigned int nr, got, total = 0;
 	int i;
 
-	for (i = 0; i < NUM_ORDERS; i++) {
-		if (size <  (PAGE_SIZE << orders[i]))
-			continue;
-		if (max_order < orders[i])
-			continue;
-		page = dmabuf_page_pool_alloc(pools[i]);
-		if (!page)
+	for (i = 0; i < NUM_ORDERS && size; i++) {
+		/*
+		 * Avoid trying to allocate memory if the process
+		 * has been killed by SIGKILL
+		 */
+		if (fatal_signal_pending(current))
+			return 0;
+
+		nr = size >> (PAGE_SHIFT + orders[i]);
+		if (!nr)
 			continue;
-		return page;
+		got = dmabuf_page_pool_alloc_bulk(pools[i], pages, nr);
+		size -= (unsigned long)got << (PAGE_SHIFT + orders[i]);
+		total += got;
 	}
-	return NULL;
+
+	return size ? 0 : total;
 }
 
 static struct dma_buf *mtk_mm_heap_do_allocate(struct dma_heap *heap,
@@ -564,8 +589,6 @@ static struct dma_buf *mtk_mm_heap_do_allocate(struct dma_heap *heap,
 {
 	struct mtk_mm_heap_buffer *buffer;
 	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
-	unsigned long size_remaining = len;
-	unsigned int max_order = orders[0];
 	struct dma_buf *dmabuf;
 	struct sg_table *table;
 	struct scatterlist *sg;
@@ -585,24 +608,9 @@ static struct dma_buf *mtk_mm_heap_do_allocate(struct dma_heap *heap,
 	buffer->uncached = uncached;
 
 	INIT_LIST_HEAD(&pages);
-	i = 0;
-	while (size_remaining > 0) {
-		/*
-		 * Avoid trying to allocate memory if the process
-		 * has been killed by SIGKILL
-		 */
-		if (fatal_signal_pending(current))
-			goto free_buffer;
-
-		page = alloc_largest_available(size_remaining, max_order);
-		if (!page)
-			goto free_buffer;
-
-		list_add_tail(&page->lru, &pages);
-		size_remaining -= page_size(page);
-		max_order = compound_order(page);
-		i++;
-	}
+	i = alloc_largest_available(len, &pages);
+	if (!i)
+		goto free_buffer;
 
 	table = &buffer->sg_table;
 	if (sg_alloc_table(table, i, GFP_KERNEL))
@@ -671,10 +679,8 @@ static struct dma_buf *mtk_mm_heap_allocate(struct dma_heap *heap,
 }
 
 static long mtk_mm_heap_get_pool_size(struct dma_heap *heap) {
-	int i, j;
-	long page_cnt = 0;
-	struct dmabuf_page_pool *pool;
-	int count = 0;
+	int i;
+	long pool_size = 0;
 
 	/*
 	 * "mtk_mm" & "mtk_mm-uncached" use same page pool
@@ -683,19 +689,10 @@ static long mtk_mm_heap_get_pool_size(struct dma_heap *heap) {
 	if (heap != mtk_mm_heap)
 		return 0;
 
-	for (i = 0; i < NUM_ORDERS; i++) {
-		pool = pools[i];
-		count = 0;
-
-		mutex_lock(&pool->mutex);
-		for (j = 0; j < POOL_TYPE_SIZE; j++) {
-			count += pool->count[j];
-		}
-		page_cnt += (count << pool->order);
-		mutex_unlock(&pool->mutex);
-	}
+	for (i = 0; i < NUM_ORDERS; i++)
+		pool_size += dmabuf_page_pool_get_size(pools[i]);
 
-	return page_cnt * PAGE_SIZE;
+	return pool_size;
 }
 
 
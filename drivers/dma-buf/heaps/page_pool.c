@@ -8,15 +8,30 @@
  * Copyright (C) 2011 Google, Inc.
  */
 
+#include <linux/debugfs.h>
 #include <linux/freezer.h>
+#include <linux/kthread.h>
 #include <linux/list.h>
+#include <linux/percpu.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/sched/signal.h>
+#include <linux/seq_file.h>
 #include "page_pool.h"
 
 static LIST_HEAD(pool_list);
 static DEFINE_MUTEX(pool_list_lock);
+static int pool_next_id;
+
+/* do not refill pools for a while after the shrinker took pages from them */
+#define POOL_REFILL_BACKOFF	(2 * HZ)
+
+static wait_queue_head_t refill_waitqueue;
+static struct task_struct *refill_task;
+static atomic_t refill_pending = ATOMIC_INIT(0);
+static unsigned long pool_last_shrink;
+static struct dentry *pool_debugfs_root;
 
 static inline
 struct page *dmabuf_page_pool_alloc_pages(struct dmabuf_page_pool *pool)
@@ -32,7 +47,7 @@ static inline void dmabuf_page_pool_free_pages(struct dmabuf_page_pool *pool,
 	__free_pages(page, pool->order);
 }
 
-static void dmabuf_page_pool_add(struct dmabuf_page_pool *pool, struct page *page)
+static void __dmabuf_page_pool_add(struct dmabuf_page_pool *pool, struct page *page)
 {
 	int index;
 
@@ -41,42 +56,188 @@ static void dmabuf_page_pool_add(struct dmabuf_page_pool *pool, struct page *pag
 	else
 		index = POOL_LOWPAGE;
 
-	mutex_lock(&pool->mutex);
 	list_add_tail(&page->lru, &pool->items[index]);
 	pool->count[index]++;
-	mutex_unlock(&pool->mutex);
-	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
-			    1 << pool->order);
 }
 
-static struct page *dmabuf_page_pool_remove(struct dmabuf_page_pool *pool, int index)
+static struct page *__dmabuf_page_pool_remove(struct dmabuf_page_pool *pool, int index)
 {
 	struct page *page;
 
-	mutex_lock(&pool->mutex);
 	page = list_first_entry_or_null(&pool->items[index], struct page, lru);
 	if (page) {
 		pool->count[index]--;
 		list_del(&page->lru);
+	}
+
+	return page;
+}
+
+static struct page *dmabuf_page_pool_remove(struct dmabuf_page_pool *pool, int index)
+{
+	struct page *page;
+
+	mutex_lock(&pool->mutex);
+	page = __dmabuf_page_pool_remove(pool, index);
+	mutex_unlock(&pool->mutex);
+
+	if (page)
 		mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
 				    -(1 << pool->order));
+
+	return page;
+}
+
+static void dmabuf_page_pool_kick_refill(struct dmabuf_page_pool *pool)
+{
+	if (!READ_ONCE(pool->low_wm) || !refill_task)
+		return;
+
+	if (!atomic_xchg(&refill_pending, 1))
+		wake_up(&refill_waitqueue);
+}
+
+/*
+ * Move pages between the shared lists and a per-cpu magazine. Pages stay
+ * accounted as NR_KERNEL_MISC_RECLAIMABLE while they sit in either place,
+ * so the batch helpers do not touch the node counters.
+ */
+static unsigned int dmabuf_page_pool_fetch_batch(struct dmabuf_page_pool *pool,
+						 struct page **pages,
+						 unsigned int nr)
+{
+	unsigned int i;
+	unsigned int left;
+
+	mutex_lock(&pool->mutex);
+	for (i = 0; i < nr; i++) {
+		pages[i] = __dmabuf_page_pool_remove(pool, POOL_HIGHPAGE);
+		if (!pages[i])
+			pages[i] = __dmabuf_page_pool_remove(pool, POOL_LOWPAGE);
+		if (!pages[i])
+			break;
 	}
+	left = pool->count[POOL_LOWPAGE] + pool->count[POOL_HIGHPAGE];
 	mutex_unlock(&pool->mutex);
 
-	return page;
+	if (left < READ_ONCE(pool->low_wm))
+		dmabuf_page_pool_kick_refill(pool);
+
+	return i;
 }
 
-static struct page *dmabuf_page_pool_fetch(struct dmabuf_page_pool *pool)
+static void dmabuf_page_pool_put_batch(struct dmabuf_page_pool *pool,
+				       struct page **pages,
+				       unsigned int nr)
 {
+	unsigned int i;
+
+	mutex_lock(&pool->mutex);
+	for (i = 0; i < nr; i++)
+		__dmabuf_page_pool_add(pool, pages[i]);
+	mutex_unlock(&pool->mutex);
+}
+
+static struct page *dmabuf_page_pool_pcp_alloc(struct dmabuf_page_pool *pool)
+{
+	struct page *batch[POOL_PCP_MAX];
+	struct dmabuf_page_pool_pcp *pcp;
 	struct page *page = NULL;
+	unsigned int nr, i;
 
-	page = dmabuf_page_pool_remove(pool, POOL_HIGHPAGE);
-	if (!page)
-		page = dmabuf_page_pool_remove(pool, POOL_LOWPAGE);
+	pcp = get_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	if (pcp->count)
+		page = pcp->pages[--pcp->count];
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->pcp);
+
+	if (page)
+		goto out;
 
+	/* magazine is empty, refill it from the shared lists in one go */
+	nr = dmabuf_page_pool_fetch_batch(pool, batch, pool->pcp_batch);
+	if (!nr)
+		return NULL;
+	page = batch[--nr];
+
+	pcp = get_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	for (i = 0; i < nr && pcp->count < pool->pcp_high; i++)
+		pcp->pages[pcp->count++] = batch[i];
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->pcp);
+
+	/* someone else refilled this magazine meanwhile, return the excess */
+	if (i < nr)
+		dmabuf_page_pool_put_batch(pool, batch + i, nr - i);
+out:
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    -(1 << pool->order));
 	return page;
 }
 
+static void dmabuf_page_pool_pcp_free(struct dmabuf_page_pool *pool,
+				      struct page *page)
+{
+	struct page *batch[POOL_PCP_MAX];
+	struct dmabuf_page_pool_pcp *pcp;
+	unsigned int nr = 0;
+
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    1 << pool->order);
+
+	pcp = get_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	if (pcp->count >= pool->pcp_high) {
+		/* magazine is full, spill the coldest pages to the shared lists */
+		nr = pool->pcp_batch;
+		memcpy(batch, pcp->pages, nr * sizeof(*batch));
+		pcp->count -= nr;
+		memmove(pcp->pages, pcp->pages + nr,
+			pcp->count * sizeof(*batch));
+	}
+	pcp->pages[pcp->count++] = page;
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->pcp);
+
+	if (nr)
+		dmabuf_page_pool_put_batch(pool, batch, nr);
+}
+
+/* Flush every cpu's magazine back to the shared lists */
+static void dmabuf_page_pool_drain_pcp(struct dmabuf_page_pool *pool)
+{
+	struct page *batch[POOL_PCP_MAX];
+	struct dmabuf_page_pool_pcp *pcp;
+	unsigned int nr;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->pcp, cpu);
+
+		spin_lock(&pcp->lock);
+		nr = pcp->count;
+		memcpy(batch, pcp->pages, nr * sizeof(*batch));
+		pcp->count = 0;
+		spin_unlock(&pcp->lock);
+
+		if (nr)
+			dmabuf_page_pool_put_batch(pool, batch, nr);
+	}
+}
+
+static int dmabuf_page_pool_pcp_count(struct dmabuf_page_pool *pool)
+{
+	int count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += READ_ONCE(per_cpu_ptr(pool->pcp, cpu)->count);
+
+	return count;
+}
+
 struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool)
 {
 	struct page *page = NULL;
@@ -84,10 +245,16 @@ struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool)
 	if (WARN_ON(!pool))
 		return NULL;
 
-	page = dmabuf_page_pool_fetch(pool);
+	page = dmabuf_page_pool_pcp_alloc(pool);
+	if (page) {
+		this_cpu_inc(pool->pcp->hits);
+		return page;
+	}
 
-	if (!page)
-		page = dmabuf_page_pool_alloc_pages(pool);
+	/* pool is dry, zero synchronously through __GFP_ZERO */
+	this_cpu_inc(pool->pcp->misses);
+	dmabuf_page_pool_kick_refill(pool);
+	page = dmabuf_page_pool_alloc_pages(pool);
 	return page;
 }
 EXPORT_SYMBOL_GPL(dmabuf_page_pool_alloc);
@@ -97,10 +264,140 @@ void dmabuf_page_pool_free(struct dmabuf_page_pool *pool, struct page *page)
 	if (WARN_ON(pool->order != compound_order(page)))
 		return;
 
-	dmabuf_page_pool_add(pool, page);
+	dmabuf_page_pool_pcp_free(pool, page);
 }
 EXPORT_SYMBOL_GPL(dmabuf_page_pool_free);
 
+/**
+ * dmabuf_page_pool_alloc_bulk - allocate several pages of the pool's order
+ * @pool: pool to allocate from
+ * @list: list the pages are appended to, linked through page->lru
+ * @nr: number of pages wanted
+ *
+ * Takes what it can from the local magazine, then the rest of the pooled
+ * pages under a single pool->mutex round-trip, and only then falls back
+ * to the buddy allocator page by page.
+ *
+ * Return: the number of pages appended to @list, may be less than @nr.
+ */
+unsigned int dmabuf_page_pool_alloc_bulk(struct dmabuf_page_pool *pool,
+					 struct list_head *list,
+					 unsigned int nr)
+{
+	struct dmabuf_page_pool_pcp *pcp;
+	struct page *page;
+	unsigned int got = 0, hits, misses = 0, left;
+
+	if (WARN_ON(!pool))
+		return 0;
+
+	pcp = get_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	while (got < nr && pcp->count) {
+		page = pcp->pages[--pcp->count];
+		list_add_tail(&page->lru, list);
+		got++;
+	}
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->pcp);
+
+	if (got < nr) {
+		mutex_lock(&pool->mutex);
+		while (got < nr) {
+			page = __dmabuf_page_pool_remove(pool, POOL_HIGHPAGE);
+			if (!page)
+				page = __dmabuf_page_pool_remove(pool, POOL_LOWPAGE);
+			if (!page)
+				break;
+			list_add_tail(&page->lru, list);
+			got++;
+		}
+		left = pool->count[POOL_LOWPAGE] + pool->count[POOL_HIGHPAGE];
+		mutex_unlock(&pool->mutex);
+
+		if (left < READ_ONCE(pool->low_wm))
+			dmabuf_page_pool_kick_refill(pool);
+	}
+
+	hits = got;
+	if (hits) {
+		/* the pooled pages are the last @hits entries of @list */
+		page = list_last_entry(list, struct page, lru);
+		for (left = hits; left; left--) {
+			mod_node_page_state(page_pgdat(page),
+					    NR_KERNEL_MISC_RECLAIMABLE,
+					    -(1 << pool->order));
+			page = list_prev_entry(page, lru);
+		}
+		this_cpu_add(pool->pcp->hits, hits);
+	}
+
+	while (got < nr) {
+		misses++;
+		page = dmabuf_page_pool_alloc_pages(pool);
+		if (!page)
+			break;
+		list_add_tail(&page->lru, list);
+		got++;
+	}
+	if (misses)
+		this_cpu_add(pool->pcp->misses, misses);
+
+	return got;
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_alloc_bulk);
+
+/**
+ * dmabuf_page_pool_free_bulk - return a list of pages to the pool
+ * @pool: pool the pages belong to
+ * @list: pages of the pool's order, linked through page->lru
+ *
+ * Fills the local magazine and moves whatever does not fit to the shared
+ * lists under a single pool->mutex round-trip. @list is empty on return.
+ */
+void dmabuf_page_pool_free_bulk(struct dmabuf_page_pool *pool,
+				struct list_head *list)
+{
+	struct dmabuf_page_pool_pcp *pcp;
+	struct page *page, *tmp;
+	unsigned int nr = 0;
+
+	list_for_each_entry_safe(page, tmp, list, lru) {
+		if (WARN_ON(pool->order != compound_order(page))) {
+			list_del(&page->lru);
+			__free_pages(page, compound_order(page));
+			continue;
+		}
+		mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+				    1 << pool->order);
+		nr++;
+	}
+	if (!nr)
+		return;
+
+	pcp = get_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	list_for_each_entry_safe(page, tmp, list, lru) {
+		if (pcp->count >= pool->pcp_high)
+			break;
+		list_del(&page->lru);
+		pcp->pages[pcp->count++] = page;
+	}
+	spin_unlock(&pcp->lock);
+	put_cpu_ptr(pool->pcp);
+
+	if (list_empty(list))
+		return;
+
+	mutex_lock(&pool->mutex);
+	list_for_each_entry_safe(page, tmp, list, lru) {
+		list_del(&page->lru);
+		__dmabuf_page_pool_add(pool, page);
+	}
+	mutex_unlock(&pool->mutex);
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_free_bulk);
+
 static int dmabuf_page_pool_total(struct dmabuf_page_pool *pool, bool high)
 {
 	int count = pool->count[POOL_LOWPAGE];
@@ -108,17 +405,227 @@ static int dmabuf_page_pool_total(struct dmabuf_page_pool *pool, bool high)
 	if (high)
 		count += pool->count[POOL_HIGHPAGE];
 
+	/* magazines are drained before any page is reclaimed, count them all */
+	count += dmabuf_page_pool_pcp_count(pool);
+
 	return count << pool->order;
 }
 
+/* Return the number of bytes currently cached by the pool */
+long dmabuf_page_pool_get_size(struct dmabuf_page_pool *pool)
+{
+	return (long)dmabuf_page_pool_total(pool, true) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_get_size);
+
+/*
+ * Set the background refill watermarks, in pages of the pool's order.
+ * The refill thread tops the pool up to @high_wm with zeroed pages once
+ * it drops below @low_wm. A @low_wm of 0 disables refill for this pool.
+ */
+void dmabuf_page_pool_set_watermark(struct dmabuf_page_pool *pool,
+				    unsigned int low_wm, unsigned int high_wm)
+{
+	WRITE_ONCE(pool->high_wm, max(low_wm, high_wm));
+	WRITE_ONCE(pool->low_wm, low_wm);
+	dmabuf_page_pool_kick_refill(pool);
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_set_watermark);
+
+static void dmabuf_page_pool_refill(struct dmabuf_page_pool *pool)
+{
+	/* background refill must never push the system into direct reclaim */
+	gfp_t gfp = (pool->gfp_mask | __GFP_NOWARN | __GFP_NORETRY) &
+		    ~__GFP_RECLAIM;
+	unsigned int low = READ_ONCE(pool->low_wm);
+	unsigned int high = READ_ONCE(pool->high_wm);
+	struct page *batch[POOL_PCP_MAX];
+	unsigned int total, nr, i;
+	u64 start, elapsed;
+
+	if (!low)
+		return;
+
+	total = dmabuf_page_pool_total(pool, true) >> pool->order;
+	if (total >= low)
+		return;
+
+	start = ktime_get_ns();
+	while (total < high) {
+		nr = min_t(unsigned int, high - total, POOL_PCP_MAX);
+		for (i = 0; i < nr; i++) {
+			batch[i] = alloc_pages(gfp, pool->order);
+			if (!batch[i])
+				break;
+			mod_node_page_state(page_pgdat(batch[i]),
+					    NR_KERNEL_MISC_RECLAIMABLE,
+					    1 << pool->order);
+		}
+		if (i)
+			dmabuf_page_pool_put_batch(pool, batch, i);
+
+		total += i;
+		atomic64_add(i, &pool->refill_pages);
+		if (i < nr)
+			break;
+		cond_resched();
+	}
+	elapsed = ktime_get_ns() - start;
+
+	atomic64_inc(&pool->refill_count);
+	atomic64_add(elapsed, &pool->refill_ns);
+	if (elapsed > atomic64_read(&pool->refill_max_ns))
+		atomic64_set(&pool->refill_max_ns, elapsed);
+}
+
+static int dmabuf_page_pool_refill_thread(void *data)
+{
+	struct dmabuf_page_pool *pool;
+	long backoff;
+
+	set_freezable();
+
+	while (true) {
+		wait_event_freezable(refill_waitqueue,
+				     atomic_read(&refill_pending));
+
+		/* keep the request pending and retry once the backoff expires */
+		backoff = (long)(READ_ONCE(pool_last_shrink) +
+				 POOL_REFILL_BACKOFF - jiffies);
+		if (backoff > 0) {
+			freezable_schedule_timeout_interruptible(backoff);
+			continue;
+		}
+		atomic_set(&refill_pending, 0);
+
+		mutex_lock(&pool_list_lock);
+		list_for_each_entry(pool, &pool_list, list)
+			dmabuf_page_pool_refill(pool);
+		mutex_unlock(&pool_list_lock);
+	}
+
+	return 0;
+}
+
+static int dmabuf_page_pool_low_wm_get(void *data, u64 *val)
+{
+	struct dmabuf_page_pool *pool = data;
+
+	*val = READ_ONCE(pool->low_wm);
+	return 0;
+}
+
+static int dmabuf_page_pool_low_wm_set(void *data, u64 val)
+{
+	struct dmabuf_page_pool *pool = data;
+
+	if (val > UINT_MAX)
+		return -EINVAL;
+
+	dmabuf_page_pool_set_watermark(pool, val, READ_ONCE(pool->high_wm));
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(dmabuf_page_pool_low_wm_fops,
+			 dmabuf_page_pool_low_wm_get,
+			 dmabuf_page_pool_low_wm_set, "%llu\n");
+
+static int dmabuf_page_pool_high_wm_get(void *data, u64 *val)
+{
+	struct dmabuf_page_pool *pool = data;
+
+	*val = READ_ONCE(pool->high_wm);
+	return 0;
+}
+
+static int dmabuf_page_pool_high_wm_set(void *data, u64 val)
+{
+	struct dmabuf_page_pool *pool = data;
+
+	if (val > UINT_MAX)
+		return -EINVAL;
+
+	dmabuf_page_pool_set_watermark(pool, READ_ONCE(pool->low_wm), val);
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(dmabuf_page_pool_high_wm_fops,
+			 dmabuf_page_pool_high_wm_get,
+			 dmabuf_page_pool_high_wm_set, "%llu\n");
+
+static void dmabuf_page_pool_debugfs_add(struct dmabuf_page_pool *pool)
+{
+	char name[16];
+
+	if (!pool_debugfs_root)
+		return;
+
+	snprintf(name, sizeof(name), "pool%d", pool->id);
+	pool->debugfs = debugfs_create_dir(name, pool_debugfs_root);
+	debugfs_create_u32("order", 0444, pool->debugfs, &pool->order);
+	debugfs_create_file_unsafe("low_watermark", 0644, pool->debugfs, pool,
+				   &dmabuf_page_pool_low_wm_fops);
+	debugfs_create_file_unsafe("high_watermark", 0644, pool->debugfs, pool,
+				   &dmabuf_page_pool_high_wm_fops);
+}
+
+static int dmabuf_page_pool_stats_show(struct seq_file *s, void *unused)
+{
+	struct dmabuf_page_pool *pool;
+	unsigned long hits, misses;
+	u64 refills;
+	int cpu;
+
+	seq_puts(s, "pool order low  high count hits misses refills refill_pages avg_us max_us\n");
+
+	mutex_lock(&pool_list_lock);
+	list_for_each_entry(pool, &pool_list, list) {
+		hits = 0;
+		misses = 0;
+		for_each_possible_cpu(cpu) {
+			hits += per_cpu_ptr(pool->pcp, cpu)->hits;
+			misses += per_cpu_ptr(pool->pcp, cpu)->misses;
+		}
+		refills = atomic64_read(&pool->refill_count);
+
+		seq_printf(s, "%-4d %-5u %-4u %-4u %-5d %lu %lu %llu %llu %llu %llu\n",
+			   pool->id, pool->order, pool->low_wm, pool->high_wm,
+			   dmabuf_page_pool_total(pool, true) >> pool->order,
+			   hits, misses, refills,
+			   (u64)atomic64_read(&pool->refill_pages),
+			   refills ? div64_u64(atomic64_read(&pool->refill_ns),
+					       refills) / NSEC_PER_USEC : 0,
+			   div64_u64(atomic64_read(&pool->refill_max_ns),
+				     NSEC_PER_USEC));
+	}
+	mutex_unlock(&pool_list_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dmabuf_page_pool_stats);
+
 struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask, unsigned int order)
 {
-	struct dmabuf_page_pool *pool = kmalloc(sizeof(*pool), GFP_KERNEL);
-	int i;
+	struct dmabuf_page_pool *pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	int i, cpu;
 
 	if (!pool)
 		return NULL;
 
+	pool->pcp = alloc_percpu(struct dmabuf_page_pool_pcp);
+	if (!pool->pcp) {
+		kfree(pool);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu) {
+		struct dmabuf_page_pool_pcp *pcp = per_cpu_ptr(pool->pcp, cpu);
+
+		spin_lock_init(&pcp->lock);
+		pcp->count = 0;
+	}
+	/* keep roughly 1MB per cpu and order, but at least a couple of pages */
+	pool->pcp_high = clamp_t(unsigned int, (SZ_1M >> PAGE_SHIFT) >> order,
+				 2, POOL_PCP_MAX);
+	pool->pcp_batch = pool->pcp_high / 2;
+
 	for (i = 0; i < POOL_TYPE_SIZE; i++) {
 		pool->count[i] = 0;
 		INIT_LIST_HEAD(&pool->items[i]);
@@ -128,9 +635,12 @@ struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask, unsigned int or
 	mutex_init(&pool->mutex);
 
 	mutex_lock(&pool_list_lock);
+	pool->id = pool_next_id++;
 	list_add(&pool->list, &pool_list);
 	mutex_unlock(&pool_list_lock);
 
+	dmabuf_page_pool_debugfs_add(pool);
+
 	return pool;
 }
 EXPORT_SYMBOL_GPL(dmabuf_page_pool_create);
@@ -140,17 +650,21 @@ void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool)
 	struct page *page;
 	int i;
 
+	debugfs_remove_recursive(pool->debugfs);
+
 	/* Remove us from the pool list */
 	mutex_lock(&pool_list_lock);
 	list_del(&pool->list);
 	mutex_unlock(&pool_list_lock);
 
 	/* Free any remaining pages in the pool */
+	dmabuf_page_pool_drain_pcp(pool);
 	for (i = 0; i < POOL_TYPE_SIZE; i++) {
 		while ((page = dmabuf_page_pool_remove(pool, i)))
 			dmabuf_page_pool_free_pages(pool, page);
 	}
 
+	free_percpu(pool->pcp);
 	kfree(pool);
 }
 EXPORT_SYMBOL_GPL(dmabuf_page_pool_destroy);
@@ -169,6 +683,8 @@ static int dmabuf_page_pool_do_shrink(struct dmabuf_page_pool *pool, gfp_t gfp_m
 	if (nr_to_scan == 0)
 		return dmabuf_page_pool_total(pool, high);
 
+	dmabuf_page_pool_drain_pcp(pool);
+
 	while (freed < nr_to_scan) {
 		struct page *page;
 
@@ -229,6 +745,7 @@ static unsigned long dmabuf_page_pool_shrink_scan(struct shrinker *shrinker,
 {
 	if (sc->nr_to_scan == 0)
 		return 0;
+	WRITE_ONCE(pool_last_shrink, jiffies);
 	return dmabuf_page_pool_shrink(sc->gfp_mask, sc->nr_to_scan);
 }
 
@@ -241,7 +758,25 @@ struct shrinker pool_shrinker = {
 
 static int dmabuf_page_pool_init_shrinker(void)
 {
+	pool_debugfs_root = debugfs_create_dir("dmabuf_page_pool", NULL);
+	debugfs_create_file("stats", 0444, pool_debugfs_root, NULL,
+			    &dmabuf_page_pool_stats_fops);
+
+	init_waitqueue_head(&refill_waitqueue);
+	refill_task = kthread_run(dmabuf_page_pool_refill_thread, NULL,
+				  "%s", "dmabuf-page-pool-refill");
+	if (IS_ERR(refill_task)) {
+		pr_err("Creating thread for page pool refill failed\n");
+		refill_task = NULL;
+	} else {
+		sched_set_normal(refill_task, 19);
+	}
+
 	return register_shrinker(&pool_shrinker);
 }
 module_init(dmabuf_page_pool_init_shrinker);
 MODULE_LICENSE("GPL v2");
+
+#ifdef CONFIG_DMABUF_HEAPS_PAGE_POOL_KUNIT_TEST
+#include "page_pool_test.c"
+#endif
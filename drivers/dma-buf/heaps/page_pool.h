@@ -15,6 +15,7 @@
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/shrinker.h>
+#include <linux/spinlock.h>
 #include <linux/types.h>
 
 /* page types we track in the pool */
@@ -25,6 +26,26 @@ enum {
 	POOL_TYPE_SIZE,
 };
 
+/* max number of pages a per-cpu magazine can hold, for any order */
+#define POOL_PCP_MAX	32
+
+/**
+ * struct dmabuf_page_pool_pcp - per-cpu magazine in front of a pool
+ * @lock:		protects this magazine, only contended when the
+ *			shrinker or pool destroy drains it from another cpu
+ * @count:		number of pages currently held in @pages
+ * @hits:		allocations served from the pool on this cpu
+ * @misses:		allocations that fell back to the buddy allocator
+ * @pages:		stack of cached pages, most recently freed on top
+ */
+struct dmabuf_page_pool_pcp {
+	spinlock_t lock;
+	unsigned int count;
+	unsigned long hits;
+	unsigned long misses;
+	struct page *pages[POOL_PCP_MAX];
+};
+
 /**
  * struct dmabuf_page_pool - pagepool struct
  * @count[]:		array of number of pages of that type in the pool
@@ -33,9 +54,24 @@ enum {
  *			item list
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
+ * @pcp:		per-cpu magazines serving the common alloc/free path
+ * @pcp_high:		max number of pages kept in one magazine
+ * @pcp_batch:		number of pages moved between a magazine and the
+ *			shared lists on refill or drain
+ * @low_wm:		background refill starts when the pool drops below
+ *			this many pages of @order, 0 disables refill
+ * @high_wm:		background refill stops at this many pages of @order
+ * @refill_count:	number of background refill runs
+ * @refill_pages:	number of pages added by background refill
+ * @refill_ns:		total time spent in background refill
+ * @refill_max_ns:	longest single background refill run
+ * @id:			pool index, used to name the debugfs entries
+ * @debugfs:		debugfs directory of this pool
  * @list:		list node for list of pools
  *
- * Allows you to keep a pool of pre allocated pages to use
+ * Allows you to keep a pool of pre allocated pages to use. Pages in the
+ * pool are always zeroed: either they come straight from the buddy
+ * allocator with __GFP_ZERO, or heaps clear them before giving them back.
  */
 struct dmabuf_page_pool {
 	int count[POOL_TYPE_SIZE];
@@ -43,6 +79,17 @@ struct dmabuf_page_pool {
 	struct mutex mutex;
 	gfp_t gfp_mask;
 	unsigned int order;
+	struct dmabuf_page_pool_pcp __percpu *pcp;
+	unsigned int pcp_high;
+	unsigned int pcp_batch;
+	unsigned int low_wm;
+	unsigned int high_wm;
+	atomic64_t refill_count;
+	atomic64_t refill_pages;
+	atomic64_t refill_ns;
+	atomic64_t refill_max_ns;
+	int id;
+	struct dentry *debugfs;
 	struct list_head list;
 };
 
@@ -51,5 +98,13 @@ struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask,
 void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool);
 struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool);
 void dmabuf_page_pool_free(struct dmabuf_page_pool *pool, struct page *page);
+unsigned int dmabuf_page_pool_alloc_bulk(struct dmabuf_page_pool *pool,
+					 struct list_head *list,
+					 unsigned int nr);
+void dmabuf_page_pool_free_bulk(struct dmabuf_page_pool *pool,
+				struct list_head *list);
+long dmabuf_page_pool_get_size(struct dmabuf_page_pool *pool);
+void dmabuf_page_pool_set_watermark(struct dmabuf_page_pool *pool,
+				    unsigned int low_wm, unsigned int high_wm);
 
 #endif /* _DMABUF_PAGE_POOL_H */
@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the DMA-BUF heaps page pool, included by page_pool.c.
+ */
+#include <kunit/test.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+
+#define POOL_TEST_PAGES		8
+#define POOL_TEST_ITERS		20000
+
+static void dmabuf_page_pool_test_recycle(struct kunit *test)
+{
+	struct page *pages[POOL_TEST_PAGES];
+	struct dmabuf_page_pool *pool;
+	unsigned int i;
+
+	pool = dmabuf_page_pool_create(GFP_KERNEL, 0);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pool);
+
+	for (i = 0; i < POOL_TEST_PAGES; i++) {
+		pages[i] = dmabuf_page_pool_alloc(pool);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pages[i]);
+	}
+	for (i = 0; i < POOL_TEST_PAGES; i++)
+		dmabuf_page_pool_free(pool, pages[i]);
+	KUNIT_EXPECT_EQ(test, dmabuf_page_pool_get_size(pool),
+			(long)POOL_TEST_PAGES << PAGE_SHIFT);
+
+	/*
+	 * Pages come back from the pool before the buddy allocator. Drain
+	 * the magazines first so a migration between the two loops does
+	 * not leave them on another cpu.
+	 */
+	dmabuf_page_pool_drain_pcp(pool);
+	for (i = 0; i < POOL_TEST_PAGES; i++) {
+		pages[i] = dmabuf_page_pool_alloc(pool);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pages[i]);
+	}
+	KUNIT_EXPECT_EQ(test, dmabuf_page_pool_get_size(pool), 0L);
+
+	for (i = 0; i < POOL_TEST_PAGES; i++)
+		dmabuf_page_pool_free(pool, pages[i]);
+	dmabuf_page_pool_destroy(pool);
+}
+
+/* The pool->mutex round-trip every alloc and free took before magazines */
+static struct page *dmabuf_page_pool_test_locked_alloc(struct dmabuf_page_pool *pool)
+{
+	struct page *page;
+
+	page = dmabuf_page_pool_remove(pool, POOL_HIGHPAGE);
+	if (!page)
+		page = dmabuf_page_pool_remove(pool, POOL_LOWPAGE);
+	if (!page)
+		page = dmabuf_page_pool_alloc_pages(pool);
+
+	return page;
+}
+
+static void dmabuf_page_pool_test_locked_free(struct dmabuf_page_pool *pool,
+					      struct page *page)
+{
+	mutex_lock(&pool->mutex);
+	__dmabuf_page_pool_add(pool, page);
+	mutex_unlock(&pool->mutex);
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    1 << pool->order);
+}
+
+struct dmabuf_page_pool_test_bench {
+	struct dmabuf_page_pool *pool;
+	bool locked;
+	struct completion start;
+	struct completion done;
+	atomic_t running;
+};
+
+struct dmabuf_page_pool_test_worker {
+	struct dmabuf_page_pool_test_bench *bench;
+	u64 ns;
+	bool failed;
+};
+
+static int dmabuf_page_pool_test_bench_thread(void *data)
+{
+	struct dmabuf_page_pool_test_worker *worker = data;
+	struct dmabuf_page_pool_test_bench *bench = worker->bench;
+	struct dmabuf_page_pool *pool = bench->pool;
+	struct page *page;
+	u64 start;
+	int i;
+
+	wait_for_completion(&bench->start);
+
+	start = ktime_get_ns();
+	for (i = 0; i < POOL_TEST_ITERS; i++) {
+		if (bench->locked)
+			page = dmabuf_page_pool_test_locked_alloc(pool);
+		else
+			page = dmabuf_page_pool_alloc(pool);
+		if (!page) {
+			worker->failed = true;
+			break;
+		}
+		if (bench->locked)
+			dmabuf_page_pool_test_locked_free(pool, page);
+		else
+			dmabuf_page_pool_free(pool, page);
+	}
+	worker->ns = ktime_get_ns() - start;
+
+	if (atomic_dec_and_test(&bench->running))
+		complete(&bench->done);
+
+	return 0;
+}
+
+/* Run alloc/free pairs on @nr cpus at once, return allocations per second */
+static u64 dmabuf_page_pool_test_bench_run(struct kunit *test,
+					   struct dmabuf_page_pool *pool,
+					   bool locked, unsigned int nr)
+{
+	struct dmabuf_page_pool_test_bench bench = {
+		.pool = pool,
+		.locked = locked,
+	};
+	struct dmabuf_page_pool_test_worker *workers;
+	struct task_struct *task;
+	unsigned int started = 0, i;
+	u64 max_ns = 1;
+	int cpu;
+
+	workers = kunit_kzalloc(test, nr * sizeof(*workers), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, workers);
+	init_completion(&bench.start);
+	init_completion(&bench.done);
+
+	for_each_online_cpu(cpu) {
+		if (started == nr)
+			break;
+		workers[started].bench = &bench;
+		task = kthread_create(dmabuf_page_pool_test_bench_thread,
+				      &workers[started], "pool_bench/%d", cpu);
+		if (IS_ERR(task))
+			break;
+		kthread_bind(task, cpu);
+		wake_up_process(task);
+		started++;
+	}
+	KUNIT_EXPECT_EQ(test, started, nr);
+	if (!started)
+		return 0;
+
+	atomic_set(&bench.running, started);
+	complete_all(&bench.start);
+	wait_for_completion(&bench.done);
+
+	for (i = 0; i < started; i++) {
+		KUNIT_EXPECT_FALSE(test, workers[i].failed);
+		max_ns = max(max_ns, workers[i].ns);
+	}
+
+	return div64_u64((u64)started * POOL_TEST_ITERS * NSEC_PER_SEC, max_ns);
+}
+
+/*
+ * Not a pass/fail check: reports allocations per second through the
+ * magazines and through the single pool->mutex path for 1..N threads.
+ */
+static void dmabuf_page_pool_test_bench(struct kunit *test)
+{
+	unsigned int nr_cpus = num_online_cpus();
+	struct dmabuf_page_pool *pool;
+	u64 locked, pcp;
+	unsigned int nr;
+
+	pool = dmabuf_page_pool_create(GFP_KERNEL, 0);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pool);
+
+	for (nr = 1; ; nr = min(nr * 2, nr_cpus)) {
+		locked = dmabuf_page_pool_test_bench_run(test, pool, true, nr);
+		pcp = dmabuf_page_pool_test_bench_run(test, pool, false, nr);
+		kunit_info(test, "%u threads: mutex %llu allocs/s, magazine %llu allocs/s\n",
+			   nr, locked, pcp);
+		if (nr == nr_cpus)
+			break;
+	}
+
+	dmabuf_page_pool_destroy(pool);
+}
+
+static struct kunit_case dmabuf_page_pool_test_cases[] = {
+	KUNIT_CASE(dmabuf_page_pool_test_recycle),
+	KUNIT_CASE(dmabuf_page_pool_test_bench),
+	{}
+};
+
+static struct kunit_suite dmabuf_page_pool_test_suite = {
+	.name = "dmabuf-page-pool",
+	.test_cases = dmabuf_page_pool_test_cases,
+};
+
+kunit_test_suites(&dmabuf_page_pool_test_suite);
@@ -62,8 +62,19 @@ struct system_heap_buffer {
 	char                    pid_name[TASK_COMM_LEN];
 	char                    tid_name[TASK_COMM_LEN];
 	unsigned long long       ts; /* us */
+	int                     map_users[BUF_PRIV_MAX_CNT]; /* attachments using mapped_table */
+	struct list_head        iova_cache_node; /* on iova_cache_list while any dom mapped */
 };
 
+/*
+ * mtk_mm buffers keep one mapped sg_table per iommu domain alive across
+ * detach/attach, so per-frame importers reuse the IOVA. Idle mappings are
+ * dropped on buffer release or by iova_cache_shrinker under memory pressure.
+ */
+static LIST_HEAD(iova_cache_list);
+static DEFINE_MUTEX(iova_cache_lock);
+static atomic_long_t iova_cache_nr = ATOMIC_LONG_INIT(0);
+
 #define LOW_ORDER_GFP (GFP_HIGHUSER | __GFP_ZERO | __GFP_COMP)
 #define MID_ORDER_GFP (LOW_ORDER_GFP | __GFP_NOWARN)
 #define HIGH_ORDER_GFP  (((GFP_HIGHUSER | __GFP_ZERO | __GFP_NOWARN \
@@ -110,79 +121,32 @@ static struct sg_table *dup_sg_table(struct sg_table *table)
 	return new_table;
 }
 
-/* source copy to dest, no memory alloc */
-static int copy_sg_table(struct sg_table *source, struct sg_table *dest)
+static unsigned int dev_dom_id(struct device *dev)
 {
-	int i;
-	struct scatterlist *sgl, *dest_sgl;
-
-	if (source->orig_nents != dest->orig_nents) {
-		pr_info("nents not match %d-%d\n",
-			source->orig_nents, dest->orig_nents);
+	struct iommu_fwspec *fwspec = dev_iommu_fwspec_get(dev);
 
-		return -EINVAL;
-	}
-
-	/* copy mapped nents */
-	dest->nents = source->nents;
-
-	dest_sgl = dest->sgl;
-	for_each_sg(source->sgl, sgl, source->orig_nents, i) {
-		memcpy(dest_sgl, sgl, sizeof(*sgl));
-		dest_sgl = sg_next(dest_sgl);
-	}
+	if (!fwspec)
+		return BUF_PRIV_MAX_CNT;
 
-	return 0;
-};
+	return MTK_M4U_TO_DOM(fwspec->ids[0]);
+}
 
-/*
- * must check domain info before call fill_buffer_info
- * @Return 0: pass
- */
-static int fill_buffer_info(struct system_heap_buffer *buffer,
-			    struct sg_table *table,
-			    struct dma_buf_attachment *a,
-			    enum dma_data_direction dir,
-			    int iommu_dom_id)
+/* caller must hold buffer->map_lock or own the last reference */
+static void iova_cache_unmap_dom(struct system_heap_buffer *buffer, int dom_id)
 {
-	struct sg_table *new_table = NULL;
-	int ret = 0;
-
-	/*
-	 * devices without iommus attribute,
-	 * use common flow, skip set buf_info
-	 */
-	if (iommu_dom_id >= BUF_PRIV_MAX_CNT)
-		return 0;
+	struct sg_table *table = buffer->mapped_table[dom_id];
+	struct mtk_heap_dev_info *dev_info = &buffer->dev_info[dom_id];
+	unsigned long attrs = dev_info->map_attrs;
 
-	if (buffer->mapped[iommu_dom_id]) {
-		pr_info("%s err: already mapped before\n", __func__);
-		return -EINVAL;
-	}
-
-	new_table = kzalloc(sizeof(*new_table), GFP_KERNEL);
-	if (!new_table)
-		return -ENOMEM;
-
-	ret = sg_alloc_table(new_table, table->orig_nents, GFP_KERNEL);
-	if (ret) {
-		pr_info("%s err: sg_alloc_table failed\n", __func__);
-		kfree(new_table);
-		return -ENOMEM;
-	}
-
-	ret = copy_sg_table(table, new_table);
-	if (ret)
-		return ret;
-
-	buffer->mapped_table[iommu_dom_id] = new_table;
-	buffer->mapped[iommu_dom_id] = true;
-	buffer->dev_info[iommu_dom_id].dev = a->dev;
-	buffer->dev_info[iommu_dom_id].direction = dir;
-	/* TODO: check map_attrs affect??? */
-	buffer->dev_info[iommu_dom_id].map_attrs = a->dma_map_attrs;
+	if (buffer->uncached)
+		attrs |= DMA_ATTR_SKIP_CPU_SYNC;
 
-	return 0;
+	dma_unmap_sgtable(dev_info->dev, table, dev_info->direction, attrs);
+	buffer->mapped[dom_id] = false;
+	buffer->mapped_table[dom_id] = NULL;
+	sg_free_table(table);
+	kfree(table);
+	atomic_long_dec(&iova_cache_nr);
 }
 
 static int system_heap_attach(struct dma_buf *dmabuf,
@@ -190,19 +154,13 @@ static int system_heap_attach(struct dma_buf *dmabuf,
 {
 	struct system_heap_buffer *buffer = dmabuf->priv;
 	struct dma_heap_attachment *a;
-	struct sg_table *table;
 
 	a = kzalloc(sizeof(*a), GFP_KERNEL);
 	if (!a)
 		return -ENOMEM;
 
-	table = dup_sg_table(&buffer->sg_table);
-	if (IS_ERR(table)) {
-		kfree(a);
-		return -ENOMEM;
-	}
-
-	a->table = table;
+	/* the sg_table is set up at map time, cached mappings need none */
+	a->table = NULL;
 	a->dev = attachment->dev;
 	INIT_LIST_HEAD(&a->list);
 	a->mapped = false;
@@ -226,85 +184,105 @@ static void system_heap_detach(struct dma_buf *dmabuf,
 	list_del(&a->list);
 	mutex_unlock(&buffer->lock);
 
-	sg_free_table(a->table);
-	kfree(a->table);
+	if (a->cached) {
+		mutex_lock(&buffer->map_lock);
+		buffer->map_users[dev_dom_id(a->dev)]--;
+		mutex_unlock(&buffer->map_lock);
+	} else if (a->table) {
+		sg_free_table(a->table);
+		kfree(a->table);
+	}
 	kfree(a);
 }
 
-static struct sg_table *mtk_mm_heap_map_dma_buf(struct dma_buf_attachment *attachment,
+static struct sg_table *system_heap_map_dma_buf(struct dma_buf_attachment *attachment,
 						enum dma_data_direction direction)
 {
 	struct dma_heap_attachment *a = attachment->priv;
+	struct system_heap_buffer *buffer = attachment->dmabuf->priv;
 	struct sg_table *table = a->table;
 	int attr = attachment->dma_map_attrs;
 	int ret;
 
-	struct iommu_fwspec *fwspec = dev_iommu_fwspec_get(attachment->dev);
-	unsigned int dom_id = BUF_PRIV_MAX_CNT;
-	struct system_heap_buffer *buffer = attachment->dmabuf->priv;
-
 	if (a->uncached)
 		attr |= DMA_ATTR_SKIP_CPU_SYNC;
 
-	mutex_lock(&buffer->map_lock);
-
-	if (fwspec)
-		dom_id = MTK_M4U_TO_DOM(fwspec->ids[0]);
-
-	/* device with iommus attribute AND mapped before */
-	if (fwspec && buffer->mapped[dom_id]) {
-		/* mapped before, return saved table */
-		ret = copy_sg_table(buffer->mapped_table[dom_id], table);
-
-		/* update device info */
-		buffer->dev_info[dom_id].dev = attachment->dev;
-		buffer->dev_info[dom_id].direction = direction;
-		buffer->dev_info[dom_id].map_attrs = attr;
-
-		mutex_unlock(&buffer->map_lock);
-		if (ret)
-			return ERR_PTR(-EINVAL);
-
-		a->mapped = true;
-		return table;
-	}
-
-	/* first map OR device without iommus attribute */
-	if (dma_map_sgtable(attachment->dev, table, direction, attr)) {
-		pr_info("%s map fail dom:%d, dev:%s\n",
-			__func__, dom_id, dev_name(attachment->dev));
-		mutex_unlock(&buffer->map_lock);
-		return ERR_PTR(-ENOMEM);
+	if (!table) {
+		table = dup_sg_table(&buffer->sg_table);
+		if (IS_ERR(table))
+			return table;
+		a->table = table;
 	}
 
-	ret = fill_buffer_info(buffer, table,
-			       attachment, direction, dom_id);
-	if (ret) {
-		mutex_unlock(&buffer->map_lock);
+	ret = dma_map_sgtable(attachment->dev, table, direction, attr);
+	if (ret)
 		return ERR_PTR(ret);
-	}
-	mutex_unlock(&buffer->map_lock);
-	a->mapped = true;
 
+	a->mapped = true;
 	return table;
 }
 
-static struct sg_table *system_heap_map_dma_buf(struct dma_buf_attachment *attachment,
+static struct sg_table *mtk_mm_heap_map_dma_buf(struct dma_buf_attachment *attachment,
 						enum dma_data_direction direction)
 {
 	struct dma_heap_attachment *a = attachment->priv;
-	struct sg_table *table = a->table;
+	struct system_heap_buffer *buffer = attachment->dmabuf->priv;
+	unsigned int dom_id = dev_dom_id(attachment->dev);
 	int attr = attachment->dma_map_attrs;
-	int ret;
+	struct sg_table *table;
+
+	/* device without iommus attribute, use common flow */
+	if (dom_id >= BUF_PRIV_MAX_CNT)
+		return system_heap_map_dma_buf(attachment, direction);
 
 	if (a->uncached)
 		attr |= DMA_ATTR_SKIP_CPU_SYNC;
 
-	ret = dma_map_sgtable(attachment->dev, table, direction, attr);
-	if (ret)
-		return ERR_PTR(ret);
+	mutex_lock(&buffer->map_lock);
+
+	table = buffer->mapped_table[dom_id];
+	if (!buffer->mapped[dom_id]) {
+		/* first map of this domain, cache it until release */
+		table = dup_sg_table(&buffer->sg_table);
+		if (IS_ERR(table)) {
+			mutex_unlock(&buffer->map_lock);
+			return table;
+		}
+
+		if (dma_map_sgtable(attachment->dev, table, direction, attr)) {
+			pr_info("%s map fail dom:%d, dev:%s\n",
+				__func__, dom_id, dev_name(attachment->dev));
+			sg_free_table(table);
+			kfree(table);
+			mutex_unlock(&buffer->map_lock);
+			return ERR_PTR(-ENOMEM);
+		}
+
+		buffer->mapped_table[dom_id] = table;
+		buffer->mapped[dom_id] = true;
+		atomic_long_inc(&iova_cache_nr);
+
+		mutex_lock(&iova_cache_lock);
+		if (list_empty(&buffer->iova_cache_node))
+			list_add_tail(&buffer->iova_cache_node, &iova_cache_list);
+		mutex_unlock(&iova_cache_lock);
+	}
+
+	/* update device info */
+	buffer->dev_info[dom_id].dev = attachment->dev;
+	buffer->dev_info[dom_id].direction = direction;
+	buffer->dev_info[dom_id].map_attrs = attr;
+	/* one user per attachment, dropped at detach */
+	if (!a->cached)
+		buffer->map_users[dom_id]++;
+
+	mutex_unlock(&buffer->map_lock);
 
+	/* importers only read the table, share the cached one as is */
+	a->table = table;
+	a->cached = true;
 	a->mapped = true;
+
 	return table;
 }
 
@@ -314,24 +292,49 @@ static void system_heap_unmap_dma_buf(struct dma_buf_attachment *attachment,
 {
 	struct dma_heap_attachment *a = attachment->priv;
 	int attr = attachment->dma_map_attrs;
-	struct iommu_fwspec *fwspec = dev_iommu_fwspec_get(attachment->dev);
-	struct dma_buf *buf = attachment->dmabuf;
 
 	if (a->uncached)
 		attr |= DMA_ATTR_SKIP_CPU_SYNC;
 	a->mapped = false;
 
 	/*
-	 * mtk_mm heap: for devices with iommus attribute,
-	 * unmap iova when release dma-buf.
+	 * mtk_mm heap: for devices with iommus attribute, the iova stays
+	 * cached until dma-buf release or memory pressure.
 	 * system heap: unmap it every time
 	 */
-	if (is_mtk_mm_heap_dmabuf(buf) && fwspec)
+	if (a->cached)
 		return;
 
 	dma_unmap_sgtable(attachment->dev, table, direction, attr);
 }
 
+/*
+ * Cached domain mappings are shared by all attachments of that domain and
+ * outlive them, so sync each one once per CPU access transition instead of
+ * once per attachment.
+ */
+static void system_heap_sync_iova_cache(struct system_heap_buffer *buffer,
+					enum dma_data_direction direction,
+					bool for_cpu)
+{
+	int i;
+
+	mutex_lock(&buffer->map_lock);
+	for (i = 0; i < BUF_PRIV_MAX_CNT; i++) {
+		if (!buffer->mapped[i])
+			continue;
+		if (for_cpu)
+			dma_sync_sgtable_for_cpu(buffer->dev_info[i].dev,
+						 buffer->mapped_table[i],
+						 direction);
+		else
+			dma_sync_sgtable_for_device(buffer->dev_info[i].dev,
+						    buffer->mapped_table[i],
+						    direction);
+	}
+	mutex_unlock(&buffer->map_lock);
+}
+
 static int system_heap_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 						enum dma_data_direction direction)
 {
@@ -345,10 +348,11 @@ static int system_heap_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 
 	if (!buffer->uncached) {
 		list_for_each_entry(a, &buffer->attachments, list) {
-			if (!a->mapped)
+			if (!a->mapped || a->cached)
 				continue;
 			dma_sync_sgtable_for_cpu(a->dev, a->table, direction);
 		}
+		system_heap_sync_iova_cache(buffer, direction, true);
 	}
 	mutex_unlock(&buffer->lock);
 
@@ -368,10 +372,11 @@ static int system_heap_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 
 	if (!buffer->uncached) {
 		list_for_each_entry(a, &buffer->attachments, list) {
-			if (!a->mapped)
+			if (!a->mapped || a->cached)
 				continue;
 			dma_sync_sgtable_for_device(a->dev, a->table, direction);
 		}
+		system_heap_sync_iova_cache(buffer, direction, false);
 	}
 	mutex_unlock(&buffer->lock);
 
@@ -491,6 +496,7 @@ static void system_heap_buf_free(struct deferred_freelist_item *item,
 				 enum df_reason reason)
 {
 	struct system_heap_buffer *buffer;
+	struct list_head pool_pages[NUM_ORDERS];
 	struct sg_table *table;
 	struct scatterlist *sg;
 	int i, j;
@@ -501,6 +507,9 @@ static void system_heap_buf_free(struct deferred_freelist_item *item,
 		if (system_heap_zero_buffer(buffer))
 			reason = DF_UNDER_PRESSURE; // On failure, just free
 
+	for (j = 0; j < NUM_ORDERS; j++)
+		INIT_LIST_HEAD(&pool_pages[j]);
+
 	table = &buffer->sg_table;
 	for_each_sg(table->sgl, sg, table->nents, i) {
 		struct page *page = sg_page(sg);
@@ -514,11 +523,16 @@ static void system_heap_buf_free(struct deferred_freelist_item *item,
 			}
 			if (j >= NUM_ORDERS) {
 				WARN_ON(1);
-				return;
+				__free_pages(page, compound_order(page));
+				continue;
 			}
-			dmabuf_page_pool_free(pools[j], page);
+			list_add_tail(&page->lru, &pool_pages[j]);
 		}
 	}
+	/* give the pages back to each pool in one batch */
+	if (reason != DF_UNDER_PRESSURE)
+		for (j = 0; j < NUM_ORDERS; j++)
+			dmabuf_page_pool_free_bulk(pools[j], &pool_pages[j]);
 	sg_free_table(table);
 	kfree(buffer);
 }
@@ -536,22 +550,14 @@ static void mtk_mm_heap_dma_buf_release(struct dma_buf *dmabuf)
 		 dmabuf->name?:"NULL");
 	spin_unlock(&dmabuf->name_lock);
 
+	mutex_lock(&iova_cache_lock);
+	list_del_init(&buffer->iova_cache_node);
+	mutex_unlock(&iova_cache_lock);
+
 	/* unmap all domains' iova */
 	for (i = 0; i < BUF_PRIV_MAX_CNT; i++) {
-		struct sg_table *table = buffer->mapped_table[i];
-		struct mtk_heap_dev_info dev_info = buffer->dev_info[i];
-		unsigned long attrs = dev_info.map_attrs;
-
-		if (buffer->uncached)
-			attrs |= DMA_ATTR_SKIP_CPU_SYNC;
-
-		if (!buffer->mapped[i])
-			continue;
-
-		dma_unmap_sgtable(dev_info.dev, table, dev_info.direction, attrs);
-		buffer->mapped[i] = false;
-		sg_free_table(table);
-		kfree(table);
+		if (buffer->mapped[i])
+			iova_cache_unmap_dom(buffer, i);
 	}
 
 	/* free buffer memory */
@@ -619,23 +625,35 @@ static const struct dma_buf_ops system_heap_buf_ops = {
 	.get_flags = system_heap_dma_buf_get_flags,
 };
 
-static struct page *alloc_largest_available(unsigned long size,
-					    unsigned int max_order)
+/*
+ * Fill @pages with chunks covering @size, largest order first. Each order
+ * is taken from its pool with one bulk call, so a large buffer costs a
+ * handful of pool operations rather than one per chunk.
+ * Return the number of chunks added to @pages, 0 on failure.
+ */
+static unsigned int alloc_largest_available(unsigned long size,
+					    struct list_head *pages)
 {
-	struct page *page;
+	unsigned int nr, got, total = 0;
 	int i;
 
-	for (i = 0; i < NUM_ORDERS; i++) {
-		if (size <  (PAGE_SIZE << orders[i]))
-			continue;
-		if (max_order < orders[i])
-			continue;
-		page = dmabuf_page_pool_alloc(pools[i]);
-		if (!page)
+	for (i = 0; i < NUM_ORDERS && size; i++) {
+		/*
+		 * Avoid trying to allocate memory if the process
+		 * has been killed by SIGKILL
+		 */
+		if (fatal_signal_pending(current))
+			return 0;
+
+		nr = size >> (PAGE_SHIFT + orders[i]);
+		if (!nr)
 			continue;
-		return page;
+		got = dmabuf_page_pool_alloc_bulk(pools[i], pages, nr);
+		size -= (unsigned long)got << (PAGE_SHIFT + orders[i]);
+		total += got;
 	}
-	return NULL;
+
+	return size ? 0 : total;
 }
 
 static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
@@ -647,8 +665,6 @@ static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
 {
 	struct system_heap_buffer *buffer;
 	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
-	unsigned long size_remaining = len;
-	unsigned int max_order = orders[0];
 	struct dma_buf *dmabuf;
 	struct sg_table *table;
 	struct scatterlist *sg;
@@ -668,24 +684,9 @@ static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
 	buffer->uncached = uncached;
 
 	INIT_LIST_HEAD(&pages);
-	i = 0;
-	while (size_remaining > 0) {
-		/*
-		 * Avoid trying to allocate memory if the process
-		 * has been killed by SIGKILL
-		 */
-		if (fatal_signal_pending(current))
-			goto free_buffer;
-
-		page = alloc_largest_available(size_remaining, max_order);
-		if (!page)
-			goto free_buffer;
-
-		list_add_tail(&page->lru, &pages);
-		size_remaining -= page_size(page);
-		max_order = compound_order(page);
-		i++;
-	}
+	i = alloc_largest_available(len, &pages);
+	if (!i)
+		goto free_buffer;
 
 	table = &buffer->sg_table;
 	if (sg_alloc_table(table, i, GFP_KERNEL))
@@ -699,6 +700,7 @@ static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
 	}
 
 	mutex_init(&buffer->map_lock);
+	INIT_LIST_HEAD(&buffer->iova_cache_node);
 	/* add alloc pid & tid info */
 	get_task_comm(buffer->pid_name, task);
 	get_task_comm(buffer->tid_name, current);
@@ -767,19 +769,67 @@ static struct dma_buf *mtk_mm_heap_allocate(struct dma_heap *heap,
 }
 
 
+static unsigned long iova_cache_shrink_count(struct shrinker *shrinker,
+					     struct shrink_control *sc)
+{
+	return atomic_long_read(&iova_cache_nr);
+}
+
+/* drop cached domain mappings no attachment is using any more */
+static unsigned long iova_cache_shrink_scan(struct shrinker *shrinker,
+					    struct shrink_control *sc)
+{
+	struct system_heap_buffer *buffer, *tmp;
+	unsigned long freed = 0;
+	bool busy;
+	int i;
+
+	mutex_lock(&iova_cache_lock);
+	list_for_each_entry_safe(buffer, tmp, &iova_cache_list, iova_cache_node) {
+		if (freed >= sc->nr_to_scan)
+			break;
+		if (!mutex_trylock(&buffer->map_lock))
+			continue;
+
+		busy = false;
+		for (i = 0; i < BUF_PRIV_MAX_CNT; i++) {
+			if (!buffer->mapped[i])
+				continue;
+			if (buffer->map_users[i]) {
+				busy = true;
+				continue;
+			}
+			iova_cache_unmap_dom(buffer, i);
+			freed++;
+		}
+		if (!busy)
+			list_del_init(&buffer->iova_cache_node);
+
+		mutex_unlock(&buffer->map_lock);
+	}
+	mutex_unlock(&iova_cache_lock);
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker iova_cache_shrinker = {
+	.count_objects = iova_cache_shrink_count,
+	.scan_objects = iova_cache_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+	.batch = 0,
+};
+
 static long system_get_pool_size(struct dma_heap *heap)
 {
 	int i;
-	long num_pages = 0;
+	long num_bytes = 0;
 	struct dmabuf_page_pool **pool;
 
 	pool = pools;
-	for (i = 0; i < NUM_ORDERS; i++, pool++) {
-		num_pages += ((*pool)->count[POOL_LOWPAGE] +
-			      (*pool)->count[POOL_HIGHPAGE]) << (*pool)->order;
-	}
+	for (i = 0; i < NUM_ORDERS; i++, pool++)
+		num_bytes += dmabuf_page_pool_get_size(*pool);
 
-	return num_pages << PAGE_SHIFT;
+	return num_bytes;
 }
 
 static const struct dma_heap_ops system_heap_ops = {
@@ -950,7 +1000,8 @@ static int system_heap_create(void)
 	mb(); /* make sure we only set allocate after dma_mask is set */
 	mtk_mm_uncached_heap_ops.allocate = mtk_mm_uncached_heap_allocate;
 	pr_info("%s add heap[%s] success\n", __func__, exp_info.name);
-	return 0;
+
+	return register_shrinker(&iova_cache_shrinker);
 }
 
 /* ref code: dma_buf.c, dma_buf_set_name */
@@ -596,6 +596,9 @@ static int layering_get_valid_hrt(struct drm_crtc *crtc,
 
 void mtk_update_layering_opt_by_disp_opt(enum MTK_DRM_HELPER_OPT opt, int value)
 {
+	/* any helper option may change what the HW rollback allows */
+	mtk_layering_rule_cache_invalidate();
+
 	switch (opt) {
 	case MTK_DRM_OPT_OVL_EXT_LAYER:
 		mtk_set_layering_opt(LYE_OPT_EXT_LAYER, value);
@@ -18,6 +18,9 @@
 #include <linux/file.h>
 #include <linux/string.h>
 #include <linux/mm.h>
+#include <linux/sort.h>
+#include <linux/jhash.h>
+#include <linux/list.h>
 #include <drm/drm_modes.h>
 #include <drm/drm_property.h>
 #ifdef CONFIG_MTK_DCS
@@ -45,6 +48,7 @@ static int ext_id_tuning(struct drm_device *dev,
 			  int disp_idx);
 static bool is_rsz_valid(struct drm_mtk_layer_config *c);
 static unsigned int roll_gpu_for_idle;
+static u64 lye_cache_hit, lye_cache_miss;
 static int g_emi_bound_table[HRT_LEVEL_NUM];
 
 static DEFINE_MUTEX(layering_info_lock);
@@ -368,6 +372,9 @@ static void dump_disp_info(struct drm_mtk_layering_info *disp_info,
 	int i, j;
 	struct drm_mtk_layer_config *layer_info;
 
+	DDPDBG("%s: decision cache hit:%llu, miss:%llu\n", __func__,
+		lye_cache_hit, lye_cache_miss);
+
 	for (i = 0; i < HRT_DISP_TYPE_NUM; i++) {
 
 		if (disp_info->layer_num[i] <= 0)
@@ -1020,224 +1027,180 @@ static int filter_by_ovl_cnt(struct drm_device *dev,
 	return ret;
 }
 
-static struct hrt_sort_entry *x_entry_list, *y_entry_list;
-
-#ifdef HRT_DEBUG_LEVEL2
-static int dump_entry_list(bool sort_by_y)
+/*
+ * HRT overlap is found with a sweep line over the dst rects. The y edges
+ * of all layers are sorted once; walking them adds or removes each layer's
+ * x interval in a max segment tree over the sorted x edges, whose root is
+ * the heaviest x overlap among the layers crossing the sweep line. Every
+ * edge costs O(log n), so a display takes O(n log n) instead of re-sorting
+ * the x edges of the active layers at each y edge.
+ */
+static int hrt_sweep_init(struct hrt_sweep *sweep, int layer_num)
 {
-	struct hrt_sort_entry *temp;
-	struct drm_mtk_layer_config *layer_info;
+	size_t edge_cnt = 2 * (size_t)max(layer_num, 1);
+	void *buf;
 
-	if (sort_by_y)
-		temp = y_entry_list;
-	else
-		temp = x_entry_list;
-
-	DDPMSG("%s, sort_by_y:%d, addr:0x%p\n", __func__, sort_by_y, temp);
-	while (temp) {
-		layer_info = temp->layer_info;
-		DDPMSG("key:%d, offset(%d, %d), w/h(%d, %d), overlap_w:%d\n",
-		       temp->key, layer_info->dst_offset_x,
-		       layer_info->dst_offset_y, layer_info->dst_width,
-		       layer_info->dst_height, temp->overlap_w);
-		temp = temp->tail;
-	}
-	DDPMSG("%s end\n", __func__);
+	memset(sweep, 0, sizeof(*sweep));
+	/* y edges, then x keys, per layer x edges and the two tree arrays */
+	buf = kvzalloc(edge_cnt * (sizeof(struct hrt_edge) + 10 * sizeof(int)),
+		       GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	sweep->y_edge = buf;
+	sweep->x_key = (int *)(sweep->y_edge + edge_cnt);
+	sweep->x_begin = sweep->x_key + edge_cnt;
+	sweep->x_end = sweep->x_begin + edge_cnt / 2;
+	sweep->seg_max = sweep->x_end + edge_cnt / 2;
+	sweep->seg_add = sweep->seg_max + 4 * edge_cnt;
 	return 0;
 }
-#endif
 
-static int insert_entry(struct hrt_sort_entry **head,
-			struct hrt_sort_entry *sort_entry)
+static void hrt_sweep_free(struct hrt_sweep *sweep)
 {
-	struct hrt_sort_entry *temp;
+	kvfree(sweep->y_edge);
+	sweep->y_edge = NULL;
+}
 
-	temp = *head;
-	while (temp) {
-		if (sort_entry->key < temp->key ||
-		    ((sort_entry->key == temp->key) &&
-		     (sort_entry->overlap_w > 0))) {
-			sort_entry->head = temp->head;
-			sort_entry->tail = temp;
-			if (temp->head != NULL)
-				temp->head->tail = sort_entry;
-			else
-				*head = sort_entry;
-			temp->head = sort_entry;
-			break;
-		}
+static void hrt_sweep_add_layer(struct hrt_sweep *sweep,
+				struct drm_mtk_layer_config *l_info,
+				int overlap_w)
+{
+	struct hrt_edge *edge;
+	int idx = sweep->layer_cnt;
 
-		if (temp->tail == NULL) {
-			temp->tail = sort_entry;
-			sort_entry->head = temp;
-			sort_entry->tail = NULL;
-			break;
-		}
-		temp = temp->tail;
-	}
+	/* an empty rect or weight never changes the overlap */
+	if (!sweep->y_edge || overlap_w <= 0 ||
+	    !l_info->dst_width || !l_info->dst_height)
+		return;
 
-	return 0;
+	edge = &sweep->y_edge[2 * idx];
+	edge[0].key = l_info->dst_offset_y;
+	edge[0].overlap_w = overlap_w;
+	edge[0].layer = idx;
+	edge[1].key = l_info->dst_offset_y + l_info->dst_height - 1;
+	edge[1].overlap_w = -overlap_w;
+	edge[1].layer = idx;
+
+	sweep->x_begin[idx] = l_info->dst_offset_x;
+	sweep->x_end[idx] = l_info->dst_offset_x + l_info->dst_width - 1;
+	sweep->layer_cnt++;
 }
 
-static int add_layer_entry(struct drm_mtk_layer_config *l_info, bool sort_by_y,
-			   int overlap_w)
+static int hrt_edge_cmp(const void *a, const void *b)
 {
-	struct hrt_sort_entry *begin_t, *end_t;
-	struct hrt_sort_entry **p_entry;
+	const struct hrt_edge *l = a, *r = b;
 
-	begin_t = kzalloc(sizeof(struct hrt_sort_entry), GFP_KERNEL);
-	end_t = kzalloc(sizeof(struct hrt_sort_entry), GFP_KERNEL);
+	if (l->key != r->key)
+		return l->key < r->key ? -1 : 1;
 
-	begin_t->head = NULL;
-	begin_t->tail = NULL;
-	end_t->head = NULL;
-	end_t->tail = NULL;
-	if (sort_by_y) {
-		begin_t->key = l_info->dst_offset_y;
-		end_t->key = l_info->dst_offset_y + l_info->dst_height - 1;
-		p_entry = &y_entry_list;
-	} else {
-		begin_t->key = l_info->dst_offset_x;
-		end_t->key = l_info->dst_offset_x + l_info->dst_width - 1;
-		p_entry = &x_entry_list;
-	}
-
-	begin_t->overlap_w = overlap_w;
-	begin_t->layer_info = l_info;
-	end_t->overlap_w = -overlap_w;
-	end_t->layer_info = l_info;
-
-	if (*p_entry == NULL) {
-		*p_entry = begin_t;
-		begin_t->head = NULL;
-		begin_t->tail = end_t;
-		end_t->head = begin_t;
-		end_t->tail = NULL;
-	} else {
-		/* Inser begin entry */
-		insert_entry(p_entry, begin_t);
-#ifdef HRT_DEBUG_LEVEL2
-		DDPMSG("Insert key:%d\n", begin_t->key);
-		dump_entry_list(sort_by_y);
-#endif
-		/* Inser end entry */
-		insert_entry(p_entry, end_t);
-#ifdef HRT_DEBUG_LEVEL2
-		DDPMSG("Insert key:%d\n", end_t->key);
-		dump_entry_list(sort_by_y);
-#endif
-	}
+	/* begin edges go first, so rects sharing a line do overlap */
+	if ((l->overlap_w > 0) != (r->overlap_w > 0))
+		return l->overlap_w > 0 ? -1 : 1;
 
-	return 0;
+	/*
+	 * The running sum is checked against the bound at every edge, so
+	 * ties need a fixed order: upper layers begin first and end last.
+	 */
+	if (l->overlap_w > 0)
+		return r->layer - l->layer;
+	return l->layer - r->layer;
 }
 
-static int remove_layer_entry(struct drm_mtk_layer_config *layer_info,
-			      bool sort_by_y)
+static int hrt_key_cmp(const void *a, const void *b)
 {
-	struct hrt_sort_entry *temp, *free_entry;
+	int l = *(const int *)a, r = *(const int *)b;
 
-	if (sort_by_y)
-		temp = y_entry_list;
-	else
-		temp = x_entry_list;
-
-	while (temp) {
-		if (temp->layer_info == layer_info) {
-			free_entry = temp;
-			temp = temp->tail;
-			if (free_entry->head == NULL) {
-				/* Free head entry */
-				if (temp != NULL)
-					temp->head = NULL;
-				if (sort_by_y)
-					y_entry_list = temp;
-				else
-					x_entry_list = temp;
-				kfree(free_entry);
-			} else {
-				free_entry->head->tail = free_entry->tail;
-				if (temp)
-					temp->head = free_entry->head;
-				kfree(free_entry);
-			}
-		} else {
-			temp = temp->tail;
-		}
+	return l < r ? -1 : l > r;
+}
+
+static int hrt_key_index(struct hrt_sweep *sweep, int key)
+{
+	int lo = 0, hi = sweep->x_cnt - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (sweep->x_key[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	return 0;
+	return lo;
 }
 
-static int free_all_layer_entry(bool sort_by_y)
+/* Add @w to the x keys [lo, hi]; seg_max[node] includes its own seg_add */
+static void hrt_seg_add(struct hrt_sweep *sweep, int node, int l, int r,
+			int lo, int hi, int w)
 {
-	struct hrt_sort_entry *cur_entry, *next_entry;
+	int mid;
 
-	if (sort_by_y)
-		cur_entry = y_entry_list;
-	else
-		cur_entry = x_entry_list;
+	if (hi < l || r < lo)
+		return;
 
-	while (cur_entry) {
-		next_entry = cur_entry->tail;
-		kfree(cur_entry);
-		cur_entry = next_entry;
+	if (lo <= l && r <= hi) {
+		sweep->seg_max[node] += w;
+		sweep->seg_add[node] += w;
+		return;
 	}
 
-	if (sort_by_y)
-		y_entry_list = NULL;
-	else
-		x_entry_list = NULL;
-
-	return 0;
+	mid = (l + r) / 2;
+	hrt_seg_add(sweep, node * 2, l, mid, lo, hi, w);
+	hrt_seg_add(sweep, node * 2 + 1, mid + 1, r, lo, hi, w);
+	sweep->seg_max[node] = sweep->seg_add[node] +
+			       max(sweep->seg_max[node * 2],
+				   sweep->seg_max[node * 2 + 1]);
 }
 
-static int scan_x_overlap(struct drm_mtk_layering_info *disp_info,
-			  int disp_index, int ovl_overlap_limit_w)
+static int hrt_sweep_scan(struct hrt_sweep *sweep, int ovl_overlap_limit_w)
 {
-	struct hrt_sort_entry *tmp_entry;
-	int overlap_w_sum, max_overlap;
+	int i, overlap_w_sum, tmp_overlap, max_overlap;
+	int edge_cnt = 2 * sweep->layer_cnt;
 
-	overlap_w_sum = 0;
-	max_overlap = 0;
-	tmp_entry = x_entry_list;
-	while (tmp_entry) {
-		overlap_w_sum += tmp_entry->overlap_w;
-		max_overlap = (overlap_w_sum > max_overlap) ? overlap_w_sum
-							    : max_overlap;
-		tmp_entry = tmp_entry->tail;
+	if (!sweep->layer_cnt)
+		return 0;
+
+	/* x edges become indices into the sorted, unique x keys */
+	for (i = 0; i < sweep->layer_cnt; i++) {
+		sweep->x_key[2 * i] = sweep->x_begin[i];
+		sweep->x_key[2 * i + 1] = sweep->x_end[i];
+	}
+	sort(sweep->x_key, edge_cnt, sizeof(int), hrt_key_cmp, NULL);
+	sweep->x_cnt = 1;
+	for (i = 1; i < edge_cnt; i++)
+		if (sweep->x_key[i] != sweep->x_key[sweep->x_cnt - 1])
+			sweep->x_key[sweep->x_cnt++] = sweep->x_key[i];
+	for (i = 0; i < sweep->layer_cnt; i++) {
+		sweep->x_begin[i] = hrt_key_index(sweep, sweep->x_begin[i]);
+		sweep->x_end[i] = hrt_key_index(sweep, sweep->x_end[i]);
 	}
-	return max_overlap;
-}
 
-static int scan_y_overlap(struct drm_mtk_layering_info *disp_info,
-			  int disp_index, int ovl_overlap_limit_w)
-{
-	struct hrt_sort_entry *tmp_entry;
-	int overlap_w_sum, tmp_overlap, max_overlap;
+	sort(sweep->y_edge, edge_cnt, sizeof(struct hrt_edge), hrt_edge_cmp,
+	     NULL);
 
 	overlap_w_sum = 0;
-	tmp_overlap = 0;
 	max_overlap = 0;
-	tmp_entry = y_entry_list;
-	while (tmp_entry) {
-		overlap_w_sum += tmp_entry->overlap_w;
-		if (tmp_entry->overlap_w > 0) {
-			add_layer_entry(tmp_entry->layer_info, false,
-					tmp_entry->overlap_w);
-		} else {
-			remove_layer_entry(tmp_entry->layer_info, false);
-		}
+	for (i = 0; i < edge_cnt; i++) {
+		struct hrt_edge *edge = &sweep->y_edge[i];
+
+		overlap_w_sum += edge->overlap_w;
+		hrt_seg_add(sweep, 1, 0, sweep->x_cnt - 1,
+			    sweep->x_begin[edge->layer],
+			    sweep->x_end[edge->layer], edge->overlap_w);
 
+		/* only look at x when the y sum alone exceeds the bound */
 		if (overlap_w_sum > ovl_overlap_limit_w &&
-		    overlap_w_sum > max_overlap) {
-			tmp_overlap = scan_x_overlap(disp_info, disp_index,
-						     ovl_overlap_limit_w);
-		} else {
+		    overlap_w_sum > max_overlap)
+			tmp_overlap = sweep->seg_max[1];
+		else
 			tmp_overlap = overlap_w_sum;
-		}
 
+#ifdef HRT_DEBUG_LEVEL2
+		DDPMSG("y:%d, layer:%d, overlap_w:%d, sum:%d, x overlap:%d\n",
+		       edge->key, edge->layer, edge->overlap_w, overlap_w_sum,
+		       sweep->seg_max[1]);
+#endif
 		max_overlap =
 			(tmp_overlap > max_overlap) ? tmp_overlap : max_overlap;
-		tmp_entry = tmp_entry->tail;
 	}
 
 	return max_overlap;
@@ -1336,10 +1299,15 @@ static int _calc_hrt_num(struct drm_device *dev,
 	int overlap_w, layer_idx, phy_layer_idx, ovl_cnt;
 	bool has_gles = false;
 	struct drm_mtk_layer_config *layer_info;
+	struct hrt_sweep sweep;
 
 	if (!has_hrt_limit(disp_info, disp))
 		return 0;
 
+	/* Without the sweep buffer every layer is taken as overlapping */
+	if (hrt_sweep_init(&sweep, disp_info->layer_num[disp]))
+		DDPPR_ERR("%s: no memory for HRT overlap scan\n", __func__);
+
 	/* 1.Initial overlap conditions. */
 	sum_overlap_w = 0;
 	/*
@@ -1349,7 +1317,7 @@ static int _calc_hrt_num(struct drm_device *dev,
 	overlap_l_bound = g_emi_bound_table[0] * HRT_UINT_BOUND_BPP;
 
 	/*
-	 * 2.Add each layer info to layer list and sort it by yoffset.
+	 * 2.Add the dst rect of each layer to the sweep.
 	 * Also add up each layer overlap weight.
 	 */
 	layer_idx = -1;
@@ -1386,7 +1354,7 @@ static int _calc_hrt_num(struct drm_device *dev,
 			}
 			overlap_w = get_layer_weight(disp, layer_info);
 			sum_overlap_w += overlap_w;
-			add_layer_entry(layer_info, true, overlap_w);
+			hrt_sweep_add_layer(&sweep, layer_info, overlap_w);
 		} else if (i == disp_info->gles_head[disp]) {
 			/* Add GLES layer */
 			if (hrt_type != HRT_TYPE_EMI) {
@@ -1418,10 +1386,9 @@ static int _calc_hrt_num(struct drm_device *dev,
 	 * 3.Calculate the HRT bound if the total layer weight over the
 	 * lower bound or has secondary display.
 	 */
-	if (sum_overlap_w > overlap_l_bound ||
-	    has_hrt_limit(disp_info, HRT_SECONDARY) || force_scan_y) {
-		sum_overlap_w =
-			scan_y_overlap(disp_info, disp, overlap_l_bound);
+	if (sweep.y_edge && (sum_overlap_w > overlap_l_bound ||
+	    has_hrt_limit(disp_info, HRT_SECONDARY) || force_scan_y)) {
+		sum_overlap_w = hrt_sweep_scan(&sweep, overlap_l_bound);
 		/* Add overlap weight of Gles layer and Assert layer. */
 		if (has_gles)
 			sum_overlap_w += get_layer_weight(disp, NULL);
@@ -1434,7 +1401,7 @@ static int _calc_hrt_num(struct drm_device *dev,
 	       disp, disp, hrt_type, sum_overlap_w);
 #endif
 
-	free_all_layer_entry(true);
+	hrt_sweep_free(&sweep);
 	return sum_overlap_w;
 }
 
@@ -2601,61 +2568,219 @@ static int get_crtc_num(
 	return crtc_num;
 }
 
-static int layering_rule_start(struct drm_mtk_layering_info *disp_info_user,
-			       int debug_mode, struct drm_device *dev)
+/*
+ * Layering decisions only depend on the layer configs and a few display
+ * states, and SurfaceFlinger repeats the same geometry for long stretches
+ * (video playback, static UI). The outcome of pre-distribution and
+ * overlapping is kept in a small LRU keyed by all of those inputs, and the
+ * whole input is compared on a hash match. Dispatching is not cached, as it
+ * allocates the per-frame layer blobs and checks the idle state.
+ */
+#define LYE_CACHE_SIZE 8
+
+struct lye_cache_sig {
+	unsigned int gen;
+	int dal_enable;
+	unsigned int opt[LYE_OPT_NUM];
+	int emi_bound[HRT_LEVEL_NUM];
+	int disp_mode[HRT_DISP_TYPE_NUM];
+	int disp_mode_idx[HRT_DISP_TYPE_NUM];
+	int layer_num[HRT_DISP_TYPE_NUM];
+	int gles_head[HRT_DISP_TYPE_NUM];
+	int gles_tail[HRT_DISP_TYPE_NUM];
+	/* followed by the layer configs of every display, in order */
+	struct drm_mtk_layer_config config[];
+};
+
+struct lye_cache_entry {
+	struct list_head list;
+	u32 hash;
+	size_t sig_size;
+	struct lye_cache_sig *sig;
+	/* decided layer configs, laid out as in sig */
+	struct drm_mtk_layer_config *config;
+	int gles_head[HRT_DISP_TYPE_NUM];
+	int gles_tail[HRT_DISP_TYPE_NUM];
+	int hrt_num;
+	__u32 hrt_weight;
+	int addon_scn[HRT_DISP_TYPE_NUM];
+	int primary_fps;
+	int bound_tb_idx;
+};
+
+static DEFINE_MUTEX(lye_cache_lock);
+static LIST_HEAD(lye_cache_lru);
+static int lye_cache_cnt;
+static unsigned int lye_cache_gen;
+
+/* Drop all cached decisions, e.g. when a display helper option changes */
+void mtk_layering_rule_cache_invalidate(void)
 {
-	int ret;
-	int overlap_num;
-	struct mtk_drm_lyeblob_ids *lyeblob_ids;
-	unsigned int scale_num = 0;
-	unsigned int scn_decision_flag = 0;
-	int crtc_num, crtc_mask;
-	int disp_idx = 0;
+	mutex_lock(&lye_cache_lock);
+	lye_cache_gen++;
+	mutex_unlock(&lye_cache_lock);
+}
 
-	DRM_MMP_EVENT_START(layering, (unsigned long)disp_info_user,
-			(unsigned long)dev);
+static struct lye_cache_sig *lye_cache_sign(struct drm_mtk_layering_info *info,
+					    size_t *size)
+{
+	struct lye_cache_sig *sig;
+	size_t n = 0;
+	int i;
 
-	roll_gpu_for_idle = 0;
+	for (i = 0; i < HRT_DISP_TYPE_NUM; i++)
+		n += max(info->layer_num[i], 0);
 
-	if (l_rule_ops == NULL || l_rule_info == NULL) {
-		DRM_MMP_MARK(layering, 0, 0);
-		DRM_MMP_EVENT_END(layering, 0, 0);
-		DDPPR_ERR("Layering rule has not been initialize:(%p,%p)\n",
-				l_rule_ops, l_rule_info);
-		return -EFAULT;
+	*size = sizeof(*sig) + n * sizeof(struct drm_mtk_layer_config);
+	sig = kzalloc(*size, GFP_KERNEL);
+	if (!sig)
+		return NULL;
+
+	sig->gen = READ_ONCE(lye_cache_gen);
+	sig->dal_enable = l_rule_info->dal_enable;
+	for (i = 0; i < LYE_OPT_NUM; i++)
+		sig->opt[i] = get_layering_opt(i);
+	memcpy(sig->emi_bound, g_emi_bound_table, sizeof(sig->emi_bound));
+
+	n = 0;
+	for (i = 0; i < HRT_DISP_TYPE_NUM; i++) {
+		sig->disp_mode[i] = info->disp_mode[i];
+		sig->disp_mode_idx[i] = info->disp_mode_idx[i];
+		sig->layer_num[i] = info->layer_num[i];
+		sig->gles_head[i] = info->gles_head[i];
+		sig->gles_tail[i] = info->gles_tail[i];
+		if (info->layer_num[i] <= 0)
+			continue;
+
+		memcpy(&sig->config[n], info->input_config[i],
+		       info->layer_num[i] * sizeof(struct drm_mtk_layer_config));
+		n += info->layer_num[i];
 	}
 
-	if (check_disp_info(disp_info_user) < 0) {
-		DRM_MMP_MARK(layering, 0, 1);
-		DRM_MMP_EVENT_END(layering, 0, 0);
-		DDPPR_ERR("check_disp_info fail\n");
-		return -EFAULT;
+	return sig;
+}
+
+static void lye_cache_restore(struct lye_cache_entry *entry,
+			      struct drm_mtk_layering_info *info)
+{
+	size_t n = 0;
+	int i;
+
+	for (i = 0; i < HRT_DISP_TYPE_NUM; i++) {
+		info->gles_head[i] = entry->gles_head[i];
+		info->gles_tail[i] = entry->gles_tail[i];
+		l_rule_info->addon_scn[i] = entry->addon_scn[i];
+		if (info->layer_num[i] <= 0)
+			continue;
+
+		memcpy(info->input_config[i], &entry->config[n],
+		       info->layer_num[i] * sizeof(struct drm_mtk_layer_config));
+		n += info->layer_num[i];
 	}
+	info->hrt_num = entry->hrt_num;
+	info->hrt_weight = entry->hrt_weight;
+	l_rule_info->primary_fps = entry->primary_fps;
+	l_rule_info->bound_tb_idx = entry->bound_tb_idx;
+}
 
-	if (set_disp_info(disp_info_user, debug_mode)) {
-		DRM_MMP_MARK(layering, 0, 2);
-		DRM_MMP_EVENT_END(layering, 0, 0);
-		return -EFAULT;
+/* On a hit @sig is freed and @info holds the cached decision */
+static bool lye_cache_lookup(struct lye_cache_sig *sig, size_t size,
+			     struct drm_mtk_layering_info *info)
+{
+	struct lye_cache_entry *entry;
+	u32 hash = jhash(sig, size, 0);
+
+	mutex_lock(&lye_cache_lock);
+	list_for_each_entry(entry, &lye_cache_lru, list) {
+		if (entry->hash != hash || entry->sig_size != size ||
+		    memcmp(entry->sig, sig, size))
+			continue;
+
+		lye_cache_restore(entry, info);
+		list_move(&entry->list, &lye_cache_lru);
+		lye_cache_hit++;
+		mutex_unlock(&lye_cache_lock);
+		kfree(sig);
+		return true;
 	}
+	lye_cache_miss++;
+	mutex_unlock(&lye_cache_lock);
 
-	print_disp_info_to_log_buffer(&layering_info);
+	return false;
+}
 
-	DDPDBG("============================================ before\n");
-	dump_disp_info(&layering_info, DISP_DEBUG_LEVEL_INFO);
+/* Takes over @sig; the least recently used entry is recycled when full */
+static void lye_cache_insert(struct lye_cache_sig *sig, size_t size,
+			     struct drm_mtk_layering_info *info)
+{
+	struct lye_cache_entry *entry = NULL;
+	struct drm_mtk_layer_config *config;
+	size_t n = 0;
+	int i;
 
-	l_rule_info->hrt_idx++;
-	if (l_rule_info->hrt_idx == 0xffffffff)
-		l_rule_info->hrt_idx = 0;
+	config = kmalloc(size - sizeof(*sig), GFP_KERNEL);
+	if (!config) {
+		kfree(sig);
+		return;
+	}
 
-	l_rule_ops->copy_hrt_bound_table(&layering_info,
-		0, g_emi_bound_table, dev);
+	mutex_lock(&lye_cache_lock);
+	if (lye_cache_cnt < LYE_CACHE_SIZE) {
+		entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+		if (entry)
+			lye_cache_cnt++;
+	}
+	if (!entry) {
+		if (list_empty(&lye_cache_lru)) {
+			mutex_unlock(&lye_cache_lock);
+			kfree(config);
+			kfree(sig);
+			return;
+		}
+		entry = list_last_entry(&lye_cache_lru, struct lye_cache_entry,
+					list);
+		list_del(&entry->list);
+		kfree(entry->sig);
+		kfree(entry->config);
+	}
 
-	/* 1.Pre-distribution */
-	l_rule_info->dal_enable = mtk_drm_dal_enable();
+	entry->hash = jhash(sig, size, 0);
+	entry->sig_size = size;
+	entry->sig = sig;
+	entry->config = config;
+	for (i = 0; i < HRT_DISP_TYPE_NUM; i++) {
+		entry->gles_head[i] = info->gles_head[i];
+		entry->gles_tail[i] = info->gles_tail[i];
+		entry->addon_scn[i] = l_rule_info->addon_scn[i];
+		if (info->layer_num[i] <= 0)
+			continue;
+
+		memcpy(&config[n], info->input_config[i],
+		       info->layer_num[i] * sizeof(struct drm_mtk_layer_config));
+		n += info->layer_num[i];
+	}
+	entry->hrt_num = info->hrt_num;
+	entry->hrt_weight = info->hrt_weight;
+	entry->primary_fps = l_rule_info->primary_fps;
+	entry->bound_tb_idx = l_rule_info->bound_tb_idx;
+	list_add(&entry->list, &lye_cache_lru);
+	mutex_unlock(&lye_cache_lock);
+}
 
+/*
+ * Pre-distribution and overlapping: roll back what the HW cannot take,
+ * group ext layers and compute the HRT weight of the remaining layers.
+ */
+static void layering_rule_decision(struct drm_device *dev)
+{
+	int overlap_num;
+	unsigned int scale_num = 0;
+	unsigned int scn_decision_flag = 0;
+
+	/* 1.Pre-distribution */
 	if (l_rule_ops->rollback_to_gpu_by_hw_limitation)
-		ret = l_rule_ops->rollback_to_gpu_by_hw_limitation(
-			dev, &layering_info);
+		l_rule_ops->rollback_to_gpu_by_hw_limitation(dev,
+							     &layering_info);
 
 	scn_decision_flag = get_scn_decision_flag(&layering_info);
 	/* Check and choose the Resize Scenario */
@@ -2689,14 +2814,14 @@ static int layering_rule_start(struct drm_mtk_layering_info *disp_info_user,
 		l_rule_ops->fbdc_adjust_layout(&layering_info,
 					       ADJUST_LAYOUT_EXT_GROUPING);
 
-	ret = ext_layer_grouping(dev, &layering_info);
+	ext_layer_grouping(dev, &layering_info);
 
 	if (l_rule_ops->fbdc_restore_layout)
 		l_rule_ops->fbdc_restore_layout(&layering_info,
 						ADJUST_LAYOUT_EXT_GROUPING);
 
 	/* GLES adjustment and ext layer checking */
-	ret = filter_by_ovl_cnt(dev, &layering_info);
+	filter_by_ovl_cnt(dev, &layering_info);
 	/*
 	 * 2.Overlapping
 	 * Calculate overlap number of available input layers.
@@ -2714,6 +2839,65 @@ static int layering_rule_start(struct drm_mtk_layering_info *disp_info_user,
 	if (l_rule_ops->fbdc_restore_layout)
 		l_rule_ops->fbdc_restore_layout(&layering_info,
 						ADJUST_LAYOUT_OVERLAP_CAL);
+}
+
+static int layering_rule_start(struct drm_mtk_layering_info *disp_info_user,
+			       int debug_mode, struct drm_device *dev)
+{
+	int ret;
+	struct mtk_drm_lyeblob_ids *lyeblob_ids;
+	struct lye_cache_sig *sig;
+	size_t sig_size = 0;
+	int crtc_num, crtc_mask;
+	int disp_idx = 0;
+
+	DRM_MMP_EVENT_START(layering, (unsigned long)disp_info_user,
+			(unsigned long)dev);
+
+	roll_gpu_for_idle = 0;
+
+	if (l_rule_ops == NULL || l_rule_info == NULL) {
+		DRM_MMP_MARK(layering, 0, 0);
+		DRM_MMP_EVENT_END(layering, 0, 0);
+		DDPPR_ERR("Layering rule has not been initialize:(%p,%p)\n",
+				l_rule_ops, l_rule_info);
+		return -EFAULT;
+	}
+
+	if (check_disp_info(disp_info_user) < 0) {
+		DRM_MMP_MARK(layering, 0, 1);
+		DRM_MMP_EVENT_END(layering, 0, 0);
+		DDPPR_ERR("check_disp_info fail\n");
+		return -EFAULT;
+	}
+
+	if (set_disp_info(disp_info_user, debug_mode)) {
+		DRM_MMP_MARK(layering, 0, 2);
+		DRM_MMP_EVENT_END(layering, 0, 0);
+		return -EFAULT;
+	}
+
+	print_disp_info_to_log_buffer(&layering_info);
+
+	DDPDBG("============================================ before\n");
+	dump_disp_info(&layering_info, DISP_DEBUG_LEVEL_INFO);
+
+	l_rule_info->hrt_idx++;
+	if (l_rule_info->hrt_idx == 0xffffffff)
+		l_rule_info->hrt_idx = 0;
+
+	l_rule_ops->copy_hrt_bound_table(&layering_info,
+		0, g_emi_bound_table, dev);
+
+	l_rule_info->dal_enable = mtk_drm_dal_enable();
+
+	/* 1.Pre-distribution and 2.Overlapping, unless recently decided */
+	sig = debug_mode ? NULL : lye_cache_sign(&layering_info, &sig_size);
+	if (!sig || !lye_cache_lookup(sig, sig_size, &layering_info)) {
+		layering_rule_decision(dev);
+		if (sig)
+			lye_cache_insert(sig, sig_size, &layering_info);
+	}
 
 	/*
 	 * 3.Dispatching
@@ -3184,3 +3368,7 @@ int mtk_layering_rule_ioctl(struct drm_device *dev, void *data,
 
 	return 0;
 }
+
+#ifdef CONFIG_DRM_MEDIATEK_HRT_KUNIT_TEST
+#include "mtk_layering_rule_base_test.c"
+#endif
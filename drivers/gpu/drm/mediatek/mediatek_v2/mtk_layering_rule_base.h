@@ -126,11 +126,19 @@ enum LYE_TYPE {
 	LYE_LC,
 };
 
-struct hrt_sort_entry {
-	struct hrt_sort_entry *head, *tail;
-	struct drm_mtk_layer_config *layer_info;
+struct hrt_edge {
 	int key;
-	int overlap_w;
+	int overlap_w;	/* > 0 on the begin edge, < 0 on the end edge */
+	int layer;	/* index into hrt_sweep x_begin/x_end */
+};
+
+struct hrt_sweep {
+	int layer_cnt;
+	int x_cnt;
+	struct hrt_edge *y_edge;
+	int *x_key;
+	int *x_begin, *x_end;
+	int *seg_max, *seg_add;
 };
 
 struct layering_rule_info_t {
@@ -233,6 +241,7 @@ bool mtk_is_layer_id_valid(struct drm_mtk_layering_info *disp_info,
 			   int disp_idx, int i);
 int mtk_layering_rule_ioctl(struct drm_device *drm, void *data,
 	struct drm_file *file_priv);
+void mtk_layering_rule_cache_invalidate(void);
 
 bool is_triple_disp(struct drm_mtk_layering_info *disp_info);
 #endif
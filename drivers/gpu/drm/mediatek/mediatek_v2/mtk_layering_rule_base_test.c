@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the HRT overlap scan, included by mtk_layering_rule_base.c.
+ */
+#include <kunit/test.h>
+#include <linux/prandom.h>
+
+#define HRT_TEST_LAYERS		12
+#define HRT_TEST_ROUNDS		2000
+
+/*
+ * Reference: the sorted edge lists the sweep line replaced, kept in
+ * arrays. A begin edge goes in front of the edges with an equal key,
+ * an end edge behind them; the x list is rescanned at every y edge
+ * where the running weight exceeds the bound.
+ */
+struct hrt_test_list {
+	int cnt;
+	struct hrt_edge edge[2 * HRT_TEST_LAYERS];
+};
+
+static void hrt_test_list_insert(struct hrt_test_list *list,
+				 struct hrt_edge *new)
+{
+	int pos;
+
+	for (pos = 0; pos < list->cnt; pos++) {
+		struct hrt_edge *cur = &list->edge[pos];
+
+		if (new->key < cur->key ||
+		    (new->key == cur->key && new->overlap_w > 0))
+			break;
+	}
+	memmove(&list->edge[pos + 1], &list->edge[pos],
+		(list->cnt - pos) * sizeof(*new));
+	list->edge[pos] = *new;
+	list->cnt++;
+}
+
+static void hrt_test_list_add(struct hrt_test_list *list, int layer,
+			      int begin, int end, int overlap_w)
+{
+	struct hrt_edge edge = { begin, overlap_w, layer };
+
+	hrt_test_list_insert(list, &edge);
+	edge.key = end;
+	edge.overlap_w = -overlap_w;
+	hrt_test_list_insert(list, &edge);
+}
+
+static void hrt_test_list_remove(struct hrt_test_list *list, int layer)
+{
+	int i, cnt = 0;
+
+	for (i = 0; i < list->cnt; i++)
+		if (list->edge[i].layer != layer)
+			list->edge[cnt++] = list->edge[i];
+	list->cnt = cnt;
+}
+
+static int hrt_test_list_max(struct hrt_test_list *list)
+{
+	int i, sum = 0, max_overlap = 0;
+
+	for (i = 0; i < list->cnt; i++) {
+		sum += list->edge[i].overlap_w;
+		max_overlap = max(max_overlap, sum);
+	}
+	return max_overlap;
+}
+
+static int hrt_test_list_scan(struct drm_mtk_layer_config *cfg, int *weight,
+			      int layer_num, int limit)
+{
+	struct hrt_test_list y = { 0 }, x = { 0 };
+	int i, sum = 0, tmp_overlap, max_overlap = 0;
+
+	for (i = 0; i < layer_num; i++)
+		hrt_test_list_add(&y, i, cfg[i].dst_offset_y,
+				  cfg[i].dst_offset_y + cfg[i].dst_height - 1,
+				  weight[i]);
+
+	for (i = 0; i < y.cnt; i++) {
+		struct hrt_edge *edge = &y.edge[i];
+		struct drm_mtk_layer_config *l_info = &cfg[edge->layer];
+
+		sum += edge->overlap_w;
+		if (edge->overlap_w > 0)
+			hrt_test_list_add(&x, edge->layer,
+					  l_info->dst_offset_x,
+					  l_info->dst_offset_x +
+					  l_info->dst_width - 1,
+					  edge->overlap_w);
+		else
+			hrt_test_list_remove(&x, edge->layer);
+
+		if (sum > limit && sum > max_overlap)
+			tmp_overlap = hrt_test_list_max(&x);
+		else
+			tmp_overlap = sum;
+		max_overlap = max(max_overlap, tmp_overlap);
+	}
+
+	return max_overlap;
+}
+
+static int hrt_test_sweep_scan(struct kunit *test,
+			       struct drm_mtk_layer_config *cfg, int *weight,
+			       int layer_num, int limit)
+{
+	struct hrt_sweep sweep;
+	int i, ret;
+
+	KUNIT_ASSERT_EQ(test, hrt_sweep_init(&sweep, layer_num), 0);
+	for (i = 0; i < layer_num; i++)
+		hrt_sweep_add_layer(&sweep, &cfg[i], weight[i]);
+	ret = hrt_sweep_scan(&sweep, limit);
+	hrt_sweep_free(&sweep);
+
+	return ret;
+}
+
+/* Two layers that only share their last and first line do overlap */
+static void hrt_test_touching(struct kunit *test)
+{
+	struct drm_mtk_layer_config cfg[2] = {
+		{ .dst_offset_x = 0, .dst_offset_y = 0,
+		  .dst_width = 100, .dst_height = 100 },
+		{ .dst_offset_x = 99, .dst_offset_y = 99,
+		  .dst_width = 100, .dst_height = 100 },
+	};
+	int weight[2] = { 200, 200 };
+
+	KUNIT_EXPECT_EQ(test, hrt_test_sweep_scan(test, cfg, weight, 2, 0),
+			400);
+	cfg[1].dst_offset_x = 100;
+	KUNIT_EXPECT_EQ(test, hrt_test_sweep_scan(test, cfg, weight, 2, 0),
+			200);
+}
+
+static int hrt_test_rand(struct rnd_state *rnd, int n)
+{
+	return prandom_u32_state(rnd) % n;
+}
+
+/*
+ * Random layers on a coarse grid, so that edges often share a key and
+ * the tie order matters, checked against the list scan for a range of
+ * bounds.
+ */
+static void hrt_test_random(struct kunit *test)
+{
+	struct drm_mtk_layer_config cfg[HRT_TEST_LAYERS];
+	int weight[HRT_TEST_LAYERS];
+	struct rnd_state rnd;
+	int round, i;
+
+	prandom_seed_state(&rnd, 0x4852545f);
+	for (round = 0; round < HRT_TEST_ROUNDS; round++) {
+		int layer_num = 1 + hrt_test_rand(&rnd, HRT_TEST_LAYERS);
+		int limit, total = 0;
+
+		memset(cfg, 0, sizeof(cfg));
+		for (i = 0; i < layer_num; i++) {
+			cfg[i].dst_offset_x = 60 * hrt_test_rand(&rnd, 18);
+			cfg[i].dst_offset_y = 60 * hrt_test_rand(&rnd, 40);
+			cfg[i].dst_width = 1 + 60 * hrt_test_rand(&rnd, 18);
+			cfg[i].dst_height = 1 + 60 * hrt_test_rand(&rnd, 40);
+			weight[i] = 100 * (1 + hrt_test_rand(&rnd, 4));
+			total += weight[i];
+		}
+
+		for (limit = 0; limit <= total; limit += 100) {
+			int ref = hrt_test_list_scan(cfg, weight, layer_num,
+						     limit);
+			int got = hrt_test_sweep_scan(test, cfg, weight,
+						      layer_num, limit);
+
+			KUNIT_EXPECT_EQ_MSG(test, got, ref,
+					    "round %d, %d layers, bound %d",
+					    round, layer_num, limit);
+			if (got != ref)
+				return;
+		}
+	}
+}
+
+static struct kunit_case hrt_test_cases[] = {
+	KUNIT_CASE(hrt_test_touching),
+	KUNIT_CASE(hrt_test_random),
+	{}
+};
+
+static struct kunit_suite hrt_test_suite = {
+	.name = "mtk-layering-hrt",
+	.test_cases = hrt_test_cases,
+};
+
+kunit_test_suites(&hrt_test_suite);
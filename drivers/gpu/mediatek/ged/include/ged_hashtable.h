@@ -41,4 +41,9 @@ void ged_hashtable_iterator_delete(GED_HASHTABLE_HANDLE hHashTable,
 
 unsigned long ged_hashtable_get_count(GED_HASHTABLE_HANDLE hHashTable);
 
+GED_ERROR ged_hashtable_bench_run(unsigned int ui32Threads,
+	unsigned int ui32Rounds);
+
+ssize_t ged_hashtable_bench_show(char *buf);
+
 #endif
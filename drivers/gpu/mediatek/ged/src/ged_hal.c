@@ -27,6 +27,7 @@
 #include "ged_notify_sw_vsync.h"
 #include "ged_kpi.h"
 #include "ged_global.h"
+#include "ged_hashtable.h"
 
 #ifdef GED_DEBUG_FS
 #include "ged_debugFS.h"
@@ -356,6 +357,31 @@ static ssize_t gpu_boost_level_store(struct kobject *kobj,
 
 static KOBJ_ATTR_RW(gpu_boost_level);
 //-----------------------------------------------------------------------------
+static ssize_t hashtable_bench_show(struct kobject *kobj,
+		struct kobj_attribute *attr,
+		char *buf)
+{
+	return ged_hashtable_bench_show(buf);
+}
+
+/* "<threads> <rounds>" runs concurrent find/insert/remove on a scratch table */
+static ssize_t hashtable_bench_store(struct kobject *kobj,
+		struct kobj_attribute *attr,
+		const char *buf, size_t count)
+{
+	unsigned int ui32Threads, ui32Rounds;
+
+	if (sscanf(buf, "%u %u", &ui32Threads, &ui32Rounds) != 2)
+		return -EINVAL;
+
+	if (ged_hashtable_bench_run(ui32Threads, ui32Rounds) != GED_OK)
+		return -EINVAL;
+
+	return count;
+}
+
+static KOBJ_ATTR_RW(hashtable_bench);
+//-----------------------------------------------------------------------------
 int ged_dvfs_boost_value(void)
 {
 	return _boost_level;
@@ -754,6 +780,12 @@ GED_ERROR ged_hal_init(void)
 		goto ERROR;
 	}
 
+	err = ged_sysfs_create_file(hal_kobj, &kobj_attr_hashtable_bench);
+	if (unlikely(err != GED_OK)) {
+		GED_LOGE("Failed to create hashtable_bench entry!\n");
+		goto ERROR;
+	}
+
 #ifdef MTK_GED_KPI
 	err = ged_sysfs_create_file(hal_kobj, &kobj_attr_ged_kpi);
 	if (unlikely(err != GED_OK)) {
@@ -828,6 +860,7 @@ void ged_hal_exit(void)
 #ifdef MTK_GED_KPI
 	ged_sysfs_remove_file(hal_kobj, &kobj_attr_ged_kpi);
 #endif
+	ged_sysfs_remove_file(hal_kobj, &kobj_attr_hashtable_bench);
 	ged_sysfs_remove_file(hal_kobj, &kobj_attr_gpu_boost_level);
 	ged_sysfs_remove_file(hal_kobj, &kobj_attr_gpu_utilization);
 	ged_sysfs_remove_file(hal_kobj, &kobj_attr_previous_freqency);
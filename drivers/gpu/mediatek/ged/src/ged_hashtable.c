@@ -6,15 +6,36 @@
 #include "ged_base.h"
 #include "ged_hashtable.h"
 #include <linux/hashtable.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+
+/*
+ * Lookups walk the buckets under rcu_read_lock() only. Writers are
+ * serialized by sLock. The bucket array is resized from a work item:
+ * every node carries two hlist links, the new array is chained through
+ * the link the old one does not use, so readers on the old array never
+ * see a half-moved chain. The old array is freed after a grace period.
+ */
+struct GED_HASHBUCKETS {
+	unsigned int		ui32Bits;
+	unsigned int		ui32Link;	/* which GED_HASHNODE link */
+	struct hlist_head	asHead[];
+};
 
 struct GED_HASHTABLE {
 	unsigned int		version;
-	unsigned int		ui32Bits;
-	unsigned int		ui32Tmp;
-	unsigned long		ulLength;
+	unsigned int		ui32MinBits;
+	spinlock_t		sLock;
 	unsigned long		ulCount;
 	unsigned long		ulCurrentID;
-	struct list_head	*psHashTable;
+	struct GED_HASHBUCKETS __rcu *psBuckets;
+	struct work_struct	sResizeWork;
 };
 
 #define HT_VERSION sizeof(struct GED_HASHTABLE)
@@ -22,10 +43,12 @@ struct GED_HASHTABLE {
 struct GED_HASHNODE {
 	unsigned long		ulID;
 	void				*pvoid;
-	struct list_head	sList;
+	struct hlist_node	asLink[2];
+	struct rcu_head		sRcu;
 };
 
 #define GED_HASHTABLE_INIT_ID 1234 // 0 = invalid
+#define GED_HASHTABLE_MAX_BITS 20
 
 static struct GED_HASHTABLE
 *__ged_hashtable_verify(GED_HASHTABLE_HANDLE hHashTable)
@@ -37,30 +60,149 @@ static struct GED_HASHTABLE
 	return NULL;
 }
 
-static void *__ged_hashtable_find(struct list_head *psList, unsigned long ulID)
+static inline struct GED_HASHNODE *ged_hashnode(struct hlist_node *psLink,
+	unsigned int ui32Link)
+{
+	return container_of(psLink - ui32Link, struct GED_HASHNODE, asLink[0]);
+}
+
+#define ged_hashbucket_for_each(psHN, psLink, psB, ulHash) \
+	for (psLink = rcu_dereference_raw( \
+			hlist_first_rcu(&(psB)->asHead[ulHash])); \
+		psLink && ((psHN = ged_hashnode(psLink, (psB)->ui32Link)), 1); \
+		psLink = rcu_dereference_raw(hlist_next_rcu(psLink)))
+
+static unsigned long ged_hash(struct GED_HASHBUCKETS *psB, unsigned long ulID)
+{
+	return hash_long(ulID, psB->ui32Bits);
+}
+
+static struct GED_HASHNODE *__ged_hashtable_find(struct GED_HASHBUCKETS *psB,
+	unsigned long ulID)
 {
 	struct GED_HASHNODE *psHN;
-	struct list_head *psListEntry, *psListEntryTemp;
+	struct hlist_node *psLink;
 
-	list_for_each_safe(psListEntry, psListEntryTemp, psList) {
-		psHN = list_entry(psListEntry, struct GED_HASHNODE, sList);
-		if (psHN && (psHN->ulID == ulID))
+	ged_hashbucket_for_each(psHN, psLink, psB, ged_hash(psB, ulID)) {
+		if (psHN->ulID == ulID)
 			return psHN;
 	}
 	return NULL;
 }
 
-static unsigned long ged_hash(struct GED_HASHTABLE *psHT, unsigned long ulID)
+static struct GED_HASHBUCKETS *ged_hashbuckets_alloc(unsigned int ui32Bits,
+	gfp_t gfp)
+{
+	struct GED_HASHBUCKETS *psB;
+	unsigned long i, ulLength = 1UL << ui32Bits;
+
+	psB = kvmalloc(struct_size(psB, asHead, ulLength), gfp);
+	if (psB) {
+		psB->ui32Bits = ui32Bits;
+		psB->ui32Link = 0;
+		for (i = 0; i < ulLength; i++)
+			INIT_HLIST_HEAD(&psB->asHead[i]);
+	}
+	return psB;
+}
+
+static inline struct GED_HASHBUCKETS *
+ged_hashbuckets_locked(struct GED_HASHTABLE *psHT)
+{
+	return rcu_dereference_protected(psHT->psBuckets,
+		lockdep_is_held(&psHT->sLock));
+}
+
+/* Grow at load factor 1, shrink at 1/4 but never below the create size */
+static unsigned int ged_hashtable_wanted_bits(struct GED_HASHTABLE *psHT,
+	struct GED_HASHBUCKETS *psB)
+{
+	unsigned long ulLength = 1UL << psB->ui32Bits;
+
+	if (psHT->ulCount > ulLength &&
+		psB->ui32Bits < GED_HASHTABLE_MAX_BITS)
+		return psB->ui32Bits + 1;
+	if (psHT->ulCount < ulLength / 4 && psB->ui32Bits > psHT->ui32MinBits)
+		return psB->ui32Bits - 1;
+	return psB->ui32Bits;
+}
+
+static void ged_hashtable_resize_work(struct work_struct *psWork)
+{
+	struct GED_HASHTABLE *psHT =
+		container_of(psWork, struct GED_HASHTABLE, sResizeWork);
+	struct GED_HASHBUCKETS *psOld, *psNew;
+	struct GED_HASHNODE *psHN;
+	struct hlist_node *psLink;
+	unsigned long ulIRQFlags, i;
+	unsigned int ui32Bits;
+
+	/* ulCount only changes under sLock */
+	spin_lock_irqsave(&psHT->sLock, ulIRQFlags);
+	psOld = ged_hashbuckets_locked(psHT);
+	ui32Bits = ged_hashtable_wanted_bits(psHT, psOld);
+	spin_unlock_irqrestore(&psHT->sLock, ulIRQFlags);
+	if (ui32Bits == psOld->ui32Bits)
+		return;
+
+	psNew = ged_hashbuckets_alloc(ui32Bits, GFP_KERNEL);
+	if (!psNew)
+		return;
+
+	/*
+	 * Only this work replaces the array, so psOld is still current.
+	 * The count may have moved meanwhile; the next add or remove
+	 * checks it against the new size again.
+	 */
+	spin_lock_irqsave(&psHT->sLock, ulIRQFlags);
+	psNew->ui32Link = psOld->ui32Link ^ 1;
+	for (i = 0; i < (1UL << psOld->ui32Bits); i++) {
+		ged_hashbucket_for_each(psHN, psLink, psOld, i)
+			hlist_add_head_rcu(&psHN->asLink[psNew->ui32Link],
+				&psNew->asHead[ged_hash(psNew, psHN->ulID)]);
+	}
+	rcu_assign_pointer(psHT->psBuckets, psNew);
+	spin_unlock_irqrestore(&psHT->sLock, ulIRQFlags);
+
+	/*
+	 * Readers may still walk the old links; they must be quiescent
+	 * before the next resize reuses them.
+	 */
+	synchronize_rcu();
+	kvfree(psOld);
+}
+
+static void ged_hashtable_check_resize(struct GED_HASHTABLE *psHT,
+	struct GED_HASHBUCKETS *psB)
+{
+	if (ged_hashtable_wanted_bits(psHT, psB) != psB->ui32Bits)
+		schedule_work(&psHT->sResizeWork);
+}
+
+static void __ged_hashtable_add(struct GED_HASHTABLE *psHT,
+	struct GED_HASHBUCKETS *psB, struct GED_HASHNODE *psHN)
+{
+	hlist_add_head_rcu(&psHN->asLink[psB->ui32Link],
+		&psB->asHead[ged_hash(psB, psHN->ulID)]);
+	psHT->ulCount += 1;
+	ged_hashtable_check_resize(psHT, psB);
+}
+
+static void __ged_hashtable_del(struct GED_HASHTABLE *psHT,
+	struct GED_HASHBUCKETS *psB, struct GED_HASHNODE *psHN)
 {
-	return hash_long(ulID, psHT->ui32Bits);
+	WRITE_ONCE(psHN->pvoid, NULL);
+	hlist_del_rcu(&psHN->asLink[psB->ui32Link]);
+	kfree_rcu(psHN, sRcu);
+	psHT->ulCount -= 1;
+	ged_hashtable_check_resize(psHT, psB);
 }
 
 GED_HASHTABLE_HANDLE ged_hashtable_create(unsigned int ui32Bits)
 {
 	struct GED_HASHTABLE *psHT;
-	unsigned long i;
 
-	if (ui32Bits > 20) {
+	if (ui32Bits > GED_HASHTABLE_MAX_BITS) {
 		// 1048576 slots !?
 		// Need to check the necessary
 		return NULL;
@@ -69,22 +211,23 @@ GED_HASHTABLE_HANDLE ged_hashtable_create(unsigned int ui32Bits)
 	psHT = (struct GED_HASHTABLE *)
 		ged_alloc_atomic(sizeof(struct GED_HASHTABLE));
 	if (psHT) {
+		struct GED_HASHBUCKETS *psB;
+
 		psHT->version = HT_VERSION;
-		psHT->ui32Bits = ui32Bits;
-		psHT->ulLength = (unsigned long)(1 << ui32Bits);
+		psHT->ui32MinBits = ui32Bits;
 		psHT->ulCount = 0;
 		psHT->ulCurrentID = GED_HASHTABLE_INIT_ID; /* 0 = invalid */
-		psHT->psHashTable = (struct list_head *)
-		ged_alloc_atomic(psHT->ulLength * sizeof(struct list_head));
+		spin_lock_init(&psHT->sLock);
+		INIT_WORK(&psHT->sResizeWork, ged_hashtable_resize_work);
 
-		if (psHT->psHashTable) {
-			for (i = 0; i < psHT->ulLength; i++)
-				INIT_LIST_HEAD(&psHT->psHashTable[i]);
+		psB = ged_hashbuckets_alloc(ui32Bits, GFP_KERNEL);
+		if (psB) {
+			RCU_INIT_POINTER(psHT->psBuckets, psB);
 			return (GED_HASHTABLE_HANDLE)psHT;
 		}
+		ged_free(psHT, sizeof(struct GED_HASHTABLE));
 	}
 
-	ged_hashtable_destroy(psHT);
 	return NULL;
 }
 
@@ -93,31 +236,28 @@ void ged_hashtable_destroy(GED_HASHTABLE_HANDLE hHashTable)
 	struct GED_HASHTABLE *psHT = __ged_hashtable_verify(hHashTable);
 
 	if (psHT) {
-		unsigned long i = 0;
-		struct list_head *psListEntry, *psListEntryTemp;
-
-		for (; i < psHT->ulLength; i++) {
-			struct list_head *psList = &psHT->psHashTable[i];
-
-			list_for_each_safe(psListEntry,
-				psListEntryTemp, psList) {
-				struct GED_HASHNODE *psHN =
-					list_entry(psListEntry,
-					struct GED_HASHNODE, sList);
-
-				if (psHN) {
-					list_del(&psHN->sList);
-					ged_free(psHN,
-						sizeof(struct GED_HASHNODE));
-				}
+		struct GED_HASHBUCKETS *psB;
+		struct GED_HASHNODE *psHN;
+		struct hlist_node *psLink, *psNext;
+		unsigned long i;
+
+		cancel_work_sync(&psHT->sResizeWork);
+		psB = rcu_dereference_protected(psHT->psBuckets, 1);
+
+		for (i = 0; i < (1UL << psB->ui32Bits); i++) {
+			for (psLink = psB->asHead[i].first; psLink;
+				psLink = psNext) {
+				psNext = psLink->next;
+				psHN = ged_hashnode(psLink, psB->ui32Link);
+				kfree_rcu(psHN, sRcu);
 			}
 		}
 
 		psHT->version = 0xf2eef2ee;
 
 		/* free the hash table */
-		ged_free(psHT->psHashTable,
-			psHT->ulLength * sizeof(struct list_head));
+		synchronize_rcu();
+		kvfree(psB);
 		ged_free(psHT, sizeof(struct GED_HASHTABLE));
 	}
 }
@@ -126,22 +266,28 @@ GED_ERROR ged_hashtable_insert(GED_HASHTABLE_HANDLE hHashTable,
 	void *pvoid, unsigned long *pulID)
 {
 	struct GED_HASHTABLE *psHT = __ged_hashtable_verify(hHashTable);
+	struct GED_HASHBUCKETS *psB;
 	struct GED_HASHNODE *psHN = NULL;
-	unsigned long ulHash, ulID;
+	unsigned long ulID, ulIRQFlags;
 	GED_BOOL bFindSlot = GED_FALSE;
 
 	if ((!psHT) || (!pulID))
 		return GED_ERROR_INVALID_PARAMS;
 
+	psHN =
+	(struct GED_HASHNODE *)ged_alloc_atomic(sizeof(struct GED_HASHNODE));
+	if (!psHN)
+		return GED_ERROR_OOM;
+
+	spin_lock_irqsave(&psHT->sLock, ulIRQFlags);
+	psB = ged_hashbuckets_locked(psHT);
 	ulID = psHT->ulCurrentID + 1;
 
 	while (1) {
-		ulHash = ged_hash(psHT, ulID);
-		psHN = __ged_hashtable_find(&psHT->psHashTable[ulHash], ulID);
-		if (psHN != NULL) {
+		if (ulID == 0) /*skip the value 0 */
+			ulID = 1;
+		if (__ged_hashtable_find(psB, ulID) != NULL) {
 			ulID++;
-			if (ulID == 0) /*skip the value 0 */
-				ulID = 1;
 			if (ulID == psHT->ulCurrentID) {
 				bFindSlot = GED_FALSE;
 				break;
@@ -152,24 +298,20 @@ GED_ERROR ged_hashtable_insert(GED_HASHTABLE_HANDLE hHashTable,
 		}
 	};
 
-	if (bFindSlot == GED_FALSE)
+	if (bFindSlot == GED_FALSE) {
+		spin_unlock_irqrestore(&psHT->sLock, ulIRQFlags);
+		ged_free(psHN, sizeof(struct GED_HASHNODE));
 		return GED_ERROR_FAIL;
-
-	psHN =
-	(struct GED_HASHNODE *)ged_alloc_atomic(sizeof(struct GED_HASHNODE));
-
-	if (psHN) {
-		psHN->pvoid = pvoid;
-		psHN->ulID = ulID;
-		*pulID = ulID;
-		INIT_LIST_HEAD(&psHN->sList);
-		psHT->ulCurrentID = ulID;
-		psHT->ulCount += 1;
-		list_add(&psHN->sList, &psHT->psHashTable[ulHash]);
-		return GED_OK;
 	}
 
-	return GED_ERROR_OOM;
+	psHN->pvoid = pvoid;
+	psHN->ulID = ulID;
+	*pulID = ulID;
+	psHT->ulCurrentID = ulID;
+	__ged_hashtable_add(psHT, psB, psHN);
+	spin_unlock_irqrestore(&psHT->sLock, ulIRQFlags);
+
+	return GED_OK;
 }
 
 void ged_hashtable_remove(GED_HASHTABLE_HANDLE hHashTable, unsigned long ulID)
@@ -177,38 +319,40 @@ void ged_hashtable_remove(GED_HASHTABLE_HANDLE hHashTable, unsigned long ulID)
 	struct GED_HASHTABLE *psHT = __ged_hashtable_verify(hHashTable);
 
 	if (psHT) {
-		unsigned long ulHash = ged_hash(psHT, ulID);
-		struct GED_HASHNODE *psHN =
-			__ged_hashtable_find(&psHT->psHashTable[ulHash], ulID);
+		struct GED_HASHBUCKETS *psB;
+		struct GED_HASHNODE *psHN;
+		unsigned long ulIRQFlags;
 
-		if (psHN) {
-			psHN->pvoid = NULL;
-			list_del(&psHN->sList);
-			ged_free(psHN, sizeof(struct GED_HASHNODE));
-			psHT->ulCount -= 1;
-		}
+		spin_lock_irqsave(&psHT->sLock, ulIRQFlags);
+		psB = ged_hashbuckets_locked(psHT);
+		psHN = __ged_hashtable_find(psB, ulID);
+		if (psHN)
+			__ged_hashtable_del(psHT, psB, psHN);
+		spin_unlock_irqrestore(&psHT->sLock, ulIRQFlags);
 	}
 }
 
 void *ged_hashtable_find(GED_HASHTABLE_HANDLE hHashTable, unsigned long ulID)
 {
 	struct GED_HASHTABLE *psHT = __ged_hashtable_verify(hHashTable);
+	void *pvoid = NULL;
 
 	if (psHT) {
-		unsigned long ulHash = ged_hash(psHT, ulID);
-		struct GED_HASHNODE *psHN =
-			__ged_hashtable_find(&psHT->psHashTable[ulHash], ulID);
+		struct GED_HASHNODE *psHN;
 
+		rcu_read_lock();
+		psHN = __ged_hashtable_find(rcu_dereference(psHT->psBuckets),
+			ulID);
 		if (psHN)
-			return psHN->pvoid;
+			pvoid = READ_ONCE(psHN->pvoid);
+		rcu_read_unlock();
+
 #ifdef GED_DEBUG
-		if (ulID != 0)
-			GED_LOGD(
-			"@%s: ulID=%lu ulHash=%lu fail\n", __func__,
-			ulID, ulHash);
+		if (!psHN && ulID != 0)
+			GED_LOGD("@%s: ulID=%lu fail\n", __func__, ulID);
 #endif
 	}
-	return NULL;
+	return pvoid;
 }
 
 GED_ERROR ged_hashtable_set(GED_HASHTABLE_HANDLE hHashTable,
@@ -217,26 +361,32 @@ GED_ERROR ged_hashtable_set(GED_HASHTABLE_HANDLE hHashTable,
 	struct GED_HASHTABLE *psHT = __ged_hashtable_verify(hHashTable);
 
 	if (psHT) {
-		unsigned long ulHash = ged_hash(psHT, ulID);
-		struct GED_HASHNODE *psHN =
-			__ged_hashtable_find(&psHT->psHashTable[ulHash], ulID);
+		struct GED_HASHBUCKETS *psB;
+		struct GED_HASHNODE *psHN, *psNew;
+		unsigned long ulIRQFlags;
+		GED_ERROR err = GED_OK;
 
-		if (psHN) {
-			psHN->pvoid = pvoid;
-		} else {
-			psHN =
-			(struct GED_HASHNODE *)
+		psNew = (struct GED_HASHNODE *)
 			ged_alloc_atomic(sizeof(struct GED_HASHNODE));
 
-			if (psHN == NULL)
-				return GED_ERROR_OOM;
-			psHN->pvoid = pvoid;
-			psHN->ulID = ulID;
-			INIT_LIST_HEAD(&psHN->sList);
-			list_add(&psHN->sList, &psHT->psHashTable[ulHash]);
-			psHT->ulCount += 1;
+		spin_lock_irqsave(&psHT->sLock, ulIRQFlags);
+		psB = ged_hashbuckets_locked(psHT);
+		psHN = __ged_hashtable_find(psB, ulID);
+		if (psHN) {
+			WRITE_ONCE(psHN->pvoid, pvoid);
+		} else if (psNew) {
+			psNew->pvoid = pvoid;
+			psNew->ulID = ulID;
+			__ged_hashtable_add(psHT, psB, psNew);
+			psNew = NULL;
+		} else {
+			err = GED_ERROR_OOM;
 		}
-		return GED_OK;
+		spin_unlock_irqrestore(&psHT->sLock, ulIRQFlags);
+
+		/* the preallocated node was not needed */
+		ged_free(psNew, sizeof(struct GED_HASHNODE));
+		return err;
 	}
 	return GED_ERROR_INVALID_PARAMS;
 }
@@ -248,24 +398,22 @@ void ged_hashtable_iterator(GED_HASHTABLE_HANDLE hHashTable,
 	struct GED_HASHTABLE *psHT = __ged_hashtable_verify(hHashTable);
 
 	if (psHT) {
+		struct GED_HASHBUCKETS *psB;
 		struct GED_HASHNODE *psHN;
+		struct hlist_node *psLink;
 		unsigned long i;
-		struct list_head *psListEntry, *psListEntryTemp;
-
-		for (i = 0; i < psHT->ulLength; ++i) {
-			struct list_head *psList = &psHT->psHashTable[i];
-
-			list_for_each_safe(psListEntry,
-				psListEntryTemp, psList) {
-				psHN = list_entry(psListEntry,
-					struct GED_HASHNODE, sList);
-				if (psHN) {
-					if (!iterator(psHN->ulID,
-						psHN->pvoid, pvParam))
-						return;
-				}
+
+		rcu_read_lock();
+		psB = rcu_dereference(psHT->psBuckets);
+		for (i = 0; i < (1UL << psB->ui32Bits); ++i) {
+			ged_hashbucket_for_each(psHN, psLink, psB, i) {
+				if (!iterator(psHN->ulID,
+					READ_ONCE(psHN->pvoid), pvParam))
+					goto out;
 			}
 		}
+out:
+		rcu_read_unlock();
 	}
 }
 
@@ -277,27 +425,23 @@ void *ged_hashtable_search(GED_HASHTABLE_HANDLE hHashTable,
 	void *pResult = NULL;
 
 	if (psHT) {
+		struct GED_HASHBUCKETS *psB;
 		struct GED_HASHNODE *psHN;
+		struct hlist_node *psLink;
 		unsigned long i;
-		struct list_head *psListEntry, *psListEntryTemp;
-
-		for (i = 0; i < psHT->ulLength; ++i) {
-			struct list_head *psList = &psHT->psHashTable[i];
-
-			list_for_each_safe(psListEntry, psListEntryTemp,
-				psList) {
-				psHN = list_entry(psListEntry,
-					struct GED_HASHNODE,
-					sList);
-
-				if (psHN) {
-					pResult = pFunc(psHN->ulID,
-						psHN->pvoid, pvParam);
-					if (pResult)
-						return pResult;
-				}
+
+		rcu_read_lock();
+		psB = rcu_dereference(psHT->psBuckets);
+		for (i = 0; i < (1UL << psB->ui32Bits); ++i) {
+			ged_hashbucket_for_each(psHN, psLink, psB, i) {
+				pResult = pFunc(psHN->ulID,
+					READ_ONCE(psHN->pvoid), pvParam);
+				if (pResult)
+					goto out;
 			}
 		}
+out:
+		rcu_read_unlock();
 	}
 	return pResult;
 }
@@ -310,34 +454,32 @@ void ged_hashtable_iterator_delete(GED_HASHTABLE_HANDLE hHashTable,
 	struct GED_HASHTABLE *psHT = __ged_hashtable_verify(hHashTable);
 
 	if (psHT) {
+		struct GED_HASHBUCKETS *psB;
 		struct GED_HASHNODE *psHN;
-		unsigned long i;
-		struct list_head *psListEntry, *psListEntryTemp;
-
-		for (i = 0; i < psHT->ulLength; ++i) {
-			struct list_head *psList = &psHT->psHashTable[i];
-
-			list_for_each_safe(psListEntry,
-				psListEntryTemp, psList) {
-				psHN = list_entry(psListEntry,
-					struct GED_HASHNODE, sList);
-				if (psHN) {
-					GED_BOOL bDeleted = GED_FALSE;
-					GED_BOOL bContinue = pFunc(psHN->ulID,
+		struct hlist_node *psLink, *psNext;
+		unsigned long i, ulIRQFlags;
+
+		spin_lock_irqsave(&psHT->sLock, ulIRQFlags);
+		psB = ged_hashbuckets_locked(psHT);
+		for (i = 0; i < (1UL << psB->ui32Bits); ++i) {
+			for (psLink = psB->asHead[i].first; psLink;
+				psLink = psNext) {
+				GED_BOOL bDeleted = GED_FALSE;
+				GED_BOOL bContinue;
+
+				psNext = psLink->next;
+				psHN = ged_hashnode(psLink, psB->ui32Link);
+				bContinue = pFunc(psHN->ulID,
 					psHN->pvoid, pvParam, &bDeleted);
 
-					if (bDeleted) {
-						psHN->pvoid = NULL;
-						list_del(&psHN->sList);
-						ged_free(psHN,
-						sizeof(struct GED_HASHNODE));
-						psHT->ulCount -= 1;
-					}
-					if (!bContinue)
-						return;
-				}
+				if (bDeleted)
+					__ged_hashtable_del(psHT, psB, psHN);
+				if (!bContinue)
+					goto out;
 			}
 		}
+out:
+		spin_unlock_irqrestore(&psHT->sLock, ulIRQFlags);
 	}
 
 }
@@ -347,7 +489,134 @@ unsigned long ged_hashtable_get_count(GED_HASHTABLE_HANDLE hHashTable)
 	struct GED_HASHTABLE *psHT = __ged_hashtable_verify(hHashTable);
 
 	if (psHT)
-		return psHT->ulCount;
+		return READ_ONCE(psHT->ulCount);
 	return 0;
 }
 
+/* ------------------------------------------------------------------- */
+/* microbenchmark: concurrent find / insert / remove                   */
+/* ------------------------------------------------------------------- */
+#define GED_HT_BENCH_PREFILL	1024
+#define GED_HT_BENCH_BATCH	64
+#define GED_HT_BENCH_UPDATES	8
+#define GED_HT_BENCH_MAX_THREADS	16
+
+struct GED_HT_BENCH_THREAD {
+	GED_HASHTABLE_HANDLE	hHT;
+	unsigned long		*pulIDs;
+	unsigned int		ui32Rounds;
+	u64			ullFindNs, ullInsertNs, ullRemoveNs;
+	struct completion	sDone;
+};
+
+static struct {
+	unsigned int	ui32Threads;
+	unsigned long	ulOps;
+	u64		ullFindNs, ullInsertNs, ullRemoveNs;	/* per op */
+} gsHTBench;
+
+static int ged_hashtable_bench_thread(void *pvData)
+{
+	struct GED_HT_BENCH_THREAD *psT = pvData;
+	unsigned long aulIDs[GED_HT_BENCH_UPDATES];
+	unsigned int r, i;
+	ktime_t start;
+
+	for (r = 0; r < psT->ui32Rounds; r++) {
+		start = ktime_get();
+		for (i = 0; i < GED_HT_BENCH_BATCH; i++)
+			ged_hashtable_find(psT->hHT, psT->pulIDs[
+				prandom_u32() % GED_HT_BENCH_PREFILL]);
+		psT->ullFindNs += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		for (i = 0; i < GED_HT_BENCH_UPDATES; i++)
+			if (ged_hashtable_insert(psT->hHT, psT, &aulIDs[i]))
+				aulIDs[i] = 0;
+		psT->ullInsertNs += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		for (i = 0; i < GED_HT_BENCH_UPDATES; i++)
+			ged_hashtable_remove(psT->hHT, aulIDs[i]);
+		psT->ullRemoveNs += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		cond_resched();
+	}
+
+	complete(&psT->sDone);
+	return 0;
+}
+
+GED_ERROR ged_hashtable_bench_run(unsigned int ui32Threads,
+	unsigned int ui32Rounds)
+{
+	struct GED_HT_BENCH_THREAD *psThreads;
+	GED_HASHTABLE_HANDLE hHT;
+	unsigned long *pulIDs;
+	u64 ullFind = 0, ullInsert = 0, ullRemove = 0;
+	unsigned long ulOps;
+	GED_ERROR err = GED_OK;
+	unsigned int i;
+
+	if (!ui32Threads || ui32Threads > GED_HT_BENCH_MAX_THREADS ||
+		!ui32Rounds)
+		return GED_ERROR_INVALID_PARAMS;
+
+	/* start small so the prefill exercises resizing as well */
+	hHT = ged_hashtable_create(4);
+	pulIDs = kcalloc(GED_HT_BENCH_PREFILL, sizeof(*pulIDs), GFP_KERNEL);
+	psThreads = kcalloc(ui32Threads, sizeof(*psThreads), GFP_KERNEL);
+	if (!hHT || !pulIDs || !psThreads) {
+		err = GED_ERROR_OOM;
+		goto out;
+	}
+
+	for (i = 0; i < GED_HT_BENCH_PREFILL; i++) {
+		err = ged_hashtable_insert(hHT, pulIDs, &pulIDs[i]);
+		if (err != GED_OK)
+			goto out;
+	}
+
+	for (i = 0; i < ui32Threads; i++) {
+		struct task_struct *psTask;
+
+		psThreads[i].hHT = hHT;
+		psThreads[i].pulIDs = pulIDs;
+		psThreads[i].ui32Rounds = ui32Rounds;
+		init_completion(&psThreads[i].sDone);
+		psTask = kthread_run(ged_hashtable_bench_thread,
+			&psThreads[i], "ged_ht_bench/%u", i);
+		if (IS_ERR(psTask))
+			complete(&psThreads[i].sDone);
+	}
+
+	for (i = 0; i < ui32Threads; i++) {
+		wait_for_completion(&psThreads[i].sDone);
+		ullFind += psThreads[i].ullFindNs;
+		ullInsert += psThreads[i].ullInsertNs;
+		ullRemove += psThreads[i].ullRemoveNs;
+	}
+
+	ulOps = (unsigned long)ui32Threads * ui32Rounds;
+	gsHTBench.ui32Threads = ui32Threads;
+	gsHTBench.ulOps = ulOps;
+	gsHTBench.ullFindNs = div64_u64(ullFind, ulOps * GED_HT_BENCH_BATCH);
+	gsHTBench.ullInsertNs =
+		div64_u64(ullInsert, ulOps * GED_HT_BENCH_UPDATES);
+	gsHTBench.ullRemoveNs =
+		div64_u64(ullRemove, ulOps * GED_HT_BENCH_UPDATES);
+out:
+	kfree(psThreads);
+	kfree(pulIDs);
+	ged_hashtable_destroy(hHT);
+	return err;
+}
+
+ssize_t ged_hashtable_bench_show(char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE,
+		"threads: %u rounds: %lu\nfind: %llu ns\ninsert: %llu ns\nremove: %llu ns\n",
+		gsHTBench.ui32Threads, gsHTBench.ulOps,
+		gsHTBench.ullFindNs, gsHTBench.ullInsertNs,
+		gsHTBench.ullRemoveNs);
+}
@@ -10,6 +10,11 @@
 #include <linux/atomic.h>
 #include <linux/module.h>
 #include <linux/version.h>
+#include <linux/percpu.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/wait.h>
+#include <linux/rcupdate.h>
 #include <ged_kpi.h>
 #include <ged_base.h>
 #include <ged_hashtable.h>
@@ -107,6 +112,8 @@ struct GED_KPI_HEAD {
 	GED_KPI_FRC_MODE_TYPE frc_mode;
 	int frc_client;
 	unsigned long long last_QedBufferDelay;
+	/* freed after a grace period, timer paths walk the table locklessly */
+	struct rcu_head sRcu;
 };
 
 struct GED_CPU_INFO {
@@ -191,8 +198,25 @@ struct GED_TIMESTAMP {
 	unsigned int i32GPUloading;
 	int i32QedBuffer_length;
 	int isSF;
-	struct work_struct sWork;
 	void *fence_addr;
+	u64 ullSeq;
+};
+
+/*
+ * KPI timestamps are pushed into a per-CPU ring with local interrupts
+ * off and no lock taken, so producers never wait on each other. Every
+ * event takes a global sequence number; the KPI thread merges the rings
+ * back into sequence order, which per-CPU rings preserve individually.
+ * A full ring drops the event instead of blocking the producer.
+ */
+#define GED_KPI_RING_SIZE 256 /* power of 2 */
+#define GED_KPI_DRAIN_BATCH 64
+
+struct GED_KPI_RING {
+	unsigned int ui32Head;	/* written by the producing CPU */
+	unsigned int ui32Tail;	/* written by the KPI thread */
+	unsigned long ulDropped;	/* logged by the KPI thread */
+	struct GED_TIMESTAMP asEvent[GED_KPI_RING_SIZE];
 };
 
 struct GED_KPI_GPU_TS {
@@ -213,13 +237,13 @@ static int is_game_control_frame_rate;
 static int target_fps_4_main_head = 60;
 static long long vsync_period = GED_KPI_SEC_DIVIDER / GED_KPI_MAX_FPS;
 static GED_LOG_BUF_HANDLE ghLogBuf_KPI;
-static struct workqueue_struct *g_psWorkQueue;
+static struct GED_KPI_RING __percpu *gs_kpi_rings;
+static atomic64_t gs_kpi_seq = ATOMIC64_INIT(0);
+static u64 gs_kpi_next_seq = 1;
+static DECLARE_WAIT_QUEUE_HEAD(gs_kpi_wait);
 static struct workqueue_struct *g_FenceWorkQueue;
 
 static GED_HASHTABLE_HANDLE gs_hashtable;
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-static spinlock_t gs_hashtableLock;
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
 static struct GED_KPI g_asKPI[GED_KPI_TOTAL_ITEMS];
 static int g_i32Pos;
 static GED_THREAD_HANDLE ghThread;
@@ -1066,7 +1090,7 @@ static GED_BOOL ged_kpi_iterator_delete_func(unsigned long ulID,
 	struct GED_KPI_HEAD *psHead = (struct GED_KPI_HEAD *)pvoid;
 
 	if (psHead) {
-		ged_free(psHead, sizeof(struct GED_KPI_HEAD));
+		kfree_rcu(psHead, sRcu);
 		*pbDeleted = GED_TRUE;
 	}
 
@@ -1206,18 +1230,13 @@ static GED_BOOL ged_kpi_find_and_delete_miss_tag(u64 ulID, int i32FrameID
 	return ret;
 }
 /* ------------------------------------------------------------------- */
-static void ged_kpi_work_cb(struct work_struct *psWork)
+static void ged_kpi_process_event(struct GED_TIMESTAMP *psTimeStamp)
 {
-	struct GED_TIMESTAMP *psTimeStamp =
-		GED_CONTAINER_OF(psWork, struct GED_TIMESTAMP, sWork);
 	struct GED_KPI_HEAD *psHead;
 	struct GED_KPI *psKPI = NULL;
 	u64 ulID;
 	unsigned long long phead_last1;
 	int target_FPS;
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-	unsigned long ulIRQFlags;
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
 
 #ifdef GED_KPI_DEBUG
 	GED_LOGD("[GED_KPI] ts type = %d, pid = %d, wnd = %llu, frame = %lu\n",
@@ -1245,17 +1264,9 @@ static void ged_kpi_work_cb(struct work_struct *psWork)
 			&& (psHead->sList.next == &(psHead->sList))) {
 				if (psHead == main_head)
 					main_head = NULL;
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-				spin_lock_irqsave(&gs_hashtableLock,
-					ulIRQFlags);
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
 				ged_hashtable_remove(gs_hashtable
 					, (unsigned long)ulID);
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-				spin_unlock_irqrestore(&gs_hashtableLock,
-					ulIRQFlags);
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
-				ged_free(psHead, sizeof(struct GED_KPI_HEAD));
+				kfree_rcu(psHead, sRcu);
 			}
 		} else {
 #ifdef GED_KPI_DEBUG
@@ -1286,21 +1297,13 @@ static void ged_kpi_work_cb(struct work_struct *psWork)
 					GED_KPI_DEFAULT_FPS_MARGIN,
 					GED_KPI_FRC_DEFAULT_MODE, -1);
 				INIT_LIST_HEAD(&psHead->sList);
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-				spin_lock_irqsave(&gs_hashtableLock,
-					ulIRQFlags);
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
 				ged_hashtable_set(gs_hashtable
 				, (unsigned long)ulID, (void *)psHead);
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-				spin_unlock_irqrestore(&gs_hashtableLock,
-					ulIRQFlags);
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
 			} else {
 				GED_PR_DEBUG(
 				"[GED_KPI][Exception] ged_alloc_atomic");
 				GED_PR_DEBUG("(sizeof(GED_KPI_HEAD)) failed\n");
-				goto work_cb_end;
+				return;
 			}
 		}
 		memset(psKPI, 0, sizeof(struct GED_KPI));
@@ -1340,7 +1343,7 @@ static void ged_kpi_work_cb(struct work_struct *psWork)
 				GED_PR_DEBUG(
 					"TYPE_1: psKPI NULL, frameID: %lu\n",
 					psTimeStamp->i32FrameID);
-				goto work_cb_end;
+				return;
 			}
 
 			/* new data */
@@ -1882,8 +1885,112 @@ static void ged_kpi_work_cb(struct work_struct *psWork)
 	default:
 		break;
 	}
-work_cb_end:
-	ged_free(psTimeStamp, sizeof(struct GED_TIMESTAMP));
+}
+/* ------------------------------------------------------------------- */
+/* Returns the oldest committed event across all rings, if it is next */
+static struct GED_TIMESTAMP *ged_kpi_ring_peek(struct GED_KPI_RING **ppsRing)
+{
+	struct GED_TIMESTAMP *psOldest = NULL;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct GED_KPI_RING *psRing = per_cpu_ptr(gs_kpi_rings, cpu);
+		unsigned int ui32Tail = psRing->ui32Tail;
+		struct GED_TIMESTAMP *psEvent;
+
+		if (smp_load_acquire(&psRing->ui32Head) == ui32Tail)
+			continue;
+
+		psEvent = &psRing->asEvent[ui32Tail & (GED_KPI_RING_SIZE - 1)];
+		if (!psOldest || psEvent->ullSeq < psOldest->ullSeq) {
+			psOldest = psEvent;
+			*ppsRing = psRing;
+		}
+	}
+
+	/*
+	 * A smaller sequence number may still be in flight on another
+	 * CPU; hold back until it is committed so order is preserved.
+	 */
+	if (psOldest && psOldest->ullSeq != gs_kpi_next_seq)
+		return NULL;
+	return psOldest;
+}
+
+/* Log timestamps lost to full rings since the last report */
+static void ged_kpi_ring_report_dropped(void)
+{
+	static unsigned long ulReported;
+	unsigned long ulDropped = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		ulDropped +=
+			READ_ONCE(per_cpu_ptr(gs_kpi_rings, cpu)->ulDropped);
+	if (ulDropped == ulReported)
+		return;
+
+	ged_log_buf_print(ghLogBuf_KPI,
+		"[GED_KPI] %lu timestamps dropped, ring full",
+		ulDropped - ulReported);
+	ulReported = ulDropped;
+}
+
+static void ged_kpi_thread_func(void *pvData)
+{
+	struct GED_KPI_RING *psRing;
+	struct GED_TIMESTAMP *psEvent;
+	int i;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		wait_event_freezable(gs_kpi_wait,
+			ged_kpi_ring_peek(&psRing) || kthread_should_stop());
+
+		for (i = 0; i < GED_KPI_DRAIN_BATCH; i++) {
+			psEvent = ged_kpi_ring_peek(&psRing);
+			if (!psEvent)
+				break;
+
+			ged_kpi_process_event(psEvent);
+			gs_kpi_next_seq++;
+			/* the slot may be reused once the tail moves past it */
+			smp_store_release(&psRing->ui32Tail,
+				psRing->ui32Tail + 1);
+		}
+		ged_kpi_ring_report_dropped();
+		cond_resched();
+	}
+}
+/* ------------------------------------------------------------------- */
+static struct GED_TIMESTAMP *ged_kpi_ring_reserve(unsigned long *pulFlags)
+{
+	struct GED_KPI_RING *psRing;
+	unsigned int ui32Head;
+
+	local_irq_save(*pulFlags);
+	psRing = this_cpu_ptr(gs_kpi_rings);
+	ui32Head = psRing->ui32Head;
+	if (ui32Head - smp_load_acquire(&psRing->ui32Tail) >=
+		GED_KPI_RING_SIZE) {
+		WRITE_ONCE(psRing->ulDropped, psRing->ulDropped + 1);
+		local_irq_restore(*pulFlags);
+		return NULL;
+	}
+	return &psRing->asEvent[ui32Head & (GED_KPI_RING_SIZE - 1)];
+}
+
+static void ged_kpi_ring_commit(struct GED_TIMESTAMP *psEvent,
+	unsigned long ulFlags)
+{
+	struct GED_KPI_RING *psRing = this_cpu_ptr(gs_kpi_rings);
+
+	psEvent->ullSeq = atomic64_inc_return(&gs_kpi_seq);
+	smp_store_release(&psRing->ui32Head, psRing->ui32Head + 1);
+	local_irq_restore(ulFlags);
+
+	if (wq_has_sleeper(&gs_kpi_wait))
+		wake_up(&gs_kpi_wait);
 }
 /* ------------------------------------------------------------------- */
 static GED_ERROR ged_kpi_push_timestamp(
@@ -1901,20 +2008,15 @@ static GED_ERROR ged_kpi_push_timestamp(
 	unsigned long ui32IRQFlags;
 #endif /* GED_ENABLE_FB_DVFS */
 
-	if (g_psWorkQueue && is_GED_KPI_enabled) {
-		struct GED_TIMESTAMP *psTimeStamp =
-			(struct GED_TIMESTAMP *)ged_alloc_atomic(
-			sizeof(struct GED_TIMESTAMP));
+	if (gs_kpi_rings && is_GED_KPI_enabled) {
+		struct GED_TIMESTAMP sTimeStamp = {0};
+		struct GED_TIMESTAMP *psTimeStamp = &sTimeStamp;
+		struct GED_TIMESTAMP *psSlot;
+		unsigned long ulRingFlags;
 #ifdef GED_ENABLE_FB_DVFS
 		unsigned int pui32Block, pui32Idle;
 #endif /* GED_ENABLE_FB_DVFS */
 
-		if (!psTimeStamp) {
-			GED_PR_DEBUG("[GED_KPI]: GED_ERROR_OOM in %s\n",
-				__func__);
-			return GED_ERROR_OOM;
-		}
-
 		if (eTimeStampType == GED_TIMESTAMP_TYPE_2) {
 #ifdef GED_ENABLE_FB_DVFS
 			spin_lock_irqsave(&gsGpuUtilLock, ui32IRQFlags);
@@ -1950,8 +2052,15 @@ static GED_ERROR ged_kpi_push_timestamp(
 		psTimeStamp->i32QedBuffer_length = QedBuffer_length;
 		psTimeStamp->isSF = isSF;
 		psTimeStamp->fence_addr = fence_addr;
-		INIT_WORK(&psTimeStamp->sWork, ged_kpi_work_cb);
-		queue_work(g_psWorkQueue, &psTimeStamp->sWork);
+
+		psSlot = ged_kpi_ring_reserve(&ulRingFlags);
+		if (!psSlot) {
+			GED_PR_DEBUG("[GED_KPI]: ring full in %s\n", __func__);
+			return GED_ERROR_OOM;
+		}
+		*psSlot = sTimeStamp;
+		ged_kpi_ring_commit(psSlot, ulRingFlags);
+
 		switch (eTimeStampType) {
 		case GED_TIMESTAMP_TYPE_D:
 			break;
@@ -1987,7 +2096,7 @@ static GED_ERROR ged_kpi_push_timestamp(
 	}
 #ifdef GED_KPI_DEBUG
 	else {
-		GED_LOGD("[GED_KPI][Exception]: g_psWorkQueue: ",
+		GED_LOGD("[GED_KPI][Exception]: gs_kpi_rings: ",
 			"NULL or GED KPI is disabled\n");
 		return GED_ERROR_FAIL;
 	}
@@ -2315,24 +2424,33 @@ GED_ERROR ged_kpi_system_init(void)
 #else
 	ghLogBuf_KPI = 0;
 #endif /* GED_BUFFER_LOG_DISABLE */
-	g_psWorkQueue =
-		alloc_ordered_workqueue("ged_kpi",
-			WQ_FREEZABLE | WQ_MEM_RECLAIM);
+	gs_kpi_rings = alloc_percpu(struct GED_KPI_RING);
 	g_FenceWorkQueue =
 		alloc_ordered_workqueue("ged_fence",
 			WQ_FREEZABLE | WQ_MEM_RECLAIM);
-	if (g_psWorkQueue && g_FenceWorkQueue) {
+	if (gs_kpi_rings && g_FenceWorkQueue) {
 		int i;
 
 		memset(g_asKPI, 0, sizeof(g_asKPI));
 		for (i = 0; i < GED_KPI_TOTAL_ITEMS; i++)
 			g_asKPI[i].ullWnd = 0x0 - 1;
 		gs_hashtable = ged_hashtable_create(10);
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-		spin_lock_init(&gs_hashtableLock);
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
-		return gs_hashtable ? GED_OK : GED_ERROR_FAIL;
+		if (gs_hashtable) {
+			GED_ERROR err = ged_thread_create(&ghThread,
+				"ged_kpi", ged_kpi_thread_func, NULL);
+
+			if (err == GED_OK)
+				return GED_OK;
+			ged_hashtable_destroy(gs_hashtable);
+			gs_hashtable = NULL;
+		}
 	}
+	/* ged_exit() still runs ged_kpi_system_exit() after a failure */
+	if (g_FenceWorkQueue)
+		destroy_workqueue(g_FenceWorkQueue);
+	g_FenceWorkQueue = NULL;
+	free_percpu(gs_kpi_rings);
+	gs_kpi_rings = NULL;
 	return GED_ERROR_FAIL;
 #else
 	return GED_OK;
@@ -2342,19 +2460,16 @@ GED_ERROR ged_kpi_system_init(void)
 void ged_kpi_system_exit(void)
 {
 #ifdef MTK_GED_KPI
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-	unsigned long ulIRQFlags;
-
-	spin_lock_irqsave(&gs_hashtableLock, ulIRQFlags);
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
+	/* stop the consumer before the heads it works on go away */
+	ged_thread_destroy(ghThread);
+	ghThread = NULL;
 	ged_hashtable_iterator_delete(gs_hashtable,
 		ged_kpi_iterator_delete_func, NULL);
-#ifdef GED_ENABLE_TIMER_BASED_DVFS_MARGIN
-	spin_unlock_irqrestore(&gs_hashtableLock, ulIRQFlags);
-#endif /* GED_ENABLE_TIMER_BASED_DVFS_MARGIN */
-	destroy_workqueue(g_psWorkQueue);
-	destroy_workqueue(g_FenceWorkQueue);
-	ged_thread_destroy(ghThread);
+	if (g_FenceWorkQueue)
+		destroy_workqueue(g_FenceWorkQueue);
+	g_FenceWorkQueue = NULL;
+	free_percpu(gs_kpi_rings);
+	gs_kpi_rings = NULL;
 #ifndef GED_BUFFER_LOG_DISABLE
 	ged_log_buf_free(ghLogBuf_KPI);
 	ghLogBuf_KPI = 0;
@@ -2504,12 +2619,13 @@ GED_ERROR ged_kpi_timer_based_pick_riskyBQ(int *pT_gpu_real, int *pT_gpu_pipe,
 	unsigned int deltaTime = 0;
 	unsigned int loading = 0;
 	int i;
-	unsigned long ulIRQFlags;
 
-	spin_lock_irqsave(&gs_hashtableLock, ulIRQFlags);
+	/*
+	 * The iterator runs under rcu_read_lock() and heads are freed with
+	 * kfree_rcu(), so the snapshot below needs no extra lock.
+	 */
 	ged_hashtable_iterator(gs_hashtable,
 		ged_kpi_find_riskyBQ_func, (void *)&sRiskyBQ);
-	spin_unlock_irqrestore(&gs_hashtableLock, ulIRQFlags);
 
 	if (sRiskyBQ.ullWnd == 0
 			|| sRiskyBQ.last_TimeStamp2 == 0
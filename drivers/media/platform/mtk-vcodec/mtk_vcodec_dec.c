@@ -506,239 +506,81 @@ static void clean_free_fm_buffer(struct mtk_vcodec_ctx *ctx)
 	} while (framptr);
 }
 
-static dma_addr_t create_meta_buffer_info(struct mtk_vcodec_ctx *ctx, int fd)
-{
-	int i = 0;
-	struct dma_buf *dmabuf = NULL;
-	struct dma_buf_attachment *buf_att = NULL;
-	struct sg_table *sgt = NULL;
-	dma_addr_t dma_meta_addr = 0;
-
-	dmabuf = dma_buf_get(fd);
-	mtk_v4l2_debug(5, "%s, dmabuf:%p", __func__, dmabuf);
-	if (dmabuf == NULL) {
-		mtk_v4l2_debug(0, "invalid meta fd %d\n", fd);
-		return 0;
-	}
-
-	buf_att = dma_buf_attach(
-		dmabuf,
-		&ctx->dev->plat_dev->dev);
-	sgt = dma_buf_map_attachment(buf_att, DMA_TO_DEVICE);
-	dma_meta_addr  = sg_dma_address(sgt->sgl);
-
-	mtk_v4l2_debug(4, "map new, dmabuf:%p, dma_addr:%p",
-		dmabuf, dma_meta_addr);
-	//save va and dmabuf
-	if (dma_meta_addr) {
-		for (i = 0; i < MAX_META_BUF_CNT; ++i) {
-			if (ctx->dma_meta_list[i].dma_meta_addr == 0) {
-				ctx->dma_meta_list[i].dmabuf = dmabuf;
-				ctx->dma_meta_list[i].dma_meta_addr = dma_meta_addr;
-				ctx->dma_meta_list[i].buf_att = buf_att;
-				ctx->dma_meta_list[i].sgt = sgt;
-				mtk_v4l2_debug(2, "save meta buf dmabuf %p  addr:%p at %d",
-					dmabuf, dma_meta_addr, i);
-				break;
-			}
-		}
-		if (i == MAX_META_BUF_CNT)
-			mtk_v4l2_err("dma_buf_list is overflow!\n");
-	}
-
-	return dma_meta_addr;
-}
-
 static dma_addr_t get_meta_buffer_dma_addr(struct mtk_vcodec_ctx *ctx, int fd)
 {
 	dma_addr_t dma_addr = 0;
-	int i = 0;
 	struct dma_buf *dmabuf = NULL;
 
 	dmabuf = dma_buf_get(fd);
 	mtk_v4l2_debug(5, "%s, dmabuf:%p", __func__, dmabuf);
-
-	if (dmabuf) {
-		for (i = 0; i < MAX_META_BUF_CNT; ++i) {
-			if (dmabuf == ctx->dma_meta_list[i].dmabuf) {
-				dma_addr = ctx->dma_meta_list[i].dma_meta_addr;
-				mtk_v4l2_debug(4, "reuse dma_addr %p at %d", dma_addr, i);
-				break;
-			}
-		}
-	}
-
-	if (dma_addr == 0) {
-		dma_addr = create_meta_buffer_info(ctx, fd);
-		for (i = 0; i < MAX_META_BUF_CNT; ++i) {
-			if (dmabuf == ctx->dma_meta_list[i].dmabuf) {
-				dma_addr = ctx->dma_meta_list[i].dma_meta_addr;
-				mtk_v4l2_debug(4, "reuse dma_addr %p at %d", dma_addr, i);
-				break;
-			}
-		}
+	if (IS_ERR_OR_NULL(dmabuf)) {
+		mtk_v4l2_debug(0, "invalid meta fd %d\n", fd);
+		return 0;
 	}
 
-	if (dmabuf)
-		dma_buf_put(dmabuf);
+	dma_addr = mtk_vcodec_dmabuf_cache_dma_addr(&ctx->meta_buf_cache, dmabuf);
+	dma_buf_put(dmabuf);
 
 	return dma_addr;
 }
 
-static int *create_general_buffer_info(struct mtk_vcodec_ctx *ctx, int fd)
+/*
+ * The mapping stays pinned in the cache until put_general_buffer_va(),
+ * which keeps it valid for the fence written back at dqbuf.
+ */
+static int *get_general_buffer_va(struct mtk_vcodec_ctx *ctx,
+	struct mtk_video_dec_buf *mtkbuf)
 {
-	int *va = 0;
-	int i = 0;
+	int fd = mtkbuf->general_user_fd;
+	int *va = NULL;
 	struct dma_buf *dmabuf = NULL;
-	struct dma_buf_attachment *buf_att = NULL;
-	struct sg_table *sgt = NULL;
-	dma_addr_t dma_general_addr = 0;
 
 	dmabuf = dma_buf_get(fd);
 	mtk_v4l2_debug(5, "%s, dmabuf:%p", __func__, dmabuf);
-	if (dmabuf == NULL) {
+	if (IS_ERR_OR_NULL(dmabuf)) {
 		mtk_v4l2_debug(0, "invalid general fd %d\n", fd);
-		return 0;
-	}
-	dma_buf_begin_cpu_access(dmabuf, DMA_TO_DEVICE);
-	va = dma_buf_vmap(dmabuf);
-	buf_att = dma_buf_attach(
-		dmabuf,
-		&ctx->dev->plat_dev->dev);
-	sgt = dma_buf_map_attachment(buf_att, DMA_TO_DEVICE);
-	dma_general_addr  = sg_dma_address(sgt->sgl);
-
-	mtk_v4l2_debug(4, "map new va %p, dmabuf:%p, dma_addr:%p",
-		va, dmabuf, dma_general_addr);
-	//save va and dmabuf
-	if (va) {
-		for (i = 0; i < MAX_GEN_BUF_CNT; ++i) {
-			if (ctx->dma_buf_list[i].va == 0) {
-				ctx->dma_buf_list[i].va = va;
-				ctx->dma_buf_list[i].dmabuf = dmabuf;
-				ctx->dma_buf_list[i].dma_general_addr = dma_general_addr;
-				ctx->dma_buf_list[i].buf_att = buf_att;
-				ctx->dma_buf_list[i].sgt = sgt;
-				mtk_v4l2_debug(4, "save general buf va %p dmabuf %p  addr:%p at %d",
-					va, dmabuf, dma_general_addr, i);
-				break;
-			}
-		}
-		if (i == MAX_GEN_BUF_CNT)
-			mtk_v4l2_err("dma_buf_list is overflow!\n");
+		return NULL;
 	}
 
+	va = mtk_vcodec_dmabuf_cache_va(&ctx->gen_buf_cache, dmabuf);
+	/* the pinned cache entry holds its own reference on dmabuf */
+	if (va)
+		mtkbuf->general_va_buf = dmabuf;
+	dma_buf_put(dmabuf);
+
 	return va;
 }
 
-static int *get_general_buffer_va(struct mtk_vcodec_ctx *ctx, int fd)
+static void put_general_buffer_va(struct mtk_vcodec_ctx *ctx,
+	struct mtk_video_dec_buf *mtkbuf)
 {
-	int *va = 0;
-	int i = 0;
-	struct dma_buf *dmabuf = NULL;
-
-	dmabuf = dma_buf_get(fd);
-	mtk_v4l2_debug(5, "%s, dmabuf:%p", __func__, dmabuf);
-
-	if (dmabuf) {
-		for (i = 0; i < MAX_GEN_BUF_CNT; ++i) {
-			if (dmabuf == ctx->dma_buf_list[i].dmabuf) {
-				va = ctx->dma_buf_list[i].va;
-				mtk_v4l2_debug(4, "reuse va %p at %d", va, i);
-				break;
-			}
-		}
-	}
-
-	if (va == 0)
-		va = create_general_buffer_info(ctx, fd);
-
-	if (dmabuf)
-		dma_buf_put(dmabuf);
+	if (!mtkbuf->general_va_buf)
+		return;
 
-	return va;
+	mtk_vcodec_dmabuf_cache_unpin(&ctx->gen_buf_cache,
+		mtkbuf->general_va_buf);
+	mtkbuf->general_va_buf = NULL;
+	mtkbuf->general_dma_va = NULL;
 }
 
 static dma_addr_t get_general_buffer_dma_addr(struct mtk_vcodec_ctx *ctx, int fd)
 {
 	dma_addr_t dma_addr = 0;
-	int i = 0;
 	struct dma_buf *dmabuf = NULL;
 
 	dmabuf = dma_buf_get(fd);
 	mtk_v4l2_debug(5, "%s, dmabuf:%p", __func__, dmabuf);
-
-	if (dmabuf) {
-		for (i = 0; i < MAX_GEN_BUF_CNT; ++i) {
-			if (dmabuf == ctx->dma_buf_list[i].dmabuf) {
-				dma_addr = ctx->dma_buf_list[i].dma_general_addr;
-				mtk_v4l2_debug(4, "reuse dma_addr %p at %d", dma_addr, i);
-				break;
-			}
-		}
-	}
-
-	if (dma_addr == 0) {
-		create_general_buffer_info(ctx, fd);
-		for (i = 0; i < MAX_GEN_BUF_CNT; ++i) {
-			if (dmabuf == ctx->dma_buf_list[i].dmabuf) {
-				dma_addr = ctx->dma_buf_list[i].dma_general_addr;
-				mtk_v4l2_debug(4, "reuse dma_addr %p at %d", dma_addr, i);
-				break;
-			}
-		}
+	if (IS_ERR_OR_NULL(dmabuf)) {
+		mtk_v4l2_debug(0, "invalid general fd %d\n", fd);
+		return 0;
 	}
 
-	if (dmabuf)
-		dma_buf_put(dmabuf);
+	dma_addr = mtk_vcodec_dmabuf_cache_dma_addr(&ctx->gen_buf_cache, dmabuf);
+	dma_buf_put(dmabuf);
 
 	return dma_addr;
 }
 
-static int flush_dma_buffer(const struct sg_table *sgt,
-	const struct mtk_vcodec_ctx *ctx, unsigned int size,
-	enum dma_data_direction direction)
-{
-	struct sg_table *sgt_tmp;
-	struct scatterlist *s_sgl, *d_sgl;
-	unsigned int contig_size = 0;
-	int ret, i;
-
-	sgt_tmp = kzalloc(sizeof(*sgt_tmp), GFP_KERNEL);
-	if (!sgt_tmp)
-		return -1;
-
-	ret = sg_alloc_table(sgt_tmp, sgt->orig_nents, GFP_KERNEL);
-	if (ret) {
-		mtk_v4l2_debug(0, "%s sg alloc table failed %d.\n",
-			__func__, ret);
-		kfree(sgt_tmp);
-		return -1;
-	}
-	sgt_tmp->nents = 0;
-	d_sgl = sgt_tmp->sgl;
-
-	for_each_sg(sgt->sgl, s_sgl, sgt->orig_nents, i) {
-		mtk_v4l2_debug(4, "%d contig_size %d bytesused %d.\n",
-			i, contig_size, size);
-		if (contig_size >= size)
-			break;
-		memcpy(d_sgl, s_sgl, sizeof(*s_sgl));
-		contig_size += s_sgl->length;
-		d_sgl = sg_next(d_sgl);
-		sgt_tmp->nents++;
-	}
-	dma_sync_sg_for_device(&ctx->dev->plat_dev->dev,
-		sgt_tmp->sgl,
-		sgt_tmp->nents,
-		direction);
-	mtk_v4l2_debug(4, "flush nents %d total nents %d\n",
-		sgt_tmp->nents, sgt->orig_nents);
-	sg_free_table(sgt_tmp);
-	kfree(sgt_tmp);
-	return 0;
-}
-
 int mtk_vdec_defer_put_fb_job(struct mtk_vcodec_ctx *ctx, int type)
 {
 	int ret = -1;
@@ -878,6 +720,7 @@ static void mtk_vdec_reset_decoder(struct mtk_vcodec_ctx *ctx, bool is_drain,
 	unsigned int src_chg = 0;
 	struct vdec_fb drain_fb;
 	int i, ret = 0;
+	struct mtk_vcodec_dmabuf_entry *entry;
 	struct vb2_v4l2_buffer *dst_vb2_v4l2, *src_vb2_v4l2;
 	struct mtk_video_dec_buf *dstbuf, *srcbuf;
 	struct vb2_queue *dstq, *srcq;
@@ -887,39 +730,15 @@ static void mtk_vdec_reset_decoder(struct mtk_vcodec_ctx *ctx, bool is_drain,
 	if (ctx->input_driven == INPUT_DRIVEN_CB_FRM)
 		wake_up(&ctx->fm_wq);
 
-	for (i = 0; i < MAX_GEN_BUF_CNT; ++i) {
-		if (ctx->dma_buf_list[i].va && ctx->dma_buf_list[i].dmabuf) {
-			int *dma_va = ctx->dma_buf_list[i].va;
-			struct dma_buf *dmabuf = ctx->dma_buf_list[i].dmabuf;
-			struct dma_buf_attachment *buf_att = ctx->dma_buf_list[i].buf_att;
-			struct sg_table *sgt = ctx->dma_buf_list[i].sgt;
-
-			*dma_va = -1;
-
-			dma_buf_unmap_attachment(buf_att, sgt, DMA_TO_DEVICE);
-			dma_buf_detach(dmabuf, buf_att);
-			dma_buf_vunmap(dmabuf, dma_va);
-			dma_buf_end_cpu_access(dmabuf,
-				DMA_TO_DEVICE);
-			dma_buf_put(dmabuf);
-		}
-	}
-	memset(ctx->dma_buf_list, 0,
-		sizeof(struct dma_gen_buf) * MAX_GEN_BUF_CNT);
-
-	for (i = 0; i < MAX_META_BUF_CNT; ++i) {
-		if (ctx->dma_meta_list[i].dmabuf) {
-			struct dma_buf *dmabuf = ctx->dma_meta_list[i].dmabuf;
-			struct dma_buf_attachment *buf_att = ctx->dma_meta_list[i].buf_att;
-			struct sg_table *sgt = ctx->dma_meta_list[i].sgt;
-
-			dma_buf_unmap_attachment(buf_att, sgt, DMA_TO_DEVICE);
-			dma_buf_detach(dmabuf, buf_att);
-			dma_buf_put(dmabuf);
-		}
+	/* no fence will be signalled for the buffers being dropped */
+	mutex_lock(&ctx->gen_buf_cache.lock);
+	list_for_each_entry(entry, &ctx->gen_buf_cache.lru, lru) {
+		if (entry->va)
+			*(int *)entry->va = -1;
 	}
-	memset(ctx->dma_meta_list, 0,
-		sizeof(struct dma_meta_buf) * MAX_META_BUF_CNT);
+	mutex_unlock(&ctx->gen_buf_cache.lock);
+	mtk_vcodec_dmabuf_cache_flush(&ctx->gen_buf_cache);
+	mtk_vcodec_dmabuf_cache_flush(&ctx->meta_buf_cache);
 	mutex_unlock(&ctx->gen_buf_va_lock);
 
 	if (is_drain) {
@@ -1560,6 +1379,91 @@ static int vidioc_decoder_cmd(struct file *file, void *priv,
 	return 0;
 }
 
+/*
+ * LAT and CORE are arbitrated independently, so one context can parse on
+ * LAT while another reconstructs on CORE. Each core has its own queue:
+ * realtime contexts are served before best-effort ones, and within a
+ * class the context that has used the core least goes first.
+ */
+static bool mtk_vdec_sched_before(struct mtk_vdec_sched_entity *a,
+	struct mtk_vdec_sched_entity *b)
+{
+	if (a->background != b->background)
+		return !a->background;
+	return a->vruntime < b->vruntime;
+}
+
+static bool mtk_vdec_sched_acquire(struct mtk_vcodec_ctx *ctx,
+	struct mtk_vdec_sched_core *core, struct mtk_vdec_sched_entity *se)
+{
+	struct mtk_vdec_sched_entity *pos;
+	bool granted = false;
+
+	spin_lock(&core->lock);
+	if (core->owner)
+		goto out;
+	list_for_each_entry(pos, &core->waiters, node) {
+		if (pos != se && mtk_vdec_sched_before(pos, se))
+			goto out;
+	}
+	list_del_init(&se->node);
+	core->owner = ctx;
+	granted = true;
+out:
+	spin_unlock(&core->lock);
+
+	return granted;
+}
+
+static void mtk_vdec_sched_wait(struct mtk_vcodec_ctx *ctx, u32 hw_id)
+{
+	struct mtk_vdec_sched_core *core = &ctx->dev->dec_sched[hw_id];
+	struct mtk_vdec_sched_entity *se = &ctx->dec_sched[hw_id];
+	u64 wait_ns;
+
+	spin_lock(&core->lock);
+	se->background = ctx->dec_params.priority == 1;
+	/* an idle context must not bank credit against busy ones */
+	se->vruntime = max(se->vruntime, core->min_vruntime);
+	se->wait_start = ktime_get();
+	list_add_tail(&se->node, &core->waiters);
+	spin_unlock(&core->lock);
+
+	wait_event(core->wq, mtk_vdec_sched_acquire(ctx, core, se));
+
+	se->run_start = ktime_get();
+	wait_ns = ktime_to_ns(ktime_sub(se->run_start, se->wait_start));
+	se->wait_ns += wait_ns;
+	se->wait_max_ns = max(se->wait_max_ns, wait_ns);
+	se->runs++;
+}
+
+static void mtk_vdec_sched_release(struct mtk_vcodec_ctx *ctx, u32 hw_id)
+{
+	struct mtk_vdec_sched_core *core = &ctx->dev->dec_sched[hw_id];
+	struct mtk_vdec_sched_entity *se = &ctx->dec_sched[hw_id];
+	struct mtk_vdec_sched_entity *pos;
+	u64 busy_ns, min_vruntime;
+
+	spin_lock(&core->lock);
+	if (core->owner != ctx) {
+		spin_unlock(&core->lock);
+		return;
+	}
+	busy_ns = ktime_to_ns(ktime_sub(ktime_get(), se->run_start));
+	se->busy_ns += busy_ns;
+	se->vruntime += busy_ns;
+	core->owner = NULL;
+
+	min_vruntime = se->vruntime;
+	list_for_each_entry(pos, &core->waiters, node)
+		min_vruntime = min(min_vruntime, pos->vruntime);
+	core->min_vruntime = max(core->min_vruntime, min_vruntime);
+	spin_unlock(&core->lock);
+
+	wake_up_all(&core->wq);
+}
+
 void mtk_vdec_unlock(struct mtk_vcodec_ctx *ctx, u32 hw_id)
 {
 	if (hw_id >= MTK_VDEC_HW_NUM)
@@ -1571,6 +1475,7 @@ void mtk_vdec_unlock(struct mtk_vcodec_ctx *ctx, u32 hw_id)
 	if (hw_id < MTK_VDEC_HW_NUM) {
 		ctx->hw_locked[hw_id] = 0;
 		up(&ctx->dev->dec_sem[hw_id]);
+		mtk_vdec_sched_release(ctx, hw_id);
 	}
 }
 
@@ -1584,6 +1489,7 @@ int mtk_vdec_lock(struct mtk_vcodec_ctx *ctx, u32 hw_id)
 	mtk_v4l2_debug(4, "ctx %p [%d] hw_id %d sem_cnt %d",
 		ctx, ctx->id, hw_id, ctx->dev->dec_sem[hw_id].count);
 
+	mtk_vdec_sched_wait(ctx, hw_id);
 	while (hw_id < MTK_VDEC_HW_NUM && ret != 0)
 		ret = down_interruptible(&ctx->dev->dec_sem[hw_id]);
 
@@ -1926,13 +1832,13 @@ static int vidioc_vdec_qbuf(struct file *file, void *priv,
 				buf->length, mtkbuf,
 				buf->reserved, mtkbuf->general_user_fd);
 		mutex_lock(&ctx->gen_buf_va_lock);
+		put_general_buffer_va(ctx, mtkbuf);
 		mtkbuf->general_dma_va = NULL;
 		if (mtkbuf->general_user_fd != -1) {
 			// NOTE: all codec should use a common struct
 			//to save dma_va, fencefd should be
 			//the 1st member in struct of general buffer
-			general_buf_va = get_general_buffer_va(ctx,
-				mtkbuf->general_user_fd);
+			general_buf_va = get_general_buffer_va(ctx, mtkbuf);
 			pFenceFd = general_buf_va;
 			if (general_buf_va != NULL && *pFenceFd == 1 &&
 				ctx->dec_params.svp_mode == 0) {
@@ -2024,6 +1930,7 @@ static int vidioc_vdec_dqbuf(struct file *file, void *priv,
 
 			mutex_lock(&ctx->gen_buf_va_lock);
 			if (ctx->state == MTK_STATE_FLUSH) {
+				put_general_buffer_va(ctx, mtkbuf);
 				mutex_unlock(&ctx->gen_buf_va_lock);
 				mtk_v4l2_debug(2, "invalid dma_va %p!\n",
 					dma_va);
@@ -2047,6 +1954,9 @@ static int vidioc_vdec_dqbuf(struct file *file, void *priv,
 			mutex_unlock(&ctx->gen_buf_va_lock);
 		}
 		#endif
+		mutex_lock(&ctx->gen_buf_va_lock);
+		put_general_buffer_va(ctx, mtkbuf);
+		mutex_unlock(&ctx->gen_buf_va_lock);
 	}
 
 	return ret;
@@ -2685,10 +2595,17 @@ static int vb2ops_vdec_buf_prepare(struct vb2_buffer *vb)
 		if (vb->vb2_queue->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
 			struct mtk_vcodec_mem src_mem;
 			struct vb2_dc_buf *dc_buf = vb->planes[0].mem_priv;
+			ktime_t start = 0;
+
 			mtk_v4l2_debug(4, "[%d] Cache sync+", ctx->id);
+			if (mtk_vcodec_perf)
+				start = ktime_get();
 
-			flush_dma_buffer(dc_buf->dma_sgt, ctx, vb->planes[0].bytesused,
-				DMA_TO_DEVICE);
+			mtk_dma_sync_sg_range(dc_buf->dma_sgt,
+				&ctx->dev->plat_dev->dev,
+				vb->planes[0].bytesused, DMA_TO_DEVICE);
+			if (mtk_vcodec_perf)
+				mtk_vcodec_perf_frame_done(ctx, start);
 
 			src_mem.dma_addr = vb2_dma_contig_plane_dma_addr(vb, 0);
 			src_mem.size = (size_t)vb->planes[0].bytesused;
@@ -3052,6 +2969,9 @@ static void vb2ops_vdec_buf_finish(struct vb2_buffer *vb)
 	vb2_v4l2 = container_of(vb, struct vb2_v4l2_buffer, vb2_buf);
 	mtkbuf = container_of(vb2_v4l2, struct mtk_video_dec_buf, vb);
 	if (mtkbuf->frame_buffer.dma_general_buf != 0) {
+		if (mtkbuf->frame_buffer.dma_general_addr)
+			mtk_vcodec_dmabuf_cache_unpin(&ctx->gen_buf_cache,
+				mtkbuf->frame_buffer.dma_general_buf);
 		dma_buf_put(mtkbuf->frame_buffer.dma_general_buf);
 		mtkbuf->frame_buffer.dma_general_buf = 0;
 		mtk_v4l2_debug(4,
@@ -3061,6 +2981,9 @@ static void vb2ops_vdec_buf_finish(struct vb2_buffer *vb)
 		(unsigned long)mtkbuf->frame_buffer.dma_general_addr);
 	}
 	if (mtkbuf->frame_buffer.dma_meta_buf != 0) {
+		if (mtkbuf->frame_buffer.dma_meta_addr)
+			mtk_vcodec_dmabuf_cache_unpin(&ctx->meta_buf_cache,
+				mtkbuf->frame_buffer.dma_meta_buf);
 		dma_buf_put(mtkbuf->frame_buffer.dma_meta_buf);
 		mtkbuf->frame_buffer.dma_meta_buf = 0;
 		mtk_v4l2_debug(4,
@@ -3107,6 +3030,12 @@ static void vb2ops_vdec_buf_cleanup(struct vb2_buffer *vb)
 		struct mtk_video_dec_buf, vb);
 
 	ctx = vb2_get_drv_priv(vb->vb2_queue);
+	if (vb->vb2_queue->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		/* queued but never dequeued, the fence va is not needed */
+		mutex_lock(&ctx->gen_buf_va_lock);
+		put_general_buffer_va(ctx, buf);
+		mutex_unlock(&ctx->gen_buf_va_lock);
+	}
 	if (vb->vb2_queue->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE &&
 		!vb2_is_streaming(vb->vb2_queue)) {
 		mutex_lock(&ctx->buf_lock);
@@ -65,6 +65,7 @@ struct mtk_video_dec_buf {
 	int     flags;
 	int     general_user_fd;
 	int     *general_dma_va;
+	struct dma_buf *general_va_buf;
 	int     meta_user_fd;
 	int vpeek;
 };
@@ -19,6 +19,8 @@
 #include <linux/delay.h>
 #include <linux/suspend.h>
 #include <linux/pm_runtime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "mtk_vcodec_dec_pm.h"
 #include "mtk_vcodec_dec_pm_plat.h"
@@ -174,10 +176,10 @@ static int fops_vcodec_open(struct file *file)
 	if (ctx->p_timeline_obj != NULL)
 		ctx->fence_idx = ctx->p_timeline_obj->value + 1;
 #endif
-	memset(ctx->dma_buf_list, 0,
-		sizeof(struct dma_gen_buf) * MAX_GEN_BUF_CNT);
-	memset(ctx->dma_meta_list, 0,
-		sizeof(struct dma_meta_buf) * MAX_META_BUF_CNT);
+	mtk_vcodec_dmabuf_cache_init(&ctx->gen_buf_cache,
+		&dev->plat_dev->dev, DMA_TO_DEVICE, MAX_GEN_BUF_CNT);
+	mtk_vcodec_dmabuf_cache_init(&ctx->meta_buf_cache,
+		&dev->plat_dev->dev, DMA_TO_DEVICE, MAX_META_BUF_CNT);
 	ctx->resched = false;
 	mutex_init(&ctx->resched_lock);
 	return ret;
@@ -205,7 +207,6 @@ static int fops_vcodec_release(struct file *file)
 {
 	struct mtk_vcodec_dev *dev = video_drvdata(file);
 	struct mtk_vcodec_ctx *ctx = fh_to_ctx(file->private_data);
-	int i = 0;
 
 	mtk_v4l2_debug(0, "[%d] decoder", ctx->id);
 	mutex_lock(&dev->dev_mutex);
@@ -238,37 +239,8 @@ static int fops_vcodec_release(struct file *file)
 	if (ctx->p_timeline_obj)
 		timeline_destroy(ctx->p_timeline_obj);
 #endif
-	for (i = 0; i < MAX_GEN_BUF_CNT; ++i) {
-		if (ctx->dma_buf_list[i].va && ctx->dma_buf_list[i].dmabuf) {
-			int *dma_va = ctx->dma_buf_list[i].va;
-			struct dma_buf *dmabuf = ctx->dma_buf_list[i].dmabuf;
-			struct dma_buf_attachment *buf_att = ctx->dma_buf_list[i].buf_att;
-			struct sg_table *sgt = ctx->dma_buf_list[i].sgt;
-
-			dma_buf_unmap_attachment(buf_att, sgt, DMA_TO_DEVICE);
-			dma_buf_detach(dmabuf, buf_att);
-			dma_buf_vunmap(dmabuf, dma_va);
-			dma_buf_end_cpu_access(dmabuf,
-				DMA_TO_DEVICE);
-			dma_buf_put(dmabuf);
-		}
-	}
-	memset(ctx->dma_buf_list, 0,
-		sizeof(struct dma_gen_buf) * MAX_GEN_BUF_CNT);
-
-	for (i = 0; i < MAX_META_BUF_CNT; ++i) {
-		if (ctx->dma_meta_list[i].dmabuf) {
-			struct dma_buf *dmabuf = ctx->dma_meta_list[i].dmabuf;
-			struct dma_buf_attachment *buf_att = ctx->dma_meta_list[i].buf_att;
-			struct sg_table *sgt = ctx->dma_meta_list[i].sgt;
-
-			dma_buf_unmap_attachment(buf_att, sgt, DMA_TO_DEVICE);
-			dma_buf_detach(dmabuf, buf_att);
-			dma_buf_put(dmabuf);
-		}
-	}
-	memset(ctx->dma_meta_list, 0,
-		sizeof(struct dma_meta_buf) * MAX_META_BUF_CNT);
+	mtk_vcodec_dmabuf_cache_release(&ctx->gen_buf_cache);
+	mtk_vcodec_dmabuf_cache_release(&ctx->meta_buf_cache);
 
 	kfree(ctx->dec_flush_buf);
 	kfree(ctx);
@@ -363,6 +335,32 @@ static int mtk_vcodec_dec_suspend_notifier(struct notifier_block *nb,
 	return NOTIFY_DONE;
 }
 
+static int mtk_vdec_sched_show(struct seq_file *m, void *unused)
+{
+	struct mtk_vcodec_dev *dev = m->private;
+	struct mtk_vdec_sched_entity *se;
+	struct mtk_vcodec_ctx *ctx;
+	int i;
+
+	seq_puts(m, "ctx prio core runs busy_us avg_wait_us max_wait_us\n");
+	mutex_lock(&dev->ctx_mutex);
+	list_for_each_entry(ctx, &dev->ctx_list, list) {
+		for (i = 0; i < MTK_VDEC_HW_NUM; i++) {
+			se = &ctx->dec_sched[i];
+			seq_printf(m, "%d %d %d %u %llu %llu %llu\n",
+				ctx->id, ctx->dec_params.priority, i, se->runs,
+				div_u64(se->busy_ns, NSEC_PER_USEC),
+				se->runs ? div_u64(div_u64(se->wait_ns,
+					se->runs), NSEC_PER_USEC) : 0,
+				div_u64(se->wait_max_ns, NSEC_PER_USEC));
+		}
+	}
+	mutex_unlock(&dev->ctx_mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mtk_vdec_sched);
+
 #if IS_ENABLED(CONFIG_MTK_TINYSYS_VCP_SUPPORT)
 extern void vdec_vcp_probe(struct mtk_vcodec_dev *dev);
 #endif
@@ -479,6 +477,9 @@ static int mtk_vcodec_dec_probe(struct platform_device *pdev)
 
 	for (i = 0; i < MTK_VDEC_HW_NUM; i++) {
 		sema_init(&dev->dec_sem[i], 1);
+		spin_lock_init(&dev->dec_sched[i].lock);
+		INIT_LIST_HEAD(&dev->dec_sched[i].waiters);
+		init_waitqueue_head(&dev->dec_sched[i].wq);
 		spin_lock_init(&dev->dec_power_lock[i]);
 		dev->dec_is_power_on[i] = false;
 	}
@@ -603,6 +604,10 @@ static int mtk_vcodec_dec_probe(struct platform_device *pdev)
 	INIT_LIST_HEAD(&dev->prop_param_list);
 	dev_ptr = dev;
 
+	dev->dec_debugfs = debugfs_create_dir(MTK_VCODEC_DEC_NAME, NULL);
+	debugfs_create_file("sched", 0444, dev->dec_debugfs, dev,
+		&mtk_vdec_sched_fops);
+
 	return 0;
 
 err_dec_reg:
@@ -644,6 +649,7 @@ static int mtk_vcodec_dec_remove(struct platform_device *pdev)
 
 	mtk_unprepare_vdec_emi_bw(dev);
 	mtk_unprepare_vdec_dvfs(dev);
+	debugfs_remove_recursive(dev->dec_debugfs);
 
 	flush_workqueue(dev->decode_workqueue);
 	destroy_workqueue(dev->decode_workqueue);
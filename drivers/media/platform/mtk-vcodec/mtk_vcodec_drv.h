@@ -50,8 +50,9 @@
 #define SUSPEND_TIMEOUT_CNT     5000
 #define MTK_MAX_CTRLS_HINT      64
 #define V4L2_BUF_FLAG_OUTPUT_NOT_GENERATED 0x02000000
-#define MAX_GEN_BUF_CNT		32
-#define MAX_META_BUF_CNT		32
+/* one general and one meta buffer per queued frame at most */
+#define MAX_GEN_BUF_CNT		VB2_MAX_FRAME
+#define MAX_META_BUF_CNT		VB2_MAX_FRAME
 
 #define MAX_CODEC_FREQ_STEP	10
 
@@ -418,8 +419,6 @@ struct venc_frm_buf {
 	unsigned int roimap;
 	bool has_meta;
 	struct dma_buf *meta_dma;
-	struct dma_buf_attachment *buf_att;
-	struct sg_table *sgt;
 	dma_addr_t meta_addr;
 	struct dma_buf_attachment *qpmap_dma_att;
 	struct sg_table *qpmap_sgt;
@@ -431,27 +430,10 @@ struct venc_frm_buf {
 	dma_addr_t metabuffer_addr;
 	bool has_dynamic_ctl;
 	struct dma_buf *dynamic_ctl_dma;
-	struct dma_buf_attachment *dynamic_ctl_att;
-	struct sg_table *dynamic_ctl_sgt;
 	dma_addr_t dynamic_ctl_addr;
 	unsigned int dynamic_ctl_fd;
 };
 
-struct dma_gen_buf {
-	void  *va;
-	struct dma_buf *dmabuf;
-	dma_addr_t dma_general_addr;
-	struct dma_buf_attachment *buf_att;
-	struct sg_table *sgt;
-};
-
-struct dma_meta_buf {
-	struct dma_buf *dmabuf;
-	dma_addr_t dma_meta_addr;
-	struct dma_buf_attachment *buf_att;
-	struct sg_table *sgt;
-};
-
 enum metadata_type {
 	METADATA_HDR               = 0,
 	METADATA_QPMAP             = 1
@@ -469,6 +451,46 @@ struct metadata_info {
 	struct meta_describe metadata_dsc[MTK_MAX_METADATA_NUM];
 };
 
+/**
+ * struct mtk_vdec_sched_entity - a context's place in one decoder core queue
+ * @node: link in mtk_vdec_sched_core.waiters while waiting
+ * @background: context asked for best-effort priority
+ * @vruntime: hardware time consumed on the core, the fairness key
+ * @wait_start: when the context started waiting for the core
+ * @run_start: when the context was granted the core
+ * @wait_ns: total time spent waiting for the core
+ * @wait_max_ns: longest single wait for the core
+ * @busy_ns: total time the core was held
+ * @runs: number of times the core was granted
+ */
+struct mtk_vdec_sched_entity {
+	struct list_head node;
+	bool background;
+	u64 vruntime;
+	ktime_t wait_start;
+	ktime_t run_start;
+	u64 wait_ns;
+	u64 wait_max_ns;
+	u64 busy_ns;
+	unsigned int runs;
+};
+
+/**
+ * struct mtk_vdec_sched_core - arbitration of one decoder hardware core
+ * @lock: protects the fields below and the queued entities
+ * @waiters: contexts waiting for the core
+ * @wq: woken whenever the core is released
+ * @owner: context holding the core
+ * @min_vruntime: floor applied to contexts joining the queue
+ */
+struct mtk_vdec_sched_core {
+	spinlock_t lock;
+	struct list_head waiters;
+	wait_queue_head_t wq;
+	struct mtk_vcodec_ctx *owner;
+	u64 min_vruntime;
+};
+
 /**
  * struct mtk_vcodec_ctx - Context (instance) private data.
  *
@@ -568,6 +590,7 @@ struct mtk_vcodec_ctx {
 	/* for user lock HW case release check */
 	struct mutex hw_status;
 	int hw_locked[MTK_VDEC_HW_NUM];
+	struct mtk_vdec_sched_entity dec_sched[MTK_VDEC_HW_NUM];
 	int core_locked[MTK_VENC_HW_NUM];
 	int async_mode;
 	int oal_vcodec;
@@ -594,8 +617,9 @@ struct mtk_vcodec_ctx {
 	bool use_fence;
 	int fence_idx;
 	unsigned int slbc_addr;
-	struct dma_gen_buf dma_buf_list[MAX_GEN_BUF_CNT];
-	struct dma_meta_buf dma_meta_list[MAX_META_BUF_CNT];
+	struct mtk_vcodec_dmabuf_cache gen_buf_cache;
+	struct mtk_vcodec_dmabuf_cache meta_buf_cache;
+	struct mtk_vcodec_perf_stat bs_perf;
 	struct mutex gen_buf_va_lock;
 	/*
 	 * need resched or not
@@ -647,6 +671,8 @@ struct venc_larb_port {
  * @enc_lt_irq: vp8 encoder irq resource
  *
  * @dec_sem: decoder hw lock. Use sem for gce different thread lock unlock
+ * @dec_sched: per decoder core queues deciding which context gets @dec_sem
+ * @dec_debugfs: decoder debugfs directory
  * @enc_sem: encoder hw lock. Use sem for gce different thread lock unlock
  *
  * @pm: power management control
@@ -698,6 +724,8 @@ struct mtk_vcodec_dev {
 	int enc_lt_irq;
 
 	struct semaphore dec_sem[MTK_VDEC_HW_NUM];
+	struct mtk_vdec_sched_core dec_sched[MTK_VDEC_HW_NUM];
+	struct dentry *dec_debugfs;
 	struct semaphore enc_sem[MTK_VENC_HW_NUM];
 
 	struct mutex dec_dvfs_mutex;
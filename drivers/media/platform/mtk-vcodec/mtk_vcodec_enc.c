@@ -1630,17 +1630,13 @@ static int vidioc_venc_qbuf(struct file *file, void *priv,
 			return -EINVAL;
 		}
 
-		mtkbuf->frm_buf.buf_att = dma_buf_attach(mtkbuf->frm_buf.meta_dma,
-			&ctx->dev->plat_dev->dev);
-		mtkbuf->frm_buf.sgt = dma_buf_map_attachment(mtkbuf->frm_buf.buf_att,
-			DMA_TO_DEVICE);
-		if (IS_ERR_OR_NULL(mtkbuf->frm_buf.sgt)) {
-			mtk_v4l2_err("dma_buf_map_attachment fail %d.\n",
-				mtkbuf->frm_buf.sgt);
-			dma_buf_detach(mtkbuf->frm_buf.meta_dma, mtkbuf->frm_buf.buf_att);
+		mtkbuf->frm_buf.meta_addr = mtk_vcodec_dmabuf_cache_dma_addr(
+			&ctx->meta_buf_cache, mtkbuf->frm_buf.meta_dma);
+		if (!mtkbuf->frm_buf.meta_addr) {
+			dma_buf_put(mtkbuf->frm_buf.meta_dma);
+			mtkbuf->frm_buf.meta_dma = 0;
 			return -EINVAL;
 		}
-		mtkbuf->frm_buf.meta_addr = sg_dma_address(mtkbuf->frm_buf.sgt->sgl);
 
 		mtk_v4l2_debug(1, "[%d] Have HDR info meta fd, buf->index:%d. mtkbuf:%p, fd:%u",
 			ctx->id, buf->index, mtkbuf, buf->reserved);
@@ -1688,19 +1684,13 @@ static int vidioc_venc_qbuf(struct file *file, void *priv,
 			return -EINVAL;
 		}
 
-		mtkbuf->frm_buf.dynamic_ctl_att =
-			dma_buf_attach(mtkbuf->frm_buf.dynamic_ctl_dma, &ctx->dev->plat_dev->dev);
-		mtkbuf->frm_buf.dynamic_ctl_sgt =
-			dma_buf_map_attachment(mtkbuf->frm_buf.dynamic_ctl_att, DMA_TO_DEVICE);
-		if (IS_ERR_OR_NULL(mtkbuf->frm_buf.dynamic_ctl_sgt)) {
-			mtk_v4l2_err("dma_buf_map_attachment fail %d.\n",
-				mtkbuf->frm_buf.dynamic_ctl_sgt);
-			dma_buf_detach(mtkbuf->frm_buf.dynamic_ctl_dma,
-				mtkbuf->frm_buf.dynamic_ctl_att);
+		mtkbuf->frm_buf.dynamic_ctl_addr = mtk_vcodec_dmabuf_cache_dma_addr(
+			&ctx->meta_buf_cache, mtkbuf->frm_buf.dynamic_ctl_dma);
+		if (!mtkbuf->frm_buf.dynamic_ctl_addr) {
+			dma_buf_put(mtkbuf->frm_buf.dynamic_ctl_dma);
+			mtkbuf->frm_buf.dynamic_ctl_dma = 0;
 			return -EINVAL;
 		}
-		mtkbuf->frm_buf.dynamic_ctl_addr =
-			sg_dma_address(mtkbuf->frm_buf.dynamic_ctl_sgt->sgl);
 
 		mtkbuf->frm_buf.has_dynamic_ctl = 1;
 		mtkbuf->frm_buf.dynamic_ctl_fd = buf->reserved2;
@@ -2092,7 +2082,10 @@ static void vb2ops_venc_buf_finish(struct vb2_buffer *vb)
 			struct mtk_vcodec_mem dst_mem;
 			struct dma_buf_attachment *buf_att;
 			struct sg_table *sgt;
+			ktime_t start = 0;
 
+			if (mtk_vcodec_perf)
+				start = ktime_get();
 			buf_att = dma_buf_attach(vb->planes[0].dbuf,
 				&ctx->dev->plat_dev->dev);
 			sgt = dma_buf_map_attachment(buf_att, DMA_FROM_DEVICE);
@@ -2108,6 +2101,8 @@ static void vb2ops_venc_buf_finish(struct vb2_buffer *vb)
 			dst_mem.dma_addr = vb2_dma_contig_plane_dma_addr(vb, 0);
 			dst_mem.size = (size_t)vb->planes[0].bytesused;
 			dma_buf_detach(vb->planes[0].dbuf, buf_att);
+			if (mtk_vcodec_perf)
+				mtk_vcodec_perf_frame_done(ctx, start);
 			mtk_v4l2_debug(4,
 				"[%d] Cache sync FD for %lx sz=%d dev %p",
 				ctx->id,
@@ -2122,9 +2117,8 @@ static void vb2ops_venc_buf_finish(struct vb2_buffer *vb)
 			"dma_buf_put dma_buf=%p, DMA=%lx",
 			mtkbuf->frm_buf.meta_dma,
 			(unsigned long)mtkbuf->frm_buf.meta_addr);
-		dma_buf_unmap_attachment(mtkbuf->frm_buf.buf_att,
-			mtkbuf->frm_buf.sgt, DMA_TO_DEVICE);
-		dma_buf_detach(mtkbuf->frm_buf.meta_dma, mtkbuf->frm_buf.buf_att);
+		mtk_vcodec_dmabuf_cache_unpin(&ctx->meta_buf_cache,
+			mtkbuf->frm_buf.meta_dma);
 		dma_buf_put(mtkbuf->frm_buf.meta_dma);
 		mtkbuf->frm_buf.meta_dma = 0;
 	}
@@ -2157,12 +2151,8 @@ static void vb2ops_venc_buf_finish(struct vb2_buffer *vb)
 			"dma_buf_put dynamic_ctl_dma=%p, DMA=%llx",
 			mtkbuf->frm_buf.dynamic_ctl_dma,
 			(unsigned long long)mtkbuf->frm_buf.dynamic_ctl_addr);
-		if (mtkbuf->frm_buf.dynamic_ctl_sgt != NULL) {
-			dma_buf_unmap_attachment(mtkbuf->frm_buf.dynamic_ctl_att,
-			mtkbuf->frm_buf.dynamic_ctl_sgt, DMA_TO_DEVICE);
-			dma_buf_detach(mtkbuf->frm_buf.dynamic_ctl_dma,
-				mtkbuf->frm_buf.dynamic_ctl_att);
-		}
+		mtk_vcodec_dmabuf_cache_unpin(&ctx->meta_buf_cache,
+			mtkbuf->frm_buf.dynamic_ctl_dma);
 		dma_buf_put(mtkbuf->frm_buf.dynamic_ctl_dma);
 		mtkbuf->frm_buf.dynamic_ctl_dma = 0;
 	}
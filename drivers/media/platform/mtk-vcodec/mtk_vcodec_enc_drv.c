@@ -100,6 +100,8 @@ static int fops_vcodec_open(struct file *file)
 	mutex_init(&ctx->worker_lock);
 	mutex_init(&ctx->hw_status);
 	mutex_init(&ctx->q_mutex);
+	mtk_vcodec_dmabuf_cache_init(&ctx->meta_buf_cache,
+		&dev->plat_dev->dev, DMA_TO_DEVICE, MAX_META_BUF_CNT);
 
 	ctx->type = MTK_INST_ENCODER;
 	ret = mtk_vcodec_enc_ctrls_setup(ctx);
@@ -185,6 +187,7 @@ static int fops_vcodec_release(struct file *file)
 	v4l2_fh_del(&ctx->fh);
 	v4l2_fh_exit(&ctx->fh);
 	v4l2_ctrl_handler_free(&ctx->ctrl_hdl);
+	mtk_vcodec_dmabuf_cache_release(&ctx->meta_buf_cache);
 
 	kfree(ctx->enc_flush_buf);
 	kfree(ctx);
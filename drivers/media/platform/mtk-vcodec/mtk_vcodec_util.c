@@ -9,6 +9,7 @@
 #include <linux/module.h>
 #include <media/v4l2-mem2mem.h>
 #include <media/videobuf2-dma-contig.h>
+#include <linux/dma-buf.h>
 #include <linux/dma-heap.h>
 #include <linux/dma-direction.h>
 #include <uapi/linux/dma-heap.h>
@@ -356,55 +357,288 @@ void v4l2_m2m_buf_queue_check(struct v4l2_m2m_ctx *m2m_ctx,
 }
 EXPORT_SYMBOL_GPL(v4l2_m2m_buf_queue_check);
 
+/*
+ * Sync the leading entries of an already mapped table that cover @size
+ * bytes. The table is used in place; small bitstreams typically touch a
+ * single entry instead of the whole buffer.
+ */
 int mtk_dma_sync_sg_range(const struct sg_table *sgt,
 	struct device *dev, unsigned int size,
 	enum dma_data_direction direction)
 {
-	struct sg_table *sgt_tmp;
-	struct scatterlist *s_sgl, *d_sgl;
+	struct scatterlist *s;
 	unsigned int contig_size = 0;
-	int ret, i;
-
-	sgt_tmp = kzalloc(sizeof(*sgt_tmp), GFP_KERNEL);
-	if (!sgt_tmp)
-		return -1;
-
-	ret = sg_alloc_table(sgt_tmp, sgt->orig_nents, GFP_KERNEL);
-	if (ret) {
-		mtk_v4l2_debug(0, "sg alloc table failed %d.\n", ret);
-		kfree(sgt_tmp);
-		return -1;
-	}
-	sgt_tmp->nents = 0;
-	d_sgl = sgt_tmp->sgl;
+	int nents = 0, i;
 
-	for_each_sg(sgt->sgl, s_sgl, sgt->orig_nents, i) {
-		mtk_v4l2_debug(4, "%d contig_size %d bytesused %d.\n",
-			i, contig_size, size);
+	for_each_sg(sgt->sgl, s, sgt->orig_nents, i) {
 		if (contig_size >= size)
 			break;
-		memcpy(d_sgl, s_sgl, sizeof(*s_sgl));
-		contig_size += sg_dma_len(s_sgl);
-		d_sgl = sg_next(d_sgl);
-		sgt_tmp->nents++;
+		contig_size += s->length;
+		nents++;
 	}
+
 	if (direction == DMA_TO_DEVICE) {
-		dma_sync_sg_for_device(dev, sgt_tmp->sgl, sgt_tmp->nents, direction);
+		dma_sync_sg_for_device(dev, sgt->sgl, nents, direction);
 	} else if (direction == DMA_FROM_DEVICE) {
-		dma_sync_sg_for_cpu(dev, sgt_tmp->sgl, sgt_tmp->nents, direction);
+		dma_sync_sg_for_cpu(dev, sgt->sgl, nents, direction);
 	} else {
 		mtk_v4l2_debug(0, "direction %d not correct\n", direction);
 		return -1;
 	}
 	mtk_v4l2_debug(4, "flush nents %d total nents %d\n",
-		sgt_tmp->nents, sgt->orig_nents);
-	sg_free_table(sgt_tmp);
-	kfree(sgt_tmp);
+		nents, sgt->orig_nents);
 
 	return 0;
 }
 EXPORT_SYMBOL(mtk_dma_sync_sg_range);
 
+/*
+ * Benchmark mode (mtk_vcodec_perf): accumulate the per-frame time the
+ * driver spends on bitstream buffer maintenance and report the average
+ * and worst case every MTK_VCODEC_PERF_FRAMES frames.
+ */
+void mtk_vcodec_perf_frame_done(struct mtk_vcodec_ctx *ctx, ktime_t start)
+{
+	struct mtk_vcodec_perf_stat *stat = &ctx->bs_perf;
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	stat->total_ns += ns;
+	if (ns > stat->max_ns)
+		stat->max_ns = ns;
+	if (++stat->frames < MTK_VCODEC_PERF_FRAMES)
+		return;
+
+	mtk_vcodec_perf_log("[%d] %s bs overhead avg %llu ns max %llu ns (%u frames)",
+		ctx->id, ctx->type == MTK_INST_ENCODER ? "enc" : "dec",
+		div_u64(stat->total_ns, stat->frames), stat->max_ns,
+		stat->frames);
+	memset(stat, 0, sizeof(*stat));
+}
+EXPORT_SYMBOL_GPL(mtk_vcodec_perf_frame_done);
+
+void mtk_vcodec_dmabuf_cache_init(struct mtk_vcodec_dmabuf_cache *cache,
+	struct device *dev, enum dma_data_direction dir, unsigned int max)
+{
+	hash_init(cache->hash);
+	INIT_LIST_HEAD(&cache->lru);
+	mutex_init(&cache->lock);
+	cache->dev = dev;
+	cache->dir = dir;
+	cache->count = 0;
+	cache->max = max;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->evictions = 0;
+}
+EXPORT_SYMBOL_GPL(mtk_vcodec_dmabuf_cache_init);
+
+static void mtk_vcodec_dmabuf_entry_free(struct mtk_vcodec_dmabuf_cache *cache,
+	struct mtk_vcodec_dmabuf_entry *entry)
+{
+	if (entry->sgt) {
+		dma_buf_unmap_attachment(entry->att, entry->sgt, cache->dir);
+		dma_buf_detach(entry->dmabuf, entry->att);
+	}
+	if (entry->va) {
+		dma_buf_vunmap(entry->dmabuf, entry->va);
+		dma_buf_end_cpu_access(entry->dmabuf, cache->dir);
+	}
+	hash_del(&entry->node);
+	list_del(&entry->lru);
+	dma_buf_put(entry->dmabuf);
+	kfree(entry);
+	cache->count--;
+}
+
+static struct mtk_vcodec_dmabuf_entry *mtk_vcodec_dmabuf_cache_find(
+	struct mtk_vcodec_dmabuf_cache *cache, struct dma_buf *dmabuf)
+{
+	struct mtk_vcodec_dmabuf_entry *entry;
+
+	hash_for_each_possible(cache->hash, entry, node, (unsigned long)dmabuf) {
+		if (entry->dmabuf == dmabuf)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find or import @dmabuf and make it the most recently used entry.
+ * A new entry only takes a reference; attaching and mapping are left to
+ * the first lookup that needs them. When the cache is full the least
+ * recently used unpinned entry is released, the others may still be
+ * read or written by the hardware. If every entry is pinned the lookup
+ * fails rather than growing the cache.
+ */
+static struct mtk_vcodec_dmabuf_entry *mtk_vcodec_dmabuf_cache_get(
+	struct mtk_vcodec_dmabuf_cache *cache, struct dma_buf *dmabuf)
+{
+	struct mtk_vcodec_dmabuf_entry *entry;
+
+	entry = mtk_vcodec_dmabuf_cache_find(cache, dmabuf);
+	if (entry) {
+		list_move(&entry->lru, &cache->lru);
+		cache->hits++;
+		return entry;
+	}
+
+	cache->misses++;
+	if (cache->count >= cache->max) {
+		list_for_each_entry_reverse(entry, &cache->lru, lru) {
+			if (!entry->pins)
+				break;
+		}
+		if (list_entry_is_head(entry, &cache->lru, lru)) {
+			mtk_v4l2_err("all %u dmabuf entries pinned", cache->count);
+			return NULL;
+		}
+		mtk_v4l2_debug(2, "evict dmabuf %p", entry->dmabuf);
+		mtk_vcodec_dmabuf_entry_free(cache, entry);
+		cache->evictions++;
+	}
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return NULL;
+
+	get_dma_buf(dmabuf);
+	entry->dmabuf = dmabuf;
+	hash_add(cache->hash, &entry->node, (unsigned long)dmabuf);
+	list_add(&entry->lru, &cache->lru);
+	cache->count++;
+
+	return entry;
+}
+
+dma_addr_t mtk_vcodec_dmabuf_cache_dma_addr(
+	struct mtk_vcodec_dmabuf_cache *cache, struct dma_buf *dmabuf)
+{
+	struct mtk_vcodec_dmabuf_entry *entry;
+	struct dma_buf_attachment *att;
+	struct sg_table *sgt;
+	dma_addr_t dma_addr = 0;
+
+	if (IS_ERR_OR_NULL(dmabuf))
+		return 0;
+
+	mutex_lock(&cache->lock);
+	entry = mtk_vcodec_dmabuf_cache_get(cache, dmabuf);
+	if (!entry)
+		goto out;
+
+	if (!entry->sgt) {
+		att = dma_buf_attach(dmabuf, cache->dev);
+		if (IS_ERR(att)) {
+			mtk_v4l2_err("dma_buf_attach fail %ld", PTR_ERR(att));
+			goto out;
+		}
+		sgt = dma_buf_map_attachment(att, cache->dir);
+		if (IS_ERR_OR_NULL(sgt)) {
+			mtk_v4l2_err("dma_buf_map_attachment fail %p", sgt);
+			dma_buf_detach(dmabuf, att);
+			goto out;
+		}
+		entry->att = att;
+		entry->sgt = sgt;
+		entry->dma_addr = sg_dma_address(sgt->sgl);
+		mtk_v4l2_debug(4, "map new, dmabuf:%p, dma_addr:%pad",
+			dmabuf, &entry->dma_addr);
+	}
+	entry->pins++;
+	dma_addr = entry->dma_addr;
+out:
+	mutex_unlock(&cache->lock);
+
+	return dma_addr;
+}
+EXPORT_SYMBOL_GPL(mtk_vcodec_dmabuf_cache_dma_addr);
+
+void *mtk_vcodec_dmabuf_cache_va(struct mtk_vcodec_dmabuf_cache *cache,
+	struct dma_buf *dmabuf)
+{
+	struct mtk_vcodec_dmabuf_entry *entry;
+	void *va = NULL;
+
+	if (IS_ERR_OR_NULL(dmabuf))
+		return NULL;
+
+	mutex_lock(&cache->lock);
+	entry = mtk_vcodec_dmabuf_cache_get(cache, dmabuf);
+	if (!entry)
+		goto out;
+
+	if (!entry->va) {
+		dma_buf_begin_cpu_access(dmabuf, cache->dir);
+		entry->va = dma_buf_vmap(dmabuf);
+		if (!entry->va) {
+			mtk_v4l2_err("dma_buf_vmap fail, dmabuf:%p", dmabuf);
+			dma_buf_end_cpu_access(dmabuf, cache->dir);
+			goto out;
+		}
+		mtk_v4l2_debug(4, "map new va %p, dmabuf:%p", entry->va, dmabuf);
+	}
+	entry->pins++;
+	va = entry->va;
+out:
+	mutex_unlock(&cache->lock);
+
+	return va;
+}
+EXPORT_SYMBOL_GPL(mtk_vcodec_dmabuf_cache_va);
+
+/*
+ * Drop one pin taken by mtk_vcodec_dmabuf_cache_dma_addr() or
+ * mtk_vcodec_dmabuf_cache_va(). The entry stays cached for the next
+ * lookup and becomes a candidate for eviction once unpinned.
+ */
+void mtk_vcodec_dmabuf_cache_unpin(struct mtk_vcodec_dmabuf_cache *cache,
+	struct dma_buf *dmabuf)
+{
+	struct mtk_vcodec_dmabuf_entry *entry;
+
+	if (IS_ERR_OR_NULL(dmabuf))
+		return;
+
+	mutex_lock(&cache->lock);
+	entry = mtk_vcodec_dmabuf_cache_find(cache, dmabuf);
+	if (!WARN_ON(!entry || !entry->pins))
+		entry->pins--;
+	mutex_unlock(&cache->lock);
+}
+EXPORT_SYMBOL_GPL(mtk_vcodec_dmabuf_cache_unpin);
+
+/* Release every entry no buffer holds a pin on. */
+void mtk_vcodec_dmabuf_cache_flush(struct mtk_vcodec_dmabuf_cache *cache)
+{
+	struct mtk_vcodec_dmabuf_entry *entry, *tmp;
+
+	mutex_lock(&cache->lock);
+	list_for_each_entry_safe(entry, tmp, &cache->lru, lru) {
+		if (!entry->pins)
+			mtk_vcodec_dmabuf_entry_free(cache, entry);
+	}
+	mutex_unlock(&cache->lock);
+}
+EXPORT_SYMBOL_GPL(mtk_vcodec_dmabuf_cache_flush);
+
+/*
+ * Release every entry, pinned or not. Only for context teardown, once
+ * the vb2 queues are released and nothing can reach the buffers.
+ */
+void mtk_vcodec_dmabuf_cache_release(struct mtk_vcodec_dmabuf_cache *cache)
+{
+	struct mtk_vcodec_dmabuf_entry *entry, *tmp;
+
+	mutex_lock(&cache->lock);
+	mtk_v4l2_debug(2, "dmabuf cache %u entries, hit %lu miss %lu evict %lu",
+		cache->count, cache->hits, cache->misses, cache->evictions);
+	list_for_each_entry_safe(entry, tmp, &cache->lru, lru)
+		mtk_vcodec_dmabuf_entry_free(cache, entry);
+	mutex_unlock(&cache->lock);
+}
+EXPORT_SYMBOL_GPL(mtk_vcodec_dmabuf_cache_release);
+
 void v4l_fill_mtk_fmtdesc(struct v4l2_fmtdesc *fmt)
 {
 	const char *descr = NULL;
@@ -11,6 +11,10 @@
 #include <aee.h>
 #include <linux/types.h>
 #include <linux/dma-direction.h>
+#include <linux/hashtable.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
 #include <linux/mtk_vcu_controls.h>
 #include "vcodec_ipi_msg.h"
 #include "vcp_helper.h"
@@ -57,6 +61,72 @@ struct mtk_vcodec_mem {
 	__s64 buf_fd;
 };
 
+#define MTK_VCODEC_PERF_FRAMES	256
+
+/**
+ * struct mtk_vcodec_perf_stat  - per-frame driver overhead in benchmark mode
+ * @total_ns	: time accumulated since the last report
+ * @max_ns	: worst frame since the last report
+ * @frames	: frames accounted since the last report
+ */
+struct mtk_vcodec_perf_stat {
+	u64 total_ns;
+	u64 max_ns;
+	unsigned int frames;
+};
+
+#define MTK_VCODEC_DMABUF_HASH_BITS	5
+
+/**
+ * struct mtk_vcodec_dmabuf_entry  - one imported dma-buf
+ * @node	: link in the cache hash table, keyed by @dmabuf
+ * @lru		: link in the cache LRU list, most recent first
+ * @dmabuf	: imported buffer, the entry holds a reference on it
+ * @att		: device attachment, created on first dma address lookup
+ * @sgt		: mapped attachment
+ * @dma_addr	: device address of the first segment
+ * @va		: kernel mapping, created on first va lookup
+ * @pins	: lookups not yet released by their user, a pinned entry is
+ *		  never evicted nor flushed
+ */
+struct mtk_vcodec_dmabuf_entry {
+	struct hlist_node node;
+	struct list_head lru;
+	struct dma_buf *dmabuf;
+	struct dma_buf_attachment *att;
+	struct sg_table *sgt;
+	dma_addr_t dma_addr;
+	void *va;
+	unsigned int pins;
+};
+
+/**
+ * struct mtk_vcodec_dmabuf_cache  - per-context dma-buf import cache
+ * @hash	: entries by struct dma_buf
+ * @lru		: entries in use order, the last unpinned one is evicted
+ *		  when full
+ * @lock	: protects the entries and counters
+ * @dev		: device the buffers are attached to
+ * @dir		: mapping direction
+ * @count	: number of cached entries
+ * @max		: capacity of the cache
+ * @hits	: lookups served from the cache
+ * @misses	: lookups that imported a new buffer
+ * @evictions	: entries dropped to make room
+ */
+struct mtk_vcodec_dmabuf_cache {
+	DECLARE_HASHTABLE(hash, MTK_VCODEC_DMABUF_HASH_BITS);
+	struct list_head lru;
+	struct mutex lock;
+	struct device *dev;
+	enum dma_data_direction dir;
+	unsigned int count;
+	unsigned int max;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+};
+
 /**
  * struct vdec_fb_status  - decoder frame buffer status
  * @FB_ST_INIT        : initial state
@@ -273,6 +343,17 @@ int mtk_dma_sync_sg_range(const struct sg_table *sgt,
 	struct device *dev, unsigned int size,
 	enum dma_data_direction direction);
 void v4l_fill_mtk_fmtdesc(struct v4l2_fmtdesc *fmt);
+void mtk_vcodec_dmabuf_cache_init(struct mtk_vcodec_dmabuf_cache *cache,
+	struct device *dev, enum dma_data_direction dir, unsigned int max);
+dma_addr_t mtk_vcodec_dmabuf_cache_dma_addr(
+	struct mtk_vcodec_dmabuf_cache *cache, struct dma_buf *dmabuf);
+void *mtk_vcodec_dmabuf_cache_va(struct mtk_vcodec_dmabuf_cache *cache,
+	struct dma_buf *dmabuf);
+void mtk_vcodec_dmabuf_cache_unpin(struct mtk_vcodec_dmabuf_cache *cache,
+	struct dma_buf *dmabuf);
+void mtk_vcodec_dmabuf_cache_flush(struct mtk_vcodec_dmabuf_cache *cache);
+void mtk_vcodec_dmabuf_cache_release(struct mtk_vcodec_dmabuf_cache *cache);
+void mtk_vcodec_perf_frame_done(struct mtk_vcodec_ctx *ctx, ktime_t start);
 
 #if IS_ENABLED(CONFIG_MTK_TINYSYS_VCP_SUPPORT)
 int mtk_vcodec_alloc_mem(struct vcodec_mem_obj *mem, struct device *dev,
@@ -19,6 +19,7 @@
 #include <linux/dma-fence.h>
 #include <linux/hashtable.h>
 #include <linux/genalloc.h>
+#include <linux/idr.h>
 
 #include "apusys_core.h"
 #include "apusys_device.h"
@@ -104,6 +105,7 @@ struct mdw_mem {
 	struct list_head u_item; //to mpriv
 	struct list_head d_node; //to mdev
 	struct list_head p_chunk; //to mem pool
+	struct mdw_mem *chunk; //chunk of pool entry
 	struct mutex mtx;
 	void (*release)(struct mdw_mem *m);
 };
@@ -111,6 +113,20 @@ struct mdw_mem {
 /* default chunk size of memory pool */
 #define MDW_MEM_POOL_CHUNK_SIZE (4*1024*1024)
 
+/* size classes of memory pool slabs: 256B ~ 32KB */
+#define MDW_MEM_POOL_SLAB_MIN_SHIFT (8)
+#define MDW_MEM_POOL_SLAB_NUM (8)
+#define MDW_MEM_POOL_SLAB_MAX_SIZE \
+	(1U << (MDW_MEM_POOL_SLAB_MIN_SHIFT + MDW_MEM_POOL_SLAB_NUM - 1))
+
+struct mdw_mem_pool_slab {
+	uint32_t size;
+	/* list of free entries, linked by d_node */
+	struct list_head free;
+	uint32_t nr_free;
+	uint32_t nr_total;
+};
+
 struct mdw_mem_pool {
 	struct mdw_fpriv *mpriv;
 	/* pool attribute */
@@ -125,6 +141,9 @@ struct mdw_mem_pool {
 	struct list_head m_chunks;
 	/* list of allocated memories from gp */
 	struct list_head m_list;
+	/* size-class slabs and the gp blocks backing them */
+	struct mdw_mem_pool_slab slabs[MDW_MEM_POOL_SLAB_NUM];
+	struct list_head m_blocks;
 	/* ref count for cmd/mem */
 	struct kref m_ref;
 	void (*get)(struct mdw_mem_pool *pool);
@@ -224,6 +243,7 @@ struct mdw_fpriv {
 	struct list_head mems;
 	struct list_head invokes;
 	struct list_head cmds;
+	struct idr cmd_preps;
 	struct mutex mtx;
 	struct mdw_mem_pool cmd_buf_pool;
 
@@ -291,6 +311,16 @@ struct mdw_cmd {
 	struct mdw_fence *fence;
 	struct work_struct t_wk;
 	struct dma_fence *wait_fence;
+
+	struct mdw_cmd_prep *prep;
+};
+
+/* prepared cmd, validated once and run many times */
+struct mdw_cmd_prep {
+	int id;
+	struct mdw_cmd *tmpl; //validated cmd with resolved cmdbufs
+	atomic_t running;
+	struct kref ref;
 };
 
 struct mdw_dev_func {
@@ -338,6 +368,8 @@ int mdw_cmd_ioctl(struct mdw_fpriv *mpriv, void *data);
 int mdw_util_ioctl(struct mdw_fpriv *mpriv, void *data);
 
 void mdw_cmd_mpriv_release(struct mdw_fpriv *mpriv);
+void mdw_cmd_prep_mpriv_release(struct mdw_fpriv *mpriv);
+int mdw_cmd_submit_stat_show(char *buf, int size);
 void mdw_mem_mpriv_release(struct mdw_fpriv *mpriv);
 
 void mdw_mem_all_print(struct mdw_fpriv *mpriv);
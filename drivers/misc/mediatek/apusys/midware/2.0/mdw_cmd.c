@@ -23,6 +23,44 @@
 	c->num_cmdbufs, c->size_cmdbufs, \
 	c->pid, c->tgid, current->pid)
 
+enum {
+	MDW_CMD_SUBMIT_RUN,
+	MDW_CMD_SUBMIT_PREPARED,
+
+	MDW_CMD_SUBMIT_MAX,
+};
+
+/* time spent building cmds before they are run, per submit path */
+static struct mdw_cmd_submit_stat {
+	atomic64_t cnt;
+	atomic64_t ns;
+} g_submit_stat[MDW_CMD_SUBMIT_MAX];
+
+static void mdw_cmd_submit_stat_add(int type, uint64_t start_ts)
+{
+	atomic64_inc(&g_submit_stat[type].cnt);
+	atomic64_add(sched_clock() - start_ts, &g_submit_stat[type].ns);
+}
+
+int mdw_cmd_submit_stat_show(char *buf, int size)
+{
+	static const char * const names[MDW_CMD_SUBMIT_MAX] = {
+		"run", "prepared",
+	};
+	int64_t cnt = 0, ns = 0;
+	int n = 0, i = 0;
+
+	for (i = 0; i < MDW_CMD_SUBMIT_MAX; i++) {
+		cnt = atomic64_read(&g_submit_stat[i].cnt);
+		ns = atomic64_read(&g_submit_stat[i].ns);
+		n += scnprintf(buf + n, size - n,
+			"%-8s cmds(%lld) avg(%lldns)\n", names[i], cnt,
+			cnt ? div64_s64(ns, cnt) : 0);
+	}
+
+	return n;
+}
+
 static void mdw_cmd_put_cmdbufs(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
 {
 	struct mdw_subcmd_kinfo *ksubcmd = NULL;
@@ -50,8 +88,9 @@ static void mdw_cmd_put_cmdbufs(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
 			mdw_trace_begin("cbs copy out|sc(0x%llx-%u) cb-#%u/%u",
 				c->kid, i, j, ksubcmd->ori_cbs[j]->size);
 
-			/* cmdbuf copy out */
-			if (ksubcmd->cmdbufs[j].direction != MDW_CB_IN) {
+			/* cmdbuf copy out, if it was duplicated */
+			if (ksubcmd->cmdbufs[j].direction != MDW_CB_IN &&
+				ksubcmd->kvaddrs[j]) {
 				memcpy(ksubcmd->ori_cbs[j]->vaddr,
 					(void *)ksubcmd->kvaddrs[j],
 					ksubcmd->ori_cbs[j]->size);
@@ -74,6 +113,30 @@ static void mdw_cmd_put_cmdbufs(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
 		c->kid, c->num_subcmds, c->num_cmdbufs);
 }
 
+static struct mdw_mem *mdw_cmd_get_cmdbuf(struct mdw_fpriv *mpriv,
+	struct mdw_cmd *c, unsigned int i, unsigned int j)
+{
+	struct mdw_subcmd_cmdbuf *cb = &c->ksubcmds[i].cmdbufs[j];
+	struct mdw_mem *m = NULL;
+
+	/* get mem from handle */
+	m = mdw_mem_get(mpriv, cb->handle);
+	if (!m) {
+		mdw_drv_err("sc(0x%llx-%u) cb#%u(%llu) get fail\n",
+			c->kid, i, j, cb->handle);
+		return NULL;
+	}
+	/* check mem boundary */
+	if (m->vaddr == NULL || cb->size != m->size) {
+		mdw_drv_err("sc(0x%llx-%u) cb#%u invalid range(%p/%u/%u)\n",
+			c->kid, i, j, m->vaddr, cb->size, m->size);
+		mdw_mem_put(mpriv, m);
+		return NULL;
+	}
+
+	return m;
+}
+
 static int mdw_cmd_get_cmdbufs(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
 {
 	unsigned int i = 0, j = 0, ofs = 0;
@@ -117,23 +180,12 @@ static int mdw_cmd_get_cmdbufs(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
 			mdw_cmd_debug("sc(0x%llx-%u) cb#%u offset(%u)\n",
 				c->kid, i, j, ofs);
 
-			/* get mem from handle */
-			m = mdw_mem_get(mpriv, ksubcmd->cmdbufs[j].handle);
-			if (!m) {
-				mdw_drv_err("sc(0x%llx-%u) cb#%u(%llu) get fail\n",
-					c->kid, i, j,
-					ksubcmd->cmdbufs[j].handle);
-				goto free_cmdbufs;
-			}
-			/* check mem boundary */
-			if (m->vaddr == NULL ||
-				ksubcmd->cmdbufs[j].size != m->size) {
-				mdw_drv_err("sc(0x%llx-%u) cb#%u invalid range(%p/%u/%u)\n",
-					c->kid, i, j, m->vaddr,
-					ksubcmd->cmdbufs[j].size,
-					m->size);
+			/* prepared cmds come with their mems resolved */
+			m = ksubcmd->ori_cbs[j];
+			if (!m)
+				m = mdw_cmd_get_cmdbuf(mpriv, c, i, j);
+			if (!m)
 				goto free_cmdbufs;
-			}
 
 			mdw_trace_begin("cbs copy in|sc(0x%llx-%u) cb-#%u/%u",
 				c->kid, i, j,
@@ -192,10 +244,116 @@ out:
 	return ret;
 }
 
+static int mdw_cmd_alloc_ksubcmd(struct mdw_cmd *c, unsigned int i)
+{
+	/* kva for oroginal buffer */
+	c->ksubcmds[i].ori_cbs = kcalloc(c->subcmds[i].num_cmdbufs,
+		sizeof(c->ksubcmds[i].ori_cbs), GFP_KERNEL);
+	if (!c->ksubcmds[i].ori_cbs)
+		return -ENOMEM;
+
+	/* record kva for duplicate */
+	c->ksubcmds[i].kvaddrs = kcalloc(c->subcmds[i].num_cmdbufs,
+		sizeof(*c->ksubcmds[i].kvaddrs), GFP_KERNEL);
+	if (!c->ksubcmds[i].kvaddrs)
+		return -ENOMEM;
+
+	/* record dva for cmdbufs */
+	c->ksubcmds[i].daddrs = kcalloc(c->subcmds[i].num_cmdbufs,
+		sizeof(*c->ksubcmds[i].daddrs), GFP_KERNEL);
+	if (!c->ksubcmds[i].daddrs)
+		return -ENOMEM;
+
+	/* allocate for subcmd cmdbuf */
+	c->ksubcmds[i].cmdbufs = kcalloc(c->subcmds[i].num_cmdbufs,
+		sizeof(*c->ksubcmds[i].cmdbufs), GFP_KERNEL);
+	if (!c->ksubcmds[i].cmdbufs)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void mdw_cmd_free_ksubcmds(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
+{
+	unsigned int i = 0, j = 0;
+
+	for (i = 0; i < c->num_subcmds; i++) {
+		/* put mems still resolved, e.g. by a prepared cmd */
+		for (j = 0; c->ksubcmds[i].ori_cbs &&
+			j < c->subcmds[i].num_cmdbufs; j++) {
+			if (c->ksubcmds[i].ori_cbs[j])
+				mdw_mem_put(mpriv, c->ksubcmds[i].ori_cbs[j]);
+		}
+
+		/* free dvaddrs */
+		kfree(c->ksubcmds[i].daddrs);
+		c->ksubcmds[i].daddrs = NULL;
+
+		/* free kvaddrs */
+		kfree(c->ksubcmds[i].kvaddrs);
+		c->ksubcmds[i].kvaddrs = NULL;
+
+		/* free ori kvas */
+		kfree(c->ksubcmds[i].ori_cbs);
+		c->ksubcmds[i].ori_cbs = NULL;
+
+		/* free cmdbufs */
+		kfree(c->ksubcmds[i].cmdbufs);
+		c->ksubcmds[i].cmdbufs = NULL;
+	}
+}
+
+/* copy cmdbuf infos of a subcmd and accumulate their size with alignment */
+static int mdw_cmd_copy_cmdbufs(struct mdw_cmd *c, unsigned int i,
+	unsigned int *total)
+{
+	unsigned int j = 0, total_size = *total, tmp_size = 0;
+
+	/* copy cmdbuf info */
+	if (copy_from_user(c->ksubcmds[i].cmdbufs,
+		(void __user *)c->subcmds[i].cmdbufs,
+		c->subcmds[i].num_cmdbufs *
+		sizeof(*c->ksubcmds[i].cmdbufs))) {
+		return -EINVAL;
+	}
+
+	/* accumulate cmdbuf size with alignment */
+	for (j = 0; j < c->subcmds[i].num_cmdbufs; j++) {
+		c->num_cmdbufs++;
+		/* alignment */
+		if (c->ksubcmds[i].cmdbufs[j].align) {
+			tmp_size = MDW_ALIGN(total_size,
+				c->ksubcmds[i].cmdbufs[j].align);
+		} else {
+			tmp_size = MDW_ALIGN(total_size, MDW_DEFAULT_ALIGN);
+		}
+		if (tmp_size < total_size) {
+			mdw_drv_err("cmdbuf(%u,%u) size align overflow(%u/%u/%u)\n",
+				i, j, total_size,
+				c->ksubcmds[i].cmdbufs[j].align, tmp_size);
+			return -EINVAL;
+		}
+		total_size = tmp_size;
+
+		/* accumulator */
+		tmp_size = total_size + c->ksubcmds[i].cmdbufs[j].size;
+		if (tmp_size < total_size) {
+			mdw_drv_err("cmdbuf(%u,%u) size overflow(%u/%u/%u)\n",
+				i, j, total_size,
+				c->ksubcmds[i].cmdbufs[j].size, tmp_size);
+			return -EINVAL;
+		}
+		total_size = tmp_size;
+	}
+	*total = total_size;
+
+	return 0;
+}
+
 static unsigned int mdw_cmd_create_infos(struct mdw_fpriv *mpriv,
 	struct mdw_cmd *c)
 {
-	unsigned int i = 0, j = 0, total_size = 0, tmp_size = 0;
+	unsigned int i = 0, total_size = 0;
 	struct mdw_subcmd_exec_info *sc_einfo = NULL;
 	int ret = -ENOMEM;
 
@@ -218,68 +376,13 @@ static unsigned int mdw_cmd_create_infos(struct mdw_fpriv *mpriv,
 			c->subcmds[i].boost, c->subcmds[i].pack_id,
 			c->subcmds[i].num_cmdbufs, c->subcmds[i].cmdbufs);
 
-		/* kva for oroginal buffer */
-		c->ksubcmds[i].ori_cbs = kcalloc(c->subcmds[i].num_cmdbufs,
-			sizeof(c->ksubcmds[i].ori_cbs), GFP_KERNEL);
-		if (!c->ksubcmds[i].ori_cbs)
-			goto free_cmdbufs;
-
-		/* record kva for duplicate */
-		c->ksubcmds[i].kvaddrs = kcalloc(c->subcmds[i].num_cmdbufs,
-			sizeof(*c->ksubcmds[i].kvaddrs), GFP_KERNEL);
-		if (!c->ksubcmds[i].kvaddrs)
-			goto free_cmdbufs;
-
-		/* record dva for cmdbufs */
-		c->ksubcmds[i].daddrs = kcalloc(c->subcmds[i].num_cmdbufs,
-			sizeof(*c->ksubcmds[i].daddrs), GFP_KERNEL);
-		if (!c->ksubcmds[i].daddrs)
+		if (mdw_cmd_alloc_ksubcmd(c, i))
 			goto free_cmdbufs;
 
-		/* allocate for subcmd cmdbuf */
-		c->ksubcmds[i].cmdbufs = kcalloc(c->subcmds[i].num_cmdbufs,
-			sizeof(*c->ksubcmds[i].cmdbufs), GFP_KERNEL);
-		if (!c->ksubcmds[i].cmdbufs)
-			goto free_cmdbufs;
-
-		/* copy cmdbuf info */
-		if (copy_from_user(c->ksubcmds[i].cmdbufs,
-			(void __user *)c->subcmds[i].cmdbufs,
-			c->subcmds[i].num_cmdbufs *
-			sizeof(*c->ksubcmds[i].cmdbufs))) {
-			goto free_cmdbufs;
-		}
-
 		c->ksubcmds[i].sc_einfo = &sc_einfo[i];
 
-		/* accumulate cmdbuf size with alignment */
-		for (j = 0; j < c->subcmds[i].num_cmdbufs; j++) {
-			c->num_cmdbufs++;
-			/* alignment */
-			if (c->ksubcmds[i].cmdbufs[j].align) {
-				tmp_size = MDW_ALIGN(total_size,
-					c->ksubcmds[i].cmdbufs[j].align);
-			} else {
-				tmp_size = MDW_ALIGN(total_size, MDW_DEFAULT_ALIGN);
-			}
-			if (tmp_size < total_size) {
-				mdw_drv_err("cmdbuf(%u,%u) size align overflow(%u/%u/%u)\n",
-					i, j, total_size,
-					c->ksubcmds[i].cmdbufs[j].align, tmp_size);
-				goto free_cmdbufs;
-			}
-			total_size = tmp_size;
-
-			/* accumulator */
-			tmp_size = total_size + c->ksubcmds[i].cmdbufs[j].size;
-			if (tmp_size < total_size) {
-				mdw_drv_err("cmdbuf(%u,%u) size overflow(%u/%u/%u)\n",
-					i, j, total_size,
-					c->ksubcmds[i].cmdbufs[j].size, tmp_size);
-				goto free_cmdbufs;
-			}
-			total_size = tmp_size;
-		}
+		if (mdw_cmd_copy_cmdbufs(c, i, &total_size))
+			goto free_cmdbufs;
 	}
 	c->size_cmdbufs = total_size;
 
@@ -293,51 +396,63 @@ static unsigned int mdw_cmd_create_infos(struct mdw_fpriv *mpriv,
 	goto out;
 
 free_cmdbufs:
-	for (i = 0; i < c->num_subcmds; i++) {
-		/* free dvaddrs */
-		kfree(c->ksubcmds[i].daddrs);
-		c->ksubcmds[i].daddrs = NULL;
-
-		/* free kvaddrs */
-		kfree(c->ksubcmds[i].kvaddrs);
-		c->ksubcmds[i].kvaddrs = NULL;
-
-		/* free ori kvas */
-		kfree(c->ksubcmds[i].ori_cbs);
-		c->ksubcmds[i].ori_cbs = NULL;
-
-		/* free cmdbufs */
-		kfree(c->ksubcmds[i].cmdbufs);
-		c->ksubcmds[i].cmdbufs = NULL;
-	}
+	mdw_cmd_free_ksubcmds(mpriv, c);
 
 out:
 	return ret;
 }
 
-static void mdw_cmd_delete_infos(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
+/* create infos from a prepared cmd, without copying or checking again */
+static int mdw_cmd_clone_infos(struct mdw_fpriv *mpriv, struct mdw_cmd *c,
+	struct mdw_cmd *tmpl)
 {
-	unsigned int i = 0;
+	unsigned int i = 0, j = 0;
+	struct mdw_subcmd_exec_info *sc_einfo = NULL;
+	struct mdw_mem *m = NULL;
+	int ret = -ENOMEM;
 
-	mdw_cmd_put_cmdbufs(mpriv, c);
+	c->einfos = c->exec_infos->vaddr;
+	if (!c->einfos) {
+		mdw_drv_err("invalid exec info addr\n");
+		return -EINVAL;
+	}
+	/* clear run infos for return */
+	memset(c->exec_infos->vaddr, 0, c->exec_infos->size);
+	sc_einfo = &c->einfos->sc;
 
 	for (i = 0; i < c->num_subcmds; i++) {
-		/* free dvaddrs */
-		kfree(c->ksubcmds[i].daddrs);
-		c->ksubcmds[i].daddrs = NULL;
+		c->ksubcmds[i].info = &c->subcmds[i];
+		if (mdw_cmd_alloc_ksubcmd(c, i))
+			goto free_cmdbufs;
 
-		/* free kvaddrs */
-		kfree(c->ksubcmds[i].kvaddrs);
-		c->ksubcmds[i].kvaddrs = NULL;
+		memcpy(c->ksubcmds[i].cmdbufs, tmpl->ksubcmds[i].cmdbufs,
+			c->subcmds[i].num_cmdbufs *
+			sizeof(*c->ksubcmds[i].cmdbufs));
+		for (j = 0; j < c->subcmds[i].num_cmdbufs; j++) {
+			m = tmpl->ksubcmds[i].ori_cbs[j];
+			get_dma_buf(m->dbuf);
+			c->ksubcmds[i].ori_cbs[j] = m;
+		}
+		c->ksubcmds[i].sc_einfo = &sc_einfo[i];
+	}
+	c->num_cmdbufs = tmpl->num_cmdbufs;
+	c->size_cmdbufs = tmpl->size_cmdbufs;
 
-		/* free ori kvas */
-		kfree(c->ksubcmds[i].ori_cbs);
-		c->ksubcmds[i].ori_cbs = NULL;
+	ret = mdw_cmd_get_cmdbufs(mpriv, c);
+	if (ret)
+		goto free_cmdbufs;
 
-		/* free cmdbufs */
-		kfree(c->ksubcmds[i].cmdbufs);
-		c->ksubcmds[i].cmdbufs = NULL;
-	}
+	return 0;
+
+free_cmdbufs:
+	mdw_cmd_free_ksubcmds(mpriv, c);
+	return ret;
+}
+
+static void mdw_cmd_delete_infos(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
+{
+	mdw_cmd_put_cmdbufs(mpriv, c);
+	mdw_cmd_free_ksubcmds(mpriv, c);
 }
 
 void mdw_cmd_mpriv_release(struct mdw_fpriv *mpriv)
@@ -501,6 +616,28 @@ static int mdw_cmd_run(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
 	return ret;
 }
 
+static void mdw_cmd_unparse(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
+{
+	kfree(c->adj_matrix);
+	kfree(c->ksubcmds);
+	kfree(c->subcmds);
+	mdw_mem_put(mpriv, c->exec_infos);
+}
+
+static void mdw_cmd_prep_release(struct kref *ref)
+{
+	struct mdw_cmd_prep *prep =
+		container_of(ref, struct mdw_cmd_prep, ref);
+	struct mdw_cmd *tmpl = prep->tmpl;
+
+	mdw_flw_debug("s(0x%llx) prep(%d) release\n",
+		(uint64_t)tmpl->mpriv, prep->id);
+	mdw_cmd_free_ksubcmds(tmpl->mpriv, tmpl);
+	mdw_cmd_unparse(tmpl->mpriv, tmpl);
+	kfree(tmpl);
+	kfree(prep);
+}
+
 static void mdw_cmd_delete(struct mdw_cmd *c)
 {
 	struct mdw_fpriv *mpriv = c->mpriv;
@@ -511,6 +648,10 @@ static void mdw_cmd_delete(struct mdw_cmd *c)
 	mutex_lock(&mpriv->mtx);
 	mdw_cmd_delete_infos(c->mpriv, c);
 	list_del(&c->u_item);
+	if (c->prep) {
+		atomic_set(&c->prep->running, 0);
+		kref_put(&c->prep->ref, mdw_cmd_prep_release);
+	}
 	mdw_cmd_mpriv_release(c->mpriv);
 	mutex_unlock(&mpriv->mtx);
 	mdw_mem_put(c->mpriv, c->exec_infos);
@@ -606,26 +747,10 @@ static void mdw_cmd_trigger_func(struct work_struct *wk)
 	mdw_cmd_run(c->mpriv, c);
 }
 
-static struct mdw_cmd *mdw_cmd_create(struct mdw_fpriv *mpriv,
-	union mdw_cmd_args *args)
+/* copy and check cmd params, subcmds and adj matrix from user */
+static int mdw_cmd_parse(struct mdw_fpriv *mpriv, struct mdw_cmd *c,
+	struct mdw_cmd_in *in)
 {
-	struct mdw_cmd_in *in = (struct mdw_cmd_in *)args;
-	struct mdw_cmd *c = NULL;
-
-	mdw_trace_begin("%s", __func__);
-
-	mutex_lock(&mpriv->mtx);
-	/* check num subcmds maximum */
-	if (in->exec.num_subcmds > MDW_SUBCMD_MAX) {
-		mdw_drv_err("too much subcmds(%u)\n", in->exec.num_subcmds);
-		goto out;
-	}
-
-	/* alloc mdw cmd */
-	c = kzalloc(sizeof(*c), GFP_KERNEL);
-	if (!c)
-		goto out;
-
 	c->mpriv = mpriv;
 
 	/* setup cmd info */
@@ -645,7 +770,7 @@ static struct mdw_cmd *mdw_cmd_create(struct mdw_fpriv *mpriv,
 	c->exec_infos = mdw_mem_get(mpriv, in->exec.exec_infos);
 	if (!c->exec_infos) {
 		mdw_drv_err("get exec info fail\n");
-		goto free_cmd;
+		return -EINVAL;
 	}
 
 	/* check input params */
@@ -691,16 +816,30 @@ static struct mdw_cmd *mdw_cmd_create(struct mdw_fpriv *mpriv,
 	if (mdw_cmd_adj_check(c))
 		goto free_adj;
 
-	/* create infos */
-	if (mdw_cmd_create_infos(mpriv, c)) {
-		mdw_drv_err("create cmd info fail\n");
-		goto free_adj;
-	}
+	return 0;
+
+free_adj:
+	kfree(c->adj_matrix);
+	c->adj_matrix = NULL;
+free_ksubcmds:
+	kfree(c->ksubcmds);
+	c->ksubcmds = NULL;
+free_subcmds:
+	kfree(c->subcmds);
+	c->subcmds = NULL;
+put_execinfos:
+	mdw_mem_put(mpriv, c->exec_infos);
+	c->exec_infos = NULL;
+	return -EINVAL;
+}
 
+/* init run resources and add cmd to mpriv */
+static int mdw_cmd_setup_run(struct mdw_fpriv *mpriv, struct mdw_cmd *c)
+{
 	/* init fence */
 	if (mdw_fence_init(c)) {
 		mdw_drv_err("cmd init fence fail\n");
-		goto delete_infos;
+		return -ENOMEM;
 	}
 	mutex_init(&c->mtx);
 	c->mpriv->get(c->mpriv);
@@ -709,18 +848,47 @@ static struct mdw_cmd *mdw_cmd_create(struct mdw_fpriv *mpriv,
 	list_add_tail(&c->u_item, &mpriv->cmds);
 	mdw_cmd_show(c, mdw_drv_debug);
 
+	return 0;
+}
+
+static struct mdw_cmd *mdw_cmd_create(struct mdw_fpriv *mpriv,
+	union mdw_cmd_args *args)
+{
+	struct mdw_cmd_in *in = (struct mdw_cmd_in *)args;
+	struct mdw_cmd *c = NULL;
+
+	mdw_trace_begin("%s", __func__);
+
+	mutex_lock(&mpriv->mtx);
+	/* check num subcmds maximum */
+	if (in->exec.num_subcmds > MDW_SUBCMD_MAX) {
+		mdw_drv_err("too much subcmds(%u)\n", in->exec.num_subcmds);
+		goto out;
+	}
+
+	/* alloc mdw cmd */
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		goto out;
+
+	if (mdw_cmd_parse(mpriv, c, in))
+		goto free_cmd;
+
+	/* create infos */
+	if (mdw_cmd_create_infos(mpriv, c)) {
+		mdw_drv_err("create cmd info fail\n");
+		goto unparse;
+	}
+
+	if (mdw_cmd_setup_run(mpriv, c))
+		goto delete_infos;
+
 	goto out;
 
 delete_infos:
 	mdw_cmd_delete_infos(mpriv, c);
-free_adj:
-	kfree(c->adj_matrix);
-free_ksubcmds:
-	kfree(c->ksubcmds);
-free_subcmds:
-	kfree(c->subcmds);
-put_execinfos:
-	mdw_mem_put(mpriv, c->exec_infos);
+unparse:
+	mdw_cmd_unparse(mpriv, c);
 free_cmd:
 	kfree(c);
 	c = NULL;
@@ -730,22 +898,77 @@ out:
 	return c;
 }
 
-static int mdw_cmd_ioctl_run(struct mdw_fpriv *mpriv, union mdw_cmd_args *args)
+/* create a cmd from a prepared one, mpriv->mtx must be held */
+static struct mdw_cmd *mdw_cmd_create_prepared(struct mdw_fpriv *mpriv,
+	struct mdw_cmd_prep *prep)
 {
-	struct mdw_cmd_in *in = (struct mdw_cmd_in *)args;
+	struct mdw_cmd *tmpl = prep->tmpl;
 	struct mdw_cmd *c = NULL;
-	struct sync_file *sync_file = NULL;
-	int ret = 0, fd = 0, wait_fd = 0;
 
-	/* get wait fd */
-	wait_fd = in->exec.fence;
+	mdw_trace_begin("%s", __func__);
 
-	c = mdw_cmd_create(mpriv, args);
-	if (!c) {
-		mdw_drv_err("create cmd fail\n");
-		ret = -EINVAL;
+	/* alloc mdw cmd */
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
 		goto out;
+
+	/* setup cmd info */
+	c->mpriv = mpriv;
+	c->pid = current->pid;
+	c->tgid = current->tgid;
+	c->kid = (uint64_t)c;
+	c->uid = tmpl->uid;
+	c->usr_id = tmpl->usr_id;
+	c->priority = tmpl->priority;
+	c->hardlimit = tmpl->hardlimit;
+	c->softlimit = tmpl->softlimit;
+	c->power_save = tmpl->power_save;
+	c->power_plcy = tmpl->power_plcy;
+	c->power_dtime = tmpl->power_dtime;
+	c->app_type = tmpl->app_type;
+	c->num_subcmds = tmpl->num_subcmds;
+	get_dma_buf(tmpl->exec_infos->dbuf);
+	c->exec_infos = tmpl->exec_infos;
+
+	/* subcmds/ksubcmds/adj matrix, already checked at prepare */
+	c->subcmds = kmemdup(tmpl->subcmds,
+		c->num_subcmds * sizeof(*c->subcmds), GFP_KERNEL);
+	c->ksubcmds = kcalloc(c->num_subcmds, sizeof(*c->ksubcmds),
+		GFP_KERNEL);
+	c->adj_matrix = kmemdup(tmpl->adj_matrix,
+		c->num_subcmds * c->num_subcmds * sizeof(uint8_t), GFP_KERNEL);
+	if (!c->subcmds || !c->ksubcmds || !c->adj_matrix)
+		goto unparse;
+
+	/* create infos */
+	if (mdw_cmd_clone_infos(mpriv, c, tmpl)) {
+		mdw_drv_err("clone cmd info fail\n");
+		goto unparse;
 	}
+
+	if (mdw_cmd_setup_run(mpriv, c))
+		goto delete_infos;
+	c->prep = prep;
+
+	goto out;
+
+delete_infos:
+	mdw_cmd_delete_infos(mpriv, c);
+unparse:
+	mdw_cmd_unparse(mpriv, c);
+	kfree(c);
+	c = NULL;
+out:
+	mdw_trace_end("%s", __func__);
+	return c;
+}
+
+static int mdw_cmd_submit(struct mdw_fpriv *mpriv, struct mdw_cmd *c,
+	int wait_fd, union mdw_cmd_args *args)
+{
+	struct sync_file *sync_file = NULL;
+	int ret = 0, fd = 0;
+
 	memset(args, 0, sizeof(*args));
 
 	/* get sync_file fd */
@@ -782,16 +1005,191 @@ static int mdw_cmd_ioctl_run(struct mdw_fpriv *mpriv, union mdw_cmd_args *args)
 	fd_install(fd, sync_file->file);
 	args->out.exec.fence = fd;
 	mdw_flw_debug("async fd(%d)\n", fd);
-	goto out;
+	return 0;
 
 put_file:
 	put_unused_fd(fd);
 delete_cmd:
 	mdw_cmd_delete(c);
-out:
 	return ret;
 }
 
+static int mdw_cmd_ioctl_run(struct mdw_fpriv *mpriv, union mdw_cmd_args *args)
+{
+	struct mdw_cmd_in *in = (struct mdw_cmd_in *)args;
+	struct mdw_cmd *c = NULL;
+	uint64_t start_ts = sched_clock();
+	int wait_fd = 0;
+
+	/* get wait fd */
+	wait_fd = in->exec.fence;
+
+	c = mdw_cmd_create(mpriv, args);
+	if (!c) {
+		mdw_drv_err("create cmd fail\n");
+		return -EINVAL;
+	}
+	mdw_cmd_submit_stat_add(MDW_CMD_SUBMIT_RUN, start_ts);
+
+	return mdw_cmd_submit(mpriv, c, wait_fd, args);
+}
+
+/*
+ * Validate a cmd and resolve its cmdbufs once. Runs of the prepared cmd
+ * only copy in the current cmdbuf contents, so user can patch io
+ * addresses in its cmdbufs between runs. A prepared cmd shares one exec
+ * info buffer, so it runs one at a time.
+ */
+static int mdw_cmd_ioctl_prepare(struct mdw_fpriv *mpriv,
+	union mdw_cmd_args *args)
+{
+	struct mdw_cmd_in *in = (struct mdw_cmd_in *)args;
+	struct mdw_cmd_prep *prep = NULL;
+	struct mdw_cmd *tmpl = NULL;
+	unsigned int i = 0, j = 0, total_size = 0;
+	int ret = -ENOMEM;
+
+	/* check num subcmds maximum */
+	if (in->exec.num_subcmds > MDW_SUBCMD_MAX) {
+		mdw_drv_err("too much subcmds(%u)\n", in->exec.num_subcmds);
+		return -EINVAL;
+	}
+
+	prep = kzalloc(sizeof(*prep), GFP_KERNEL);
+	if (!prep)
+		return -ENOMEM;
+	tmpl = kzalloc(sizeof(*tmpl), GFP_KERNEL);
+	if (!tmpl)
+		goto free_prep;
+
+	mutex_lock(&mpriv->mtx);
+	ret = mdw_cmd_parse(mpriv, tmpl, in);
+	if (ret)
+		goto unlock;
+
+	for (i = 0; i < tmpl->num_subcmds; i++) {
+		tmpl->ksubcmds[i].info = &tmpl->subcmds[i];
+		ret = mdw_cmd_alloc_ksubcmd(tmpl, i);
+		if (ret)
+			goto free_infos;
+
+		ret = mdw_cmd_copy_cmdbufs(tmpl, i, &total_size);
+		if (ret)
+			goto free_infos;
+
+		for (j = 0; j < tmpl->subcmds[i].num_cmdbufs; j++) {
+			tmpl->ksubcmds[i].ori_cbs[j] =
+				mdw_cmd_get_cmdbuf(mpriv, tmpl, i, j);
+			if (!tmpl->ksubcmds[i].ori_cbs[j]) {
+				ret = -EINVAL;
+				goto free_infos;
+			}
+		}
+	}
+	tmpl->size_cmdbufs = total_size;
+	if (!tmpl->size_cmdbufs) {
+		ret = -EINVAL;
+		goto free_infos;
+	}
+
+	prep->tmpl = tmpl;
+	atomic_set(&prep->running, 0);
+	kref_init(&prep->ref);
+	ret = idr_alloc(&mpriv->cmd_preps, prep, 1, 0, GFP_KERNEL);
+	if (ret < 0)
+		goto free_infos;
+	prep->id = ret;
+	mutex_unlock(&mpriv->mtx);
+
+	mdw_flw_debug("s(0x%llx) prep(%d) subcmds(%u) cmdbufs(%u/%u)\n",
+		(uint64_t)mpriv, prep->id, tmpl->num_subcmds,
+		tmpl->num_cmdbufs, tmpl->size_cmdbufs);
+	memset(args, 0, sizeof(*args));
+	args->out.exec.id = prep->id;
+
+	return 0;
+
+free_infos:
+	mdw_cmd_free_ksubcmds(mpriv, tmpl);
+	mdw_cmd_unparse(mpriv, tmpl);
+unlock:
+	mutex_unlock(&mpriv->mtx);
+	kfree(tmpl);
+free_prep:
+	kfree(prep);
+	return ret;
+}
+
+static int mdw_cmd_ioctl_run_prepared(struct mdw_fpriv *mpriv,
+	union mdw_cmd_args *args)
+{
+	struct mdw_cmd_in *in = (struct mdw_cmd_in *)args;
+	struct mdw_cmd_prep *prep = NULL;
+	struct mdw_cmd *c = NULL;
+	uint64_t start_ts = sched_clock();
+	int wait_fd = 0;
+
+	/* get wait fd */
+	wait_fd = in->run.fence;
+
+	mutex_lock(&mpriv->mtx);
+	prep = idr_find(&mpriv->cmd_preps, in->run.id);
+	if (!prep) {
+		mutex_unlock(&mpriv->mtx);
+		mdw_drv_err("s(0x%llx) no prep(%llu)\n",
+			(uint64_t)mpriv, in->run.id);
+		return -EINVAL;
+	}
+	if (atomic_cmpxchg(&prep->running, 0, 1)) {
+		mutex_unlock(&mpriv->mtx);
+		mdw_drv_warn("s(0x%llx) prep(%d) is running\n",
+			(uint64_t)mpriv, prep->id);
+		return -EBUSY;
+	}
+	kref_get(&prep->ref);
+
+	c = mdw_cmd_create_prepared(mpriv, prep);
+	if (!c) {
+		atomic_set(&prep->running, 0);
+		kref_put(&prep->ref, mdw_cmd_prep_release);
+		mutex_unlock(&mpriv->mtx);
+		mdw_drv_err("create prepared cmd fail\n");
+		return -EINVAL;
+	}
+	mutex_unlock(&mpriv->mtx);
+	mdw_cmd_submit_stat_add(MDW_CMD_SUBMIT_PREPARED, start_ts);
+
+	return mdw_cmd_submit(mpriv, c, wait_fd, args);
+}
+
+static int mdw_cmd_ioctl_unprepare(struct mdw_fpriv *mpriv,
+	union mdw_cmd_args *args)
+{
+	struct mdw_cmd_in *in = (struct mdw_cmd_in *)args;
+	struct mdw_cmd_prep *prep = NULL;
+
+	mutex_lock(&mpriv->mtx);
+	prep = idr_remove(&mpriv->cmd_preps, in->unprepare.id);
+	if (prep)
+		kref_put(&prep->ref, mdw_cmd_prep_release);
+	mutex_unlock(&mpriv->mtx);
+
+	return prep ? 0 : -EINVAL;
+}
+
+/* release prepared cmds of mpriv, mpriv->mtx must be held */
+void mdw_cmd_prep_mpriv_release(struct mdw_fpriv *mpriv)
+{
+	struct mdw_cmd_prep *prep = NULL;
+	int id = 0;
+
+	idr_for_each_entry(&mpriv->cmd_preps, prep, id) {
+		idr_remove(&mpriv->cmd_preps, id);
+		kref_put(&prep->ref, mdw_cmd_prep_release);
+	}
+	idr_destroy(&mpriv->cmd_preps);
+}
+
 int mdw_cmd_ioctl(struct mdw_fpriv *mpriv, void *data)
 {
 	union mdw_cmd_args *args = (union mdw_cmd_args *)data;
@@ -804,6 +1202,18 @@ int mdw_cmd_ioctl(struct mdw_fpriv *mpriv, void *data)
 		ret = mdw_cmd_ioctl_run(mpriv, args);
 		break;
 
+	case MDW_CMD_IOCTL_PREPARE:
+		ret = mdw_cmd_ioctl_prepare(mpriv, args);
+		break;
+
+	case MDW_CMD_IOCTL_RUN_PREPARED:
+		ret = mdw_cmd_ioctl_run_prepared(mpriv, args);
+		break;
+
+	case MDW_CMD_IOCTL_UNPREPARE:
+		ret = mdw_cmd_ioctl_unprepare(mpriv, args);
+		break;
+
 	default:
 		ret = -EINVAL;
 		break;
@@ -69,6 +69,7 @@ static int mdw_drv_open(struct inode *inode, struct file *filp)
 	INIT_LIST_HEAD(&mpriv->mems);
 	INIT_LIST_HEAD(&mpriv->invokes);
 	INIT_LIST_HEAD(&mpriv->cmds);
+	idr_init(&mpriv->cmd_preps);
 
 	if (!atomic_read(&g_inited)) {
 		ret = mdw_dev->dev_funcs->sw_init(mdw_dev);
@@ -104,6 +105,7 @@ static int mdw_drv_close(struct inode *inode, struct file *filp)
 	mdw_flw_debug("mpriv(0x%llx)\n", (uint64_t)mpriv);
 	mutex_lock(&mpriv->mtx);
 	atomic_set(&mpriv->active, 0);
+	mdw_cmd_prep_mpriv_release(mpriv);
 	mdw_mem_pool_destroy(&mpriv->cmd_buf_pool);
 	mdw_cmd_mpriv_release(mpriv);
 	mutex_unlock(&mpriv->mtx);
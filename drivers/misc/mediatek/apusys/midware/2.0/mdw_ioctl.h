@@ -158,6 +158,9 @@ union mdw_mem_args {
 
 enum mdw_cmd_ioctl_op {
 	MDW_CMD_IOCTL_RUN,
+	MDW_CMD_IOCTL_PREPARE,
+	MDW_CMD_IOCTL_RUN_PREPARED,
+	MDW_CMD_IOCTL_UNPREPARE,
 };
 
 enum {
@@ -235,6 +238,13 @@ struct mdw_cmd_in {
 			uint64_t fence;
 			uint64_t exec_infos;
 		} exec;
+		struct {
+			uint64_t id;
+			uint64_t fence;
+		} run;
+		struct {
+			uint64_t id;
+		} unprepare;
 	};
 };
 
@@ -4,6 +4,7 @@
  */
 
 #include <linux/genalloc.h>
+#include <linux/dma-buf.h>
 #include <linux/log2.h>
 #include <linux/kernel.h>
 #include <uapi/linux/dma-buf.h>
@@ -22,6 +23,24 @@
 	m->device_va, m->dva_size, m->align, m->flags, m->need_handle, \
 	m->priv, current->pid)
 
+/* gp block carved for a slab, split into slab entries */
+struct mdw_mem_pool_block {
+	unsigned long addr;
+	size_t size;
+	struct list_head node;
+};
+
+/* statistics of all memory pools */
+static struct mdw_mem_pool_stat {
+	atomic64_t chunks;
+	atomic64_t chunk_bytes;
+	atomic64_t large_allocs;
+	atomic64_t hits[MDW_MEM_POOL_SLAB_NUM];
+	atomic64_t misses[MDW_MEM_POOL_SLAB_NUM];
+	atomic64_t entries[MDW_MEM_POOL_SLAB_NUM];
+	atomic64_t free[MDW_MEM_POOL_SLAB_NUM];
+} mdw_mem_pool_stat;
+
 /* allocate a memory chunk, and add it to pool */
 static int mdw_mem_pool_chunk_add(struct mdw_mem_pool *pool, uint32_t size)
 {
@@ -70,6 +89,8 @@ static int mdw_mem_pool_chunk_add(struct mdw_mem_pool *pool, uint32_t size)
 	}
 	list_add_tail(&m->p_chunk, &pool->m_chunks);
 	m->pool = pool;
+	atomic64_inc(&mdw_mem_pool_stat.chunks);
+	atomic64_add(m->size, &mdw_mem_pool_stat.chunk_bytes);
 	mdw_mem_debug("add chunk: pool: 0x%llx, mem: 0x%llx, size: %d",
 		(uint64_t)m->pool, (uint64_t)m, size);
 
@@ -94,6 +115,8 @@ static void mdw_mem_pool_chunk_del(struct mdw_mem *m)
 
 	mdw_trace_begin("%s|size(%u)", __func__, size);
 	list_del(&m->p_chunk);
+	atomic64_dec(&mdw_mem_pool_stat.chunks);
+	atomic64_sub(size, &mdw_mem_pool_stat.chunk_bytes);
 	mdw_mem_debug("free chunk: pool: 0x%llx, mem: 0x%llx",
 		(uint64_t)m->pool, (uint64_t)m);
 	mdw_mem_unmap(m->mpriv, m);
@@ -105,18 +128,11 @@ static void mdw_mem_pool_chunk_del(struct mdw_mem *m)
 int mdw_mem_pool_create(struct mdw_fpriv *mpriv, struct mdw_mem_pool *pool,
 	enum mdw_mem_type type, uint32_t size, uint32_t align, uint64_t flags)
 {
-	int ret = 0;
+	int ret = 0, i = 0;
 
 	if (IS_ERR_OR_NULL(mpriv) || IS_ERR_OR_NULL(pool))
 		return -EINVAL;
 
-	/* TODO: cacheable command buffer */
-	if (flags & F_MDW_MEM_CACHEABLE) {
-		mdw_drv_err("cacheable pool is unsupported: mpriv: 0x%llx",
-			(uint64_t)mpriv);
-		return -EINVAL;
-	}
-
 	mdw_trace_begin("%s|size(%u) align(%u)",
 		__func__, size, align);
 
@@ -129,6 +145,13 @@ int mdw_mem_pool_create(struct mdw_fpriv *mpriv, struct mdw_mem_pool *pool,
 	kref_init(&pool->m_ref);
 	INIT_LIST_HEAD(&pool->m_chunks);
 	INIT_LIST_HEAD(&pool->m_list);
+	INIT_LIST_HEAD(&pool->m_blocks);
+	for (i = 0; i < MDW_MEM_POOL_SLAB_NUM; i++) {
+		pool->slabs[i].size = 1U << (MDW_MEM_POOL_SLAB_MIN_SHIFT + i);
+		INIT_LIST_HEAD(&pool->slabs[i].free);
+		pool->slabs[i].nr_free = 0;
+		pool->slabs[i].nr_total = 0;
+	}
 	pool->gp = gen_pool_create(PAGE_SHIFT, -1 /* nid */);
 
 	if (IS_ERR_OR_NULL(pool->gp)) {
@@ -158,12 +181,188 @@ out:
 	return ret;
 }
 
+/*
+ * returns the slab serving an allocation, or -1 if it is carved from gp
+ * directly. Slab entries are only aligned to MDW_DEFAULT_ALIGN.
+ */
+static int mdw_mem_pool_slab_idx(uint32_t size, uint32_t align)
+{
+	if (size > MDW_MEM_POOL_SLAB_MAX_SIZE || align > MDW_DEFAULT_ALIGN)
+		return -1;
+
+	if (size <= (1U << MDW_MEM_POOL_SLAB_MIN_SHIFT))
+		return 0;
+
+	return ilog2(size - 1) + 1 - MDW_MEM_POOL_SLAB_MIN_SHIFT;
+}
+
+/* carve a range from gp, add a new chunk to pool if gp is exhausted */
+static int mdw_mem_pool_carve(struct mdw_mem_pool *pool, size_t size,
+	uint32_t align, unsigned long *addr, struct mdw_mem **chunk)
+{
+	struct genpool_data_align data = { .align = align };
+	bool retried = false;
+	int ret = 0;
+
+retry:
+	*addr = gen_pool_alloc_algo_owner(pool->gp, size,
+		gen_pool_first_fit_align, &data, (void **)chunk);
+	if (*addr)
+		return 0;
+
+	if (retried)
+		return -ENOMEM;
+
+	/* try to add a new chunk to pool, and retry again */
+	ret = mdw_mem_pool_chunk_add(pool,
+		max(PAGE_SIZE, __roundup_pow_of_two(size)));
+	if (ret)
+		return ret;
+
+	retried = true;
+	goto retry;
+}
+
+/* frees a mdw_mem struct */
+static void mdw_mem_pool_ent_release(struct mdw_mem *m)
+{
+	mdw_mem_pool_show(m);
+	kfree(m);
+}
+
+/* allocates a mdw_mem struct */
+static struct mdw_mem *mdw_mem_pool_ent_create(struct mdw_mem_pool *pool)
+{
+	struct mdw_mem *m;
+
+	m = kzalloc(sizeof(*m), GFP_KERNEL);
+	if (!m)
+		return NULL;
+
+	m->pool = pool;
+	m->mpriv = pool->mpriv;
+	m->flags = pool->flags;
+	m->type = pool->type;
+	m->belong_apu = true;
+	m->need_handle = false;
+	m->dbuf = NULL;
+	m->mdev = NULL;
+	m->release = mdw_mem_pool_ent_release;
+	m->handle = -1;
+	mutex_init(&m->mtx);
+	INIT_LIST_HEAD(&m->maps);
+	mdw_mem_pool_show(m);
+
+	return m;
+}
+
+/* carve a block from gp, and split it into free entries of the slab */
+static int mdw_mem_pool_slab_grow(struct mdw_mem_pool *pool, int idx)
+{
+	struct mdw_mem_pool_slab *slab = &pool->slabs[idx];
+	struct mdw_mem_pool_block *blk;
+	struct mdw_mem *m = NULL, *chunk = NULL;
+	unsigned long addr = 0;
+	dma_addr_t dma;
+	size_t ofs = 0;
+	int ret = 0;
+
+	blk = kzalloc(sizeof(*blk), GFP_KERNEL);
+	if (!blk)
+		return -ENOMEM;
+
+	blk->size = max_t(size_t, PAGE_SIZE, slab->size);
+	ret = mdw_mem_pool_carve(pool, blk->size, pool->align, &addr, &chunk);
+	if (ret)
+		goto err_carve;
+
+	blk->addr = addr;
+	dma = gen_pool_virt_to_phys(pool->gp, addr);
+	for (ofs = 0; ofs + slab->size <= blk->size; ofs += slab->size) {
+		m = mdw_mem_pool_ent_create(pool);
+		if (!m)
+			break;
+		m->vaddr = (void *)(addr + ofs);
+		m->device_va = dma + ofs;
+		m->chunk = chunk;
+		list_add_tail(&m->d_node, &slab->free);
+		slab->nr_free++;
+		slab->nr_total++;
+		atomic64_inc(&mdw_mem_pool_stat.entries[idx]);
+		atomic64_inc(&mdw_mem_pool_stat.free[idx]);
+	}
+
+	if (!ofs) {
+		ret = -ENOMEM;
+		goto err_ent;
+	}
+	list_add_tail(&blk->node, &pool->m_blocks);
+
+	mdw_mem_debug("pool: 0x%llx, slab(%u) grow: %u/%u",
+		(uint64_t)pool, slab->size, slab->nr_free, slab->nr_total);
+
+	return 0;
+
+err_ent:
+	gen_pool_free(pool->gp, addr, blk->size);
+err_carve:
+	kfree(blk);
+	return ret;
+}
+
+/* take a free entry of the slab, grow the slab if it is empty */
+static struct mdw_mem *mdw_mem_pool_slab_get(struct mdw_mem_pool *pool,
+	int idx)
+{
+	struct mdw_mem_pool_slab *slab = &pool->slabs[idx];
+	struct mdw_mem *m = NULL;
+
+	if (list_empty(&slab->free)) {
+		atomic64_inc(&mdw_mem_pool_stat.misses[idx]);
+		if (mdw_mem_pool_slab_grow(pool, idx))
+			return NULL;
+	} else {
+		atomic64_inc(&mdw_mem_pool_stat.hits[idx]);
+	}
+
+	m = list_first_entry(&slab->free, struct mdw_mem, d_node);
+	list_del(&m->d_node);
+	slab->nr_free--;
+	atomic64_dec(&mdw_mem_pool_stat.free[idx]);
+
+	return m;
+}
+
+/* carve an entry bigger than any slab from gp directly */
+static struct mdw_mem *mdw_mem_pool_large_alloc(struct mdw_mem_pool *pool,
+	uint32_t size, uint32_t align)
+{
+	struct mdw_mem *m = NULL;
+	unsigned long addr = 0;
+
+	m = mdw_mem_pool_ent_create(pool);
+	if (!m)
+		return NULL;
+
+	if (mdw_mem_pool_carve(pool, size, align, &addr, &m->chunk)) {
+		kfree(m);
+		return NULL;
+	}
+	m->vaddr = (void *)addr;
+	m->device_va = gen_pool_virt_to_phys(pool->gp, addr);
+	atomic64_inc(&mdw_mem_pool_stat.large_allocs);
+
+	return m;
+}
+
 /* the release function when pool reference count reaches zero */
 static void mdw_mem_pool_release(struct kref *ref)
 {
 	struct mdw_mem_pool *pool;
 	struct mdw_fpriv *mpriv;
 	struct mdw_mem *m = NULL, *tmp = NULL;
+	struct mdw_mem_pool_block *blk = NULL, *btmp = NULL;
+	int i = 0;
 
 	pool = container_of(ref, struct mdw_mem_pool, m_ref);
 	if (IS_ERR_OR_NULL(pool->mpriv))
@@ -180,10 +379,31 @@ static void mdw_mem_pool_release(struct kref *ref)
 		list_del(&m->d_node);
 		mdw_mem_debug("free mem: pool: 0x%llx, mem: 0x%llx",
 			(uint64_t)pool, (uint64_t)m);
-		gen_pool_free(pool->gp, (unsigned long)m->vaddr, m->size);
+		if (mdw_mem_pool_slab_idx(m->size, m->align) < 0)
+			gen_pool_free(pool->gp, (unsigned long)m->vaddr,
+				m->size);
 		kfree(m);
 	}
 
+	/* release all slab entries and their blocks */
+	for (i = 0; i < MDW_MEM_POOL_SLAB_NUM; i++) {
+		list_for_each_entry_safe(m, tmp, &pool->slabs[i].free, d_node) {
+			list_del(&m->d_node);
+			kfree(m);
+		}
+		atomic64_sub(pool->slabs[i].nr_free,
+			&mdw_mem_pool_stat.free[i]);
+		atomic64_sub(pool->slabs[i].nr_total,
+			&mdw_mem_pool_stat.entries[i]);
+		pool->slabs[i].nr_free = 0;
+		pool->slabs[i].nr_total = 0;
+	}
+	list_for_each_entry_safe(blk, btmp, &pool->m_blocks, node) {
+		list_del(&blk->node);
+		gen_pool_free(pool->gp, blk->addr, blk->size);
+		kfree(blk);
+	}
+
 	/* destroy gen pool */
 	gen_pool_destroy(pool->gp);
 
@@ -205,42 +425,12 @@ void mdw_mem_pool_destroy(struct mdw_mem_pool *pool)
 	mutex_unlock(&pool->m_mtx);
 }
 
-/* frees a mdw_mem struct */
-static void mdw_mem_pool_ent_release(struct mdw_mem *m)
-{
-	mdw_mem_pool_show(m);
-	kfree(m);
-}
-
-/* allocates a mdw_mem struct */
-static struct mdw_mem *mdw_mem_pool_ent_create(struct mdw_mem_pool *pool)
-{
-	struct mdw_mem *m;
-
-	m = kzalloc(sizeof(*m), GFP_KERNEL);
-	if (!m)
-		return NULL;
-
-	m->pool = pool;
-	m->mpriv = pool->mpriv;
-	m->release = NULL;
-	m->handle = -1;
-	mutex_init(&m->mtx);
-	INIT_LIST_HEAD(&m->maps);
-	mdw_mem_pool_show(m);
-
-	return m;
-}
-
-/* alloc memory from pool, and alloc/add its mdw_mem struct to pool->list */
+/* alloc memory from pool, and add its mdw_mem struct to pool->list */
 struct mdw_mem *mdw_mem_pool_alloc(struct mdw_mem_pool *pool, uint32_t size,
 	uint32_t align)
 {
 	struct mdw_mem *m = NULL;
-	dma_addr_t dma;
-	bool retried = false;
-	unsigned long chunk_size;
-	int ret = 0;
+	int idx = 0;
 
 	if (!pool || !size)
 		return NULL;
@@ -248,78 +438,51 @@ struct mdw_mem *mdw_mem_pool_alloc(struct mdw_mem_pool *pool, uint32_t size,
 	mdw_trace_begin("%s|size(%u) align(%u)",
 		__func__, size, align);
 
-	/* create mem struct */
-	m = mdw_mem_pool_ent_create(pool);
-	if (!m)
-		goto out;
-
-	/* setup in args */
-	m->pool = pool;
-	m->size = size;
-	m->align = align;
-	m->flags = pool->flags;
-	m->type = pool->type;
-	m->belong_apu = true;
-	m->need_handle = false;
-	m->dbuf = NULL;
-	m->release = mdw_mem_pool_ent_release;
+	idx = mdw_mem_pool_slab_idx(size, align);
 
 	/* alloc mem */
 	mutex_lock(&pool->m_mtx);
-retry:
-	m->vaddr = gen_pool_dma_alloc_align(pool->gp, size, &dma, align);
-	if (m->vaddr) {
+	if (idx >= 0)
+		m = mdw_mem_pool_slab_get(pool, idx);
+	else
+		m = mdw_mem_pool_large_alloc(pool, size, align);
+	if (m) {
 		list_add_tail(&m->d_node, &pool->m_list);
 		kref_get(&pool->m_ref);
-	} else {
-		/* try to add a new chunk to pool, and retry again */
-		chunk_size = max(PAGE_SIZE, __roundup_pow_of_two(size));
-		ret = mdw_mem_pool_chunk_add(pool, chunk_size);
-		if (!ret && !retried) {
-			retried = true;
-			goto retry;
-		}
 	}
 	mutex_unlock(&pool->m_mtx);
 
-	if (!m->vaddr) {
+	if (!m) {
 		mdw_drv_err("alloc (%p,%d,%d,%d) fail\n",
-			pool, m->type, size, align);
-		goto err_alloc;
+			pool, pool->type, size, align);
+		goto out;
 	}
-	m->mdev = NULL;
-	m->device_va = dma;
+
+	/* setup in args */
+	m->size = size;
+	m->align = align;
 	m->dva_size = size;
 
 	/* zero out the allocated buffer */
 	memset(m->vaddr, 0, size);
 
 	mdw_mem_pool_show(m);
-	goto out;
-
-err_alloc:
-	kfree(m);
-	m = NULL;
+	mdw_mem_debug("pool: 0x%llx, mem: 0x%llx, size: %d, align: %d, kva: 0x%llx, iova: 0x%llx",
+		(uint64_t)pool, (uint64_t)m, size, align,
+		(uint64_t)m->vaddr, (uint64_t)m->device_va);
 
 out:
-	if (m) {
-		mdw_mem_debug("pool: 0x%llx, mem: 0x%llx, size: %d, align: %d, kva: 0x%llx, iova: 0x%llx",
-			(uint64_t)pool, (uint64_t)m, size, align,
-			(uint64_t)m->vaddr, (uint64_t)m->device_va);
-	}
-
 	mdw_trace_end("%s|size(%u) align(%u)",
 		__func__, size, align);
 	return m;
-
-
 }
 
-/* free memory from pool, and free/delete its mdw_mem struct from pool->list */
+/* free memory to pool, slab entries are kept for reuse */
 void mdw_mem_pool_free(struct mdw_mem *m)
 {
 	struct mdw_mem_pool *pool;
 	uint32_t size = 0, align = 0;
+	int idx = 0;
 
 	if (!m)
 		return;
@@ -339,52 +502,115 @@ void mdw_mem_pool_free(struct mdw_mem *m)
 		(uint64_t)pool, (uint64_t)m, m->size,
 		(uint64_t)m->vaddr, (uint64_t)m->device_va);
 
+	idx = mdw_mem_pool_slab_idx(size, align);
 
 	mutex_lock(&pool->m_mtx);
 	list_del(&m->d_node);
-	gen_pool_free(m->pool->gp, (unsigned long)m->vaddr, m->size);
+	if (idx >= 0) {
+		list_add(&m->d_node, &pool->slabs[idx].free);
+		pool->slabs[idx].nr_free++;
+		atomic64_inc(&mdw_mem_pool_stat.free[idx]);
+	} else {
+		gen_pool_free(pool->gp, (unsigned long)m->vaddr, m->size);
+	}
 	kref_put(&pool->m_ref, mdw_mem_pool_release);
 	mutex_unlock(&pool->m_mtx);
 
-	m->release(m);
+	if (idx < 0)
+		m->release(m);
 
 	mdw_trace_end("%s|size(%u) align(%u)",
 		__func__, size, align);
 }
 
-/* flush a memory, do nothing, if it's non-cacheable */
-int mdw_mem_pool_flush(struct mdw_mem *m)
+/*
+ * Pool entries share the dma-buf of their chunk, so cache maintenance only
+ * covers the entry's range of the chunk. A command packs all of its
+ * buffers into one entry, which is then synced with a single call.
+ */
+static int mdw_mem_pool_sync(struct mdw_mem *m, enum dma_data_direction dir,
+	bool to_device)
 {
+	unsigned int ofs = 0;
+	int ret = 0;
+
 	if (!m)
 		return 0;
 
-	if (m->flags ^ F_MDW_MEM_CACHEABLE)
+	if (!(m->flags & F_MDW_MEM_CACHEABLE))
+		return 0;
+
+	if (!m->chunk || !m->chunk->dbuf)
+		return -EINVAL;
+
+	ofs = (unsigned int)(m->device_va - m->chunk->device_va);
+	if (to_device)
+		ret = dma_buf_end_cpu_access_partial(m->chunk->dbuf, dir,
+			ofs, m->dva_size);
+	else
+		ret = dma_buf_begin_cpu_access_partial(m->chunk->dbuf, dir,
+			ofs, m->dva_size);
+	if (ret) {
+		mdw_drv_err("sync fail(%d): pool: 0x%llx, mem: 0x%llx\n",
+			ret, (uint64_t)m->pool, (uint64_t)m);
+		ret = -EINVAL;
+	}
+
+	return ret;
+}
+
+/* flush a memory, do nothing, if it's non-cacheable */
+int mdw_mem_pool_flush(struct mdw_mem *m)
+{
+	int ret = 0;
+
+	if (!m)
 		return 0;
 
 	mdw_trace_begin("%s|size(%u)", __func__, m->dva_size);
-	/* TODO: cacheable command buffer */
-	mdw_drv_err("cacheable buffer: pool: 0x%llx, mem: 0x%llx",
-		(uint64_t)m->pool, (uint64_t)m);
+	ret = mdw_mem_pool_sync(m, DMA_TO_DEVICE, true);
 	mdw_trace_end("%s|size(%u)", __func__, m->dva_size);
 
-	return -EINVAL;
+	return ret;
 }
 
 /* invalidate a memory, do nothing, if it's non-cacheable */
 int mdw_mem_pool_invalidate(struct mdw_mem *m)
 {
-	if (!m)
-		return 0;
+	int ret = 0;
 
-	if (m->flags ^ F_MDW_MEM_CACHEABLE)
+	if (!m)
 		return 0;
 
 	mdw_trace_begin("%s|size(%u)", __func__, m->dva_size);
-	/* TODO: cacheable command buffer */
-	mdw_drv_err("cacheable buffer: pool: 0x%llx, mem: 0x%llx",
-		(uint64_t)m->pool, (uint64_t)m);
+	ret = mdw_mem_pool_sync(m, DMA_FROM_DEVICE, false);
 	mdw_trace_end("%s|size(%u)", __func__, m->dva_size);
 
-	return -EINVAL;
+	return ret;
 }
 
+/* print statistics of all memory pools */
+int mdw_mem_pool_stat_show(char *buf, int size)
+{
+	int n = 0, i = 0;
+
+	n += scnprintf(buf + n, size - n, "chunks: %lld (%lld bytes)\n",
+		atomic64_read(&mdw_mem_pool_stat.chunks),
+		atomic64_read(&mdw_mem_pool_stat.chunk_bytes));
+	n += scnprintf(buf + n, size - n, "large allocs: %lld\n",
+		atomic64_read(&mdw_mem_pool_stat.large_allocs));
+	n += scnprintf(buf + n, size - n,
+		"%-8s %-10s %-10s %-12s %-12s\n",
+		"size", "entries", "free", "hits", "misses");
+	for (i = 0; i < MDW_MEM_POOL_SLAB_NUM; i++) {
+		n += scnprintf(buf + n, size - n,
+			"%-8u %-10lld %-10lld %-12lld %-12lld\n",
+			1U << (MDW_MEM_POOL_SLAB_MIN_SHIFT + i),
+			atomic64_read(&mdw_mem_pool_stat.entries[i]),
+			atomic64_read(&mdw_mem_pool_stat.free[i]),
+			atomic64_read(&mdw_mem_pool_stat.hits[i]),
+			atomic64_read(&mdw_mem_pool_stat.misses[i]));
+	}
+
+	return n;
+}
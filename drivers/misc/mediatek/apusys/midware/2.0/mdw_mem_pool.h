@@ -19,5 +19,7 @@ void mdw_mem_pool_free(struct mdw_mem *m);
 int mdw_mem_pool_flush(struct mdw_mem *m);
 int mdw_mem_pool_invalidate(struct mdw_mem *m);
 
+int mdw_mem_pool_stat_show(char *buf, int size);
+
 #endif
 
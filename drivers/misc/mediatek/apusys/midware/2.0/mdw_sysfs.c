@@ -10,6 +10,7 @@
 #include <linux/uaccess.h>
 
 #include "mdw_cmn.h"
+#include "mdw_mem_pool.h"
 
 static uint32_t g_sched_plcy_show;
 
@@ -113,8 +114,16 @@ static ssize_t policy_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(policy);
 
+static ssize_t submit_overhead_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	return mdw_cmd_submit_stat_show(buf, PAGE_SIZE);
+}
+static DEVICE_ATTR_RO(submit_overhead);
+
 static struct attribute *mdw_sched_attrs[] = {
 	&dev_attr_policy.attr,
+	&dev_attr_submit_overhead.attr,
 	NULL,
 };
 
@@ -136,8 +145,16 @@ static ssize_t mem_statistics_show(struct device *dev,
 }
 static DEVICE_ATTR_RO(mem_statistics);
 
+static ssize_t pool_statistics_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	return mdw_mem_pool_stat_show(buf, PAGE_SIZE);
+}
+static DEVICE_ATTR_RO(pool_statistics);
+
 static struct attribute *mdw_mem_attrs[] = {
 	&dev_attr_mem_statistics.attr,
+	&dev_attr_pool_statistics.attr,
 	NULL,
 };
 
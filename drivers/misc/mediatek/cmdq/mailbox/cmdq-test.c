@@ -899,6 +899,84 @@ static void cmdq_test_mbox_reuse_buf_va(struct cmdq_test *test)
 		cmdq_msg("val:%#x equals to ans:%#x", val, ans);
 }
 
+static void cmdq_test_mbox_pkt_build(struct cmdq_test *test, const u32 count)
+{
+	unsigned long	va = (unsigned long)(CMDQ_GPR_R32(
+		test->gce.va, CMDQ_GPR_DEBUG_DUMMY));
+	unsigned long	pa = CMDQ_GPR_R32(
+		test->gce.pa, CMDQ_GPR_DEBUG_DUMMY);
+	const u32 ans = 0x5a5a;
+
+	struct cmdq_pkt_template	*tmpl;
+	struct cmdq_reg_write		*regs;
+	struct cmdq_pkt			*pkt;
+	u64				cost, single, batch, inst;
+	s32				i, idx, val;
+
+	regs = kcalloc(count, sizeof(*regs), GFP_KERNEL);
+	if (!regs)
+		return;
+	for (i = 0; i < count; i++) {
+		regs[i].addr = pa;
+		regs[i].value = i;
+		regs[i].mask = ~0;
+	}
+
+	/* one helper call per write */
+	cost = sched_clock();
+	pkt = cmdq_pkt_create(test->clt);
+	for (i = 0; i < count; i++)
+		cmdq_pkt_write(pkt, NULL, pa, i, ~0);
+	single = sched_clock() - cost;
+	cmdq_pkt_destroy(pkt);
+
+	/* all writes in one batch */
+	cost = sched_clock();
+	pkt = cmdq_pkt_create(test->clt);
+	cmdq_pkt_write_batch(pkt, NULL, regs, count);
+	batch = sched_clock() - cost;
+	cmdq_pkt_destroy(pkt);
+
+	/* record once, then instantiate with the last write patched */
+	tmpl = cmdq_pkt_template_create(test->clt, 1);
+	if (IS_ERR(tmpl)) {
+		kfree(regs);
+		return;
+	}
+	cmdq_pkt_write_batch(tmpl->pkt, NULL, regs, count);
+	idx = cmdq_pkt_template_mark(tmpl);
+
+	cost = sched_clock();
+	pkt = cmdq_pkt_create(test->clt);
+	cmdq_pkt_template_set(tmpl, idx, ans);
+	cmdq_pkt_template_instantiate(tmpl, pkt);
+	inst = sched_clock() - cost;
+
+	cmdq_msg("%s: count:%u single:%llu batch:%llu template:%llu ns",
+		__func__, count, single, batch, inst);
+
+	if (clk_bulk_prepare_enable(CMDQ_GCE_CLK_NUM_MAX, test->gce.clks)) {
+		cmdq_pkt_destroy(pkt);
+		cmdq_pkt_template_destroy(tmpl);
+		kfree(regs);
+		return;
+	}
+
+	writel(0xdeaddead, (void *)va);
+	cmdq_pkt_flush(pkt);
+	cmdq_pkt_destroy(pkt);
+	cmdq_pkt_template_destroy(tmpl);
+	kfree(regs);
+
+	val = readl((void *)va);
+	clk_bulk_disable_unprepare(CMDQ_GCE_CLK_NUM_MAX, test->gce.clks);
+
+	if (val != ans)
+		cmdq_err("val:%#x not equal to ans:%#x", val, ans);
+	else
+		cmdq_msg("val:%#x equals to ans:%#x", val, ans);
+}
+
 static void cmdq_test_mbox_prebuilt_instr(struct cmdq_test *test,
 	const u16 mod, const u16 event)
 {
@@ -1177,6 +1255,10 @@ cmdq_test_trigger(struct cmdq_test *test, const s32 sec, const s32 id)
 	case 20:
 		cmdq_test_mbox_tzmp(test, sec, false);
 		break;
+	case 21:
+		cmdq_test_mbox_pkt_build(test, 64);
+		cmdq_test_mbox_pkt_build(test, 1024);
+		break;
 	default:
 		break;
 	}
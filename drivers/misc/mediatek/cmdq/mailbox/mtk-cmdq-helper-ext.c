@@ -3,7 +3,10 @@
  * Copyright (c) 2015 MediaTek Inc.
  */
 
+#include <linux/bitmap.h>
 #include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/debugfs.h>
 #include <linux/errno.h>
 #include <linux/of_address.h>
 #include <linux/soc/mediatek/mtk-cmdq-ext.h>
@@ -11,6 +14,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/dmapool.h>
 #include <linux/sched/clock.h>
+#include <linux/seq_file.h>
 
 #if IS_ENABLED(CONFIG_MTK_CMDQ_MBOX_EXT)
 #include "cmdq-util.h"
@@ -39,6 +43,9 @@ struct cmdq_sec_helper_fp *cmdq_sec_helper;
 #define CMDQ_EOC_CMD		((u64)((CMDQ_CODE_EOC << CMDQ_OP_CODE_SHIFT)) \
 				<< 32 | CMDQ_EOC_IRQ_EN)
 #define CMDQ_MBOX_BUF_LIMIT	16 /* default limit count */
+#define CMDQ_BATCH_INST_CNT	32 /* instructions encoded per batch chunk */
+#define CMDQ_BUF_CACHE_SIZE	8 /* pool pages kept per client per cpu */
+#define CMDQ_BUF_CACHE_BATCH	4 /* pool pages taken per cache refill */
 
 #define CMDQ_PREDUMP_TIMEOUT_MS		200
 
@@ -72,13 +79,31 @@ struct cmdq_sec_helper_fp *cmdq_sec_helper;
 #define CMDQ_DBG_PERFBEGIN		CMDQ_CMD_BUFFER_SIZE
 #define CMDQ_DBG_PERFEND		(CMDQ_DBG_PERFBEGIN + 4)
 
+/* Per-cpu stash of pool pages, only touched with local irq disabled */
+struct cmdq_buf_cache {
+	u32 cnt;
+	void *va[CMDQ_BUF_CACHE_SIZE];
+	dma_addr_t pa[CMDQ_BUF_CACHE_SIZE];
+	u64 hit;
+	u64 miss;
+	u64 fallback;
+};
+
 struct client_priv {
 	struct dma_pool *buf_pool;
 	u32 pool_limit;
 	atomic_t buf_cnt;
+	atomic_t buf_peak;
+	atomic_t buf_cached; /* pages parked in buf_cache over all cpus */
+	struct cmdq_buf_cache __percpu *buf_cache;
 	struct workqueue_struct *flushq;
+	const char *name;
+	struct list_head node;
 };
 
+static LIST_HEAD(cmdq_client_list);
+static DEFINE_MUTEX(cmdq_client_list_lock);
+
 struct cmdq_instruction {
 	u16 arg_c:16;
 	u16 arg_b:16;
@@ -216,8 +241,15 @@ struct cmdq_client *cmdq_mbox_create(struct device *dev, int index)
 
 	priv->pool_limit = CMDQ_MBOX_BUF_LIMIT;
 	priv->flushq = create_singlethread_workqueue("cmdq_flushq");
+	/* without the cache every page goes straight to the dma pool */
+	priv->buf_cache = alloc_percpu(struct cmdq_buf_cache);
+	priv->name = dev_name(dev);
 	client->cl_priv = (void *)priv;
 
+	mutex_lock(&cmdq_client_list_lock);
+	list_add_tail(&priv->node, &cmdq_client_list);
+	mutex_unlock(&cmdq_client_list_lock);
+
 	mutex_init(&client->chan_mutex);
 
 	return client;
@@ -252,10 +284,14 @@ void cmdq_mbox_pool_create(struct cmdq_client *cl)
 }
 EXPORT_SYMBOL(cmdq_mbox_pool_create);
 
+static void cmdq_mbox_cache_drain(struct client_priv *priv);
+
 void cmdq_mbox_pool_clear(struct cmdq_client *cl)
 {
 	struct client_priv *priv = (struct client_priv *)cl->cl_priv;
 
+	cmdq_mbox_cache_drain(priv);
+
 	/* check pool still in use */
 	if (unlikely((atomic_read(&priv->buf_cnt)))) {
 		cmdq_msg("buffers still in use:%d",
@@ -308,9 +344,78 @@ static void cmdq_mbox_pool_free_impl(struct dma_pool *pool, void *va,
 	atomic_dec(cnt);
 }
 
+static void cmdq_mbox_pool_peak(struct client_priv *priv)
+{
+	s32 cnt = atomic_read(&priv->buf_cnt);
+	s32 peak = atomic_read(&priv->buf_peak);
+	s32 old;
+
+	while (cnt > peak) {
+		old = atomic_cmpxchg(&priv->buf_peak, peak, cnt);
+		if (old == peak)
+			break;
+		peak = old;
+	}
+}
+
+/* Keep at most half of the pool limit parked in caches over all cpus. */
+static bool cmdq_mbox_cache_reserve(struct client_priv *priv)
+{
+	if (atomic_inc_return(&priv->buf_cached) <= priv->pool_limit / 2)
+		return true;
+
+	atomic_dec(&priv->buf_cached);
+	return false;
+}
+
+/* Take a batch from the dma pool: one for the caller, the rest cached. */
+static void *cmdq_mbox_cache_refill(struct client_priv *priv,
+	dma_addr_t *pa_out)
+{
+	struct cmdq_buf_cache *cache;
+	void *va[CMDQ_BUF_CACHE_BATCH];
+	dma_addr_t pa[CMDQ_BUF_CACHE_BATCH];
+	unsigned long flags;
+	u32 i, cnt = 0;
+
+	do {
+		va[cnt] = cmdq_mbox_pool_alloc_impl(priv->buf_pool, &pa[cnt],
+			&priv->buf_cnt, priv->pool_limit);
+		if (!va[cnt])
+			break;
+		cnt++;
+		/* keep at most half of the pool limit parked in caches */
+	} while (cnt < CMDQ_BUF_CACHE_BATCH &&
+		atomic_read(&priv->buf_cnt) < priv->pool_limit / 2);
+
+	if (!cnt)
+		return NULL;
+	cmdq_mbox_pool_peak(priv);
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(priv->buf_cache);
+	for (i = 1; i < cnt && cache->cnt < CMDQ_BUF_CACHE_SIZE &&
+		cmdq_mbox_cache_reserve(priv); i++) {
+		cache->va[cache->cnt] = va[i];
+		cache->pa[cache->cnt++] = pa[i];
+	}
+	local_irq_restore(flags);
+
+	/* frees filled the cache or the parking budget meanwhile */
+	for (; i < cnt; i++)
+		cmdq_mbox_pool_free_impl(priv->buf_pool, va[i], pa[i],
+			&priv->buf_cnt);
+
+	*pa_out = pa[0];
+	return va[0];
+}
+
 static void *cmdq_mbox_pool_alloc(struct cmdq_client *cl, dma_addr_t *pa_out)
 {
 	struct client_priv *priv = (struct client_priv *)cl->cl_priv;
+	struct cmdq_buf_cache *cache;
+	unsigned long flags;
+	void *va;
 
 	if (unlikely(!priv->buf_pool)) {
 		cmdq_mbox_pool_create(cl);
@@ -321,17 +426,89 @@ static void *cmdq_mbox_pool_alloc(struct cmdq_client *cl, dma_addr_t *pa_out)
 		}
 	}
 
-	return cmdq_mbox_pool_alloc_impl(priv->buf_pool,
-		pa_out, &priv->buf_cnt, priv->pool_limit);
+	if (unlikely(!priv->buf_cache)) {
+		va = cmdq_mbox_pool_alloc_impl(priv->buf_pool,
+			pa_out, &priv->buf_cnt, priv->pool_limit);
+		if (va)
+			cmdq_mbox_pool_peak(priv);
+		return va;
+	}
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(priv->buf_cache);
+	if (likely(cache->cnt)) {
+		cache->cnt--;
+		va = cache->va[cache->cnt];
+		*pa_out = cache->pa[cache->cnt];
+		cache->hit++;
+		local_irq_restore(flags);
+		atomic_dec(&priv->buf_cached);
+		return va;
+	}
+	cache->miss++;
+	local_irq_restore(flags);
+
+	return cmdq_mbox_cache_refill(priv, pa_out);
 }
 
 static void cmdq_mbox_pool_free(struct cmdq_client *cl, void *va, dma_addr_t pa)
 {
 	struct client_priv *priv = (struct client_priv *)cl->cl_priv;
+	struct cmdq_buf_cache *cache;
+	unsigned long flags;
+
+	if (likely(priv->buf_cache)) {
+		local_irq_save(flags);
+		cache = this_cpu_ptr(priv->buf_cache);
+		if (cache->cnt < CMDQ_BUF_CACHE_SIZE &&
+			cmdq_mbox_cache_reserve(priv)) {
+			cache->va[cache->cnt] = va;
+			cache->pa[cache->cnt++] = pa;
+			local_irq_restore(flags);
+			return;
+		}
+		local_irq_restore(flags);
+	}
 
 	cmdq_mbox_pool_free_impl(priv->buf_pool, va, pa, &priv->buf_cnt);
 }
 
+static void cmdq_mbox_cache_drain_cpu(struct client_priv *priv,
+	struct cmdq_buf_cache *cache)
+{
+	while (cache->cnt) {
+		cache->cnt--;
+		cmdq_mbox_pool_free_impl(priv->buf_pool,
+			cache->va[cache->cnt], cache->pa[cache->cnt],
+			&priv->buf_cnt);
+		atomic_dec(&priv->buf_cached);
+	}
+}
+
+static void cmdq_mbox_cache_drain_local(void *data)
+{
+	struct client_priv *priv = data;
+
+	cmdq_mbox_cache_drain_cpu(priv, this_cpu_ptr(priv->buf_cache));
+}
+
+/* Return every cached page to the dma pool */
+static void cmdq_mbox_cache_drain(struct client_priv *priv)
+{
+	int cpu;
+
+	if (!priv->buf_cache || !priv->buf_pool)
+		return;
+
+	cpus_read_lock();
+	on_each_cpu(cmdq_mbox_cache_drain_local, priv, 1);
+	for_each_possible_cpu(cpu)
+		if (!cpu_online(cpu))
+			cmdq_mbox_cache_drain_cpu(priv,
+				per_cpu_ptr(priv->buf_cache, cpu));
+	cpus_read_unlock();
+}
+
 static void *cmdq_mbox_buf_alloc_dev(struct device *dev, dma_addr_t *pa_out)
 {
 	void *va = NULL;
@@ -440,6 +617,14 @@ s32 cmdq_dev_get_event(struct device *dev, const char *name)
 }
 EXPORT_SYMBOL(cmdq_dev_get_event);
 
+static bool cmdq_pkt_use_client_pool(struct cmdq_pkt *pkt)
+{
+	struct cmdq_client *cl = (struct cmdq_client *)pkt->cl;
+
+	return cl && pkt->cur_pool.pool ==
+		((struct client_priv *)cl->cl_priv)->buf_pool;
+}
+
 struct cmdq_pkt_buffer *cmdq_pkt_alloc_buf(struct cmdq_pkt *pkt)
 {
 	struct cmdq_client *cl = (struct cmdq_client *)pkt->cl;
@@ -465,12 +650,8 @@ struct cmdq_pkt_buffer *cmdq_pkt_alloc_buf(struct cmdq_pkt *pkt)
 		return ERR_PTR(-ENODEV);
 	}
 
-	/* try dma pool if available */
-	if (pkt->cur_pool.pool)
-		buf->va_base = cmdq_mbox_pool_alloc_impl(pkt->cur_pool.pool,
-			use_iommu ? &buf->iova_base : &buf->pa_base,
-			pkt->cur_pool.cnt, *pkt->cur_pool.limit);
-	else if (cl) {
+	/* try dma pool if available, the client pool through its cache */
+	if (cl && (!pkt->cur_pool.pool || cmdq_pkt_use_client_pool(pkt))) {
 		struct client_priv *priv = (struct client_priv *)cl->cl_priv;
 
 		buf->va_base = cmdq_mbox_pool_alloc(cl,
@@ -479,8 +660,12 @@ struct cmdq_pkt_buffer *cmdq_pkt_alloc_buf(struct cmdq_pkt *pkt)
 			pkt->cur_pool.pool = priv->buf_pool;
 			pkt->cur_pool.cnt = &priv->buf_cnt;
 			pkt->cur_pool.limit = &priv->pool_limit;
-		}
-	}
+		} else if (priv->buf_cache)
+			this_cpu_inc(priv->buf_cache->fallback);
+	} else if (pkt->cur_pool.pool)
+		buf->va_base = cmdq_mbox_pool_alloc_impl(pkt->cur_pool.pool,
+			use_iommu ? &buf->iova_base : &buf->pa_base,
+			pkt->cur_pool.cnt, *pkt->cur_pool.limit);
 
 	if (buf->va_base)
 		buf->use_pool = true;
@@ -514,7 +699,10 @@ void cmdq_pkt_free_buf(struct cmdq_pkt *pkt)
 			cmdq_err("pkt:0x%p pa:%pa iova:%pa",
 			pkt, &buf->pa_base, &buf->iova_base);
 		if (buf->use_pool) {
-			if (pkt->cur_pool.pool)
+			if (cmdq_pkt_use_client_pool(pkt))
+				cmdq_mbox_pool_free(cl, buf->va_base,
+					CMDQ_BUF_ADDR(buf));
+			else if (pkt->cur_pool.pool)
 				cmdq_mbox_pool_free_impl(pkt->cur_pool.pool,
 					buf->va_base,
 					CMDQ_BUF_ADDR(buf),
@@ -581,6 +769,15 @@ EXPORT_SYMBOL(cmdq_pkt_add_cmd_buffer);
 
 void cmdq_mbox_destroy(struct cmdq_client *client)
 {
+	struct client_priv *priv = (struct client_priv *)client->cl_priv;
+
+	if (priv) {
+		mutex_lock(&cmdq_client_list_lock);
+		list_del(&priv->node);
+		mutex_unlock(&cmdq_client_list_lock);
+		cmdq_mbox_cache_drain(priv);
+		free_percpu(priv->buf_cache);
+	}
 	mbox_free_channel(client->chan);
 	kfree(client->cl_priv);
 	kfree(client);
@@ -759,6 +956,41 @@ s32 cmdq_pkt_append_command(struct cmdq_pkt *pkt, u16 arg_c, u16 arg_b,
 }
 EXPORT_SYMBOL(cmdq_pkt_append_command);
 
+s32 cmdq_pkt_append_commands(struct cmdq_pkt *pkt, const u64 *inst, u32 count)
+{
+	struct cmdq_pkt_buffer *buf;
+	u32 cnt;
+
+	if (!pkt || (count && !inst))
+		return -EINVAL;
+
+	while (count) {
+		if (unlikely(!pkt->avail_buf_size)) {
+			if (cmdq_pkt_add_cmd_buffer(pkt) < 0)
+				return -ENOMEM;
+		}
+
+		/* fill as much of the current buffer as one copy allows */
+		buf = list_last_entry(&pkt->buf, typeof(*buf), list_entry);
+		cnt = min_t(u32, count, pkt->avail_buf_size / CMDQ_INST_SIZE);
+		memcpy(buf->va_base + CMDQ_CMD_BUFFER_SIZE -
+			pkt->avail_buf_size, inst, cnt * CMDQ_INST_SIZE);
+		pkt->cmd_buf_size += cnt * CMDQ_INST_SIZE;
+		pkt->avail_buf_size -= cnt * CMDQ_INST_SIZE;
+		inst += cnt;
+		count -= cnt;
+
+		/* same as append_command, never leave a full buffer behind */
+		if (unlikely(!pkt->avail_buf_size)) {
+			if (cmdq_pkt_add_cmd_buffer(pkt) < 0)
+				return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(cmdq_pkt_append_commands);
+
 s32 cmdq_pkt_move(struct cmdq_pkt *pkt, u16 reg_idx, u64 value)
 {
 	return cmdq_pkt_append_command(pkt, CMDQ_GET_ARG_C(value),
@@ -979,6 +1211,125 @@ void cmdq_reuse_refresh(struct cmdq_pkt *pkt, struct cmdq_reuse *reuse, u32 cnt)
 }
 EXPORT_SYMBOL(cmdq_reuse_refresh);
 
+struct cmdq_pkt_template *cmdq_pkt_template_create(struct cmdq_client *client,
+	u32 max_patch)
+{
+	struct cmdq_pkt_template *tmpl;
+
+	tmpl = kzalloc(sizeof(*tmpl), GFP_KERNEL);
+	if (!tmpl)
+		return ERR_PTR(-ENOMEM);
+
+	tmpl->reuse = kcalloc(max_patch, sizeof(*tmpl->reuse), GFP_KERNEL);
+	tmpl->dirty = bitmap_zalloc(max_patch, GFP_KERNEL);
+	if ((max_patch && !tmpl->reuse) || (max_patch && !tmpl->dirty)) {
+		cmdq_pkt_template_destroy(tmpl);
+		return ERR_PTR(-ENOMEM);
+	}
+	tmpl->max = max_patch;
+
+	tmpl->pkt = cmdq_pkt_create(client);
+	if (IS_ERR(tmpl->pkt)) {
+		s32 err = PTR_ERR(tmpl->pkt);
+
+		tmpl->pkt = NULL;
+		cmdq_pkt_template_destroy(tmpl);
+		return ERR_PTR(err);
+	}
+
+	return tmpl;
+}
+EXPORT_SYMBOL(cmdq_pkt_template_create);
+
+void cmdq_pkt_template_destroy(struct cmdq_pkt_template *tmpl)
+{
+	if (tmpl->pkt)
+		cmdq_pkt_destroy(tmpl->pkt);
+	bitmap_free(tmpl->dirty);
+	kfree(tmpl->reuse);
+	kfree(tmpl);
+}
+EXPORT_SYMBOL(cmdq_pkt_template_destroy);
+
+s32 cmdq_pkt_template_mark(struct cmdq_pkt_template *tmpl)
+{
+	struct cmdq_reuse *reuse;
+	u64 *va;
+
+	if (tmpl->cnt >= tmpl->max)
+		return -ENOSPC;
+	if (tmpl->pkt->cmd_buf_size < CMDQ_INST_SIZE)
+		return -EINVAL;
+
+	va = cmdq_pkt_get_curr_buf_va(tmpl->pkt);
+	if (!va)
+		return -ENOMEM;
+
+	reuse = &tmpl->reuse[tmpl->cnt];
+	reuse->va = va - 1;
+	reuse->offset = tmpl->pkt->cmd_buf_size - CMDQ_INST_SIZE;
+	reuse->val = (u32)*reuse->va;
+
+	return tmpl->cnt++;
+}
+EXPORT_SYMBOL(cmdq_pkt_template_mark);
+
+void cmdq_pkt_template_set(struct cmdq_pkt_template *tmpl, u32 idx, u32 val)
+{
+	if (idx >= tmpl->cnt || tmpl->reuse[idx].val == val)
+		return;
+
+	tmpl->reuse[idx].val = val;
+	set_bit(idx, tmpl->dirty);
+}
+EXPORT_SYMBOL(cmdq_pkt_template_set);
+
+void cmdq_pkt_template_apply(struct cmdq_pkt_template *tmpl)
+{
+	struct cmdq_reuse *reuse;
+	u32 idx;
+
+	for_each_set_bit(idx, tmpl->dirty, tmpl->cnt) {
+		reuse = &tmpl->reuse[idx];
+		*reuse->va = (*reuse->va & GENMASK(63, 32)) | reuse->val;
+	}
+	bitmap_zero(tmpl->dirty, tmpl->max);
+}
+EXPORT_SYMBOL(cmdq_pkt_template_apply);
+
+s32 cmdq_pkt_template_instantiate(struct cmdq_pkt_template *tmpl,
+	struct cmdq_pkt *dst)
+{
+	struct cmdq_pkt_buffer *buf;
+	struct cmdq_reuse *reuse;
+	u32 cur_off = 0;
+	u32 idx = 0;
+	u64 *va;
+	s32 err;
+
+	err = cmdq_pkt_copy(dst, tmpl->pkt);
+	if (err)
+		return err;
+
+	/* patch offsets are recorded in order, so one pass over dst */
+	list_for_each_entry(buf, &dst->buf, list_entry) {
+		while (idx < tmpl->cnt && tmpl->reuse[idx].offset <
+			cur_off + CMDQ_CMD_BUFFER_SIZE) {
+			reuse = &tmpl->reuse[idx++];
+			va = (u64 *)(buf->va_base + reuse->offset - cur_off);
+			*va = (*va & GENMASK(63, 32)) | reuse->val;
+		}
+
+		if (idx >= tmpl->cnt)
+			break;
+
+		cur_off += CMDQ_CMD_BUFFER_SIZE;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(cmdq_pkt_template_instantiate);
+
 s32 cmdq_pkt_copy(struct cmdq_pkt *dst, struct cmdq_pkt *src)
 {
 	struct list_head entry;
@@ -1158,6 +1509,76 @@ s32 cmdq_pkt_write(struct cmdq_pkt *pkt, struct cmdq_base *clt_base,
 }
 EXPORT_SYMBOL(cmdq_pkt_write);
 
+s32 cmdq_pkt_write_batch(struct cmdq_pkt *pkt, struct cmdq_base *clt_base,
+	const struct cmdq_reg_write *regs, u32 count)
+{
+	u64 inst[CMDQ_BATCH_INST_CNT];
+	u32 i, cnt = 0;
+	u32 spr_high = 0;
+	bool spr_valid = false;
+	u32 last_base = 0;
+	s32 subsys = -EINVAL;
+	s32 err;
+
+	for (i = 0; i < count; i++) {
+		const dma_addr_t addr = regs[i].addr;
+		const u32 base = CMDQ_GET_ADDR_H(addr) ? 0 : addr & 0xFFFF0000;
+		const u32 mask = regs[i].mask;
+		enum cmdq_code op = CMDQ_CODE_WRITE_S;
+
+		/* each write takes at most assign + mask + write */
+		if (cnt > CMDQ_BATCH_INST_CNT - 3) {
+			err = cmdq_pkt_append_commands(pkt, inst, cnt);
+			if (err)
+				return err;
+			cnt = 0;
+		}
+
+		if (!i || base != last_base) {
+			subsys = cmdq_subsys_base_to_id(clt_base, base);
+			last_base = base;
+		}
+
+		/* the temp spr holds the high part from the previous write */
+		if (subsys < 0 && (!spr_valid ||
+			spr_high != CMDQ_GET_ADDR_HIGH(addr))) {
+			spr_high = CMDQ_GET_ADDR_HIGH(addr);
+			spr_valid = true;
+			cmdq_pkt_instr_encoder(&inst[cnt++],
+				CMDQ_GET_ARG_C(spr_high),
+				CMDQ_GET_ARG_B(spr_high), CMDQ_SPR_FOR_TEMP,
+				CMDQ_LOGIC_ASSIGN, CMDQ_IMMEDIATE_VALUE,
+				CMDQ_IMMEDIATE_VALUE, CMDQ_REG_TYPE,
+				CMDQ_CODE_LOGIC);
+		}
+
+		if (mask != 0xffffffff) {
+			cmdq_pkt_instr_encoder(&inst[cnt++],
+				CMDQ_GET_ARG_C(~mask), CMDQ_GET_ARG_B(~mask),
+				0, 0, 0, 0, 0, CMDQ_CODE_MASK);
+			op = CMDQ_CODE_WRITE_S_W_MASK;
+		}
+
+		if (subsys >= 0)
+			cmdq_pkt_instr_encoder(&inst[cnt++],
+				CMDQ_GET_ARG_C(regs[i].value),
+				CMDQ_GET_ARG_B(regs[i].value),
+				CMDQ_GET_REG_OFFSET(addr), subsys,
+				CMDQ_IMMEDIATE_VALUE, CMDQ_IMMEDIATE_VALUE,
+				CMDQ_IMMEDIATE_VALUE, op);
+		else
+			cmdq_pkt_instr_encoder(&inst[cnt++],
+				CMDQ_GET_ARG_C(regs[i].value),
+				CMDQ_GET_ARG_B(regs[i].value),
+				CMDQ_GET_ADDR_LOW(addr), CMDQ_SPR_FOR_TEMP,
+				CMDQ_IMMEDIATE_VALUE, CMDQ_IMMEDIATE_VALUE,
+				CMDQ_IMMEDIATE_VALUE, op);
+	}
+
+	return cmdq_pkt_append_commands(pkt, inst, cnt);
+}
+EXPORT_SYMBOL(cmdq_pkt_write_batch);
+
 s32 cmdq_pkt_mem_move(struct cmdq_pkt *pkt, struct cmdq_base *clt_base,
 	dma_addr_t src_addr, dma_addr_t dst_addr, u16 swap_reg_idx)
 {
@@ -2831,9 +3252,80 @@ EXPORT_SYMBOL(cmdq_sec_helper_set_fp);
 #endif
 #endif
 
+static int cmdq_mbox_pool_print(struct seq_file *seq, void *data)
+{
+	struct client_priv *priv;
+	struct cmdq_buf_cache *cache;
+	u64 hit, miss, fallback;
+	u32 cached;
+	int cpu;
+
+	seq_puts(seq,
+		"client,limit,in_use,peak,cached,hit,miss,fallback\n");
+
+	mutex_lock(&cmdq_client_list_lock);
+	list_for_each_entry(priv, &cmdq_client_list, node) {
+		hit = miss = fallback = 0;
+		cached = 0;
+		if (priv->buf_cache)
+			for_each_possible_cpu(cpu) {
+				cache = per_cpu_ptr(priv->buf_cache, cpu);
+				cached += READ_ONCE(cache->cnt);
+				hit += READ_ONCE(cache->hit);
+				miss += READ_ONCE(cache->miss);
+				fallback += READ_ONCE(cache->fallback);
+			}
+
+		seq_printf(seq, "%s,%u,%d,%d,%u,%llu,%llu,%llu\n",
+			priv->name, priv->pool_limit,
+			atomic_read(&priv->buf_cnt) - cached,
+			atomic_read(&priv->buf_peak), cached,
+			hit, miss, fallback);
+	}
+	mutex_unlock(&cmdq_client_list_lock);
+
+	return 0;
+}
+
+static int cmdq_mbox_pool_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cmdq_mbox_pool_print, inode->i_private);
+}
+
+static const struct file_operations cmdq_mbox_pool_fops = {
+	.owner = THIS_MODULE,
+	.open = cmdq_mbox_pool_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 int cmdq_helper_init(void)
 {
+	struct dentry *dir, *fs;
+	bool exists = false;
+
 	cmdq_msg("%s enter", __func__);
+
+	dir = debugfs_lookup("cmdq", NULL);
+	if (!dir) {
+		dir = debugfs_create_dir("cmdq", NULL);
+		if (!dir) {
+			cmdq_err("debugfs_create_dir cmdq failed");
+			return 0;
+		}
+	} else
+		exists = true;
+
+	fs = debugfs_create_file("cmdq-pool", 0444, dir, NULL,
+		&cmdq_mbox_pool_fops);
+	if (IS_ERR(fs))
+		cmdq_err("debugfs_create_file cmdq-pool failed:%ld",
+			PTR_ERR(fs));
+
+	if (exists)
+		dput(dir);
+
 	return 0;
 }
 EXPORT_SYMBOL(cmdq_helper_init);
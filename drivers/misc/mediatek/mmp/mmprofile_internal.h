@@ -87,6 +87,38 @@ struct compat_mmprofile_metalog_t {
 };
 #endif
 
+/*
+ * Streaming layout, mapped read-only with MMPROFILE_STREAM_BUFFER while
+ * logging keeps running. The mapping starts with this header, followed
+ * by one ring of ring_records events per CPU at ring[cpu].offset.
+ *
+ * Each CPU only ever appends to its own ring and advances head, the
+ * count of records written so far. An event at position pos sits in slot
+ * (pos & (ring_records - 1)) and its lock field holds pos + 1 once it is
+ * complete. A reader keeping a tail per CPU loads head, copies the slot
+ * and checks lock == pos + 1 both before and after the copy; any other
+ * value means the writer lapped the reader and the record is lost. A
+ * head below the reader's tail means the buffer was reset.
+ * Events from different CPUs are merged by timestamp.
+ */
+#define MMPROFILE_STREAM_VERSION 1
+
+struct mmprofile_stream_ring_t {
+	unsigned int head;
+	unsigned int offset;
+	/* keep each CPU's head on its own cache line */
+	unsigned int reserved[14];
+};
+
+struct mmprofile_stream_header_t {
+	unsigned int version;
+	unsigned int cpu_count;
+	unsigned int ring_records;
+	unsigned int record_size;
+	unsigned int reserved[12];
+	struct mmprofile_stream_ring_t ring[0];
+};
+
 #define MMPROFILE_GLOBALS_SIZE \
 	((sizeof(struct mmprofile_global_t)+(PAGE_SIZE-1))&(~(PAGE_SIZE-1)))
 
@@ -95,6 +127,7 @@ struct compat_mmprofile_metalog_t {
 #define MMPROFILE_PRIMARY_BUFFER  1
 #define MMPROFILE_GLOBALS_BUFFER  2
 #define MMPROFILE_DATA_BUFFER 3
+#define MMPROFILE_STREAM_BUFFER 4
 
 #define MMP_IOC_MAGIC 'M'
 
@@ -125,6 +158,7 @@ struct compat_mmprofile_metalog_t {
 #define MMP_IOC_REMOTESTART _IOW(MMP_IOC_MAGIC, 14, unsigned int)
 #define MMP_IOC_SETRECORDCNT _IOW(MMP_IOC_MAGIC, 15, unsigned int)
 #define MMP_IOC_SETMETABUFSIZE _IOW(MMP_IOC_MAGIC, 16, unsigned int)
+#define MMP_IOC_STREAMSIZE _IOR(MMP_IOC_MAGIC, 17, unsigned int)
 #define MMP_IOC_TEST _IOWR(MMP_IOC_MAGIC, 100, unsigned int)
 
 /* fix build warning: unused */
@@ -27,6 +27,10 @@
 #include <linux/slab.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/percpu-rwsem.h>
+#include <linux/rcupdate.h>
+#include <linux/log2.h>
 #include <linux/hardirq.h>
 #include <linux/sched.h>
 #include <linux/debugfs.h>
@@ -125,16 +129,35 @@ struct mmprofile_meta_datablock_t {
 	unsigned int cookie;
 	enum mmp_metadata_type data_type;
 	unsigned int data_size;
+	unsigned int busy;	/* payload still being copied in */
 	unsigned char meta_data[1];
 };
 
+struct mmprofile_stream_cursor_t {
+	unsigned int tail;
+	unsigned int head;
+};
+
 static int bmmprofile_init_buffer;
 static DEFINE_MUTEX(mmprofile_buffer_init_mutex);
 static DEFINE_MUTEX(mmprofile_regtable_mutex);
-static DEFINE_MUTEX(mmprofile_meta_buffer_mutex);
 static struct mmprofile_event_t *p_mmprofile_ring_buffer;
+static struct mmprofile_stream_header_t *p_mmprofile_stream;
+static struct mmprofile_stream_cursor_t *p_mmprofile_stream_cursor;
+static unsigned int mmprofile_stream_size;
+/* serialises mmprofile_merge_stream() and mmprofile_reset_stream() */
+static DEFINE_MUTEX(mmprofile_stream_mutex);
+/* writers drop events while set, checked with interrupts off */
+static bool mmprofile_stream_paused;
 #ifdef CONFIG_MTK_ENG_BUILD
 static unsigned char *p_mmprofile_meta_buffer;
+/*
+ * Meta writers only take the read side and a short list spinlock for
+ * block allocation; the payload copy runs unlocked. Dumps and resets
+ * take the write side to wait for copies in flight.
+ */
+DEFINE_STATIC_PERCPU_RWSEM(mmprofile_meta_rwsem);
+static DEFINE_SPINLOCK(mmprofile_meta_list_lock);
 #endif
 
 static struct mmprofile_global_t mmprofile_globals
@@ -168,6 +191,167 @@ static int mmprofile_register_static_events(int sync);
 
 static void mmprofile_force_start(int start);
 
+static struct mmprofile_event_t *mmprofile_stream_slot(unsigned int cpu,
+	unsigned int pos)
+{
+	struct mmprofile_event_t *p_ring = (struct mmprofile_event_t *)
+		((unsigned char *)p_mmprofile_stream +
+		p_mmprofile_stream->ring[cpu].offset);
+
+	return &p_ring[pos & (p_mmprofile_stream->ring_records - 1)];
+}
+
+/* Copy out the record at @pos, failing if it was overwritten meanwhile. */
+static bool mmprofile_stream_read(unsigned int cpu, unsigned int pos,
+	struct mmprofile_event_t *p_event)
+{
+	struct mmprofile_event_t *p_slot = mmprofile_stream_slot(cpu, pos);
+
+	if (smp_load_acquire(&p_slot->lock) != pos + 1)
+		return false;
+	*p_event = *p_slot;
+	smp_rmb();
+	if (READ_ONCE(p_slot->lock) != pos + 1)
+		return false;
+
+	return p_event->id != 0;
+}
+
+static void mmprofile_free_stream(void)
+{
+	vfree(p_mmprofile_stream);
+	p_mmprofile_stream = NULL;
+	kfree(p_mmprofile_stream_cursor);
+	p_mmprofile_stream_cursor = NULL;
+	mmprofile_stream_size = 0;
+}
+
+/* Split @records evenly into one power-of-two ring per CPU. */
+static void mmprofile_alloc_stream(unsigned int records)
+{
+	unsigned int ring_records;
+	unsigned int header_size;
+	unsigned int ring_bytes;
+	unsigned int cpu;
+
+	ring_records = rounddown_pow_of_two(max_t(unsigned int,
+		records / num_possible_cpus(), 1));
+	header_size = PAGE_ALIGN(sizeof(struct mmprofile_stream_header_t) +
+		nr_cpu_ids * sizeof(struct mmprofile_stream_ring_t));
+	ring_bytes = PAGE_ALIGN(ring_records *
+		sizeof(struct mmprofile_event_t));
+
+	p_mmprofile_stream_cursor = kcalloc(nr_cpu_ids,
+		sizeof(struct mmprofile_stream_cursor_t), GFP_KERNEL);
+	if (!p_mmprofile_stream_cursor)
+		return;
+	/* vmalloc_user() so that the rings can be handed to user space */
+	p_mmprofile_stream = vmalloc_user(header_size +
+		nr_cpu_ids * ring_bytes);
+	if (!p_mmprofile_stream) {
+		mmprofile_free_stream();
+		return;
+	}
+
+	mmprofile_stream_size = header_size + nr_cpu_ids * ring_bytes;
+	p_mmprofile_stream->version = MMPROFILE_STREAM_VERSION;
+	p_mmprofile_stream->cpu_count = nr_cpu_ids;
+	p_mmprofile_stream->ring_records = ring_records;
+	p_mmprofile_stream->record_size = sizeof(struct mmprofile_event_t);
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		p_mmprofile_stream->ring[cpu].offset =
+			header_size + cpu * ring_bytes;
+}
+
+#ifdef CONFIG_MTK_ENG_BUILD
+static void mmprofile_reset_stream(void)
+{
+	unsigned int cpu;
+
+	lockdep_assert_held(&mmprofile_stream_mutex);
+
+	/*
+	 * Writers fill their ring with interrupts off, which makes them RCU
+	 * readers: once a grace period has passed after pausing, none is
+	 * still inside a record.
+	 */
+	WRITE_ONCE(mmprofile_stream_paused, true);
+	synchronize_rcu();
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		memset(mmprofile_stream_slot(cpu, 0), 0,
+			p_mmprofile_stream->ring_records *
+			sizeof(struct mmprofile_event_t));
+		WRITE_ONCE(p_mmprofile_stream->ring[cpu].head, 0);
+	}
+	smp_store_release(&mmprofile_stream_paused, false);
+}
+#endif
+
+/*
+ * Merge the per-CPU rings by timestamp into the primary buffer, oldest
+ * first, which is the layout dumps and the primary mapping expect.
+ * Records still being written while logging stops are skipped.
+ */
+static void __mmprofile_merge_stream(void)
+{
+	struct mmprofile_stream_cursor_t *p_cursor = p_mmprofile_stream_cursor;
+	unsigned int ring_records = p_mmprofile_stream->ring_records;
+	unsigned int count = 0;
+	unsigned int cpu;
+
+	lockdep_assert_held(&mmprofile_stream_mutex);
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		unsigned int head =
+			smp_load_acquire(&p_mmprofile_stream->ring[cpu].head);
+
+		p_cursor[cpu].head = head;
+		p_cursor[cpu].tail = head - min(head, ring_records);
+	}
+
+	while (count < mmprofile_globals.buffer_size_record) {
+		struct mmprofile_event_t event;
+		unsigned long long time;
+		unsigned long long oldest_time = 0;
+		int oldest_cpu = -1;
+
+		for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+			while (p_cursor[cpu].tail != p_cursor[cpu].head &&
+				!mmprofile_stream_read(cpu, p_cursor[cpu].tail,
+					&event))
+				p_cursor[cpu].tail++;
+			if (p_cursor[cpu].tail == p_cursor[cpu].head)
+				continue;
+
+			time = event.time_low +
+				((unsigned long long)event.time_high << 32);
+			if (oldest_cpu < 0 || time < oldest_time) {
+				oldest_time = time;
+				oldest_cpu = cpu;
+				p_mmprofile_ring_buffer[count] = event;
+			}
+		}
+		if (oldest_cpu < 0)
+			break;
+
+		p_mmprofile_ring_buffer[count++].lock = 0;
+		p_cursor[oldest_cpu].tail++;
+	}
+
+	if (count < mmprofile_globals.buffer_size_record)
+		memset(&p_mmprofile_ring_buffer[count], 0,
+			(mmprofile_globals.buffer_size_record - count) *
+			sizeof(struct mmprofile_event_t));
+	mmprofile_globals.write_pointer =
+		count % mmprofile_globals.buffer_size_record;
+}
+
+static void mmprofile_merge_stream(void)
+{
+	mutex_lock(&mmprofile_stream_mutex);
+	__mmprofile_merge_stream();
+	mutex_unlock(&mmprofile_stream_mutex);
+}
+
 unsigned int mmprofile_get_dump_size(void)
 {
 	unsigned int size;
@@ -209,6 +393,11 @@ static unsigned int mmprofile_fill_dump_block(void *p_src, void *p_dst,
 	return dst_left;
 }
 
+/*
+ * Does not sleep, so it may be called from atomic context. Like the
+ * register table below, the stream is only merged if its lock is free;
+ * otherwise a size of 0 is returned and the caller retries later.
+ */
 void mmprofile_get_dump_buffer(unsigned int start, unsigned long *p_addr,
 	unsigned int *p_size)
 {
@@ -224,6 +413,15 @@ void mmprofile_get_dump_buffer(unsigned int start, unsigned long *p_addr,
 		*p_size = 0;
 		return;
 	}
+	if (start == 0) {
+		if (mutex_trylock(&mmprofile_stream_mutex) == 0) {
+			MMP_LOG(ANDROID_LOG_DEBUG, "fail to get stream lock");
+			*p_size = 0;
+			return;
+		}
+		__mmprofile_merge_stream();
+		mutex_unlock(&mmprofile_stream_mutex);
+	}
 	if (total_pos < (region_base + sizeof(struct mmprofile_global_t))) {
 		/* Global structure */
 		region_pos = total_pos;
@@ -372,6 +570,7 @@ static void mmprofile_init_buffer(void)
 		   mmprofile_globals.new_buffer_size_record) {
 		vfree(p_mmprofile_ring_buffer);
 		p_mmprofile_ring_buffer = NULL;
+		mmprofile_free_stream();
 		mmprofile_globals.buffer_size_record =
 		    mmprofile_globals.new_buffer_size_record;
 		mmprofile_globals.buffer_size_bytes =
@@ -389,6 +588,7 @@ static void mmprofile_init_buffer(void)
 #else
 		    vmalloc(mmprofile_globals.buffer_size_bytes);
 #endif
+		mmprofile_alloc_stream(mmprofile_globals.buffer_size_record);
 	}
 	MMP_LOG(ANDROID_LOG_DEBUG, "p_mmprofile_ring_buffer=0x%08lx",
 		(unsigned long)p_mmprofile_ring_buffer);
@@ -420,11 +620,13 @@ static void mmprofile_init_buffer(void)
 		"p_mmprofile_meta_buffer=0x%08lx",
 		(unsigned long)p_mmprofile_meta_buffer);
 
-	if ((!p_mmprofile_ring_buffer) || (!p_mmprofile_meta_buffer)) {
+	if ((!p_mmprofile_ring_buffer) || (!p_mmprofile_stream) ||
+		(!p_mmprofile_meta_buffer)) {
 		if (p_mmprofile_ring_buffer) {
 			vfree(p_mmprofile_ring_buffer);
 			p_mmprofile_ring_buffer = NULL;
 		}
+		mmprofile_free_stream();
 		if (p_mmprofile_meta_buffer) {
 			vfree(p_mmprofile_meta_buffer);
 			p_mmprofile_meta_buffer = NULL;
@@ -435,7 +637,12 @@ static void mmprofile_init_buffer(void)
 		return;
 	}
 #else
-	if (!p_mmprofile_ring_buffer) {
+	if ((!p_mmprofile_ring_buffer) || (!p_mmprofile_stream)) {
+		if (p_mmprofile_ring_buffer) {
+			vfree(p_mmprofile_ring_buffer);
+			p_mmprofile_ring_buffer = NULL;
+		}
+		mmprofile_free_stream();
 		bmmprofile_init_buffer = 0;
 		mutex_unlock(&mmprofile_buffer_init_mutex);
 		MMP_LOG(ANDROID_LOG_DEBUG, "Cannot allocate buffer");
@@ -477,11 +684,14 @@ static void mmprofile_reset_buffer(void)
 	if (bmmprofile_init_buffer) {
 		struct mmprofile_meta_datablock_t *p_block;
 
+		mutex_lock(&mmprofile_stream_mutex);
 		memset((void *)(p_mmprofile_ring_buffer), 0,
 			mmprofile_globals.buffer_size_bytes);
 		mmprofile_globals.write_pointer = 0;
+		mmprofile_reset_stream();
+		mutex_unlock(&mmprofile_stream_mutex);
 
-		mutex_lock(&mmprofile_meta_buffer_mutex);
+		percpu_down_write(&mmprofile_meta_rwsem);
 		mmprofile_meta_datacookie = 1;
 		memset((void *)(p_mmprofile_meta_buffer), 0,
 			mmprofile_globals.meta_buffer_size);
@@ -493,7 +703,7 @@ static void mmprofile_reset_buffer(void)
 		INIT_LIST_HEAD(&mmprofile_meta_buffer_list);
 		list_add_tail(&(p_block->list), &mmprofile_meta_buffer_list);
 
-		mutex_unlock(&mmprofile_meta_buffer_mutex);
+		percpu_up_write(&mmprofile_meta_rwsem);
 
 	}
 #endif
@@ -814,8 +1024,9 @@ static void mmprofile_log_int(mmp_event event, enum mmp_log_type type,
 	size_t prefix_len;
 	size_t size;
 	struct mmprofile_event_t *p_event = NULL;
-	unsigned int index;
-	unsigned int lock;
+	struct mmprofile_stream_ring_t *p_ring;
+	unsigned long flags;
+	unsigned int pos;
 
 	if (!mmprofile_globals.enable)
 		return;
@@ -831,75 +1042,33 @@ static void mmprofile_log_int(mmp_event event, enum mmp_log_type type,
 	 */
 	if (unlikely(event < 2))
 		return;
-	index = (atomic_inc_return((atomic_t *)
-			&(mmprofile_globals.write_pointer)) - 1)
-	    % (mmprofile_globals.buffer_size_record);
-	/*check vmalloc address is valid or not*/
-	if (!pfn_valid(vmalloc_to_pfn((struct mmprofile_event_t *)
-		&(p_mmprofile_ring_buffer[index])))) {
-		mmp_aee("write_pointer:0x%x,index:0x%x,line:%d\n",
-			mmprofile_globals.write_pointer, index, __LINE__);
-		pr_info("buffer_size_record:0x%x,new_buffer_size_record:0x%x\n",
-			mmprofile_globals.buffer_size_record,
-			mmprofile_globals.new_buffer_size_record);
+	if (unlikely(!p_mmprofile_stream))
+		return;
+
+	/*
+	 * Append to this CPU's ring. Only this CPU writes it and interrupts
+	 * are off, so no atomics are needed; the lock field tells readers
+	 * when the record is complete.
+	 */
+	local_irq_save(flags);
+	if (unlikely(READ_ONCE(mmprofile_stream_paused))) {
+		local_irq_restore(flags);
 		return;
 	}
-	lock = atomic_inc_return((atomic_t *)
-		&(p_mmprofile_ring_buffer[index].lock));
-	/*atomic_t is INT, write_pointer is UINT, avoid convert error*/
-	if (mmprofile_globals.write_pointer ==
-		mmprofile_globals.buffer_size_record)
-		mmprofile_globals.write_pointer = 0;
-	if (unlikely(lock > 1)) {
-		/* Do not reduce lock count since it need
-		 * to be marked as invalid.
-		 */
-		while (1) {
-			index =
-				(atomic_inc_return((atomic_t *)
-				&(mmprofile_globals.write_pointer)) - 1) %
-				(mmprofile_globals.buffer_size_record);
-			if (!pfn_valid(vmalloc_to_pfn
-				((struct mmprofile_event_t *)
-					&(p_mmprofile_ring_buffer[index])))) {
-				mmp_aee("write_pt:0x%x,index:0x%x,line:%d\n",
-					mmprofile_globals.write_pointer,
-					index, __LINE__);
-				pr_info("buf_size:0x%x,new_buf_size:0x%x\n",
-					mmprofile_globals.buffer_size_record,
-				mmprofile_globals.new_buffer_size_record);
-				return;
-			}
-			lock =
-			    atomic_inc_return((atomic_t *) &
-					(p_mmprofile_ring_buffer[index].lock));
-			/*avoid convert error*/
-			if (mmprofile_globals.write_pointer ==
-				mmprofile_globals.buffer_size_record)
-				mmprofile_globals.write_pointer = 0;
-			/* Do not reduce lock count since it need to be
-			 * marked as invalid.
-			 */
-			if (likely(lock == 1))
-				break;
-		}
-	}
-	p_event = (struct mmprofile_event_t *)
-		&(p_mmprofile_ring_buffer[index]);
+	p_ring = &p_mmprofile_stream->ring[smp_processor_id()];
+	pos = p_ring->head;
+	p_event = mmprofile_stream_slot(smp_processor_id(), pos);
+	WRITE_ONCE(p_event->lock, 0);
+	smp_wmb();
 	system_time(&(p_event->time_low), &(p_event->time_high));
 	p_event->id = event;
 	p_event->flag = type;
 	p_event->data1 = (unsigned int)data1;
 	p_event->data2 = (unsigned int)data2;
 	p_event->meta_data_cookie = meta_data_cookie;
-	lock = atomic_dec_return((atomic_t *) &(p_event->lock));
-	if (unlikely(lock > 0)) {
-		/* Someone has marked this record as invalid.
-		 * Kill this record.
-		 */
-		p_event->id = 0;
-		p_event->lock = 0;
-	}
+	smp_store_release(&p_event->lock, pos + 1);
+	smp_store_release(&p_ring->head, pos + 1);
+	local_irq_restore(flags);
 
 	if ((mmprofile_globals.event_state[event] & MMP_EVENT_STATE_FTRACE)
 	    || (type & MMPROFILE_FLAG_SYSTRACE)) {
@@ -931,38 +1100,28 @@ static void mmprofile_log_int(mmp_event event, enum mmp_log_type type,
 	}
 }
 
-static long mmprofile_log_meta_int(mmp_event event, enum mmp_log_type type,
-	struct mmp_metadata_t *p_meta_data, long b_from_user)
-{
 #ifdef CONFIG_MTK_ENG_BUILD
-	unsigned long retn;
-	void __user *p_data;
+/*
+ * Find room for a block of @block_size at the tail of the meta list,
+ * reclaiming the least recently used blocks. Called with
+ * mmprofile_meta_list_lock held.
+ */
+static struct mmprofile_meta_datablock_t *mmprofile_meta_alloc_block(
+	unsigned long block_size)
+{
 	struct mmprofile_meta_datablock_t *p_node = NULL;
-	unsigned long block_size;
-
-	if (!mmprofile_globals.enable)
-		return 0;
-	if ((event >= MMPROFILE_MAX_EVENT_COUNT) ||
-		(event == MMP_INVALID_EVENT))
-		return -3;
-
-	if (!is_mmp_valid(event))
-		return 0;
+	struct mmprofile_meta_datablock_t *p_next_node;
 
-	if (unlikely(!p_meta_data))
-		return -1;
-	block_size =
-	    ((offsetof(struct mmprofile_meta_datablock_t, meta_data) +
-	    p_meta_data->size) + 3) & (~3);
-	if (block_size > mmprofile_globals.meta_buffer_size)
-		return -2;
-	mutex_lock(&mmprofile_meta_buffer_mutex);
 	p_node = list_entry(mmprofile_meta_buffer_list.prev,
 		struct mmprofile_meta_datablock_t, list);
 	/* If the tail block has been used,
 	 * move the first block to tail and use it for new meta data.
 	 */
 	if (p_node->data_size > 0) {
+		p_next_node = list_first_entry(&mmprofile_meta_buffer_list,
+			struct mmprofile_meta_datablock_t, list);
+		if (p_next_node->busy)
+			return NULL;
 		list_move_tail(mmprofile_meta_buffer_list.next,
 			&mmprofile_meta_buffer_list);
 		p_node = list_entry(mmprofile_meta_buffer_list.prev,
@@ -973,12 +1132,14 @@ static long mmprofile_log_meta_int(mmp_event event, enum mmp_log_type type,
 	 * least recent used blocks.
 	 */
 	while (p_node->block_size < block_size) {
-		struct mmprofile_meta_datablock_t *p_next_node =
-		    list_entry(p_node->list.next,
+		p_next_node = list_entry(p_node->list.next,
 				struct mmprofile_meta_datablock_t, list);
 		if (&(p_next_node->list) == &mmprofile_meta_buffer_list)
 			p_next_node =  list_entry(p_next_node->list.next,
 				struct mmprofile_meta_datablock_t, list);
+		/* Cannot reclaim a block whose payload is still coming in */
+		if (p_next_node->busy)
+			return NULL;
 
 		list_del(&(p_next_node->list));
 		p_node->block_size += p_next_node->block_size;
@@ -1010,18 +1171,59 @@ static long mmprofile_log_meta_int(mmp_event event, enum mmp_log_type type,
 				mmprofile_globals.meta_buffer_size);
 		p_new_node->block_size = p_node->block_size - block_size;
 		p_new_node->data_size = 0;
+		p_new_node->busy = 0;
 		list_add(&(p_new_node->list), &(p_node->list));
 		p_node->block_size = block_size;
 	}
+	return p_node;
+}
+#endif
+
+static long mmprofile_log_meta_int(mmp_event event, enum mmp_log_type type,
+	struct mmp_metadata_t *p_meta_data, long b_from_user)
+{
+#ifdef CONFIG_MTK_ENG_BUILD
+	unsigned long retn;
+	void __user *p_data;
+	struct mmprofile_meta_datablock_t *p_node = NULL;
+	unsigned long block_size;
+
+	if (!mmprofile_globals.enable)
+		return 0;
+	if ((event >= MMPROFILE_MAX_EVENT_COUNT) ||
+		(event == MMP_INVALID_EVENT))
+		return -3;
+
+	if (!is_mmp_valid(event))
+		return 0;
+
+	if (unlikely(!p_meta_data))
+		return -1;
+	block_size =
+	    ((offsetof(struct mmprofile_meta_datablock_t, meta_data) +
+	    p_meta_data->size) + 3) & (~3);
+	if (block_size > mmprofile_globals.meta_buffer_size)
+		return -2;
+	percpu_down_read(&mmprofile_meta_rwsem);
+	spin_lock(&mmprofile_meta_list_lock);
+	p_node = mmprofile_meta_alloc_block(block_size);
+	if (!p_node) {
+		spin_unlock(&mmprofile_meta_list_lock);
+		percpu_up_read(&mmprofile_meta_rwsem);
+		return -4;
+	}
 	/* Fill data */
 	p_node->data_size = p_meta_data->size;
 	p_node->data_type = p_meta_data->data_type;
 	p_node->cookie = mmprofile_meta_datacookie;
-	mmprofile_log_int(event, type, p_meta_data->data1,
-		p_meta_data->data2, mmprofile_meta_datacookie);
+	p_node->busy = 1;
 	mmprofile_meta_datacookie++;
 	if (mmprofile_meta_datacookie == 0)
 		mmprofile_meta_datacookie++;
+	spin_unlock(&mmprofile_meta_list_lock);
+
+	mmprofile_log_int(event, type, p_meta_data->data1,
+		p_meta_data->data2, p_node->cookie);
 	p_data = (void __user *)(p_meta_data->p_data);
 	if (((unsigned long)(p_node->meta_data) + p_meta_data->size) >
 	    ((unsigned long)p_mmprofile_meta_buffer +
@@ -1054,7 +1256,8 @@ static long mmprofile_log_meta_int(mmp_event event, enum mmp_log_type type,
 		else
 			memcpy(p_node->meta_data, p_data, p_meta_data->size);
 	}
-	mutex_unlock(&mmprofile_meta_buffer_mutex);
+	WRITE_ONCE(p_node->busy, 0);
+	percpu_up_read(&mmprofile_meta_rwsem);
 #endif
 
 	return 0;
@@ -1879,7 +2082,7 @@ static long mmprofile_ioctl(struct file *file, unsigned int cmd,
 		struct mmprofile_metadata_t __user *p_meta_data =
 			(struct mmprofile_metadata_t __user *)(arg + 8);
 
-		mutex_lock(&mmprofile_meta_buffer_mutex);
+		percpu_down_write(&mmprofile_meta_rwsem);
 		list_for_each_entry(p_meta_data_block,
 			&mmprofile_meta_buffer_list, list) {
 			if (p_meta_data_block->data_size <= 0)
@@ -1934,7 +2137,7 @@ static long mmprofile_ioctl(struct file *file, unsigned int cmd,
 			index++;
 		}
 		put_user(offset - 8, (unsigned int __user *)(arg + 4));
-		mutex_unlock(&mmprofile_meta_buffer_mutex);
+		percpu_up_write(&mmprofile_meta_rwsem);
 #endif
 	}
 
@@ -1961,6 +2164,17 @@ static long mmprofile_ioctl(struct file *file, unsigned int cmd,
 		mmprofile_globals.new_meta_buffer_size = arg;
 		break;
 	}
+	case MMP_IOC_STREAMSIZE:
+	{
+		unsigned int __user *p_user = (unsigned int __user *)arg;
+
+		mmprofile_init_buffer();
+		if (!bmmprofile_init_buffer)
+			ret = -EAGAIN;
+		else
+			put_user(mmprofile_stream_size, p_user);
+	}
+	break;
 	case MMP_IOC_TRYLOG:
 		if ((!mmprofile_globals.enable) ||
 		    (!bmmprofile_init_buffer) ||
@@ -2188,7 +2402,7 @@ static long mmprofile_ioctl_compat(struct file *file, unsigned int cmd,
 
 		p_meta_data = compat_ptr(arg + 8);
 
-		mutex_lock(&mmprofile_meta_buffer_mutex);
+		percpu_down_write(&mmprofile_meta_rwsem);
 		list_for_each_entry(p_meta_data_block,
 			&mmprofile_meta_buffer_list, list) {
 			if (p_meta_data_block->data_size <= 0)
@@ -2249,7 +2463,7 @@ static long mmprofile_ioctl_compat(struct file *file, unsigned int cmd,
 		}
 		p_user = compat_ptr(arg + 4);
 		put_user(offset - 8, p_user);
-		mutex_unlock(&mmprofile_meta_buffer_mutex);
+		percpu_up_write(&mmprofile_meta_rwsem);
 #endif
 	}
 	break;
@@ -2262,6 +2476,10 @@ static long mmprofile_ioctl_compat(struct file *file, unsigned int cmd,
 	case MMP_IOC_SETMETABUFSIZE:
 		ret = mmprofile_ioctl(file, MMP_IOC_SETMETABUFSIZE, arg);
 		break;
+	case MMP_IOC_STREAMSIZE:
+		ret = mmprofile_ioctl(file, MMP_IOC_STREAMSIZE,
+			(unsigned long)compat_ptr(arg));
+		break;
 	case MMP_IOC_TRYLOG:
 		if ((!mmprofile_globals.enable) ||
 		    (!bmmprofile_init_buffer) ||
@@ -2331,6 +2549,9 @@ static int mmprofile_mmap(struct file *file, struct vm_area_struct *vma)
 		if (!bmmprofile_init_buffer)
 			return -EAGAIN;
 
+		/* A snapshot of the rings, as the legacy tools expect */
+		mmprofile_merge_stream();
+
 		pos = vma->vm_start;
 
 		for (i = 0; i < mmprofile_globals.buffer_size_bytes;
@@ -2342,6 +2563,24 @@ static int mmprofile_mmap(struct file *file, struct vm_area_struct *vma)
 			     PAGE_SIZE, PAGE_READONLY))
 				return -EAGAIN;
 		}
+	} else if (mmprofile_globals.selected_buffer ==
+		MMPROFILE_STREAM_BUFFER) {
+
+		/* Live view of the per-CPU rings, logging keeps running */
+		mmprofile_init_buffer();
+
+		if (!bmmprofile_init_buffer)
+			return -EAGAIN;
+
+		/* check user space buffer length */
+		if ((vma->vm_end - vma->vm_start) != mmprofile_stream_size)
+			return -EINVAL;
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+
+		vma->vm_flags &= ~VM_MAYWRITE;
+		if (remap_vmalloc_range(vma, p_mmprofile_stream, 0))
+			return -EAGAIN;
 	} else
 		return -EINVAL;
 	return 0;
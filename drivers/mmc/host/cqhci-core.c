@@ -32,6 +32,7 @@ struct cqhci_slot {
 #define CQHCI_HOST_CRC		BIT(2)
 #define CQHCI_HOST_TIMEOUT	BIT(3)
 #define CQHCI_HOST_OTHER	BIT(4)
+	ktime_t issue_time;
 };
 
 static inline u8 *get_desc(struct cqhci_host *cq_host, u8 tag)
@@ -424,7 +425,7 @@ static void cqhci_prep_task_desc(struct mmc_request *mrq,
 
 	desc0 = CQHCI_VALID(1) |
 		CQHCI_END(1) |
-		CQHCI_INT(1) |
+		CQHCI_INT(!cq_host->ic_enabled) |
 		CQHCI_ACT(0x5) |
 		CQHCI_FORCED_PROG(!!(req_flags & MMC_DATA_FORCED_PRG)) |
 		CQHCI_DATA_TAG(!!(req_flags & MMC_DATA_DAT_TAG)) |
@@ -638,6 +639,8 @@ static int cqhci_request(struct mmc_host *mmc, struct mmc_request *mrq)
 
 	cq_host->slot[tag].mrq = mrq;
 	cq_host->slot[tag].flags = 0;
+	if (cq_host->ops->mrq_done)
+		cq_host->slot[tag].issue_time = ktime_get();
 
 	cq_host->qcnt += 1;
 	/* Make sure descriptors are ready before ringing the doorbell */
@@ -810,6 +813,9 @@ static void cqhci_finish_mrq(struct mmc_host *mmc, unsigned int tag)
 		mmc_mtk_biolog_check(mmc, cq_host->qcnt);
 	}
 
+	if (cq_host->ops->mrq_done)
+		cq_host->ops->mrq_done(mmc, mrq, slot->issue_time);
+
 	mmc_cqe_request_done(mmc, mrq);
 }
 
@@ -11,6 +11,7 @@
 #include <linux/completion.h>
 #include <linux/wait.h>
 #include <linux/irqreturn.h>
+#include <linux/ktime.h>
 #include <asm/io.h>
 
 /* registers */
@@ -23,6 +24,13 @@
 /* capabilities */
 #define CQHCI_CAP			0x04
 #define CQHCI_CAP_CS			0x10000000 /* Crypto Support */
+#define CQHCI_CAP_ITCFMUL(x)		(((x) & GENMASK(15, 12)) >> 12)
+#define CQHCI_CAP_ITCFVAL(x)		((x) & GENMASK(9, 0))
+#define CQHCI_ITCFMUL_1KHZ		0x0
+#define CQHCI_ITCFMUL_10KHZ		0x1
+#define CQHCI_ITCFMUL_100KHZ		0x2
+#define CQHCI_ITCFMUL_1MHZ		0x3
+#define CQHCI_ITCFMUL_10MHZ		0x4
 
 /* configuration */
 #define CQHCI_CFG			0x08
@@ -244,6 +252,8 @@ struct cqhci_host {
 	bool activated;
 	bool waiting_for_idle;
 	bool recovery_halt;
+	/* data tasks leave completion interrupts to coalescing */
+	bool ic_enabled;
 
 	size_t desc_size;
 	size_t data_size;
@@ -287,6 +297,8 @@ struct cqhci_host_ops {
 				 u64 *data);
 	void (*pre_enable)(struct mmc_host *mmc);
 	void (*post_disable)(struct mmc_host *mmc);
+	void (*mrq_done)(struct mmc_host *mmc, struct mmc_request *mrq,
+			 ktime_t issue_time);
 #ifdef CONFIG_MMC_CRYPTO
 	int (*program_key)(struct cqhci_host *cq_host,
 			   const union cqhci_crypto_cfg_entry *cfg, int slot);
@@ -327,6 +327,14 @@
 
 #define DEFAULT_DEBOUNCE	(8)	/* 8 cycles CD debounce */
 
+/* data request latency buckets: <64us, <128us, ... , >=64ms */
+#define MSDC_LAT_HIST_BUCKETS	12
+#define MSDC_LAT_HIST_MIN_SHIFT	6
+
+/* CQE interrupt coalescing limits, see CQHCI_IC */
+#define MSDC_CQ_IC_MAX_THRESHOLD	31
+#define MSDC_CQ_IC_MAX_TIMEOUT		127
+
 #define PAD_DELAY_MAX	32 /* PAD delay cells */
 #define PAD_DELAY_64	64
 /*--------------------------------------------------------------------------*/
@@ -488,6 +496,11 @@ struct msdc_host {
 	u32 pc_suspend;			/* suspend/resume count */
 	u32 cmd19_fail;			/* cmd19 tune failed count */
 
+	u32 cq_ic_threshold;		/* cqe completions per interrupt */
+	u32 cq_ic_latency_us;		/* cqe completion interrupt delay bound */
+	ktime_t mrq_start;		/* issue time of the legacy data request */
+	u32 lat_hist[2][MSDC_LAT_HIST_BUCKETS]; /* [read, write] latency */
+
 #if IS_ENABLED(CONFIG_AMAZON_METRICS_LOG) || IS_ENABLED(CONFIG_AMAZON_MINERVA_METRICS_LOG)
 	struct delayed_work metrics_work;
 	bool metrics_enable;
@@ -502,6 +515,7 @@ struct msdc_host {
 	u32 cmd19_fail_p; /* reported cmd19 tune failed count */
 	u32 inserted_p; /* reported card detection count */
 	u32 inserted; /* total card detection could */
+	u32 lat_hist_p[2][MSDC_LAT_HIST_BUCKETS]; /* reported latency buckets */
 #endif
 };
 
@@ -564,6 +578,31 @@ MSDC_DEV_ATTR(reqtimeout_count, "%d", host->reqtimeout_count, u32);
 MSDC_DEV_ATTR(pc_count, "%d", host->pc_count, u32);
 MSDC_DEV_ATTR(pc_suspend, "%d", host->pc_suspend, u32);
 MSDC_DEV_ATTR(cmd19_fail, "%d", host->cmd19_fail, u32);
+/* coalescing settings take effect the next time the cqe is enabled */
+MSDC_DEV_ATTR(cq_ic_threshold, "%u", host->cq_ic_threshold, u32);
+MSDC_DEV_ATTR(cq_ic_latency_us, "%u", host->cq_ic_latency_us, u32);
+
+static ssize_t latency_hist_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct mmc_host *mmc = dev_get_drvdata(dev);
+	struct msdc_host *host = mmc_priv(mmc);
+	ssize_t len = 0;
+	int dir, i;
+
+	for (dir = 0; dir < 2; dir++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s:",
+				 dir ? "write" : "read");
+		for (i = 0; i < MSDC_LAT_HIST_BUCKETS; i++)
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %u",
+					 READ_ONCE(host->lat_hist[dir][i]));
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+
+	return len;
+}
+static DEVICE_ATTR_RO(latency_hist);
+
 static struct device_attribute *msdc_attrs[] = {
 	&dev_attr_crc_count,
 	&dev_attr_crc_invalid_count,
@@ -574,6 +613,9 @@ static struct device_attribute *msdc_attrs[] = {
 	&dev_attr_pc_count,
 	&dev_attr_pc_suspend,
 	&dev_attr_cmd19_fail,
+	&dev_attr_cq_ic_threshold,
+	&dev_attr_cq_ic_latency_us,
+	&dev_attr_latency_hist,
 	NULL,
 };
 
@@ -603,6 +645,41 @@ static void msdc_remove_device_attrs(struct msdc_host *host, struct device_attri
 		device_remove_file(host->dev, attrs[i]);
 }
 
+#if IS_ENABLED(CONFIG_AMAZON_METRICS_LOG) || IS_ENABLED(CONFIG_AMAZON_MINERVA_METRICS_LOG)
+static void msdc_log_latency_hist(struct msdc_host *host)
+{
+	struct mmc_host *mmc = mmc_from_priv(host);
+	const char *type = (mmc->caps & MMC_CAP_SD_HIGHSPEED) ? "SD" : "EMMC";
+	char name[24];
+	u32 val;
+	int dir, i;
+
+	for (dir = 0; dir < 2; dir++) {
+		for (i = 0; i < MSDC_LAT_HIST_BUCKETS; i++) {
+			val = READ_ONCE(host->lat_hist[dir][i]);
+			if (val == host->lat_hist_p[dir][i])
+				continue;
+			snprintf(name, sizeof(name), "%s_lat_%uus",
+				 dir ? "wr" : "rd",
+				 1U << (i + MSDC_LAT_HIST_MIN_SHIFT));
+#if IS_ENABLED(CONFIG_AMAZON_METRICS_LOG)
+			log_counter_to_vitals(ANDROID_LOG_INFO, "Kernel",
+				"Kernel", type, name,
+				val - host->lat_hist_p[dir][i], "count",
+				NULL, VITALS_NORMAL);
+#else
+			log_counter_to_vitals_v2(ANDROID_LOG_INFO,
+				VITALS_EMMC_GROUP_ID, VITALS_EMMC_SCHEMA_ID,
+				"Kernel", "msdc_state", type, name,
+				val - host->lat_hist_p[dir][i], "count",
+				NULL, VITALS_NORMAL, NULL, NULL);
+#endif
+			host->lat_hist_p[dir][i] = val;
+		}
+	}
+}
+#endif
+
 #if IS_ENABLED(CONFIG_AMAZON_METRICS_LOG)
 static void msdc_metrics_work(struct work_struct *work)
 {
@@ -619,6 +696,7 @@ static void msdc_metrics_work(struct work_struct *work)
 	MSDC_LOG_COUNTER_TO_VITALS(pc_suspend, host->pc_suspend);
 	MSDC_LOG_COUNTER_TO_VITALS(cmd19_fail, host->cmd19_fail);
 	MSDC_LOG_COUNTER_TO_VITALS(inserted, host->inserted);
+	msdc_log_latency_hist(host);
 }
 #endif
 
@@ -638,6 +716,7 @@ static void msdc_metrics_work(struct work_struct *work)
 	MSDC_MINERVA_COUNTER_TO_VITALS(pc_suspend, host->pc_suspend);
 	MSDC_MINERVA_COUNTER_TO_VITALS(cmd19_fail, host->cmd19_fail);
 	MSDC_MINERVA_COUNTER_TO_VITALS(inserted, host->inserted);
+	msdc_log_latency_hist(host);
 }
 #endif
 
@@ -1340,6 +1419,26 @@ static void msdc_track_cmd_data(struct msdc_host *host,
 			__func__, cmd->opcode, cmd->arg, host->error);
 }
 
+/*
+ * Buckets are powers of two starting at 64us; the last one collects
+ * everything slower. Counters may race between the legacy and cqe
+ * completion paths only across a mode switch, which is harmless here.
+ */
+static void msdc_account_latency(struct msdc_host *host,
+				 struct mmc_data *data, ktime_t start)
+{
+	u64 us = ktime_us_delta(ktime_get(), start);
+	int dir = !(data->flags & MMC_DATA_READ);
+	int i = 0;
+
+	us >>= MSDC_LAT_HIST_MIN_SHIFT;
+	while (us && i < MSDC_LAT_HIST_BUCKETS - 1) {
+		us >>= 1;
+		i++;
+	}
+	host->lat_hist[dir][i]++;
+}
+
 static void msdc_request_done(struct msdc_host *host, struct mmc_request *mrq)
 {
 	unsigned long flags;
@@ -1355,8 +1454,11 @@ static void msdc_request_done(struct msdc_host *host, struct mmc_request *mrq)
 	spin_unlock_irqrestore(&host->lock, flags);
 
 	msdc_track_cmd_data(host, mrq->cmd, mrq->data);
-	if (mrq->data)
+	if (mrq->data) {
 		msdc_unprepare_data(host, mrq);
+		if (!mrq->data->error)
+			msdc_account_latency(host, mrq->data, host->mrq_start);
+	}
 	if (host->error)
 		msdc_reset_hw(host);
 	mmc_request_done(mmc_from_priv(host), mrq);
@@ -1542,8 +1644,10 @@ static void msdc_ops_request(struct mmc_host *mmc, struct mmc_request *mrq)
 	WARN_ON(host->mrq);
 	host->mrq = mrq;
 
-	if (mrq->data)
+	if (mrq->data) {
+		host->mrq_start = ktime_get();
 		msdc_prepare_data(host, mrq);
+	}
 
 	/* if SBC is required, we have HW option and SW option.
 	 * if HW option is enabled, and SBC does not have "special" flags,
@@ -2729,6 +2833,43 @@ static void msdc_hs400_enhanced_strobe(struct mmc_host *mmc,
 	}
 }
 
+/*
+ * Program cqe interrupt coalescing: an interrupt is raised once
+ * cq_ic_threshold data tasks have completed, or cq_ic_latency_us after
+ * the first pending completion, whichever comes first. The timeout
+ * counts in units of 1024 periods of the cqe internal timer clock.
+ * Called with no task in flight, so the descriptor INT bit and the
+ * register setting always agree.
+ */
+static void msdc_cqe_set_ic(struct msdc_host *host)
+{
+	struct cqhci_host *cq_host = host->cq_host;
+	u32 cap, mul, khz, ticks, thr;
+	u64 tmp;
+
+	thr = min_t(u32, host->cq_ic_threshold, MSDC_CQ_IC_MAX_THRESHOLD);
+	cap = cqhci_readl(cq_host, CQHCI_CAP);
+	mul = CQHCI_CAP_ITCFMUL(cap);
+	khz = CQHCI_CAP_ITCFVAL(cap);
+	if (thr < 2 || !host->cq_ic_latency_us ||
+	    mul > CQHCI_ITCFMUL_10MHZ || !khz) {
+		cqhci_writel(cq_host, 0, CQHCI_IC);
+		cq_host->ic_enabled = false;
+		return;
+	}
+
+	/* ITCFVAL counts in 10^ITCFMUL kHz, 5h and up are reserved */
+	while (mul--)
+		khz *= 10;
+	tmp = div_u64((u64)host->cq_ic_latency_us * khz, 1000 * 1024);
+	ticks = clamp_t(u64, tmp, 1, MSDC_CQ_IC_MAX_TIMEOUT);
+
+	cqhci_writel(cq_host, CQHCI_IC_ENABLE | CQHCI_IC_ICCTHWEN |
+		     CQHCI_IC_ICCTH(thr) | CQHCI_IC_ICTOVALWEN |
+		     CQHCI_IC_ICTOVAL(ticks), CQHCI_IC);
+	cq_host->ic_enabled = true;
+}
+
 static void msdc_cqe_enable(struct mmc_host *mmc)
 {
 	struct msdc_host *host = mmc_priv(mmc);
@@ -2741,6 +2882,7 @@ static void msdc_cqe_enable(struct mmc_host *mmc)
 	msdc_set_busy_timeout(host, 20 * 1000000000ULL, 0);
 	/* default read data timeout 1s */
 	msdc_set_timeout(host, 1000000000ULL, 0);
+	msdc_cqe_set_ic(host);
 }
 
 static void msdc_cqe_disable(struct mmc_host *mmc, bool recovery)
@@ -2770,6 +2912,15 @@ static void msdc_cqe_disable(struct mmc_host *mmc, bool recovery)
 	}
 }
 
+static void msdc_cqe_mrq_done(struct mmc_host *mmc, struct mmc_request *mrq,
+			      ktime_t issue_time)
+{
+	struct msdc_host *host = mmc_priv(mmc);
+
+	if (mrq->data && !mrq->data->error)
+		msdc_account_latency(host, mrq->data, issue_time);
+}
+
 static void msdc_cqe_pre_enable(struct mmc_host *mmc)
 {
 	struct cqhci_host *cq_host = mmc->cqe_private;
@@ -2827,6 +2978,7 @@ static const struct cqhci_host_ops msdc_cmdq_ops = {
 	.disable        = msdc_cqe_disable,
 	.pre_enable = msdc_cqe_pre_enable,
 	.post_disable = msdc_cqe_post_disable,
+	.mrq_done = msdc_cqe_mrq_done,
 };
 
 static void msdc_of_property_parse(struct platform_device *pdev,
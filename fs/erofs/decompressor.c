@@ -7,6 +7,9 @@
 #include "compress.h"
 #include <linux/module.h>
 #include <linux/lz4.h>
+#ifdef CONFIG_EROFS_FS_ZIP_ZSTD
+#include <linux/zstd.h>
+#endif
 
 #ifndef LZ4_DISTANCE_MAX	/* history window size */
 #define LZ4_DISTANCE_MAX 65535	/* set to maximum value by default */
@@ -18,6 +21,9 @@
 #endif
 
 struct z_erofs_decompressor {
+	/* parse the on-disk configuration record (NULL for legacy images) */
+	int (*config)(struct super_block *sb, struct erofs_super_block *dsb,
+		      void *data, int size);
 	/*
 	 * if destpages have sparsed pages, fill them with bounce pages.
 	 * it also check whether destpages indicate continuous physical memory.
@@ -28,10 +34,22 @@ struct z_erofs_decompressor {
 	char *name;
 };
 
-int z_erofs_load_lz4_config(struct super_block *sb,
-			    struct erofs_super_block *dsb)
+static int z_erofs_load_lz4_config(struct super_block *sb,
+				   struct erofs_super_block *dsb,
+				   void *data, int size)
 {
-	u16 distance = le16_to_cpu(dsb->lz4_max_distance);
+	struct z_erofs_lz4_cfgs *lz4 = data;
+	u16 distance;
+
+	if (lz4) {
+		if (size < sizeof(struct z_erofs_lz4_cfgs)) {
+			erofs_err(sb, "invalid lz4 cfgs, size=%u", size);
+			return -EINVAL;
+		}
+		distance = le16_to_cpu(lz4->max_distance);
+	} else {
+		distance = le16_to_cpu(dsb->u1.lz4_max_distance);
+	}
 
 	EROFS_SB(sb)->lz4.max_distance_pages = distance ?
 					DIV_ROUND_UP(distance, PAGE_SIZE) + 1 :
@@ -39,36 +57,44 @@ int z_erofs_load_lz4_config(struct super_block *sb,
 	return 0;
 }
 
-static int z_erofs_lz4_prepare_destpages(struct z_erofs_decompress_req *rq,
-					 struct list_head *pagepool)
+/*
+ * sparse destination pages are backed by bounce pages, which can be
+ * recycled once the decoder can no longer refer back to them, i.e.
+ * after max_distance_pages further pages of output. 0 means the decoder
+ * may refer back to any earlier page, so every hole gets its own page.
+ */
+static int z_erofs_prepare_destpages(struct z_erofs_decompress_req *rq,
+				     struct list_head *pagepool,
+				     unsigned int max_distance_pages)
 {
 	const unsigned int nr =
 		PAGE_ALIGN(rq->pageofs_out + rq->outputsize) >> PAGE_SHIFT;
 	struct page *availables[LZ4_MAX_DISTANCE_PAGES] = { NULL };
 	unsigned long bounced[DIV_ROUND_UP(LZ4_MAX_DISTANCE_PAGES,
 					   BITS_PER_LONG)] = { 0 };
-	unsigned int lz4_max_distance_pages =
-				EROFS_SB(rq->sb)->lz4.max_distance_pages;
+	const bool recycle = max_distance_pages;
 	void *kaddr = NULL;
 	unsigned int i, j, top;
 
+	DBG_BUGON(max_distance_pages > LZ4_MAX_DISTANCE_PAGES);
 	top = 0;
 	for (i = j = 0; i < nr; ++i, ++j) {
 		struct page *const page = rq->out[i];
 		struct page *victim;
 
-		if (j >= lz4_max_distance_pages)
+		if (j >= max_distance_pages)
 			j = 0;
 
 		/* 'valid' bounced can only be tested after a complete round */
-		if (test_bit(j, bounced)) {
-			DBG_BUGON(i < lz4_max_distance_pages);
-			DBG_BUGON(top >= lz4_max_distance_pages);
-			availables[top++] = rq->out[i - lz4_max_distance_pages];
+		if (recycle && test_bit(j, bounced)) {
+			DBG_BUGON(i < max_distance_pages);
+			DBG_BUGON(top >= max_distance_pages);
+			availables[top++] = rq->out[i - max_distance_pages];
 		}
 
 		if (page) {
-			__clear_bit(j, bounced);
+			if (recycle)
+				__clear_bit(j, bounced);
 			if (kaddr) {
 				if (kaddr + PAGE_SIZE == page_address(page))
 					kaddr += PAGE_SIZE;
@@ -80,7 +106,8 @@ static int z_erofs_lz4_prepare_destpages(struct z_erofs_decompress_req *rq,
 			continue;
 		}
 		kaddr = NULL;
-		__set_bit(j, bounced);
+		if (recycle)
+			__set_bit(j, bounced);
 
 		if (top) {
 			victim = availables[--top];
@@ -95,6 +122,13 @@ static int z_erofs_lz4_prepare_destpages(struct z_erofs_decompress_req *rq,
 	return kaddr ? 1 : 0;
 }
 
+static int z_erofs_lz4_prepare_destpages(struct z_erofs_decompress_req *rq,
+					 struct list_head *pagepool)
+{
+	return z_erofs_prepare_destpages(rq, pagepool,
+				EROFS_SB(rq->sb)->lz4.max_distance_pages);
+}
+
 static void *generic_copy_inplace_data(struct z_erofs_decompress_req *rq,
 				       u8 *src, unsigned int pageofs_in)
 {
@@ -200,17 +234,294 @@ static int z_erofs_lz4_decompress(struct z_erofs_decompress_req *rq, u8 *out)
 	return ret;
 }
 
+#ifdef CONFIG_EROFS_FS_ZIP_ZSTD
+/* the largest zstd window accepted, which sizes the per-CPU streams */
+#define Z_EROFS_ZSTD_MAX_WINDOWLOG	17
+
+struct z_erofs_zstd_stream {
+	ZSTD_DStream *ds;
+	void *wksp;
+};
+
+static DEFINE_MUTEX(z_erofs_zstd_lock);
+static struct z_erofs_zstd_stream __percpu *z_erofs_zstd_streams;
+
+static void z_erofs_zstd_free_streams(struct z_erofs_zstd_stream __percpu *s)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kvfree(per_cpu_ptr(s, cpu)->wksp);
+	free_percpu(s);
+}
+
+static int z_erofs_load_zstd_config(struct super_block *sb,
+				    struct erofs_super_block *dsb,
+				    void *data, int size)
+{
+	const size_t window = 1UL << Z_EROFS_ZSTD_MAX_WINDOWLOG;
+	struct z_erofs_zstd_cfgs *zstd = data;
+	struct z_erofs_zstd_stream __percpu *streams;
+	size_t wkspsz;
+	int cpu, err = 0;
+
+	if (!zstd || size < sizeof(struct z_erofs_zstd_cfgs) || zstd->format) {
+		erofs_err(sb, "unsupported zstd format, size=%u", size);
+		return -EINVAL;
+	}
+
+	if (zstd->windowlog + ZSTD_WINDOWLOG_MIN > Z_EROFS_ZSTD_MAX_WINDOWLOG) {
+		erofs_err(sb, "unsupported zstd window log %u",
+			  zstd->windowlog + ZSTD_WINDOWLOG_MIN);
+		return -EINVAL;
+	}
+
+	/*
+	 * decompression runs in atomic context (see kmap_atomic() below),
+	 * so each CPU owns a stream, allocated once for all instances.
+	 */
+	mutex_lock(&z_erofs_zstd_lock);
+	if (z_erofs_zstd_streams)
+		goto out;
+
+	streams = alloc_percpu(struct z_erofs_zstd_stream);
+	if (!streams) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	wkspsz = ZSTD_DStreamWorkspaceBound(window);
+	for_each_possible_cpu(cpu) {
+		struct z_erofs_zstd_stream *strm = per_cpu_ptr(streams, cpu);
+
+		strm->wksp = kvmalloc(wkspsz, GFP_KERNEL);
+		if (!strm->wksp) {
+			err = -ENOMEM;
+			break;
+		}
+		strm->ds = ZSTD_initDStream(window, strm->wksp, wkspsz);
+		if (!strm->ds) {
+			err = -EINVAL;
+			break;
+		}
+	}
+
+	if (err)
+		z_erofs_zstd_free_streams(streams);
+	else
+		z_erofs_zstd_streams = streams;
+out:
+	mutex_unlock(&z_erofs_zstd_lock);
+	return err;
+}
+
+static int z_erofs_zstd_prepare_destpages(struct z_erofs_decompress_req *rq,
+					  struct list_head *pagepool)
+{
+	/*
+	 * with the content size known and the whole output mapped, zstd
+	 * decodes in a single pass straight into it, so matches may reach
+	 * back to any earlier page of the pcluster.
+	 */
+	return z_erofs_prepare_destpages(rq, pagepool, 0);
+}
+
+static int z_erofs_zstd_decompress(struct z_erofs_decompress_req *rq, u8 *out)
+{
+	struct z_erofs_zstd_stream *strm;
+	ZSTD_inBuffer in_buf;
+	ZSTD_outBuffer out_buf = {
+		.dst = out,
+		.size = rq->outputsize,
+	};
+	unsigned int inputmargin;
+	size_t zret;
+	bool copied;
+	u8 *src;
+	int ret = 0;
+
+	if (rq->inputsize > PAGE_SIZE)
+		return -EOPNOTSUPP;
+
+	src = kmap_atomic(*rq->in);
+
+	/* compressed data is always 0-padded to the end of the pcluster */
+	inputmargin = 0;
+	while (!src[inputmargin & ~PAGE_MASK])
+		if (!(++inputmargin & ~PAGE_MASK))
+			break;
+
+	if (inputmargin >= rq->inputsize) {
+		kunmap_atomic(src);
+		return -EIO;
+	}
+
+	/* the stream flushes ahead of its input, never decode in place */
+	copied = false;
+	if (rq->inplace_io) {
+		src = generic_copy_inplace_data(rq, src, inputmargin);
+		inputmargin = 0;
+		copied = true;
+	}
+
+	in_buf.src = src + inputmargin;
+	in_buf.size = rq->inputsize - inputmargin;
+	in_buf.pos = 0;
+
+	strm = get_cpu_ptr(z_erofs_zstd_streams);
+	zret = ZSTD_resetDStream(strm->ds);
+	while (!ZSTD_isError(zret)) {
+		zret = ZSTD_decompressStream(strm->ds, &out_buf, &in_buf);
+		/* stop at the end of the frame or once the output is full */
+		if (!zret || out_buf.pos >= out_buf.size ||
+		    in_buf.pos >= in_buf.size)
+			break;
+	}
+	put_cpu_ptr(z_erofs_zstd_streams);
+
+	if (ZSTD_isError(zret) || out_buf.pos != rq->outputsize) {
+		erofs_err(rq->sb, "failed to decompress %d in[%zu, %u] out[%u]",
+			  ZSTD_isError(zret) ? -(int)ZSTD_getErrorCode(zret) :
+			  (int)out_buf.pos, in_buf.size, inputmargin,
+			  rq->outputsize);
+		memset(out + out_buf.pos, 0, rq->outputsize - out_buf.pos);
+		ret = -EIO;
+	}
+
+	if (copied)
+		erofs_put_pcpubuf(src);
+	else
+		kunmap_atomic(src);
+	return ret;
+}
+#endif
+
 static struct z_erofs_decompressor decompressors[] = {
 	[Z_EROFS_COMPRESSION_SHIFTED] = {
 		.name = "shifted"
 	},
 	[Z_EROFS_COMPRESSION_LZ4] = {
+		.config = z_erofs_load_lz4_config,
 		.prepare_destpages = z_erofs_lz4_prepare_destpages,
 		.decompress = z_erofs_lz4_decompress,
 		.name = "lz4"
 	},
+#ifdef CONFIG_EROFS_FS_ZIP_ZSTD
+	[Z_EROFS_COMPRESSION_ZSTD] = {
+		.config = z_erofs_load_zstd_config,
+		.prepare_destpages = z_erofs_zstd_prepare_destpages,
+		.decompress = z_erofs_zstd_decompress,
+		.name = "zstd"
+	},
+#endif
 };
 
+/* read a length-prefixed record from the metadata following the sb */
+static void *z_erofs_read_cfg(struct super_block *sb, erofs_off_t *offset,
+			      int *lengthp)
+{
+	struct page *page;
+	u8 *buffer, *kaddr;
+	int len, i, cnt;
+
+	*offset = round_up(*offset, 4);
+	page = erofs_get_meta_page(sb, erofs_blknr(*offset));
+	if (IS_ERR(page))
+		return ERR_CAST(page);
+
+	kaddr = kmap_atomic(page);
+	len = le16_to_cpu(*(__le16 *)(kaddr + erofs_blkoff(*offset)));
+	kunmap_atomic(kaddr);
+	if (!len)
+		len = U16_MAX + 1;
+
+	buffer = kmalloc(len, GFP_KERNEL);
+	if (!buffer) {
+		buffer = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+	*offset += sizeof(__le16);
+	*lengthp = len;
+
+	for (i = 0; i < len; i += cnt) {
+		cnt = min_t(int, EROFS_BLKSIZ - erofs_blkoff(*offset), len - i);
+		if (page->index != erofs_blknr(*offset)) {
+			unlock_page(page);
+			put_page(page);
+			page = erofs_get_meta_page(sb, erofs_blknr(*offset));
+			if (IS_ERR(page)) {
+				kfree(buffer);
+				return ERR_CAST(page);
+			}
+		}
+		kaddr = kmap_atomic(page);
+		memcpy(buffer + i, kaddr + erofs_blkoff(*offset), cnt);
+		kunmap_atomic(kaddr);
+		*offset += cnt;
+	}
+out:
+	unlock_page(page);
+	put_page(page);
+	return buffer;
+}
+
+int z_erofs_parse_cfgs(struct super_block *sb, struct erofs_super_block *dsb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+	unsigned int algs, alg;
+	erofs_off_t offset;
+	int size, ret = 0;
+
+	if (!(sbi->feature_incompat & EROFS_FEATURE_INCOMPAT_COMPR_CFGS)) {
+		sbi->available_compr_algs = 1 << Z_EROFS_COMPRESSION_LZ4;
+		return z_erofs_load_lz4_config(sb, dsb, NULL, 0);
+	}
+
+	sbi->available_compr_algs = le16_to_cpu(dsb->u1.available_compr_algs);
+	if (sbi->available_compr_algs & ~Z_EROFS_ALL_COMPR_ALGS) {
+		erofs_err(sb, "unidentified algorithms %x, please upgrade kernel",
+			  sbi->available_compr_algs & ~Z_EROFS_ALL_COMPR_ALGS);
+		return -EOPNOTSUPP;
+	}
+
+	/* legacy (non-compacted) inodes are always lz4 */
+	sbi->lz4.max_distance_pages = LZ4_MAX_DISTANCE_PAGES;
+
+	offset = EROFS_SUPER_OFFSET + sizeof(struct erofs_super_block);
+	alg = 0;
+	for (algs = sbi->available_compr_algs; algs; algs >>= 1, ++alg) {
+		void *data;
+
+		if (!(algs & 1))
+			continue;
+
+		data = z_erofs_read_cfg(sb, &offset, &size);
+		if (IS_ERR(data))
+			return PTR_ERR(data);
+
+		if (decompressors[alg].config) {
+			ret = decompressors[alg].config(sb, dsb, data, size);
+		} else {
+			erofs_err(sb, "algorithm %u isn't enabled on this kernel",
+				  alg);
+			ret = -EOPNOTSUPP;
+		}
+		kfree(data);
+		if (ret)
+			break;
+	}
+	return ret;
+}
+
+void z_erofs_exit_decompressors(void)
+{
+#ifdef CONFIG_EROFS_FS_ZIP_ZSTD
+	if (z_erofs_zstd_streams)
+		z_erofs_zstd_free_streams(z_erofs_zstd_streams);
+	z_erofs_zstd_streams = NULL;
+#endif
+}
+
 static void copy_from_pcpubuf(struct page **out, const char *dst,
 			      unsigned short pageofs_out,
 			      unsigned int outputsize)
@@ -356,3 +667,6 @@ int z_erofs_decompress(struct z_erofs_decompress_req *rq,
 	return z_erofs_decompress_generic(rq, pagepool);
 }
 
+#ifdef CONFIG_EROFS_FS_KUNIT_TEST
+#include "decompressor_test.c"
+#endif
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for EROFS decompressors, included by decompressor.c.
+ */
+#include <kunit/test.h>
+#include <linux/random.h>
+
+#define Z_EROFS_TEST_NRPAGES	8
+#define Z_EROFS_TEST_PERIOD	64
+
+/*
+ * The first half of the output is made of pages repeating a short random
+ * period each, and the second half copies the first half, so every page
+ * of the second half starts with a match reaching back across holes.
+ */
+static void z_erofs_test_fill(u8 *data)
+{
+	unsigned int half = Z_EROFS_TEST_NRPAGES / 2;
+	unsigned int i, ofs;
+	u8 period[Z_EROFS_TEST_PERIOD];
+
+	for (i = 0; i < half; ++i) {
+		prandom_bytes(period, sizeof(period));
+		for (ofs = 0; ofs < PAGE_SIZE; ofs += sizeof(period))
+			memcpy(data + i * PAGE_SIZE + ofs, period,
+			       sizeof(period));
+	}
+	memcpy(data + half * PAGE_SIZE, data, half * PAGE_SIZE);
+}
+
+/* compress the data into the tail of a page, 0-padded like a pcluster */
+static struct page *z_erofs_test_compress(struct kunit *test, const u8 *data)
+{
+	const size_t srcsize = Z_EROFS_TEST_NRPAGES * PAGE_SIZE;
+	ZSTD_parameters params = ZSTD_getParams(3, srcsize, 0);
+	size_t wkspsz, zret;
+	struct page *page;
+	ZSTD_CCtx *cctx;
+	void *wksp;
+	u8 *buf;
+
+	params.fParams.contentSizeFlag = 1;
+	wkspsz = ZSTD_CCtxWorkspaceBound(params.cParams);
+	wksp = kvmalloc(wkspsz, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, wksp);
+	buf = kunit_kzalloc(test, PAGE_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buf);
+
+	cctx = ZSTD_initCCtx(wksp, wkspsz);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, cctx);
+	zret = ZSTD_compressCCtx(cctx, buf, PAGE_SIZE, data, srcsize, params);
+	kvfree(wksp);
+	KUNIT_ASSERT_FALSE(test, ZSTD_isError(zret));
+
+	page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, page);
+	memcpy(page_address(page) + PAGE_SIZE - zret, buf, zret);
+	return page;
+}
+
+static void z_erofs_test_zstd_sparse(struct kunit *test)
+{
+	struct z_erofs_zstd_cfgs cfgs = {
+		.windowlog = Z_EROFS_ZSTD_MAX_WINDOWLOG - ZSTD_WINDOWLOG_MIN,
+	};
+	struct page *out[Z_EROFS_TEST_NRPAGES] = { NULL };
+	struct page *in;
+	struct z_erofs_decompress_req rq = {
+		.in = &in,
+		.out = out,
+		.inputsize = PAGE_SIZE,
+		.outputsize = Z_EROFS_TEST_NRPAGES * PAGE_SIZE,
+		.alg = Z_EROFS_COMPRESSION_ZSTD,
+	};
+	const unsigned int last = Z_EROFS_TEST_NRPAGES - 1;
+	LIST_HEAD(pagepool);
+	unsigned int i, j;
+	u8 *data;
+
+	KUNIT_ASSERT_EQ(test, 0,
+			z_erofs_load_zstd_config(NULL, NULL, &cfgs,
+						 sizeof(cfgs)));
+
+	data = kunit_kzalloc(test, rq.outputsize, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, data);
+	z_erofs_test_fill(data);
+	in = z_erofs_test_compress(test, data);
+
+	/* only the first and the last page are requested */
+	out[0] = alloc_page(GFP_KERNEL);
+	out[last] = alloc_page(GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, out[0]);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, out[last]);
+
+	KUNIT_EXPECT_EQ(test, 0, z_erofs_decompress(&rq, &pagepool));
+
+	/* no two holes may share a bounce page */
+	for (i = 1; i < last; ++i)
+		for (j = i + 1; j < last; ++j)
+			KUNIT_EXPECT_PTR_NE(test, out[i], out[j]);
+
+	KUNIT_EXPECT_EQ(test, 0, memcmp(page_address(out[0]), data,
+					PAGE_SIZE));
+	KUNIT_EXPECT_EQ(test, 0, memcmp(page_address(out[last]),
+					data + last * PAGE_SIZE, PAGE_SIZE));
+
+	for (i = 0; i < Z_EROFS_TEST_NRPAGES; ++i) {
+		set_page_private(out[i], 0);
+		put_page(out[i]);
+	}
+	put_page(in);
+	put_pages_list(&pagepool);
+}
+
+static struct kunit_case z_erofs_decompressor_test_cases[] = {
+	KUNIT_CASE(z_erofs_test_zstd_sparse),
+	{}
+};
+
+static struct kunit_suite z_erofs_decompressor_test_suite = {
+	.name = "erofs-decompressor",
+	.test_cases = z_erofs_decompressor_test_cases,
+};
+
+kunit_test_suites(&z_erofs_decompressor_test_suite);
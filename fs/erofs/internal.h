@@ -80,6 +80,8 @@ struct erofs_sb_info {
 	struct inode *managed_cache;
 
 	struct erofs_sb_lz4_info lz4;
+	/* bitmap of compression algorithms used by this filesystem */
+	u16 available_compr_algs;
 #endif	/* CONFIG_EROFS_FS_ZIP */
 	u32 blocks;
 	u32 meta_blkaddr;
@@ -430,8 +432,7 @@ int erofs_try_to_free_all_cached_pages(struct erofs_sb_info *sbi,
 				       struct erofs_workgroup *egrp);
 int erofs_try_to_free_cached_page(struct address_space *mapping,
 				  struct page *page);
-int z_erofs_load_lz4_config(struct super_block *sb,
-			    struct erofs_super_block *dsb);
+int z_erofs_parse_cfgs(struct super_block *sb, struct erofs_super_block *dsb);
 #else
 static inline void erofs_shrinker_register(struct super_block *sb) {}
 static inline void erofs_shrinker_unregister(struct super_block *sb) {}
@@ -439,11 +440,11 @@ static inline int erofs_init_shrinker(void) { return 0; }
 static inline void erofs_exit_shrinker(void) {}
 static inline int z_erofs_init_zip_subsystem(void) { return 0; }
 static inline void z_erofs_exit_zip_subsystem(void) {}
-static inline int z_erofs_load_lz4_config(struct super_block *sb,
-				struct erofs_super_block *dsb)
+static inline int z_erofs_parse_cfgs(struct super_block *sb,
+				     struct erofs_super_block *dsb)
 {
-	if (dsb->lz4_max_distance) {
-		erofs_err(sb, "lz4 algorithm isn't enabled");
+	if (dsb->u1.available_compr_algs) {
+		erofs_err(sb, "compression algorithms aren't enabled");
 		return -EINVAL;
 	}
 	return 0;
@@ -7,6 +7,7 @@
 #include "zdata.h"
 #include "compress.h"
 #include <linux/prefetch.h>
+#include <linux/module.h>
 
 #include <trace/events/erofs.h>
 
@@ -39,10 +40,20 @@ typedef tagptr1_t compressed_page_t;
 static struct workqueue_struct *z_erofs_workqueue __read_mostly;
 static struct kmem_cache *pcluster_cachep __read_mostly;
 
+/*
+ * max number of contexts decompressing the pclusters of one queue at once,
+ * including the context which owns the queue. 1 keeps it serial.
+ */
+static unsigned int z_erofs_decompress_jobs __read_mostly = 4;
+module_param_named(decompress_jobs, z_erofs_decompress_jobs, uint, 0644);
+MODULE_PARM_DESC(decompress_jobs,
+		 "Max contexts decompressing one read queue in parallel");
+
 void z_erofs_exit_zip_subsystem(void)
 {
 	destroy_workqueue(z_erofs_workqueue);
 	kmem_cache_destroy(pcluster_cachep);
+	z_erofs_exit_decompressors();
 }
 
 static inline int z_erofs_init_workqueue(void)
@@ -415,7 +426,7 @@ static int z_erofs_register_collection(struct z_erofs_collector *clt,
 			Z_EROFS_PCLUSTER_FULL_LENGTH : 0);
 
 	if (map->m_flags & EROFS_MAP_ZIPPED)
-		pcl->algorithmformat = Z_EROFS_COMPRESSION_LZ4;
+		pcl->algorithmformat = EROFS_I(inode)->z_algorithmtype[0];
 	else
 		pcl->algorithmformat = Z_EROFS_COMPRESSION_SHIFTED;
 
@@ -970,11 +981,131 @@ out:
 	return err;
 }
 
-static void z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
-				     struct list_head *pagepool)
+typedef int (*z_erofs_decompress_fn)(struct super_block *sb,
+				     struct z_erofs_pcluster *pcl,
+				     struct list_head *pagepool);
+
+/*
+ * A large readahead may chain lots of pclusters into one queue. Rather than
+ * decompressing them one by one in a single context, helper works on
+ * z_erofs_workqueue pull pclusters off the shared chain together with the
+ * owner of the queue. Each context uses the per-CPU buffers of the CPU it
+ * runs on and its own page pool.
+ */
+struct z_erofs_decompress_fanout {
+	struct super_block *sb;
+	z_erofs_decompress_fn decompress;
+	spinlock_t lock;
+	/* the rest of the chain, protected by lock */
+	z_erofs_next_pcluster_t owned;
+	unsigned int nr_helpers;
+	struct z_erofs_decompress_helper {
+		struct work_struct work;
+		struct z_erofs_decompress_fanout *fo;
+	} helpers[];
+};
+
+static struct z_erofs_pcluster *
+z_erofs_decompress_pull(struct z_erofs_decompress_fanout *fo)
+{
+	struct z_erofs_pcluster *pcl = NULL;
+
+	spin_lock(&fo->lock);
+	if (fo->owned != Z_EROFS_PCLUSTER_TAIL_CLOSED) {
+		DBG_BUGON(fo->owned == Z_EROFS_PCLUSTER_TAIL);
+		DBG_BUGON(fo->owned == Z_EROFS_PCLUSTER_NIL);
+
+		pcl = container_of(fo->owned, struct z_erofs_pcluster, next);
+		/* pcl->next gets reset once pcl is decompressed */
+		fo->owned = READ_ONCE(pcl->next);
+	}
+	spin_unlock(&fo->lock);
+	return pcl;
+}
+
+static void z_erofs_decompress_helper_work(struct work_struct *work)
+{
+	struct z_erofs_decompress_helper *helper =
+		container_of(work, struct z_erofs_decompress_helper, work);
+	struct z_erofs_decompress_fanout *fo = helper->fo;
+	struct z_erofs_pcluster *pcl;
+	LIST_HEAD(pagepool);
+
+	while ((pcl = z_erofs_decompress_pull(fo)))
+		fo->decompress(fo->sb, pcl, &pagepool);
+
+	put_pages_list(&pagepool);
+}
+
+/* how many contexts to use for the chain, 1 if it's not worth fanning out */
+static unsigned int z_erofs_decompress_nr_jobs(z_erofs_next_pcluster_t owned)
+{
+	unsigned int limit = min(READ_ONCE(z_erofs_decompress_jobs),
+				 num_online_cpus());
+	unsigned int nr = 0;
+
+	/* give each context at least two pclusters to amortize the work */
+	while (owned != Z_EROFS_PCLUSTER_TAIL_CLOSED && nr < 2 * limit) {
+		struct z_erofs_pcluster *pcl =
+			container_of(owned, struct z_erofs_pcluster, next);
+
+		owned = READ_ONCE(pcl->next);
+		++nr;
+	}
+	return max(nr / 2, 1U);
+}
+
+static bool z_erofs_decompress_fanout(const struct z_erofs_decompressqueue *io,
+				      struct list_head *pagepool,
+				      z_erofs_decompress_fn decompress)
+{
+	unsigned int i, nr_jobs = z_erofs_decompress_nr_jobs(io->head);
+	struct z_erofs_decompress_fanout *fo;
+	struct z_erofs_pcluster *pcl;
+
+	if (nr_jobs <= 1)
+		return false;
+
+	fo = kmalloc(struct_size(fo, helpers, nr_jobs - 1),
+		     GFP_NOIO | __GFP_NOWARN);
+	if (!fo)
+		return false;
+
+	fo->sb = io->sb;
+	fo->decompress = decompress;
+	spin_lock_init(&fo->lock);
+	fo->owned = io->head;
+	fo->nr_helpers = nr_jobs - 1;
+	for (i = 0; i < fo->nr_helpers; ++i) {
+		fo->helpers[i].fo = fo;
+		INIT_WORK(&fo->helpers[i].work, z_erofs_decompress_helper_work);
+		queue_work(z_erofs_workqueue, &fo->helpers[i].work);
+	}
+
+	while ((pcl = z_erofs_decompress_pull(fo)))
+		decompress(io->sb, pcl, pagepool);
+
+	/*
+	 * The chain is drained, so helpers which haven't started have
+	 * nothing left to do. Cancel rather than wait for them, since the
+	 * workqueue may be saturated by other queue owners waiting here.
+	 */
+	for (i = 0; i < fo->nr_helpers; ++i)
+		cancel_work_sync(&fo->helpers[i].work);
+	kfree(fo);
+	return true;
+}
+
+/* @decompress is z_erofs_decompress_pcluster() except in the KUnit bench */
+static void __z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
+				       struct list_head *pagepool,
+				       z_erofs_decompress_fn decompress)
 {
 	z_erofs_next_pcluster_t owned = io->head;
 
+	if (z_erofs_decompress_fanout(io, pagepool, decompress))
+		return;
+
 	while (owned != Z_EROFS_PCLUSTER_TAIL_CLOSED) {
 		struct z_erofs_pcluster *pcl;
 
@@ -987,10 +1118,16 @@ static void z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
 		pcl = container_of(owned, struct z_erofs_pcluster, next);
 		owned = READ_ONCE(pcl->next);
 
-		z_erofs_decompress_pcluster(io->sb, pcl, pagepool);
+		decompress(io->sb, pcl, pagepool);
 	}
 }
 
+static void z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
+				     struct list_head *pagepool)
+{
+	__z_erofs_decompress_queue(io, pagepool, z_erofs_decompress_pcluster);
+}
+
 static void z_erofs_decompressqueue_work(struct work_struct *work)
 {
 	struct z_erofs_decompressqueue *bgq =
@@ -1402,3 +1539,6 @@ const struct address_space_operations z_erofs_aops = {
 	.readahead = z_erofs_readahead,
 };
 
+#ifdef CONFIG_EROFS_FS_KUNIT_TEST
+#include "zdata_test.c"
+#endif
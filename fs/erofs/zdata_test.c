@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit benchmark for the EROFS read queue, included by zdata.c.
+ */
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+
+#define Z_EROFS_TEST_QUEUE_PCLUSTERS	128
+#define Z_EROFS_TEST_QUEUE_NRPAGES	4
+#define Z_EROFS_TEST_QUEUE_ROUNDS	8
+#define Z_EROFS_TEST_QUEUE_BLOCK	64
+
+/* a pcluster the bench decompresses without any page cache behind it */
+struct z_erofs_test_pcluster {
+	struct z_erofs_pcluster pcl;
+	struct page *out[Z_EROFS_TEST_QUEUE_NRPAGES];
+	int err;
+};
+
+/*
+ * Most blocks repeat an earlier block of the pcluster and the rest are
+ * random, so LZ4 has both literals and matches to decode.
+ */
+static void z_erofs_test_queue_fill(u8 *data, size_t size)
+{
+	size_t ofs;
+
+	for (ofs = 0; ofs < size; ofs += Z_EROFS_TEST_QUEUE_BLOCK) {
+		unsigned int nr = ofs / Z_EROFS_TEST_QUEUE_BLOCK;
+
+		if (nr && prandom_u32() % 8)
+			memcpy(data + ofs, data + Z_EROFS_TEST_QUEUE_BLOCK *
+			       (prandom_u32() % nr), Z_EROFS_TEST_QUEUE_BLOCK);
+		else
+			prandom_bytes(data + ofs, Z_EROFS_TEST_QUEUE_BLOCK);
+	}
+}
+
+/* the LZ4 part of z_erofs_decompress_pcluster(), on the bench pages */
+static int z_erofs_test_queue_decompress(struct super_block *sb,
+					 struct z_erofs_pcluster *pcl,
+					 struct list_head *pagepool)
+{
+	struct z_erofs_test_pcluster *tp =
+		container_of(pcl, struct z_erofs_test_pcluster, pcl);
+
+	tp->err = z_erofs_decompress(&(struct z_erofs_decompress_req) {
+					.sb = sb,
+					.in = pcl->compressed_pages,
+					.out = tp->out,
+					.inputsize = PAGE_SIZE,
+					.outputsize = Z_EROFS_TEST_QUEUE_NRPAGES *
+						      PAGE_SIZE,
+					.alg = Z_EROFS_COMPRESSION_LZ4,
+				 }, pagepool);
+	WRITE_ONCE(pcl->next, Z_EROFS_PCLUSTER_NIL);
+	return tp->err;
+}
+
+/* chain the pclusters like z_erofs_submit_queue() does for a readahead */
+static void z_erofs_test_queue_chain(struct z_erofs_decompressqueue *io,
+				     struct z_erofs_test_pcluster *tps)
+{
+	int i;
+
+	io->head = Z_EROFS_PCLUSTER_TAIL_CLOSED;
+	for (i = Z_EROFS_TEST_QUEUE_PCLUSTERS - 1; i >= 0; --i) {
+		tps[i].pcl.next = io->head;
+		io->head = &tps[i].pcl.next;
+	}
+}
+
+/* Decompress the queue with up to @jobs contexts, return bytes per second */
+static u64 z_erofs_test_queue_run(struct kunit *test,
+				  struct z_erofs_decompressqueue *io,
+				  struct z_erofs_test_pcluster *tps,
+				  const u8 *data, unsigned int jobs)
+{
+	const size_t outsize = Z_EROFS_TEST_QUEUE_NRPAGES * PAGE_SIZE;
+	unsigned int saved = READ_ONCE(z_erofs_decompress_jobs);
+	LIST_HEAD(pagepool);
+	u64 ns = 0, start;
+	int round, i, j;
+
+	WRITE_ONCE(z_erofs_decompress_jobs, jobs);
+	for (round = 0; round < Z_EROFS_TEST_QUEUE_ROUNDS; ++round) {
+		z_erofs_test_queue_chain(io, tps);
+		start = ktime_get_ns();
+		__z_erofs_decompress_queue(io, &pagepool,
+					   z_erofs_test_queue_decompress);
+		ns += ktime_get_ns() - start;
+	}
+	WRITE_ONCE(z_erofs_decompress_jobs, saved);
+	put_pages_list(&pagepool);
+
+	for (i = 0; i < Z_EROFS_TEST_QUEUE_PCLUSTERS; ++i) {
+		KUNIT_EXPECT_EQ(test, tps[i].err, 0);
+		KUNIT_EXPECT_PTR_EQ(test, tps[i].pcl.next, Z_EROFS_PCLUSTER_NIL);
+		for (j = 0; j < Z_EROFS_TEST_QUEUE_NRPAGES; ++j)
+			KUNIT_EXPECT_EQ(test, 0,
+					memcmp(page_address(tps[i].out[j]),
+					       data + i * outsize + j * PAGE_SIZE,
+					       PAGE_SIZE));
+	}
+
+	return div64_u64((u64)Z_EROFS_TEST_QUEUE_ROUNDS *
+			 Z_EROFS_TEST_QUEUE_PCLUSTERS * outsize * NSEC_PER_SEC,
+			 max_t(u64, ns, 1));
+}
+
+/*
+ * Not a pass/fail check: reports how fast one readahead-sized queue of
+ * LZ4 pclusters is decompressed serially (decompress_jobs=1, the old
+ * behaviour) and fanned out over 2..N contexts. It leaves out the I/O
+ * and the page cache, so it bounds what the fan-out can buy on a cold
+ * start rather than measuring one.
+ */
+static void z_erofs_test_queue_bench(struct kunit *test)
+{
+	const size_t outsize = Z_EROFS_TEST_QUEUE_NRPAGES * PAGE_SIZE;
+	unsigned int nr_cpus = num_online_cpus();
+	struct z_erofs_decompressqueue io = { };
+	struct z_erofs_test_pcluster *tps;
+	struct erofs_sb_info *sbi;
+	unsigned int jobs;
+	u64 serial, fanout;
+	void *wrkmem;
+	u8 *data;
+	int i, j, len;
+
+	sbi = kunit_kzalloc(test, sizeof(*sbi), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sbi);
+	sbi->lz4.max_distance_pages =
+		DIV_ROUND_UP(LZ4_DISTANCE_MAX, PAGE_SIZE) + 1;
+	io.sb = kunit_kzalloc(test, sizeof(*io.sb), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, io.sb);
+	io.sb->s_fs_info = sbi;
+
+	tps = kunit_kzalloc(test, Z_EROFS_TEST_QUEUE_PCLUSTERS * sizeof(*tps),
+			    GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, tps);
+	wrkmem = kunit_kzalloc(test, LZ4_MEM_COMPRESS, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, wrkmem);
+	data = vzalloc(Z_EROFS_TEST_QUEUE_PCLUSTERS * outsize);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, data);
+
+	for (i = 0; i < Z_EROFS_TEST_QUEUE_PCLUSTERS; ++i) {
+		struct page *in = alloc_page(GFP_KERNEL | __GFP_ZERO);
+
+		if (!in)
+			goto out;
+		tps[i].pcl.compressed_pages[0] = in;
+		for (j = 0; j < Z_EROFS_TEST_QUEUE_NRPAGES; ++j) {
+			tps[i].out[j] = alloc_page(GFP_KERNEL);
+			if (!tps[i].out[j])
+				goto out;
+		}
+
+		z_erofs_test_queue_fill(data + i * outsize, outsize);
+		len = LZ4_compress_default(data + i * outsize,
+					   page_address(in), outsize,
+					   PAGE_SIZE, wrkmem);
+		if (!len) {
+			KUNIT_FAIL(test, "pcluster %d does not fit a page", i);
+			goto out;
+		}
+	}
+
+	serial = z_erofs_test_queue_run(test, &io, tps, data, 1);
+	kunit_info(test, "%u pclusters: serial %llu MB/s\n",
+		   Z_EROFS_TEST_QUEUE_PCLUSTERS, serial >> 20);
+	for (jobs = 2; jobs <= nr_cpus; jobs = min(jobs * 2, nr_cpus)) {
+		fanout = z_erofs_test_queue_run(test, &io, tps, data, jobs);
+		kunit_info(test, "%u pclusters: %u jobs %llu MB/s\n",
+			   Z_EROFS_TEST_QUEUE_PCLUSTERS, jobs, fanout >> 20);
+		if (jobs == nr_cpus)
+			break;
+	}
+
+out:
+	for (i = 0; i < Z_EROFS_TEST_QUEUE_PCLUSTERS; ++i) {
+		if (tps[i].pcl.compressed_pages[0])
+			put_page(tps[i].pcl.compressed_pages[0]);
+		for (j = 0; j < Z_EROFS_TEST_QUEUE_NRPAGES; ++j)
+			if (tps[i].out[j])
+				put_page(tps[i].out[j]);
+	}
+	vfree(data);
+}
+
+static struct kunit_case z_erofs_zdata_test_cases[] = {
+	KUNIT_CASE(z_erofs_test_queue_bench),
+	{}
+};
+
+static struct kunit_suite z_erofs_zdata_test_suite = {
+	.name = "erofs-zdata",
+	.test_cases = z_erofs_zdata_test_cases,
+};
+
+kunit_test_suites(&z_erofs_zdata_test_suite);
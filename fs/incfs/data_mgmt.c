@@ -180,9 +180,11 @@ void incfs_free_mount_info(struct mount_info *mi)
 
 static void data_file_segment_init(struct data_file_segment *segment)
 {
-	init_waitqueue_head(&segment->new_data_arrival_wq);
+	int i;
+
 	init_rwsem(&segment->rwsem);
-	INIT_LIST_HEAD(&segment->reads_list_head);
+	for (i = 0; i < ARRAY_SIZE(segment->reads_hash); i++)
+		INIT_HLIST_HEAD(&segment->reads_hash[i]);
 }
 
 char *file_id_to_str(incfs_uuid_t id)
@@ -364,6 +366,7 @@ void incfs_free_data_file(struct data_file *df)
 	}
 
 	incfs_free_mtree(df->df_hash_tree);
+	kvfree(df->df_hash_verified);
 	incfs_free_bfc(df->df_backing_file_context);
 	kfree(df->df_signature);
 	kfree(df->df_verity_file_digest.data);
@@ -665,22 +668,49 @@ static void log_block_read(struct mount_info *mi, incfs_uuid_t *id,
 	schedule_delayed_work(&log->ml_wakeup_work, msecs_to_jiffies(16));
 }
 
+static unsigned long *get_hash_verified_bitmap(struct data_file *df,
+					       struct mtree *tree)
+{
+	unsigned long *bitmap = smp_load_acquire(&df->df_hash_verified);
+	size_t hash_blocks;
+
+	if (bitmap)
+		return bitmap;
+
+	hash_blocks = DIV_ROUND_UP(tree->hash_tree_area_size,
+				   INCFS_DATA_FILE_BLOCK_SIZE);
+	bitmap = kvcalloc(BITS_TO_LONGS(hash_blocks), sizeof(unsigned long),
+			  GFP_NOFS);
+	if (!bitmap)
+		return NULL;
+
+	if (cmpxchg_release(&df->df_hash_verified, NULL, bitmap)) {
+		kvfree(bitmap);
+		bitmap = smp_load_acquire(&df->df_hash_verified);
+	}
+	return bitmap;
+}
+
 static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
-			      int block_index, struct mem_range data, u8 *buf)
+			      int block_index, struct mem_range data, u8 *buf,
+			      struct incfs_verify_batch *batch)
 {
 	struct data_file *df = get_incfs_data_file(f);
+	struct mount_info *mi = df->df_mount_info;
 	u8 stored_digest[INCFS_MAX_HASH_SIZE] = {};
 	u8 calculated_digest[INCFS_MAX_HASH_SIZE] = {};
 	struct mtree *tree = NULL;
 	struct incfs_df_signature *sig = NULL;
+	unsigned long *verified;
 	int digest_size;
 	int hash_block_index = block_index;
-	int lvl;
+	int lvl, top;
 	int res;
 	loff_t hash_block_offset[INCFS_MAX_MTREE_LEVELS];
 	size_t hash_offset_in_block[INCFS_MAX_MTREE_LEVELS];
 	int hash_per_block;
 	pgoff_t file_pages;
+	ktime_t start;
 
 	/*
 	 * Memory barrier to make sure tree is fully present if added via enable
@@ -691,6 +721,7 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 	if (!tree || !sig)
 		return 0;
 
+	start = ktime_get();
 	digest_size = tree->alg->digest_size;
 	hash_per_block = INCFS_DATA_FILE_BLOCK_SIZE / digest_size;
 	for (lvl = 0; lvl < tree->depth; lvl++) {
@@ -704,28 +735,60 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 		hash_block_index /= hash_per_block;
 	}
 
-	memcpy(stored_digest, tree->root_hash, digest_size);
+	if (batch && batch->leaf_offset == hash_block_offset[0]) {
+		memcpy(stored_digest, batch->leaf.data + hash_offset_in_block[0],
+		       digest_size);
+		top = 0;
+		goto verify_data;
+	}
 
+	/*
+	 * Every cached hash page was verified against its parent when it was
+	 * added, so walk up only until the first one still in the page cache
+	 * and check the levels below it.
+	 */
+	verified = get_hash_verified_bitmap(df, tree);
 	file_pages = DIV_ROUND_UP(df->df_size, INCFS_DATA_FILE_BLOCK_SIZE);
-	for (lvl = tree->depth - 1; lvl >= 0; lvl--) {
-		pgoff_t hash_page =
-			file_pages +
-			hash_block_offset[lvl] / INCFS_DATA_FILE_BLOCK_SIZE;
-		struct page *page = find_get_page_flags(
-			f->f_inode->i_mapping, hash_page, FGP_ACCESSED);
+	for (top = 0; top < tree->depth; top++) {
+		pgoff_t hash_block =
+			hash_block_offset[top] / INCFS_DATA_FILE_BLOCK_SIZE;
+		struct page *page;
+		u8 *addr;
 
-		if (page && PageChecked(page)) {
-			u8 *addr = kmap_atomic(page);
+		if (verified && !test_bit(hash_block, verified))
+			continue;
 
-			memcpy(stored_digest, addr + hash_offset_in_block[lvl],
-			       digest_size);
-			kunmap_atomic(addr);
+		page = find_get_page_flags(f->f_inode->i_mapping,
+					   file_pages + hash_block,
+					   FGP_ACCESSED);
+		if (!page)
+			continue;
+
+		if (!PageChecked(page)) {
 			put_page(page);
 			continue;
 		}
 
-		if (page)
-			put_page(page);
+		addr = kmap_atomic(page);
+		memcpy(stored_digest, addr + hash_offset_in_block[top],
+		       digest_size);
+		if (top == 0 && batch) {
+			memcpy(batch->leaf.data, addr,
+			       INCFS_DATA_FILE_BLOCK_SIZE);
+			batch->leaf_offset = hash_block_offset[0];
+		}
+		kunmap_atomic(addr);
+		put_page(page);
+		break;
+	}
+
+	if (top == tree->depth)
+		memcpy(stored_digest, tree->root_hash, digest_size);
+
+	for (lvl = top - 1; lvl >= 0; lvl--) {
+		pgoff_t hash_block =
+			hash_block_offset[lvl] / INCFS_DATA_FILE_BLOCK_SIZE;
+		struct page *page;
 
 		res = incfs_kread(bfc, buf, INCFS_DATA_FILE_BLOCK_SIZE,
 				  hash_block_offset[lvl] + sig->hash_offset);
@@ -759,7 +822,8 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 		memcpy(stored_digest, buf + hash_offset_in_block[lvl],
 		       digest_size);
 
-		page = grab_cache_page(f->f_inode->i_mapping, hash_page);
+		page = grab_cache_page(f->f_inode->i_mapping,
+				       file_pages + hash_block);
 		if (page) {
 			u8 *addr = kmap_atomic(page);
 
@@ -768,9 +832,18 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 			SetPageChecked(page);
 			unlock_page(page);
 			put_page(page);
+			if (verified)
+				set_bit(hash_block, verified);
+		}
+
+		if (lvl == 0 && batch) {
+			memcpy(batch->leaf.data, buf,
+			       INCFS_DATA_FILE_BLOCK_SIZE);
+			batch->leaf_offset = hash_block_offset[0];
 		}
 	}
 
+verify_data:
 	res = incfs_calc_digest(tree->alg, data,
 				range(calculated_digest, digest_size));
 	if (res)
@@ -781,6 +854,11 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 		return -EBADMSG;
 	}
 
+	mi->mi_reads_verified++;
+	if (!top)
+		mi->mi_reads_verify_cache_hits++;
+	mi->mi_reads_verify_time_ns += ktime_to_ns(ktime_sub(ktime_get(),
+							     start));
 	return 0;
 }
 
@@ -792,6 +870,17 @@ static struct data_file_segment *get_file_segment(struct data_file *df,
 	return &df->df_segments[seg_idx];
 }
 
+static struct hlist_head *get_pending_reads_head(
+					struct data_file_segment *segment,
+					int block_index)
+{
+	/* Blocks of one segment are SEGMENTS_PER_FILE apart */
+	int bucket = (block_index / SEGMENTS_PER_FILE) &
+		     (ARRAY_SIZE(segment->reads_hash) - 1);
+
+	return &segment->reads_hash[bucket];
+}
+
 static bool is_data_block_present(struct data_file_block *block)
 {
 	return (block->db_backing_file_data_offset != 0) &&
@@ -1034,14 +1123,17 @@ static struct pending_read *add_pending_read(struct data_file *df,
 	result->block_index = block_index;
 	result->timestamp_us = ktime_to_us(ktime_get());
 	result->uid = current_uid().val;
+	init_waitqueue_head(&result->wait);
 
 	spin_lock(&mi->pending_read_lock);
 
-	result->serial_number = ++mi->mi_last_pending_read_number;
-	mi->mi_pending_reads_count++;
+	result->serial_number = mi->mi_last_pending_read_number + 1;
+	WRITE_ONCE(mi->mi_last_pending_read_number, result->serial_number);
+	WRITE_ONCE(mi->mi_pending_reads_count, mi->mi_pending_reads_count + 1);
 
 	list_add_rcu(&result->mi_reads_list, &mi->mi_reads_list_head);
-	list_add_rcu(&result->segment_reads_list, &segment->reads_list_head);
+	hlist_add_head_rcu(&result->segment_reads_node,
+			   get_pending_reads_head(segment, block_index));
 
 	spin_unlock(&mi->pending_read_lock);
 
@@ -1074,9 +1166,9 @@ static void remove_pending_read(struct data_file *df, struct pending_read *read)
 	spin_lock(&mi->pending_read_lock);
 
 	list_del_rcu(&read->mi_reads_list);
-	list_del_rcu(&read->segment_reads_list);
+	hlist_del_rcu(&read->segment_reads_node);
 
-	mi->mi_pending_reads_count--;
+	WRITE_ONCE(mi->mi_pending_reads_count, mi->mi_pending_reads_count - 1);
 
 	spin_unlock(&mi->pending_read_lock);
 
@@ -1092,13 +1184,14 @@ static void notify_pending_reads(struct mount_info *mi,
 
 	/* Notify pending reads waiting for this block. */
 	rcu_read_lock();
-	list_for_each_entry_rcu(entry, &segment->reads_list_head,
-						segment_reads_list) {
-		if (entry->block_index == index)
+	hlist_for_each_entry_rcu(entry, get_pending_reads_head(segment, index),
+				 segment_reads_node) {
+		if (entry->block_index == index) {
 			set_read_done(entry);
+			wake_up(&entry->wait);
+		}
 	}
 	rcu_read_unlock();
-	wake_up_all(&segment->new_data_arrival_wq);
 
 	atomic_inc(&mi->mi_blocks_written);
 	wake_up_all(&mi->mi_blocks_written_notif_wq);
@@ -1184,9 +1277,32 @@ static int wait_for_data_block(struct data_file *df, int block_index,
 		return -EFSCORRUPTED;
 	}
 
+	/*
+	 * The block may have been written before the pending read became
+	 * visible to notify_pending_reads(). Check again now that it is.
+	 */
+	error = down_read_killable(&segment->rwsem);
+	if (error) {
+		remove_pending_read(df, read);
+		return error;
+	}
+	error = get_data_file_block(df, block_index, &block);
+	up_read(&segment->rwsem);
+	if (error || is_data_block_present(&block)) {
+		remove_pending_read(df, read);
+		if (error)
+			return error;
+		*res_block = block;
+		if (timeouts->min_time_us) {
+			delayed_min_us = timeouts->min_time_us;
+			error = usleep_interruptible(delayed_min_us);
+		}
+		goto out;
+	}
+
 	/* Wait for notifications about block's arrival */
 	wait_res =
-		wait_event_interruptible_timeout(segment->new_data_arrival_wq,
+		wait_event_interruptible_timeout(read->wait,
 			(is_read_done(read)),
 			usecs_to_jiffies(timeouts->max_pending_time_us));
 
@@ -1282,7 +1398,8 @@ static int incfs_update_sysfs_error(struct file *file, int index, int result,
 
 ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 			int index, struct mem_range tmp,
-			struct incfs_read_data_file_timeouts *timeouts)
+			struct incfs_read_data_file_timeouts *timeouts,
+			struct incfs_verify_batch *batch)
 {
 	loff_t pos;
 	ssize_t result;
@@ -1334,7 +1451,8 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 	}
 
 	if (result > 0) {
-		int err = validate_hash_tree(bfc, f, index, dst, tmp.data);
+		int err = validate_hash_tree(bfc, f, index, dst, tmp.data,
+					     batch);
 
 		if (err < 0)
 			result = err;
@@ -1732,13 +1850,8 @@ static int incfs_scan_metadata_chain(struct data_file *df)
  */
 bool incfs_fresh_pending_reads_exist(struct mount_info *mi, int last_number)
 {
-	bool result = false;
-
-	spin_lock(&mi->pending_read_lock);
-	result = (mi->mi_last_pending_read_number > last_number) &&
-		(mi->mi_pending_reads_count > 0);
-	spin_unlock(&mi->pending_read_lock);
-	return result;
+	return (READ_ONCE(mi->mi_last_pending_read_number) > last_number) &&
+		(READ_ONCE(mi->mi_pending_reads_count) > 0);
 }
 
 int incfs_collect_pending_reads(struct mount_info *mi, int sn_lowerbound,
@@ -1761,8 +1874,9 @@ int incfs_collect_pending_reads(struct mount_info *mi, int sn_lowerbound,
 	rcu_read_lock();
 
 	list_for_each_entry_rcu(entry, &mi->mi_reads_list_head, mi_reads_list) {
+		/* Sorted newest first, the rest have been reported already */
 		if (entry->serial_number <= sn_lowerbound)
-			continue;
+			break;
 
 		if (reads) {
 			reads[reported_reads].file_id = entry->file_id;
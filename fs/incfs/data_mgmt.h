@@ -24,6 +24,9 @@
 
 #define SEGMENTS_PER_FILE 3
 
+/* Pending reads of a segment are hashed by block into this many lists */
+#define PENDING_READS_HASH_BITS 4
+
 enum LOG_RECORD_TYPE {
 	FULL,
 	SAME_FILE,
@@ -151,11 +154,17 @@ struct mount_info {
 	 *  - reads_list_head
 	 *  - mi_pending_reads_count
 	 *  - mi_last_pending_read_number
-	 *  - data_file_segment.reads_list_head
+	 *  - data_file_segment.reads_hash
+	 * The counters may be read without it, via READ_ONCE.
 	 */
 	spinlock_t pending_read_lock;
 
-	/* List of active pending_read objects */
+	/*
+	 * List of active pending_read objects, newest first. Serial numbers
+	 * are handed out under pending_read_lock, so the list is sorted by
+	 * descending serial number and collection can stop at the first
+	 * entry it has already seen.
+	 */
 	struct list_head mi_reads_list_head;
 
 	/* Total number of items in reads_list_head */
@@ -231,6 +240,18 @@ struct mount_info {
 	 * time.
 	 */
 	u64 mi_reads_delayed_min_us;
+
+	/* Number of data blocks checked against the hash tree */
+	u32 mi_reads_verified;
+
+	/*
+	 * Number of those whose leaf hash was already trusted, so no hash
+	 * block had to be read from the backing file
+	 */
+	u32 mi_reads_verify_cache_hits;
+
+	/* Total time spent verifying data blocks */
+	u64 mi_reads_verify_time_ns;
 };
 
 struct data_file_block {
@@ -256,20 +277,23 @@ struct pending_read {
 
 	struct list_head mi_reads_list;
 
-	struct list_head segment_reads_list;
+	struct hlist_node segment_reads_node;
+
+	/* The reader waits here for its block only */
+	wait_queue_head_t wait;
 
 	struct rcu_head rcu;
 };
 
 struct data_file_segment {
-	wait_queue_head_t new_data_arrival_wq;
-
 	/* Protects reads and writes from the blockmap */
 	struct rw_semaphore rwsem;
 
-	/* List of active pending_read objects belonging to this segment */
-	/* Protected by mount_info.pending_reads_mutex */
-	struct list_head reads_list_head;
+	/*
+	 * Active pending_read objects belonging to this segment, hashed by
+	 * block index. Protected by mount_info.pending_read_lock
+	 */
+	struct hlist_head reads_hash[1 << PENDING_READS_HASH_BITS];
 };
 
 /*
@@ -352,6 +376,14 @@ struct data_file {
 	/* Guaranteed set if df_hash_tree is set. */
 	struct incfs_df_signature *df_signature;
 
+	/*
+	 * One bit per hash tree block, set once the block has been verified
+	 * and put in the page cache. A clear bit means the page cache need
+	 * not be searched for it. Allocated on first verification, use
+	 * smp_load_acquire to read it.
+	 */
+	unsigned long *df_hash_verified;
+
 	/*
 	 * The verity file digest, set when verity is enabled and the file has
 	 * been opened
@@ -421,9 +453,22 @@ struct incfs_read_data_file_timeouts {
 	u32 max_pending_time_us;
 };
 
+/*
+ * Carries the last verified leaf hash block across the reads of one batch,
+ * so neighbouring data blocks are checked without walking the hash tree.
+ */
+struct incfs_verify_batch {
+	/* INCFS_DATA_FILE_BLOCK_SIZE bytes */
+	struct mem_range leaf;
+
+	/* Offset of the block in leaf within the hash area, -1 if none */
+	loff_t leaf_offset;
+};
+
 ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 			int index, struct mem_range tmp,
-			struct incfs_read_data_file_timeouts *timeouts);
+			struct incfs_read_data_file_timeouts *timeouts,
+			struct incfs_verify_batch *batch);
 
 ssize_t incfs_read_merkle_tree_blocks(struct mem_range dst,
 				      struct data_file *df, size_t offset);
@@ -124,6 +124,9 @@ __DECLARE_STATUS_FLAG(reads_delayed_pending);
 __DECLARE_STATUS_FLAG64(reads_delayed_pending_us);
 __DECLARE_STATUS_FLAG(reads_delayed_min);
 __DECLARE_STATUS_FLAG64(reads_delayed_min_us);
+__DECLARE_STATUS_FLAG(reads_verified);
+__DECLARE_STATUS_FLAG(reads_verify_cache_hits);
+__DECLARE_STATUS_FLAG64(reads_verify_time_ns);
 
 static struct attribute *mount_attributes[] = {
 	&reads_failed_timed_out_attr.attr,
@@ -133,6 +136,9 @@ static struct attribute *mount_attributes[] = {
 	&reads_delayed_pending_us_attr.attr,
 	&reads_delayed_min_attr.attr,
 	&reads_delayed_min_us_attr.attr,
+	&reads_verified_attr.attr,
+	&reads_verify_cache_hits_attr.attr,
+	&reads_verify_time_ns_attr.attr,
 	NULL,
 };
 
@@ -45,6 +45,7 @@ static int dir_rename(struct inode *old_dir, struct dentry *old_dentry,
 static int file_open(struct inode *inode, struct file *file);
 static int file_release(struct inode *inode, struct file *file);
 static int read_single_page(struct file *f, struct page *page);
+static void readahead_batch(struct readahead_control *rac);
 static long dispatch_ioctl(struct file *f, unsigned int req, unsigned long arg);
 
 #ifdef CONFIG_COMPAT
@@ -109,7 +110,7 @@ static const struct dentry_operations incfs_dentry_ops = {
 
 static const struct address_space_operations incfs_address_space_ops = {
 	.readpage = read_single_page,
-	/* .readpages = readpages */
+	.readahead = readahead_batch,
 };
 
 static vm_fault_t incfs_fault(struct vm_fault *vmf)
@@ -472,7 +473,8 @@ static struct dentry *open_or_create_special_dir(struct dentry *backing_dir,
 
 static int read_single_page_timeouts(struct data_file *df, struct file *f,
 				     int block_index, struct mem_range range,
-				     struct mem_range tmp)
+				     struct mem_range tmp,
+				     struct incfs_verify_batch *batch)
 {
 	struct mount_info *mi = df->df_mount_info;
 	struct incfs_read_data_file_timeouts timeouts = {
@@ -504,26 +506,22 @@ static int read_single_page_timeouts(struct data_file *df, struct file *f,
 	}
 
 	return incfs_read_data_file_block(range, f, block_index, tmp,
-					  &timeouts);
+					  &timeouts, batch);
 }
 
-static int read_single_page(struct file *f, struct page *page)
+/* tmp.data is NULL if it should be allocated for this page only */
+static int read_one_page(struct data_file *df, struct file *f,
+			 struct page *page, struct mem_range tmp,
+			 struct incfs_verify_batch *batch)
 {
 	loff_t offset = 0;
 	loff_t size = 0;
 	ssize_t bytes_to_read = 0;
 	ssize_t read_result = 0;
-	struct data_file *df = get_incfs_data_file(f);
 	int result = 0;
 	void *page_start;
 	int block_index;
 
-	if (!df) {
-		SetPageError(page);
-		unlock_page(page);
-		return -EBADF;
-	}
-
 	page_start = kmap(page);
 	offset = page_offset(page);
 	block_index = (offset + df->df_mapped_offset) /
@@ -531,20 +529,25 @@ static int read_single_page(struct file *f, struct page *page)
 	size = df->df_size;
 
 	if (offset < size) {
-		struct mem_range tmp = {
-			.len = 2 * INCFS_DATA_FILE_BLOCK_SIZE
-		};
-		tmp.data = (u8 *)__get_free_pages(GFP_NOFS, get_order(tmp.len));
-		if (!tmp.data) {
-			read_result = -ENOMEM;
-			goto err;
+		bool own_tmp = !tmp.data;
+
+		if (own_tmp) {
+			tmp.data = (u8 *)__get_free_pages(GFP_NOFS,
+							  get_order(tmp.len));
+			if (!tmp.data) {
+				read_result = -ENOMEM;
+				goto err;
+			}
 		}
 		bytes_to_read = min_t(loff_t, size - offset, PAGE_SIZE);
 
 		read_result = read_single_page_timeouts(df, f, block_index,
-					range(page_start, bytes_to_read), tmp);
+					range(page_start, bytes_to_read), tmp,
+					batch);
 
-		free_pages((unsigned long)tmp.data, get_order(tmp.len));
+		if (own_tmp)
+			free_pages((unsigned long)tmp.data,
+				   get_order(tmp.len));
 	} else {
 		bytes_to_read = 0;
 		read_result = 0;
@@ -567,6 +570,58 @@ err:
 	return result;
 }
 
+static int read_single_page(struct file *f, struct page *page)
+{
+	struct data_file *df = get_incfs_data_file(f);
+	struct mem_range tmp = {
+		.len = 2 * INCFS_DATA_FILE_BLOCK_SIZE
+	};
+
+	if (!df) {
+		SetPageError(page);
+		unlock_page(page);
+		return -EBADF;
+	}
+
+	return read_one_page(df, f, page, tmp, NULL);
+}
+
+/*
+ * Reads a readahead window in one go: the scratch buffers are allocated once,
+ * and consecutive blocks are verified against the same leaf hash block.
+ */
+static void readahead_batch(struct readahead_control *rac)
+{
+	struct data_file *df = get_incfs_data_file(rac->file);
+	struct mem_range tmp = {
+		.len = 2 * INCFS_DATA_FILE_BLOCK_SIZE
+	};
+	struct incfs_verify_batch batch = {
+		.leaf = { .len = INCFS_DATA_FILE_BLOCK_SIZE },
+		.leaf_offset = -1,
+	};
+	struct page *page;
+
+	/* Pages left in rac are dropped and read later through ->readpage */
+	if (!df)
+		return;
+
+	tmp.data = (u8 *)__get_free_pages(GFP_NOFS, get_order(tmp.len));
+	batch.leaf.data = (u8 *)__get_free_page(GFP_NOFS);
+	if (!tmp.data || !batch.leaf.data)
+		goto out;
+
+	while ((page = readahead_page(rac))) {
+		read_one_page(df, rac->file, page, tmp, &batch);
+		put_page(page);
+	}
+
+out:
+	free_page((unsigned long)batch.leaf.data);
+	if (tmp.data)
+		free_pages((unsigned long)tmp.data, get_order(tmp.len));
+}
+
 int incfs_link(struct dentry *what, struct dentry *where)
 {
 	struct dentry *parent_dentry = dget_parent(where);
@@ -395,6 +395,25 @@ struct cmdq_reuse {
 	u32 offset;
 };
 
+struct cmdq_reg_write {
+	dma_addr_t addr;
+	u32 value;
+	u32 mask;
+};
+
+/*
+ * A packet recorded once and instantiated many times. Instructions whose
+ * 32-bit operand changes between instances are marked while recording
+ * and patched in place instead of re-encoding the whole packet.
+ */
+struct cmdq_pkt_template {
+	struct cmdq_pkt *pkt;
+	struct cmdq_reuse *reuse;
+	unsigned long *dirty;
+	u32 cnt;
+	u32 max;
+};
+
 u32 cmdq_subsys_id_to_base(struct cmdq_base *cmdq_base, int id);
 
 /**
@@ -473,6 +492,18 @@ s32 cmdq_pkt_append_command(struct cmdq_pkt *pkt, u16 arg_c, u16 arg_b,
 	u16 arg_a, u8 s_op, u8 arg_c_type, u8 arg_b_type, u8 arg_a_type,
 	enum cmdq_code code);
 
+/**
+ * cmdq_pkt_append_commands() - append pre-encoded instructions
+ * @pkt:	the CMDQ packet
+ * @inst:	instructions to append
+ * @count:	number of instructions
+ *
+ * Space is checked once per command buffer instead of per instruction.
+ *
+ * Return: 0 for success; else the error code is returned
+ */
+s32 cmdq_pkt_append_commands(struct cmdq_pkt *pkt, const u64 *inst, u32 count);
+
 s32 cmdq_pkt_move(struct cmdq_pkt *pkt, u16 reg_idx, u64 value);
 
 s32 cmdq_pkt_read(struct cmdq_pkt *pkt, struct cmdq_base *clt_base,
@@ -495,6 +526,22 @@ s32 cmdq_pkt_write_reg_addr(struct cmdq_pkt *pkt, dma_addr_t addr,
 s32 cmdq_pkt_write_value_addr(struct cmdq_pkt *pkt, dma_addr_t addr,
 	u32 value, u32 mask);
 
+/**
+ * cmdq_pkt_write_batch() - append a series of register writes
+ * @pkt:	the CMDQ packet
+ * @clt_base:	the client base, NULL if no subsys is used
+ * @regs:	the writes, in order
+ * @count:	number of writes
+ *
+ * Same result as calling cmdq_pkt_write() for each entry, but the
+ * instructions are encoded in chunks and consecutive addresses sharing
+ * the same high part reuse the temp spr instead of reassigning it.
+ *
+ * Return: 0 for success; else the error code is returned
+ */
+s32 cmdq_pkt_write_batch(struct cmdq_pkt *pkt, struct cmdq_base *clt_base,
+	const struct cmdq_reg_write *regs, u32 count);
+
 s32 cmdq_pkt_assign_command_reuse(struct cmdq_pkt *pkt, u16 reg_idx, u32 value,
 	u64 **curr_buf_va, u32 *inst_offset);
 
@@ -511,6 +558,53 @@ void cmdq_reuse_refresh(struct cmdq_pkt *pkt, struct cmdq_reuse *reuse, u32 cnt)
 
 s32 cmdq_pkt_copy(struct cmdq_pkt *dst, struct cmdq_pkt *src);
 
+/**
+ * cmdq_pkt_template_create() - create a packet template
+ * @client:	the CMDQ mailbox client
+ * @max_patch:	maximum number of patchable instructions
+ *
+ * Record the template by appending to tmpl->pkt as to any packet, without
+ * finalizing it, and call cmdq_pkt_template_mark() right after each
+ * instruction whose operand changes per instance.
+ *
+ * Return: template pointer or ERR_PTR
+ */
+struct cmdq_pkt_template *cmdq_pkt_template_create(struct cmdq_client *client,
+	u32 max_patch);
+
+void cmdq_pkt_template_destroy(struct cmdq_pkt_template *tmpl);
+
+/**
+ * cmdq_pkt_template_mark() - mark the last appended instruction patchable
+ * @tmpl:	the packet template
+ *
+ * Return: patch index for cmdq_pkt_template_set(), or negative error code
+ */
+s32 cmdq_pkt_template_mark(struct cmdq_pkt_template *tmpl);
+
+void cmdq_pkt_template_set(struct cmdq_pkt_template *tmpl, u32 idx, u32 val);
+
+/**
+ * cmdq_pkt_template_apply() - patch changed operands into tmpl->pkt
+ * @tmpl:	the packet template
+ *
+ * For clients that flush the template packet itself; it must be idle.
+ */
+void cmdq_pkt_template_apply(struct cmdq_pkt_template *tmpl);
+
+/**
+ * cmdq_pkt_template_instantiate() - copy the template into a packet
+ * @tmpl:	the packet template
+ * @dst:	the packet to fill, any previous content is dropped
+ *
+ * Every marked instruction in @dst carries the value last set. More
+ * instructions may be appended to @dst before it is flushed.
+ *
+ * Return: 0 for success; else the error code is returned
+ */
+s32 cmdq_pkt_template_instantiate(struct cmdq_pkt_template *tmpl,
+	struct cmdq_pkt *dst);
+
 s32 cmdq_pkt_store_value(struct cmdq_pkt *pkt, u16 indirect_dst_reg_idx,
 	u16 dst_addr_low, u32 value, u32 mask);
 